@@ -19,6 +19,8 @@ extern "C" {
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <stdint.h>
 
 #include "log.h"
 #include "sessioncase.h"
@@ -65,6 +67,10 @@ typedef std::vector<Target> TargetList;
 
 class AsChainTable;
 
+/// ODI tokens are random 64-bit values.  They appear in URIs as fixed-length
+/// hex strings, but are held and looked up in binary form.
+typedef uint64_t OdiToken;
+
 /// The AS chain.
 //
 // Clients should use AsChainLink, not this class directly.
@@ -145,7 +151,7 @@ private:
   std::vector<AsInformation> _as_info;
 
   /// ODI tokens, one for each step.
-  std::vector<std::string> _odi_tokens;
+  std::vector<OdiToken> _odi_tokens;
 
   /// Vector keeping track of whether particular app servers have responded
   /// (either by sending a response to the original request, or forwarding
@@ -165,7 +171,6 @@ private:
   std::vector<Ifc> _fallback_ifcs;
   IFCConfiguration _ifc_configuration;
   bool _using_standard_ifcs;
-  rapidxml::xml_document<>* _root;
 };
 
 
@@ -271,10 +276,7 @@ public:
   }
 
   /// Returns the ODI token of the next AsChainLink in this chain.
-  const std::string& next_odi_token() const
-  {
-    return _as_chain->_odi_tokens[_index + 1];
-  }
+  std::string next_odi_token() const;
 
   /// Returns whether the AS is responsive.
   bool responsive() const
@@ -384,13 +386,35 @@ public:
 
 private:
   friend class AsChain;
+  friend class AsChainLink;
+
+  void register_(AsChain* as_chain, std::vector<OdiToken>& tokens);
+  void unregister(std::vector<OdiToken>& tokens);
+
+  /// Converts ODI tokens to and from the form used in URIs.
+  static std::string token_to_string(OdiToken token);
+  static bool string_to_token(const std::string& str, OdiToken& token);
+
+  /// Generates a random token.
+  static OdiToken new_token();
 
-  void register_(AsChain* as_chain, std::vector<std::string>& tokens);
-  void unregister(std::vector<std::string>& tokens);
+  /// The tokens are spread across a number of shards, each with its own
+  /// lock, so that calls through different AS chains rarely contend.  Tokens
+  /// are random, so are assigned to shards by their low bits.
+  static const size_t NUM_SHARDS = 64;
 
-  static const int TOKEN_LENGTH = 10;
+  struct Shard
+  {
+    pthread_mutex_t lock;
+
+    /// Map from ODI token to pair of (AsChain, index).
+    std::unordered_map<OdiToken, AsChainLink> map;
+  };
+
+  Shard& shard(OdiToken token)
+  {
+    return _shards[token % NUM_SHARDS];
+  }
 
-  /// Map from ODI token to pair of (AsChain, index).
-  std::map<std::string, AsChainLink> _odi_token_map;
-  pthread_mutex_t _lock;
+  Shard _shards[NUM_SHARDS];
 };
@@ -0,0 +1,248 @@
+/**
+ * @file async_lookup_pool.h Pool of threads for running blocking lookups
+ * asynchronously.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef ASYNC_LOOKUP_POOL_H__
+#define ASYNC_LOOKUP_POOL_H__
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <functional>
+#include <pthread.h>
+#include <string.h>
+
+#include "log.h"
+
+/// @class AsyncLookupPool
+///
+/// Runs lookups that may block (such as DNS queries) on a dedicated pool of
+/// threads, so that the threads requesting them are never held up.  The
+/// result of each lookup is passed to a callback, which is run on the lookup
+/// thread - callbacks should do no more than hand the result back to the
+/// thread that wants it.
+///
+/// Lookups are identified by a key.  If a lookup is requested while a lookup
+/// with the same key is already queued or running, no new lookup is made -
+/// the callback is instead run with the result of the existing lookup.
+/// Operations that must never be merged (for example, because they change
+/// state) can be run using submit instead.
+template <class T>
+class AsyncLookupPool
+{
+public:
+  typedef std::function<T()> Lookup;
+  typedef std::function<void(const T&)> Callback;
+
+  /// Constructor.
+  ///
+  /// @param num_threads - The number of threads to run lookups on.
+  /// @param max_queue   - The most lookups requested using submit that can be
+  ///                      waiting for a thread at once, or 0 for no limit.
+  AsyncLookupPool(int num_threads, size_t max_queue = 0) :
+    _max_queue(max_queue),
+    _terminating(false)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+
+    for (int ii = 0; ii < num_threads; ++ii)
+    {
+      pthread_t thread;
+      int rc = pthread_create(&thread, NULL, &lookup_thread_fn, this);
+
+      if (rc == 0)
+      {
+        _threads.push_back(thread);
+      }
+      else
+      {
+        // LCOV_EXCL_START
+        TRC_ERROR("Failed to start lookup thread: %s", strerror(rc));
+        // LCOV_EXCL_STOP
+      }
+    }
+  }
+
+  /// Destructor.  Lookups that have already been requested are completed
+  /// (and their callbacks run) before this returns.
+  ~AsyncLookupPool()
+  {
+    pthread_mutex_lock(&_lock);
+    _terminating = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    for (size_t ii = 0; ii < _threads.size(); ++ii)
+    {
+      pthread_join(_threads[ii], NULL);
+    }
+
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Requests a lookup.  This never blocks.
+  ///
+  /// @param key      - Identifies the lookup.  Requests with the same key must
+  ///                   have the same result.
+  /// @param lookup   - The (blocking) function that does the lookup.
+  /// @param callback - Called with the result of the lookup.
+  /// @returns        - true if a new lookup was queued, false if the request
+  ///                   was merged with a lookup already in progress.
+  bool lookup(const std::string& key,
+              const Lookup& lookup,
+              const Callback& callback)
+  {
+    bool new_lookup = false;
+
+    pthread_mutex_lock(&_lock);
+
+    typename std::map<std::string, Query*>::iterator it = _in_flight.find(key);
+
+    if (it != _in_flight.end())
+    {
+      TRC_DEBUG("Merging lookup for %s with one already in progress",
+                key.c_str());
+      it->second->callbacks.push_back(callback);
+    }
+    else
+    {
+      Query* query = new Query();
+      query->key = key;
+      query->shared = true;
+      query->lookup = lookup;
+      query->callbacks.push_back(callback);
+      _in_flight[key] = query;
+      _queue.push_back(query);
+      pthread_cond_signal(&_cond);
+      new_lookup = true;
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    return new_lookup;
+  }
+
+  /// Requests a lookup that is never merged with any other lookup.  This
+  /// never blocks.
+  ///
+  /// @param lookup   - The (blocking) function that does the lookup.
+  /// @param callback - Called with the result of the lookup.
+  /// @returns        - false if the lookup wasn't queued (and the callback
+  ///                   will never be run) because the queue is full.
+  bool submit(const Lookup& lookup, const Callback& callback)
+  {
+    pthread_mutex_lock(&_lock);
+
+    if ((_max_queue != 0) && (_queue.size() >= _max_queue))
+    {
+      pthread_mutex_unlock(&_lock);
+      TRC_DEBUG("Rejecting lookup as %zu lookups are already queued",
+                _max_queue);
+      return false;
+    }
+
+    Query* query = new Query();
+    query->shared = false;
+    query->lookup = lookup;
+    query->callbacks.push_back(callback);
+    _queue.push_back(query);
+    pthread_cond_signal(&_cond);
+
+    pthread_mutex_unlock(&_lock);
+
+    return true;
+  }
+
+  /// Returns the number of distinct lookups queued or running, not counting
+  /// those requested using submit.
+  size_t in_flight()
+  {
+    pthread_mutex_lock(&_lock);
+    size_t count = _in_flight.size();
+    pthread_mutex_unlock(&_lock);
+    return count;
+  }
+
+private:
+  struct Query
+  {
+    std::string key;
+    bool shared;
+    Lookup lookup;
+    std::vector<Callback> callbacks;
+  };
+
+  static void* lookup_thread_fn(void* p)
+  {
+    ((AsyncLookupPool<T>*)p)->lookup_thread();
+    return NULL;
+  }
+
+  void lookup_thread()
+  {
+    pthread_mutex_lock(&_lock);
+
+    while (true)
+    {
+      if (_queue.empty())
+      {
+        if (_terminating)
+        {
+          break;
+        }
+
+        pthread_cond_wait(&_cond, &_lock);
+        continue;
+      }
+
+      // Take the next query off the queue, but leave it in the in-flight map
+      // while it runs so that further requests are merged with it.
+      Query* query = _queue.front();
+      _queue.pop_front();
+      pthread_mutex_unlock(&_lock);
+
+      T result = query->lookup();
+
+      // Now remove the query, and run all the callbacks that were added to it
+      // while it was in flight.
+      if (query->shared)
+      {
+        pthread_mutex_lock(&_lock);
+        _in_flight.erase(query->key);
+        pthread_mutex_unlock(&_lock);
+      }
+
+      for (size_t ii = 0; ii < query->callbacks.size(); ++ii)
+      {
+        query->callbacks[ii](result);
+      }
+
+      delete query; query = NULL;
+
+      pthread_mutex_lock(&_lock);
+    }
+
+    pthread_mutex_unlock(&_lock);
+  }
+
+  const size_t _max_queue;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  bool _terminating;
+  std::vector<pthread_t> _threads;
+  std::map<std::string, Query*> _in_flight;
+  std::deque<Query*> _queue;
+};
+
+#endif
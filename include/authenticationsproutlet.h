@@ -226,6 +226,22 @@ protected:
                         std::string resync,
                         pjsip_msg* req,
                         pjsip_msg* rsp);
+  bool create_challenge_async(pjsip_digest_credential* credentials,
+                              pj_bool_t stale,
+                              std::string resync,
+                              pjsip_msg* req,
+                              pjsip_msg* rsp,
+                              ACR* acr);
+  void add_challenge(AuthenticationVector* av,
+                     bool av_source_unavailable,
+                     const std::string& impi,
+                     const std::string& impu_for_hss,
+                     ImpiStore::Impi* impi_obj,
+                     pj_bool_t stale,
+                     pjsip_msg* req,
+                     pjsip_msg* rsp);
+  void send_auth_response(ACR* acr, pjsip_msg* req, pjsip_msg* rsp);
+  static std::string get_auth_type(pjsip_digest_credential* credentials);
   int calculate_challenge_expiration_time(pjsip_msg* req);
   AuthenticationVector* verify_auth_vector(rapidjson::Document* av,
                                            const std::string& impi);
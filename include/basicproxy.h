@@ -21,6 +21,7 @@
 #include "fork_error_state.h"
 #include "stack.h"
 #include "pjmodule.h"
+#include "pjutils.h"
 #include "acr.h"
 
 /// Class implementing basic SIP proxy functionality.  Various methods in
@@ -250,11 +251,17 @@ protected:
     /// Initializes a UAC transaction.
     virtual pj_status_t init(pjsip_tx_data* tdata, int allowed_host_state);
 
-    /// Sends the initial request on this UAC transaction.
+    /// Sends the initial request on this UAC transaction.  If the next hop is
+    /// still being resolved, the request is sent once it has been.
     virtual void send_request();
 
+    /// Called on a worker thread with the results of an asynchronous
+    /// resolution of the next hop.
+    virtual void on_resolved(const std::vector<AddrInfo>& servers);
+
     /// Cancels the pending transaction, using the specified status code in the
-    /// Reason header.
+    /// Reason header.  If the request is still waiting for the next hop to be
+    /// resolved, it is not sent.
     virtual void cancel_pending_tsx(int st_code);
 
     /// Attempts a retry of the request.
@@ -289,6 +296,9 @@ protected:
     /// Stops Timer C on the UAC transaction.
     void stop_timer_c();
 
+    /// Ends a UAC transaction whose request was cancelled before it was sent.
+    void end_unsent_request();
+
     /// Called when timer C expires.
     void timer_c_expired();
 
@@ -336,6 +346,31 @@ protected:
     // Whether this UAC transaction is to a stateless proxy.
     bool _stateless_proxy;
 
+    /// Whether the next hop is being resolved asynchronously, whether
+    /// send_request has been called while it is, and whether the request has
+    /// been cancelled while it is.
+    bool _resolving;
+    bool _send_pending;
+    bool _cancelled;
+
+    /// Callback used to pass the results of an asynchronous resolution back
+    /// to a worker thread.
+    class ResolvedCallback : public PJUtils::Callback
+    {
+    public:
+      ResolvedCallback(UACTsx* uac_tsx, const std::vector<AddrInfo>& servers) :
+        _uac_tsx(uac_tsx),
+        _servers(servers)
+      {
+      }
+
+      void run() { _uac_tsx->on_resolved(_servers); }
+
+    private:
+      UACTsx* _uac_tsx;
+      std::vector<AddrInfo> _servers;
+    };
+
     friend class UASTsx;
 
     static const int TIMER_C = 3;
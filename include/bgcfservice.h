@@ -16,13 +16,17 @@
 #define BGCFSERVICE_H__
 
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 
 #include <functional>
 #include "updater.h"
 #include "sas.h"
+#include "prefix_trie.h"
 
 class BgcfService
 {
@@ -30,23 +34,52 @@ public:
   BgcfService(std::string configuration = "./bgcf.json");
   ~BgcfService();
 
+  /// The ordered list of URIs that a BGCF route sends requests to.  Routes are
+  /// shared with the routing tables, so looking one up doesn't copy it, and a
+  /// route that has been returned stays valid if the configuration is
+  /// reloaded.
+  typedef std::shared_ptr<const std::vector<std::string>> RoutePtr;
+
   /// Updates the bgcf routes
   void update_routes();
 
-  std::vector<std::string> get_route_from_domain(const std::string &domain,
-                                                 SAS::TrailId trail) const;
-  std::vector<std::string> get_route_from_number(const std::string &number,
-                                                 SAS::TrailId trail) const;
+  /// Looks up the route for a domain, falling back to the default (*) route.
+  /// Returns an empty route if there is no match - never NULL.
+  RoutePtr get_route_from_domain(const std::string &domain,
+                                 SAS::TrailId trail) const;
+
+  /// Looks up the route for the longest matching number prefix.  Returns an
+  /// empty route if there is no match - never NULL.
+  RoutePtr get_route_from_number(const std::string &number,
+                                 SAS::TrailId trail) const;
 
 private:
-  std::map<std::string, std::vector<std::string>> _domain_routes;
-  std::map<std::string, std::vector<std::string>> _number_routes;
+  struct RouteEntry
+  {
+    RouteEntry(const std::vector<std::string>& uris);
+
+    RoutePtr route;
+
+    // The route URIs formatted for SAS logging, built once at load time.
+    std::string route_string;
+  };
+
+  /// The routing tables.  These are never modified once built - update_routes
+  /// builds a new set and swaps it in with std::atomic_store, and lookups take
+  /// a reference with std::atomic_load, so no lock is needed on the lookup
+  /// path.
+  struct RoutingTables
+  {
+    std::unordered_map<std::string, RouteEntry> domain_routes;
+    PrefixTrie<RouteEntry> number_routes;
+  };
+
+  std::shared_ptr<const RoutingTables> _routes;
   std::string _configuration;
   Updater<void, BgcfService>* _updater;
 
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the class, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _routes_rw_lock;
+  // Returned when there is no matching route.
+  static const RoutePtr NO_ROUTE;
 };
 
 #endif
@@ -303,6 +303,8 @@ public:
   friend class UASTransaction;
 
 private:
+  void upstream_request_complete();
+
   UASTransaction*      _uas_data;
   int                  _target;
   pj_grp_lock_t*       _lock;       //< Lock to protect this UACTransaction and the underlying PJSIP transaction
@@ -312,7 +314,11 @@ private:
                                        identify the binding. */
   pj_str_t             _aor;
   pj_str_t             _binding_id;
+
+  // The transport the request was sent on, and its size, if they have been
+  // passed to the upstream connection pool.
   pjsip_transport*     _transport;
+  int                  _tx_bytes;
 
   // Stores the list of targets returned by the SIPResolver for this transaction.
   std::vector<AddrInfo> _servers;
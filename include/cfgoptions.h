@@ -14,6 +14,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 
 #include "hssconnection.h"
 #include "subscriber_data_manager.h"
@@ -76,14 +77,21 @@ struct options
   std::string                          sas_system_name;
   std::string                          hss_server;
   std::string                          xdm_server;
+  int                                  simservs_cache_size;
+  int                                  simservs_cache_ttl;
   std::string                          local_site_name;
   std::vector<std::string>             registration_stores;
   std::vector<std::string>             impi_stores;
   std::string                          ralf_server;
   int                                  ralf_threads;
+  int                                  ralf_max_queued_acrs;
+  int                                  ralf_batch_size;
+  int                                  ralf_batch_interval;
   std::vector<std::string>             dns_servers;
+  int                                  dns_async_threads;
   std::vector<std::string>             enum_servers;
   std::string                          enum_suffix;
+  int                                  enum_cache_size;
   std::string                          enum_file;
   bool                                 default_tel_uri_translation;
   bool                                 analytics_enabled;
@@ -140,6 +148,18 @@ struct options
   bool                                 reject_if_no_matching_ifcs;
   std::string                          dummy_app_server;
   bool                                 http_acr_logging;
+  bool                                 sharded_worker_queues;
+  int                                  max_worker_queue_depth;
+  std::vector<int>                     worker_queue_priorities;
+  SubscriberDataManager::SerializationFormat aor_store_format;
+  bool                                 local_aor_expiry;
+  int                                  local_aor_expiry_backstop;
+  int                                  hss_reg_data_cache_size;
+  int                                  hss_reg_data_cache_ttl;
+  int                                  hss_async_threads;
+  int                                  remote_store_read_threads;
+  int                                  remote_store_read_deadline;
+  int                                  webrtc_threads;
 };
 
 // Objects that must be shared with dynamically linked sproutlets must be
@@ -36,8 +36,10 @@ public:
   static void destroy(DNSResolver* resolver);
   // Perform a NAPTR query for the specified domain, returning the results in
   // the naptr_reply structure, and logging to the trail.  The caller must
-  // call free_naptr_reply when it has finished with naptr_reply.
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  // call free_naptr_reply when it has finished with naptr_reply.  ttl is set
+  // to the time (in seconds) for which the result can be cached, or -1 if
+  // this isn't known.
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   // Free a naptr_reply structure.
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 
@@ -57,6 +59,9 @@ private:
                      int timeouts,
                      unsigned char* abuf,
                      int alen);
+  // Find how long the result of a query can be cached for from the raw DNS
+  // response, returning -1 if this can't be determined.
+  static int parse_ttl(int status, const unsigned char* abuf, int alen);
 
   // The ares data structure that controls actually making the query.
   ares_channel _channel;
@@ -74,6 +79,9 @@ private:
   // The reply data structure.  Only valid between ares_callback and
   // perform_naptr_query returning, and only if _status is ARES_SUCCESS.
   struct ares_naptr_reply* _naptr_reply;
+  // The TTL of the last query's result.  Only valid between ares_callback
+  // and perform_naptr_query returning.
+  int _ttl;
   // Pointer to a linked list of servers
   struct ares_addr_node _ares_addrs[3];
 
@@ -16,7 +16,10 @@
 #define ENUMSERVICE_H__
 
 #include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <pthread.h>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 #include <netinet/in.h>
@@ -26,6 +29,8 @@
 #include "dnsresolver.h"
 #include "communicationmonitor.h"
 #include "updater.h"
+#include "prefix_trie.h"
+#include "snmp_counter_table.h"
 
 /// @class EnumService
 ///
@@ -95,16 +100,15 @@ private:
     std::string replace;
   };
 
-  std::vector<NumberPrefix> _number_prefixes;
-  std::map<std::string, NumberPrefix> _prefix_regex_map;
+  typedef PrefixTrie<NumberPrefix> NumberPrefixTrie;
+
+  // The number prefixes, indexed for longest-prefix matching.  The trie is
+  // never modified once built - update_enum builds a new one and swaps it in
+  // with std::atomic_store, and lookups take a reference with
+  // std::atomic_load, so no lock is needed on the lookup path.
+  std::shared_ptr<const NumberPrefixTrie> _number_prefixes;
   std::string _configuration;
   Updater<void, JSONEnumService>* _updater;
-
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the class, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _number_prefixes_rw_lock;
-
-  const NumberPrefix* prefix_match(const std::string& number) const;
 };
 
 /// @class DNSEnumService
@@ -122,6 +126,19 @@ public:
 
   std::string lookup_uri_from_user(const std::string& user, SAS::TrailId trail) const;
 
+  // Enables caching of the rules from NAPTR responses, keyed by ENUM domain.
+  // Rules are cached for the TTL of their records, and domains that don't
+  // exist for the negative caching TTL from the response.  Concurrent lookups
+  // that miss the cache for the same domain share a single query.  When the
+  // cache is full, the least recently used domain is evicted.
+  //
+  // @param max_size   - The maximum number of domains to cache.
+  // @param hits_tbl   - Statistics tables counting cache hits and misses.
+  // @param misses_tbl
+  void enable_cache(int max_size,
+                    SNMP::CounterTable* hits_tbl,
+                    SNMP::CounterTable* misses_tbl);
+
   // Characters to strip from a key before turning it into a domain.  This is
   // all non-digit characters.
   static const boost::regex CHARS_TO_STRIP_FROM_DOMAIN;
@@ -160,9 +177,68 @@ private:
 
   };
 
+  typedef std::shared_ptr<const std::vector<Rule>> RulesPtr;
+
+  /// A NAPTR query result in the cache.
+  struct CacheEntry
+  {
+    // Whether a thread is querying for this domain.  Other threads that want
+    // the same domain wait for it to finish rather than sending a query.
+    bool pending;
+    // The number of threads waiting for the query.  The entry isn't removed
+    // until they have all read the result.
+    int waiters;
+    // The status of the query and, if it succeeded, the parsed rules.
+    int status;
+    RulesPtr rules;
+    // When the result expires, or 0 if it isn't to be cached.
+    unsigned long expiry_ms;
+    // The entry's position in the LRU list.
+    std::list<std::string>::iterator lru;
+  };
+
   // Maximum number of DNS queries per request.
   static const int MAX_DNS_QUERIES = 5;
 
+  // The negative caching TTL to use if the response to a query for a domain
+  // that doesn't exist doesn't say, and the maximum time for which any result
+  // is cached (both in seconds).
+  static const int DEFAULT_NEGATIVE_TTL = 60;
+  static const int MAX_CACHE_TTL = 86400;
+
+  // The longest time that a lookup waits for another thread's query for the
+  // same domain before making its own query (in milliseconds).
+  static const int MAX_WAIT_MS = 1000;
+
+  // Gets the rules for a domain, from the cache if enabled, or by querying
+  // the DNS server.  Returns the status of the query, and sets queried if
+  // this thread made a query.
+  int get_rules(const std::string& domain,
+                DNSResolver* resolver,
+                RulesPtr& rules,
+                bool& queried,
+                SAS::TrailId trail) const;
+  // Queries the DNS server for a domain and parses the reply into rules.
+  int query_rules(const std::string& domain,
+                  DNSResolver* resolver,
+                  RulesPtr& rules,
+                  int& ttl,
+                  SAS::TrailId trail) const;
+  // Stores the result of a query in the cache, and wakes any threads waiting
+  // for it.
+  void complete_query(const std::string& domain,
+                      int status,
+                      const RulesPtr& rules,
+                      int ttl) const;
+  // Removes the least recently used entries that nobody is using from the
+  // cache, until there is space for a new entry.  Must be called with the
+  // cache lock held.
+  void evict_cache_entries() const;
+  // Removes an entry from the cache.  Must be called with the cache lock
+  // held.
+  void erase_cache_entry(std::unordered_map<std::string, CacheEntry>::iterator it) const;
+  static unsigned long now_ms();
+
   // Converts a key to an ENUM domain name.
   std::string key_to_domain(const std::string& key) const;
   // Gets a resolver (from thread-local data).
@@ -183,6 +259,17 @@ private:
   // Helper used to track enum communication state, and issue/clear alarms
   // based upon recent activity.
   CommunicationMonitor* _comm_monitor;
+
+  // The NAPTR cache, keyed by domain, and its statistics.  The cache is
+  // disabled if _cache_max_size is 0.
+  size_t _cache_max_size;
+  mutable pthread_mutex_t _cache_lock;
+  mutable pthread_cond_t _cache_cond;
+  mutable std::unordered_map<std::string, CacheEntry> _cache;
+  // Domains in the cache, most recently used first.
+  mutable std::list<std::string> _cache_lru;
+  SNMP::CounterTable* _cache_hits_tbl;
+  SNMP::CounterTable* _cache_misses_tbl;
 };
 
 #endif
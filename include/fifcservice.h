@@ -10,6 +10,7 @@
  */
 
 #include <string>
+#include <memory>
 #include <boost/thread.hpp>
 #include "rapidxml/rapidxml.hpp"
 
@@ -33,17 +34,22 @@ public:
   /// Updates the fallback iFCs.
   void update_fifcs();
 
-  /// Get the fallback iFCs
-  std::vector<Ifc> get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const;
+  /// Get the fallback iFCs. The iFCs are shared with the service, so this
+  /// doesn't parse any XML.
+  std::vector<Ifc> get_fallback_ifcs() const;
 
 private:
   Alarm* _alarm;
-  std::vector<std::string> _fallback_ifcs;
+
+  // The current fallback iFCs, in priority order. These are never modified
+  // once loaded - a reload builds a new list and swaps this pointer.
+  std::shared_ptr<const std::vector<Ifc> > _fallback_ifcs;
   std::string _configuration;
   Updater<void, FIFCService>* _updater;
 
   // Mark as mutable to flag that this can be modified without affecting the
   // external behaviour of the calss, allowing for locking in 'const' methods.
+  // This only protects _fallback_ifcs (the pointer, not the list).
   mutable boost::shared_mutex _sets_rw_lock;
 
   // Helper functions to set/clear the alarm.
@@ -23,8 +23,10 @@ extern "C" {
 #include <cassert>
 #include <map>
 #include <unordered_map>
+#include <vector>
 #include <string>
 #include <atomic>
+#include <functional>
 
 #include "snmp_scalar.h"
 #include "stack.h"
@@ -83,7 +85,7 @@ private:
   void restart_timer(int id, int timeout);
   void expiry_timer();
 
-  void inc_ref();
+  bool inc_ref_if_live();
 
   FlowTable* _flow_table;
   pjsip_transport* _transport;
@@ -97,8 +99,9 @@ private:
   pj_timer_entry _timer;
 
   /// Lock used to protect accesses to the various data structures managing
-  /// the identifiers authorized on this flow.
-  pthread_mutex_t _flow_lock;
+  /// the identifiers authorized on this flow.  Lookups of identities and
+  /// service routes only take it for reading, so don't block each other.
+  pthread_rwlock_t _flow_lock;
 
   /// Map holding all the authenticated identifiers for this flow.  The key
   /// is a normalized address of record/public identity, the value is the
@@ -118,12 +121,12 @@ private:
   /// The default identity for this flow.
   std::string _default_id;
 
-  /// Counts the references to this Flow.  This can only be updated or tested
-  /// by a thread which currently holds the FlowTable::_flow_map_lock.
-  int _refs;
+  /// Counts the references to this Flow.  Once this reaches zero the flow is
+  /// being removed, and FlowTable lookups will no longer return it.
+  std::atomic_int _refs;
 
   // Counts the number of active dialogs on this flow. This can be
-  // updated or tested without FlowTable::_flow_map_lock being held.
+  // updated or tested without any lock being held.
   std::atomic_long _dialogs;
 
   /// Timer identifiers - the timer either runs as an expiry timer (when there
@@ -186,33 +189,63 @@ private:
     {
     }
 
-    /// Override operator< so this can be used as a map key.
-    bool operator< (const FlowKey& other) const
+    bool operator== (const FlowKey& other) const
     {
-      // Compare the transport type first.
-      if (_type < other._type)
-      {
-        return true;
-      }
-      else if (_type > other._type)
-      {
-        return false;
-      }
-      else
-      {
-        // The transport is the same, so check the remote addresses.
-        return (pj_sockaddr_cmp(&_raddr, &other._raddr) < 0);
-      }
+      return ((_type == other._type) &&
+              (pj_sockaddr_cmp(&_raddr, &other._raddr) == 0));
     }
 
+    /// Hashes the fields compared by operator==, so this can be used as an
+    /// unordered_map key.
+    size_t hash() const;
+
   private:
     int _type;
     pj_sockaddr _raddr;
   };
 
-  pthread_mutex_t _flow_map_lock;
-  std::map<FlowKey, Flow*> _tp2flow_map;        // map from transport addresses to flow
-  std::map<std::string, Flow*> _tk2flow_map;    // map from token to flow
+  struct FlowKeyHash
+  {
+    size_t operator()(const FlowKey& key) const { return key.hash(); }
+  };
+
+  /// The flows are spread across a number of shards, each with its own lock,
+  /// so that lookups and updates for different flows rarely contend.  Lookups
+  /// only take a shard's lock for reading, so never wait for each other.
+  ///
+  /// A flow is held in the shard for its transport and address, and
+  /// separately in the shard for its token.
+  static const size_t NUM_SHARDS = 64;
+
+  template <class K, class H>
+  struct Shard
+  {
+    pthread_rwlock_t lock;
+    std::unordered_map<K, Flow*, H> map;
+  };
+
+  typedef Shard<FlowKey, FlowKeyHash> AddrShard;
+  typedef Shard<std::string, std::hash<std::string> > TokenShard;
+
+  AddrShard& addr_shard(const FlowKey& key)
+  {
+    return _tp2flow_shards[key.hash() % NUM_SHARDS];
+  }
+
+  TokenShard& token_shard(const std::string& token)
+  {
+    return _tk2flow_shards[std::hash<std::string>()(token) % NUM_SHARDS];
+  }
+
+  std::vector<AddrShard> _tp2flow_shards;     // transport addresses to flow
+  std::vector<TokenShard> _tk2flow_shards;    // tokens to flow
+
+  /// The number of flows in the table.
+  std::atomic_long _flow_count;
+
+  /// Lock serializing updates to the reported flow count, and checks of
+  /// whether quiescing is complete.
+  pthread_mutex_t _count_lock;
 
   // Statistics
   void report_flow_count();
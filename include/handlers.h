@@ -20,6 +20,7 @@
 #include "sipresolver.h"
 #include "impistore.h"
 #include "fifcservice.h"
+#include "pjutils.h"
 
 /// Common factory for all handlers that deal with timer pops. This is
 /// a subclass of SpawningHandler that requests HTTP flows to be
@@ -70,20 +71,45 @@ public:
 
   virtual void run() = 0;
 
+  /// Expires any bindings and subscriptions of an AoR that are due.  This
+  /// doesn't need a request, so it is also used when an AoR's expiry is timed
+  /// locally rather than by a timer service.
+  static void process_aor_timeout(const Config* cfg,
+                                  std::string aor_id,
+                                  SAS::TrailId trail);
+
 protected:
-  void process_aor_timeout(std::string aor_id);
-  SubscriberDataManager::AoRPair* set_aor_data(
+  static SubscriberDataManager::AoRPair* set_aor_data(
                         SubscriberDataManager* current_sdm,
                         std::string aor_id,
                         AssociatedURIs* associated_uris,
                         SubscriberDataManager::AoRPair* previous_aor_data,
                         std::vector<SubscriberDataManager*> remote_sdms,
-                        bool& all_bindings_expired);
+                        bool& all_bindings_expired,
+                        SAS::TrailId trail);
 
 protected:
   const Config* _cfg;
 };
 
+/// Callback that expires the bindings and subscriptions of a batch of AoRs
+/// whose expiry is timed locally.  It is run on a worker thread.
+class AoRExpiryCallback : public PJUtils::Callback
+{
+public:
+  AoRExpiryCallback(const AoRTimeoutTask::Config* cfg,
+                    const std::vector<std::string>& aor_ids) :
+    _cfg(cfg),
+    _aor_ids(aor_ids)
+  {};
+
+  void run() override;
+
+private:
+  const AoRTimeoutTask::Config* _cfg;
+  std::vector<std::string> _aor_ids;
+};
+
 /// Base AuthTimeoutTask class for tasks that implement authentication timeout
 /// callbacks from specific timer services.
 class AuthTimeoutTask : public HttpStackUtils::Task
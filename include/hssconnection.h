@@ -13,6 +13,8 @@
 #define HSSCONNECTION_H__
 
 #include <curl/curl.h>
+#include <memory>
+#include <functional>
 #include "rapidjson/document.h"
 
 #include "httpconnection.h"
@@ -23,6 +25,8 @@
 #include "load_monitor.h"
 #include "associated_uris.h"
 #include "sifcservice.h"
+#include "reg_data_cache.h"
+#include "async_lookup_pool.h"
 
 /// @class HSSConnection
 ///
@@ -42,7 +46,8 @@ public:
                 SNMP::EventAccumulatorTable* homestead_uar_latency_tbl,
                 SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                 CommunicationMonitor* comm_monitor,
-                SIFCService* sifc_service);
+                SIFCService* sifc_service,
+                RegDataCache* reg_data_cache = NULL);
   virtual ~HSSConnection();
 
   HTTPCode get_auth_vector(const std::string& private_user_id,
@@ -123,6 +128,64 @@ public:
                                          SAS::TrailId trail);
   rapidxml::xml_document<>* parse_xml(std::string raw, const std::string& url);
 
+  /// Registration data returned by the asynchronous registration queries.
+  struct RegData
+  {
+    std::string regstate;
+    std::map<std::string, Ifcs> service_profiles;
+    AssociatedURIs associated_uris;
+    std::vector<std::string> aliases;
+    std::deque<std::string> ccfs;
+    std::deque<std::string> ecfs;
+  };
+
+  /// Callback for the asynchronous registration queries.
+  typedef std::function<void(HTTPCode, std::shared_ptr<RegData>)> RegDataCallback;
+
+  /// Callback for get_auth_vector_async.  The callback takes ownership of the
+  /// JSON object, which may be NULL.
+  typedef std::function<void(HTTPCode, rapidjson::Document*)> AuthVectorCallback;
+
+  /// Starts the threads used by the asynchronous queries.  Until this is
+  /// called the asynchronous queries are disabled.
+  ///
+  /// @param num_threads - The number of threads to start.
+  void start_async_threads(int num_threads);
+
+  /// Returns whether the asynchronous queries are enabled.
+  bool async_enabled() const { return (_async_pool != NULL); }
+
+  /// Asynchronous versions of get_auth_vector, update_registration_state and
+  /// get_registration_data.  These never block - the query is made on a
+  /// separate thread, and the callback is run on that thread when Homestead
+  /// responds, so callers must hand the result back to their own thread.
+  /// Each returns false (without running the callback) if asynchronous
+  /// queries are disabled.
+  bool get_auth_vector_async(const std::string& private_user_id,
+                             const std::string& public_user_id,
+                             const std::string& auth_type,
+                             const std::string& resync_auth,
+                             const std::string& server_name,
+                             SAS::TrailId trail,
+                             const AuthVectorCallback& callback);
+  bool update_registration_state_async(const std::string& public_user_identity,
+                                       const std::string& private_user_identity,
+                                       const std::string& type,
+                                       const std::string& server_name,
+                                       SAS::TrailId trail,
+                                       const RegDataCallback& callback);
+  bool update_registration_state_async(const std::string& public_user_identity,
+                                       const std::string& private_user_identity,
+                                       const std::string& type,
+                                       const std::string& server_name,
+                                       bool cache_allowed,
+                                       const std::string& wildcard,
+                                       SAS::TrailId trail,
+                                       const RegDataCallback& callback);
+  bool get_registration_data_async(const std::string& public_user_identity,
+                                   SAS::TrailId trail,
+                                   const RegDataCallback& callback);
+
   static const std::string REG;
   static const std::string CALL;
   static const std::string DEREG_USER;
@@ -151,6 +214,11 @@ private:
   SNMP::EventAccumulatorTable* _uar_latency_tbl;
   SNMP::EventAccumulatorTable* _lir_latency_tbl;
   SIFCService* _sifc_service;
+  RegDataCache* _reg_data_cache;
+
+  /// Threads running the asynchronous queries.  Queries are never merged, as
+  /// registration state updates must always reach Homestead.
+  AsyncLookupPool<HTTPCode>* _async_pool;
 };
 
 #endif
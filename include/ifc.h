@@ -68,19 +68,24 @@ struct AsInvocation
   bool include_register_response;
 };
 
+class CompiledIfc;
+
 /// A single Initial Filter Criterion (iFC).
+///
+/// The XML for the iFC is compiled (once per distinct iFC, see CompiledIfc)
+/// when the Ifc is constructed, and evaluation uses the compiled form.
+/// Copying an Ifc is cheap - copies share the XML and compiled form.
 class Ifc
 {
 public:
-  Ifc(rapidxml::xml_node<>* ifc) :
-    _ifc(ifc)
-  {
-  }
+  Ifc(rapidxml::xml_node<>* ifc);
 
-  /// This constructor creates an Ifc and makes sure that all of its
-  // associated memory is owned by the passed in XML document.
-  Ifc(std::string ifc_str,
-      rapidxml::xml_document<>* ifc_doc);
+  /// This constructor creates an Ifc that keeps the XML document containing
+  // the iFC alive for as long as the Ifc (or any copy of it) exists. This is
+  // used for iFCs that are parsed once from configuration and then shared
+  // between requests.
+  Ifc(rapidxml::xml_node<>* ifc,
+      std::shared_ptr<rapidxml::xml_document<> > ifc_doc);
 
   bool filter_matches(const SessionCase& session_case,
                       bool is_registered,
@@ -91,21 +96,7 @@ public:
   AsInvocation as_invocation() const;
 
 private:
-  static bool spt_matches(const SessionCase& session_case,
-                          bool is_registered,
-                          bool is_initial_registration,
-                          pjsip_msg *msg,
-                          rapidxml::xml_node<>* spt,
-                          std::string ifc_str,
-                          std::string server_name,
-                          SAS::TrailId trail);
-
-  static void invalid_ifc(std::string error,
-                          std::string server_name,
-                          int sas_event_id,
-                          int instance_id,
-                          SAS::TrailId trail);
-
   rapidxml::xml_node<>* _ifc;
-  std::string _server_name;
+  std::shared_ptr<rapidxml::xml_document<> > _ifc_doc;
+  std::shared_ptr<const CompiledIfc> _compiled;
 };
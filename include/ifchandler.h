@@ -51,7 +51,7 @@ public:
     return _ifcs[index];
   }
 
-  const std::vector<Ifc> ifcs_list() const
+  const std::vector<Ifc>& ifcs_list() const
   {
     return _ifcs;
   }
@@ -13,6 +13,8 @@
 #define IMPISTORE_H_
 
 #include "store.h"
+#include "striped_lock.h"
+#include "snmp_counter_table.h"
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 
@@ -257,8 +259,14 @@ public:
   };
 
   /// Constructor.
-  /// @param data_store    A pointer to the underlying data store.
-  ImpiStore(Store* data_store);
+  /// @param data_store          A pointer to the underlying data store.
+  /// @param lock_contention_tbl Statistics table counting writes that waited
+  ///                            for another thread writing the same IMPI.
+  /// @param cas_retries_tbl     Statistics table counting writes that failed
+  ///                            because the IMPI had changed in the store.
+  ImpiStore(Store* data_store,
+            SNMP::CounterTable* lock_contention_tbl = NULL,
+            SNMP::CounterTable* cas_retries_tbl = NULL);
 
   /// Destructor.
   virtual ~ImpiStore();
@@ -288,12 +296,20 @@ public:
   virtual Store::Status delete_impi(Impi* impi,
                                     SAS::TrailId trail);
 
+  /// Returns the lock that serializes writes to each IMPI in this store from
+  /// this process.  Callers should hold the IMPI's lock across their whole
+  /// read-modify-write loop.
+  StripedLock* write_lock() { return &_write_lock; }
+
 private:
   /// Identifier for IMPI table.
   static const std::string TABLE_IMPI;
 
   /// The underlying data store.
   Store* _data_store;
+
+  StripedLock _write_lock;
+  SNMP::CounterTable* _cas_retries_tbl;
 };
 
 // Utility function - retrieves the "corrlator" field from the give challenge
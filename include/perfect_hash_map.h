@@ -0,0 +1,284 @@
+/**
+ * @file perfect_hash_map.h Immutable perfect-hashed string lookup table.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PERFECT_HASH_MAP_H__
+#define PERFECT_HASH_MAP_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+/// @class PerfectHashMap
+///
+/// Lookup table from strings to values, built once from a fixed set of keys
+/// and read-only thereafter.  Keys are placed using "hash and displace"
+/// perfect hashing, so a lookup is two hashes of the key and a single key
+/// comparison, whatever the size of the table.  Lookups take the key as a
+/// pointer and length, so can be made directly on strings in SIP messages
+/// (such as pj_str_t) without copying them.
+///
+/// A built table is never modified, so can safely be shared between threads
+/// without locking.
+template <class T>
+class PerfectHashMap
+{
+public:
+  /// Constructor.
+  ///
+  /// @param case_insensitive - Whether keys are compared ignoring (ASCII)
+  ///                           case.
+  PerfectHashMap(bool case_insensitive = false) :
+    _case_insensitive(case_insensitive),
+    _bucket_mask(0),
+    _slot_mask(0),
+    _size(0)
+  {
+  }
+
+  /// Builds the table from the supplied entries, replacing any existing
+  /// contents.  If the table is case-insensitive and several keys differ only
+  /// in case, the first of them is kept.
+  void build(const std::map<std::string, T>& entries)
+  {
+    // Size the table so that on average there are two keys per bucket and
+    // each key has two slots to choose from.  This keeps the search for
+    // displacements short.
+    size_t num_slots = 1;
+    while (num_slots < entries.size() * 2)
+    {
+      num_slots <<= 1;
+    }
+
+    while (!try_build(entries, num_slots))
+    {
+      // LCOV_EXCL_START - only happens with pathological key sets.
+      num_slots <<= 1;
+      // LCOV_EXCL_STOP
+    }
+  }
+
+  /// Looks up a key, returning a pointer to its value, or NULL if the key
+  /// isn't in the table.
+  const T* find(const char* key, size_t len) const
+  {
+    if (_size == 0)
+    {
+      return NULL;
+    }
+
+    uint32_t seed = _seeds[hash(0, key, len) & _bucket_mask];
+    const Slot& slot = _slots[hash(seed, key, len) & _slot_mask];
+
+    return ((slot.used) && (equal(slot.key, key, len))) ? &slot.value : NULL;
+  }
+
+  const T* find(const std::string& key) const
+  {
+    return find(key.data(), key.length());
+  }
+
+  /// Returns the number of keys in the table.
+  size_t size() const { return _size; }
+
+private:
+  /// Number of displacement seeds tried for a bucket before giving up and
+  /// growing the table.
+  static const uint32_t MAX_SEED = 100000;
+
+  struct Slot
+  {
+    Slot() : used(false), value() {}
+
+    bool used;
+    std::string key;
+    T value;
+  };
+
+  typedef typename std::map<std::string, T>::const_iterator Entry;
+
+  /// Attempts to build the table with the given number of slots (a power of
+  /// two).  Returns false if some bucket's keys couldn't be placed.
+  bool try_build(const std::map<std::string, T>& entries, size_t num_slots)
+  {
+    size_t num_buckets = std::max(num_slots / 4, (size_t)1);
+    _bucket_mask = num_buckets - 1;
+    _slot_mask = num_slots - 1;
+    _seeds.assign(num_buckets, 0);
+    _slots.assign(num_slots, Slot());
+    _size = 0;
+
+    // Assign the keys to buckets, discarding any duplicates.
+    std::vector<std::vector<Entry> > buckets(num_buckets);
+
+    for (Entry it = entries.begin(); it != entries.end(); ++it)
+    {
+      std::vector<Entry>& bucket =
+           buckets[hash(0, it->first.data(), it->first.length()) & _bucket_mask];
+      bool duplicate = false;
+
+      for (size_t ii = 0; ii < bucket.size(); ++ii)
+      {
+        if (equal(bucket[ii]->first, it->first.data(), it->first.length()))
+        {
+          duplicate = true;
+          break;
+        }
+      }
+
+      if (!duplicate)
+      {
+        bucket.push_back(it);
+      }
+    }
+
+    // Place the largest buckets first, while the table is emptiest.
+    std::vector<size_t> order(num_buckets);
+    for (size_t ii = 0; ii < num_buckets; ++ii)
+    {
+      order[ii] = ii;
+    }
+    std::stable_sort(order.begin(), order.end(), BucketSizeGreater(buckets));
+
+    std::vector<size_t> positions;
+
+    for (size_t ii = 0; ii < num_buckets; ++ii)
+    {
+      const std::vector<Entry>& bucket = buckets[order[ii]];
+
+      if (bucket.empty())
+      {
+        break;
+      }
+
+      // Find a seed that puts every key in the bucket in a distinct, free
+      // slot.
+      uint32_t seed;
+      for (seed = 1; seed <= MAX_SEED; ++seed)
+      {
+        positions.clear();
+
+        for (size_t jj = 0; jj < bucket.size(); ++jj)
+        {
+          size_t pos = hash(seed,
+                            bucket[jj]->first.data(),
+                            bucket[jj]->first.length()) & _slot_mask;
+
+          if ((_slots[pos].used) ||
+              (std::find(positions.begin(), positions.end(), pos) != positions.end()))
+          {
+            break;
+          }
+
+          positions.push_back(pos);
+        }
+
+        if (positions.size() == bucket.size())
+        {
+          break;
+        }
+      }
+
+      if (seed > MAX_SEED)
+      {
+        return false; // LCOV_EXCL_LINE
+      }
+
+      _seeds[order[ii]] = seed;
+
+      for (size_t jj = 0; jj < bucket.size(); ++jj)
+      {
+        Slot& slot = _slots[positions[jj]];
+        slot.used = true;
+        slot.key = bucket[jj]->first;
+        slot.value = bucket[jj]->second;
+        _size++;
+      }
+    }
+
+    return true;
+  }
+
+  struct BucketSizeGreater
+  {
+    BucketSizeGreater(const std::vector<std::vector<Entry> >& buckets) :
+      _buckets(buckets)
+    {
+    }
+
+    bool operator()(size_t a, size_t b) const
+    {
+      return _buckets[a].size() > _buckets[b].size();
+    }
+
+    const std::vector<std::vector<Entry> >& _buckets;
+  };
+
+  static inline char lower(char c)
+  {
+    return ((c >= 'A') && (c <= 'Z')) ? (c + ('a' - 'A')) : c;
+  }
+
+  /// FNV-1a, seeded and with a final avalanche so that the low bits (which
+  /// select the bucket and slot) depend on the whole key.
+  uint32_t hash(uint32_t seed, const char* key, size_t len) const
+  {
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+
+    for (size_t ii = 0; ii < len; ++ii)
+    {
+      h ^= (uint8_t)(_case_insensitive ? lower(key[ii]) : key[ii]);
+      h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+
+    return h;
+  }
+
+  bool equal(const std::string& stored, const char* key, size_t len) const
+  {
+    if (stored.length() != len)
+    {
+      return false;
+    }
+
+    if (!_case_insensitive)
+    {
+      return (memcmp(stored.data(), key, len) == 0);
+    }
+
+    for (size_t ii = 0; ii < len; ++ii)
+    {
+      if (lower(stored[ii]) != lower(key[ii]))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool _case_insensitive;
+  uint32_t _bucket_mask;
+  uint32_t _slot_mask;
+  size_t _size;
+  std::vector<uint32_t> _seeds;
+  std::vector<Slot> _slots;
+};
+
+#endif
@@ -166,6 +166,16 @@ void resolve_next_hop(pjsip_tx_data* tdata,
                       int allowed_host_state,
                       SAS::TrailId trail);
 
+/// Resolves the next hop without blocking on DNS.  Returns true if the
+/// servers will be passed to the callback (on a resolver thread), or false if
+/// they have been resolved synchronously into servers.
+bool resolve_next_hop_async(pjsip_tx_data* tdata,
+                            int retries,
+                            std::vector<AddrInfo>& servers,
+                            int allowed_host_state,
+                            SAS::TrailId trail,
+                            const SIPResolver::ResolveCallback& callback);
+
 void blacklist_server(AddrInfo& server);
 
 void set_dest_info(pjsip_tx_data* tdata, const AddrInfo& ai);
@@ -0,0 +1,224 @@
+/**
+ * @file prefix_trie.h Longest-prefix-match table for number lookups.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PREFIX_TRIE_H__
+#define PREFIX_TRIE_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/// @class PrefixTrie
+///
+/// Character trie mapping string prefixes (typically telephone number
+/// prefixes) to values.  The trie is built once (by repeated calls to insert)
+/// and is then read-only, so a fully built trie can safely be shared between
+/// threads without locking.  Lookup cost is proportional to the length of the
+/// key, not to the number of prefixes in the table.
+///
+/// Nodes are held in a single vector and reference each other by index, with
+/// each node's children held as a sibling list sorted by character.  This
+/// keeps the per-node overhead small enough for tables with millions of
+/// prefixes.
+template <class T>
+class PrefixTrie
+{
+public:
+  PrefixTrie()
+  {
+    // Node 0 is the root, which represents the empty prefix.
+    _nodes.push_back(Node('\0'));
+  }
+
+  /// Adds a prefix to the table.  If the prefix is already present the
+  /// existing value is kept and false is returned (in the same way as
+  /// std::map::insert).
+  bool insert(const std::string& prefix, const T& value)
+  {
+    uint32_t node = ROOT;
+    std::vector<uint32_t> path;
+    path.push_back(node);
+
+    for (std::string::const_iterator c = prefix.begin(); c != prefix.end(); ++c)
+    {
+      node = find_or_add_child(node, *c);
+      path.push_back(node);
+    }
+
+    if (_nodes[node].entry != NO_ENTRY)
+    {
+      return false;
+    }
+
+    int32_t entry = (int32_t)_entries.size();
+    _entries.push_back(Entry(prefix, value));
+    _nodes[node].entry = entry;
+
+    // Update the lexicographically greatest entry below each node on the path
+    // to the new entry.
+    for (std::vector<uint32_t>::const_iterator it = path.begin();
+         it != path.end();
+         ++it)
+    {
+      int32_t& greatest = _nodes[*it].greatest;
+      if ((greatest == NO_ENTRY) ||
+          (_entries[greatest].prefix < prefix))
+      {
+        greatest = entry;
+      }
+    }
+
+    return true;
+  }
+
+  /// Returns the value for the longest prefix of the key, or NULL if no
+  /// prefix matches.
+  ///
+  /// If the key is itself a prefix of (or equal to) one or more entries, the
+  /// lexicographically greatest of those entries matches instead.  This
+  /// matches the behaviour of the reverse-ordered std::map scans that this
+  /// table replaces.
+  const T* match(const std::string& key,
+                 const std::string** matched_prefix = NULL) const
+  {
+    uint32_t node = ROOT;
+    int32_t best = _nodes[ROOT].entry;
+    bool exhausted = true;
+
+    for (std::string::const_iterator c = key.begin(); c != key.end(); ++c)
+    {
+      node = find_child(node, *c);
+
+      if (node == NO_NODE)
+      {
+        exhausted = false;
+        break;
+      }
+
+      if (_nodes[node].entry != NO_ENTRY)
+      {
+        best = _nodes[node].entry;
+      }
+    }
+
+    if (exhausted)
+    {
+      best = _nodes[node].greatest;
+    }
+
+    if (best == NO_ENTRY)
+    {
+      return NULL;
+    }
+
+    if (matched_prefix != NULL)
+    {
+      *matched_prefix = &_entries[best].prefix;
+    }
+
+    return &_entries[best].value;
+  }
+
+  /// Returns the number of prefixes in the table.
+  size_t size() const { return _entries.size(); }
+
+private:
+  static const uint32_t ROOT = 0;
+  static const uint32_t NO_NODE = 0xFFFFFFFF;
+  static const int32_t NO_ENTRY = -1;
+
+  struct Node
+  {
+    Node(char c) :
+      c(c),
+      first_child(NO_NODE),
+      next_sibling(NO_NODE),
+      entry(NO_ENTRY),
+      greatest(NO_ENTRY)
+    {
+    }
+
+    char c;
+    uint32_t first_child;
+    uint32_t next_sibling;
+
+    // The entry ending at this node (if any).
+    int32_t entry;
+
+    // The lexicographically greatest entry at or below this node (if any).
+    int32_t greatest;
+  };
+
+  struct Entry
+  {
+    Entry(const std::string& prefix, const T& value) :
+      prefix(prefix),
+      value(value)
+    {
+    }
+
+    std::string prefix;
+    T value;
+  };
+
+  uint32_t find_child(uint32_t parent, char c) const
+  {
+    uint32_t child = _nodes[parent].first_child;
+
+    // Siblings are sorted, so we can stop as soon as we pass the character.
+    while ((child != NO_NODE) && (_nodes[child].c < c))
+    {
+      child = _nodes[child].next_sibling;
+    }
+
+    return ((child != NO_NODE) && (_nodes[child].c == c)) ? child : NO_NODE;
+  }
+
+  uint32_t find_or_add_child(uint32_t parent, char c)
+  {
+    uint32_t prev = NO_NODE;
+    uint32_t child = _nodes[parent].first_child;
+
+    while ((child != NO_NODE) && (_nodes[child].c < c))
+    {
+      prev = child;
+      child = _nodes[child].next_sibling;
+    }
+
+    if ((child != NO_NODE) && (_nodes[child].c == c))
+    {
+      return child;
+    }
+
+    // Insert a new node between prev and child to keep the siblings sorted.
+    // Note that this may reallocate _nodes, so don't hold references across
+    // it.
+    uint32_t new_node = (uint32_t)_nodes.size();
+    _nodes.push_back(Node(c));
+    _nodes[new_node].next_sibling = child;
+
+    if (prev == NO_NODE)
+    {
+      _nodes[parent].first_child = new_node;
+    }
+    else
+    {
+      _nodes[prev].next_sibling = new_node;
+    }
+
+    return new_node;
+  }
+
+  std::vector<Node> _nodes;
+  std::vector<Entry> _entries;
+};
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * @file priority_event_queue.h Multi-level priority queue for worker threads.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PRIORITY_EVENT_QUEUE_H__
+#define PRIORITY_EVENT_QUEUE_H__
+
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+
+/// @class PriorityEventQueue
+///
+/// Blocking queue with a number of priority levels (0 being the highest).
+/// Events are normally popped from the highest priority level that has any
+/// events, in FIFO order within the level.  To stop lower priority events
+/// from being starved, an event that has been queued for longer than the
+/// maximum wait time is popped ahead of higher priority events.
+///
+/// The queue supports the same deadlock detection as eventq - it is deadlocked
+/// if it has held events without any being popped for longer than the
+/// deadlock threshold.
+template <class T>
+class PriorityEventQueue
+{
+public:
+  PriorityEventQueue(int num_priorities, int max_wait_ms) :
+    _levels(num_priorities),
+    _max_wait_ms(max_wait_ms),
+    _size(0),
+    _terminated(false),
+    _deadlock_threshold_ms(0),
+    _service_time_ms(0)
+  {
+    pthread_mutex_init(&_lock, NULL);
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+  }
+
+  ~PriorityEventQueue()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Adds an event to the queue at the specified priority level.
+  void push(const T& item, int priority)
+  {
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&_lock);
+
+    if (_size == 0)
+    {
+      // The queue was empty, so start timing service from now.
+      _service_time_ms = now;
+    }
+
+    _levels[priority].push_back(Entry(item, now));
+    _size++;
+    pthread_cond_signal(&_cond);
+
+    pthread_mutex_unlock(&_lock);
+  }
+
+  /// Pops the next event from the queue, waiting for up to timeout_ms for one
+  /// to be available (or indefinitely if timeout_ms is -1).  Returns false if
+  /// the queue is terminated or the wait times out.
+  bool pop(T& item, int timeout_ms = -1)
+  {
+    struct timespec deadline;
+    if (timeout_ms > 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += timeout_ms / 1000;
+      deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+    }
+
+    pthread_mutex_lock(&_lock);
+
+    int rc = 0;
+    while ((_size == 0) && (!_terminated) && (timeout_ms != 0) && (rc != ETIMEDOUT))
+    {
+      if (timeout_ms < 0)
+      {
+        pthread_cond_wait(&_cond, &_lock);
+      }
+      else
+      {
+        rc = pthread_cond_timedwait(&_cond, &_lock, &deadline);
+      }
+    }
+
+    bool found = ((_size > 0) && (!_terminated));
+
+    if (found)
+    {
+      std::deque<Entry>& level = _levels[next_level(now_ms())];
+      item = level.front().item;
+      level.pop_front();
+      _size--;
+      _service_time_ms = now_ms();
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    return found;
+  }
+
+  /// Returns the number of events on the queue.
+  int size()
+  {
+    pthread_mutex_lock(&_lock);
+    int size = _size;
+    pthread_mutex_unlock(&_lock);
+    return size;
+  }
+
+  /// Terminates the queue, waking any threads waiting to pop from it.
+  void terminate()
+  {
+    pthread_mutex_lock(&_lock);
+    _terminated = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  /// Sets the deadlock detection threshold.  Zero disables deadlock detection.
+  void set_deadlock_threshold(int threshold_ms)
+  {
+    pthread_mutex_lock(&_lock);
+    _deadlock_threshold_ms = threshold_ms;
+    pthread_mutex_unlock(&_lock);
+  }
+
+  /// Returns whether the queue has held events without any being popped for
+  /// longer than the deadlock threshold.
+  bool is_deadlocked()
+  {
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&_lock);
+    bool deadlocked = ((_deadlock_threshold_ms > 0) &&
+                       (_size > 0) &&
+                       (now - _service_time_ms > (uint64_t)_deadlock_threshold_ms));
+    pthread_mutex_unlock(&_lock);
+
+    return deadlocked;
+  }
+
+private:
+  struct Entry
+  {
+    Entry(const T& item, uint64_t queued_ms) :
+      item(item),
+      queued_ms(queued_ms)
+    {
+    }
+
+    T item;
+    uint64_t queued_ms;
+  };
+
+  static uint64_t now_ms()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+  }
+
+  /// Selects the level to pop the next event from.  Must be called with the
+  /// lock held and the queue non-empty.
+  size_t next_level(uint64_t now)
+  {
+    size_t selected = _levels.size();
+
+    for (size_t ii = 0; ii < _levels.size(); ++ii)
+    {
+      if (_levels[ii].empty())
+      {
+        continue;
+      }
+
+      if (selected == _levels.size())
+      {
+        // This is the highest priority level with any events.
+        selected = ii;
+      }
+      else if ((now - _levels[ii].front().queued_ms > (uint64_t)_max_wait_ms) &&
+               (_levels[ii].front().queued_ms < _levels[selected].front().queued_ms))
+      {
+        // This lower priority event has waited too long, and for longer than
+        // the event currently selected.
+        selected = ii;
+      }
+    }
+
+    return selected;
+  }
+
+  std::vector<std::deque<Entry> > _levels;
+  int _max_wait_ms;
+  int _size;
+  bool _terminated;
+  int _deadlock_threshold_ms;
+  uint64_t _service_time_ms;
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+};
+
+#endif
@@ -12,18 +12,45 @@
 #ifndef RALF_PROCESSOR_H_
 #define RALF_PROCESSOR_H_
 
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+
 #include "threadpool.h"
 #include "sas.h"
+#include "utils.h"
 #include "httpconnection.h"
 #include "exception_handler.h"
+#include "snmp_counter_table.h"
+#include "snmp_event_accumulator_table.h"
 
 class RalfProcessor
 {
 public:
   /// Constructor
+  ///
+  /// @param ralf_connection   - Connection to Ralf.
+  /// @param exception_handler - Exception handler for the sending threads.
+  /// @param ralf_threads      - Number of threads sending ACRs to Ralf.
+  /// @param max_queued_acrs   - The maximum number of ACRs waiting to be sent.
+  ///                            Further ACRs are dropped until the backlog
+  ///                            clears.
+  /// @param batch_size        - The number of ACRs collected before they are
+  ///                            handed to the sending threads, which share
+  ///                            them out.  1 disables batching.
+  /// @param batch_interval_ms - The longest time an ACR waits for its batch
+  ///                            to fill up.
+  /// @param latency_tbl       - Statistics table for the time from an ACR
+  ///                            being queued to Ralf responding to it.
+  /// @param dropped_tbl       - Statistics table counting dropped ACRs.
   RalfProcessor(HttpConnection* ralf_connection,
                 ExceptionHandler* exception_handler,
-                const int ralf_threads);
+                const int ralf_threads,
+                const int max_queued_acrs = DEFAULT_MAX_QUEUED_ACRS,
+                const int batch_size = 1,
+                const int batch_interval_ms = DEFAULT_BATCH_INTERVAL_MS,
+                SNMP::EventAccumulatorTable* latency_tbl = NULL,
+                SNMP::CounterTable* dropped_tbl = NULL);
 
   /// Destructor
   virtual ~RalfProcessor();
@@ -33,41 +60,60 @@ public:
     std::string path;
     std::string message;
     SAS::TrailId trail;
+
+    // Times the request from being queued until Ralf responds.
+    Utils::StopWatch stopwatch;
   };
 
+  /// A batch of requests, sent back-to-back by a single thread.  Each batch
+  /// collected is split into one of these per sending thread, so that its
+  /// requests are sent concurrently.
+  typedef std::vector<RalfRequest*> RalfBatch;
+
   /// This function adds a ralf request to the pool. Actually sending
   /// the Ralf request must be done in a separate thread to avoid
-  /// introducing unnecessary latencies in the call path.
+  /// introducing unnecessary latencies in the call path.  This never blocks -
+  /// if too many requests are already queued the request is dropped.
   /// @param rr         The RalfRequest to add to the queue
   virtual void send_request_to_ralf(RalfRequest* rr);
 
-  static void exception_callback(RalfProcessor::RalfRequest* work)
+  static void exception_callback(RalfProcessor::RalfBatch* work)
   {
     // No recovery behaviour as this is asynchronous, so we can't sensibly
     // respond
   }
 
+  static const int DEFAULT_MAX_QUEUED_ACRS = 10000;
+  static const int DEFAULT_BATCH_INTERVAL_MS = 10;
+
 private:
   /// @class Pool
   /// The thread pool used by the ralf processor
-  class Pool : public ThreadPool<RalfProcessor::RalfRequest*>
+  class Pool : public ThreadPool<RalfProcessor::RalfBatch*>
   {
   public:
     /// Constructor.
+    /// @param ralf_processor     The processor that owns this pool.
     /// @param ralf_connection    A pointer to the underlying ralf connection.
     /// @param num_threads        Number of ralf threads to start
     /// @param exception_handler  Exception handler
-    Pool(HttpConnection* ralf_connection,
+    /// @param max_queue          Maximum number of batches on the queue
+    Pool(RalfProcessor* ralf_processor,
+         HttpConnection* ralf_connection,
          ExceptionHandler* exception_handler,
-         void (*callback)(RalfProcessor::RalfRequest*),
-         unsigned int num_threads);
+         void (*callback)(RalfProcessor::RalfBatch*),
+         unsigned int num_threads,
+         unsigned int max_queue);
 
     /// Destructor
     virtual ~Pool();
 
   private:
     /// Called by worker threads when they pull work off the queue.
-    virtual void process_work(RalfProcessor::RalfRequest*&);
+    virtual void process_work(RalfProcessor::RalfBatch*&);
+
+    /// The owning processor
+    RalfProcessor* _ralf_processor;
 
     /// Underlying Ralf connection
     HttpConnection* _ralf_connection;
@@ -75,8 +121,38 @@ private:
 
   friend class Pool;
 
+  /// Hands the pending batch to the thread pool, split between the sending
+  /// threads.  Must be called with _batch_lock held.
+  void flush_batch();
+
+  /// Entry point for the thread that flushes part-filled batches.
+  static void* flush_thread_fn(void* p);
+  void flush_thread();
+
   ///  Thread pool
   Pool* _thread_pool;
+
+  const int _ralf_threads;
+  const int _max_queued_acrs;
+  const int _batch_size;
+  const int _batch_interval_ms;
+
+  /// The number of ACRs queued but not yet sent, including those in the
+  /// pending batch.
+  std::atomic<int> _queued_acrs;
+
+  /// The batch currently being filled, and when the first request was added
+  /// to it.  Only used if batching is enabled.
+  RalfBatch* _pending_batch;
+  struct timespec _pending_since;
+  pthread_mutex_t _batch_lock;
+  pthread_cond_t _batch_cond;
+  pthread_t _flush_thread;
+  bool _flush_thread_started;
+  bool _terminating;
+
+  SNMP::EventAccumulatorTable* _latency_tbl;
+  SNMP::CounterTable* _dropped_tbl;
 };
 
 #endif
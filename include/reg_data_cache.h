@@ -0,0 +1,163 @@
+/**
+ * @file reg_data_cache.h Cache of registration data retrieved from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef REG_DATA_CACHE_H__
+#define REG_DATA_CACHE_H__
+
+#include <string>
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ifchandler.h"
+#include "associated_uris.h"
+#include "snmp_counter_table.h"
+
+/// @class RegDataCache
+///
+/// Size-bounded LRU cache of the decoded registration data returned by
+/// Homestead, keyed by IMPU, so that repeated lookups of the same subscriber
+/// don't each need an HTTP request and a parse of the XML.  Entries expire
+/// after a fixed time, which bounds how stale the cache can be relative to
+/// changes made through other nodes.
+///
+/// The cache is split into shards, each with its own lock and LRU list, so
+/// that worker threads looking up different subscribers don't contend.
+///
+/// Each IMPU has a generation, which changes whenever its data is
+/// invalidated.  Callers read the generation before asking Homestead for the
+/// data and pass it to put, so that a slow response can't overwrite the
+/// results of a registration that happened while it was outstanding.
+class RegDataCache
+{
+public:
+  /// The registration data for an IMPU, as decoded from the Homestead XML.
+  struct RegData
+  {
+    std::string regstate;
+    std::map<std::string, Ifcs> ifcs_map;
+    AssociatedURIs associated_uris;
+    std::vector<std::string> aliases;
+    std::deque<std::string> ccfs;
+    std::deque<std::string> ecfs;
+  };
+
+  /// Constructor.
+  ///
+  /// @param max_size     - The maximum number of IMPUs to cache.
+  /// @param ttl          - How long entries are cached for (in seconds).
+  /// @param hits_tbl     - Statistics tables counting cache hits, misses and
+  /// @param misses_tbl     evictions of unexpired entries to make space.
+  /// @param evictions_tbl
+  RegDataCache(int max_size,
+               int ttl,
+               SNMP::CounterTable* hits_tbl,
+               SNMP::CounterTable* misses_tbl,
+               SNMP::CounterTable* evictions_tbl);
+  virtual ~RegDataCache();
+
+  /// Looks up the registration data for an IMPU.
+  ///
+  /// @return - The data, or NULL if the IMPU isn't cached or has expired.
+  std::shared_ptr<const RegData> get(const std::string& impu);
+
+  /// Returns the current generation of an IMPU's data.
+  uint64_t generation(const std::string& impu);
+
+  /// Caches the registration data for an IMPU, replacing any existing entry.
+  /// The data is discarded if the IMPU's data has been invalidated since the
+  /// generation was read.
+  ///
+  /// @param generation  - The IMPU's generation when the request for the data
+  ///                      was sent.
+  /// @param irs_changed - Whether the implicit registration set may have
+  ///                      changed, in which case anything cached for the
+  ///                      other IMPUs in it is discarded.
+  void put(const std::string& impu,
+           const RegData& data,
+           uint64_t generation,
+           bool irs_changed = false);
+
+  /// Invalidates the cached data for an IMPU, and for the rest of its
+  /// implicit registration set.
+  ///
+  /// @return - The IMPU's new generation.
+  uint64_t invalidate(const std::string& impu);
+
+  /// Invalidates the cached data for all the IMPUs in an implicit
+  /// registration set.
+  void invalidate_irs(const AssociatedURIs& associated_uris);
+
+  /// Returns the number of cached IMPUs.
+  int size();
+
+private:
+  static const int NUM_SHARDS = 16;
+
+  /// Generations are held for groups of IMPUs (chosen by hash), so that they
+  /// don't need to be kept for every IMPU ever seen.  Invalidating one IMPU
+  /// in a group stops the others' outstanding responses being cached too,
+  /// which is safe.
+  static const int GENERATIONS_PER_SHARD = 64;
+
+  struct Entry
+  {
+    std::shared_ptr<const RegData> data;
+    unsigned long expiry_ms;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  struct Shard
+  {
+    pthread_mutex_t lock;
+    std::unordered_map<std::string, Entry> entries;
+
+    // IMPUs in order of use, most recently used first.
+    std::list<std::string> lru;
+
+    uint64_t generations[GENERATIONS_PER_SHARD];
+  };
+
+  Shard& shard_for(const std::string& impu);
+  static uint64_t& generation_for(Shard& shard, const std::string& impu);
+
+  /// Stores an IMPU's entry, evicting others if the shard is full.  Must be
+  /// called with the shard lock held.
+  void store(Shard& shard,
+             const std::string& impu,
+             std::shared_ptr<const RegData> new_data);
+
+  /// Removes a single IMPU's entry and advances its generation, returning the
+  /// data it held (if any) and the new generation.
+  std::shared_ptr<const RegData> remove(const std::string& impu,
+                                        uint64_t& generation);
+
+  /// Removes the entries for all the IMPUs in an implicit registration set,
+  /// apart from the specified one.
+  void remove_irs(const AssociatedURIs& associated_uris,
+                  const std::string& except);
+
+  static unsigned long now_ms();
+
+  Shard _shards[NUM_SHARDS];
+  size_t _max_shard_size;
+  unsigned long _ttl_ms;
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+  SNMP::CounterTable* _evictions_tbl;
+};
+
+#endif
@@ -109,6 +109,20 @@ public:
 
 protected:
   void process_register_request(pjsip_msg* req);
+  void complete_register_request(pjsip_msg* req,
+                                 ACR* acr,
+                                 int now,
+                                 int expiry,
+                                 int num_contacts,
+                                 int num_emergency_bindings,
+                                 int num_emergency_deregisters,
+                                 bool reject_with_400,
+                                 const std::string& public_id,
+                                 const std::string& private_id,
+                                 const std::string& private_id_for_binding,
+                                 pjsip_sip_uri* routing_uri,
+                                 HTTPCode http_code,
+                                 HSSConnection::RegData& reg_data);
 
   SubscriberDataManager::AoRPair* write_to_store(
                      SubscriberDataManager* primary_sdm,         ///<store to write to
@@ -153,6 +153,33 @@ private:
                      const std::string& wildcard,
                      SAS::TrailId trail);
 
+  /// Read data for a public user identity from the HSS without blocking.  The
+  /// callback is run on the HSS query thread once homestead responds, and
+  /// the data can then be pulled out with extract_hss_data.  Returns false
+  /// (without running the callback) if asynchronous queries are disabled.
+  bool read_hss_data_async(const std::string& public_id,
+                           const std::string& private_id,
+                           const std::string& req_type,
+                           const std::string& scscf_uri,
+                           bool cache_allowed,
+                           const std::string& wildcard,
+                           SAS::TrailId trail,
+                           const HSSConnection::RegDataCallback& callback);
+
+  /// Pull the data for a public user identity out of the response from the
+  /// HSS.
+  static void extract_hss_data(const std::string& public_id,
+                               long http_code,
+                               HSSConnection::RegData& data,
+                               bool& registered,
+                               bool& barred,
+                               std::string& default_uri,
+                               std::vector<std::string>& uris,
+                               std::vector<std::string>& aliases,
+                               Ifcs& ifcs,
+                               std::deque<std::string>& ccfs,
+                               std::deque<std::string>& ecfs);
+
   /// Record that communication with an AS failed.
   ///
   /// @param uri               - The URI of the AS.
@@ -272,6 +299,13 @@ private:
   /// the 'orig' param), and sets those as member variables.
   void retrieve_odi_and_sesscase(pjsip_msg* req);
 
+  /// Fetches the served user's data from the HSS without blocking, then
+  /// continues processing the initial request.
+  bool fetch_hss_data_async(const std::string& public_id, pjsip_msg* req);
+
+  /// Processes an initial request once the session case is known.
+  void process_initial_request(pjsip_msg* req);
+
   /// Determines the served user for the request.
   pjsip_status_code determine_served_user(pjsip_msg* req);
 
@@ -330,6 +364,11 @@ private:
   /// the HSS. Returns the HTTP result code received from homestead.
   long get_data_from_hss(std::string public_id);
 
+  /// Stores the subscriber's data fetched asynchronously from the HSS.
+  void store_hss_data(const std::string& public_id,
+                      long http_code,
+                      HSSConnection::RegData& data);
+
   /// Look up the registration state for the given public ID, using the
   /// per-transaction cache if possible (and caching them and the iFC otherwise).
   bool is_user_registered(std::string public_id);
@@ -404,6 +443,9 @@ private:
 
   /// Data retrieved from HSS for this service hop.
   bool _hss_data_cached;
+  bool _hss_data_fetched;
+  std::string _hss_data_public_id;
+  long _hss_data_http_code;
   bool _registered;
   bool _barred;
   std::string _default_uri;
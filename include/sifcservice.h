@@ -13,6 +13,7 @@
 #define SIFCSERVICE_H__
 
 #include <map>
+#include <memory>
 #include <string>
 #include <boost/thread.hpp>
 #include "rapidxml/rapidxml.hpp"
@@ -40,21 +41,30 @@ public:
   /// Updates the shared iFC sets
   void update_sets();
 
-  /// Get the iFCs that belong to a set of IDs
+  /// Get the iFCs that belong to a set of IDs. The iFCs are shared with the
+  /// service, so this doesn't parse any XML.
   virtual void get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                 const std::set<int32_t>& id,
-                                std::shared_ptr<xml_document<> > ifc_doc,
                                 SAS::TrailId trail) const;
 
 private:
+  /// The shared iFC sets, keyed by set ID. Each set is a list of iFCs and
+  /// their priorities.
+  typedef std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>> IfcSets;
+
   Alarm* _alarm;
   SNMP::CounterTable* _no_shared_ifcs_set_tbl;
-  std::map<int32_t, std::vector<std::pair<int32_t, std::string>>> _shared_ifc_sets;
+
+  // The current shared iFC sets. These are never modified once loaded - a
+  // reload builds new sets and swaps this pointer, so requests can keep using
+  // the old sets without holding the lock.
+  std::shared_ptr<const IfcSets> _shared_ifc_sets;
   std::string _configuration;
   Updater<void, SIFCService>* _updater;
 
   // Mark as mutable to flag that this can be modified without affecting the
   // external behaviour of the class, allowing for locking in 'const' methods.
+  // This only protects _shared_ifc_sets (the pointer, not the sets).
   mutable boost::shared_mutex _sets_rw_lock;
 
   // Helper functions to set/clear the alarm.
@@ -0,0 +1,131 @@
+/**
+ * @file simservs_cache.h Cache of the simservs documents retrieved from the
+ * XDMS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SIMSERVS_CACHE_H__
+#define SIMSERVS_CACHE_H__
+
+#include <list>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <pthread.h>
+
+#include "sas.h"
+#include "simservs.h"
+#include "xdmconnection.h"
+#include "snmp_counter_table.h"
+
+/// @class SimservsCache
+///
+/// Size-bounded cache of parsed simservs documents, keyed by public ID, so
+/// that the MMTel AS doesn't need to fetch and parse a subscriber's
+/// supplementary service settings from the XDMS on every call.
+///
+/// Cached documents are used without contacting the XDMS for a fixed TTL.
+/// After that they are revalidated using the document's ETag, so that an
+/// unchanged document is neither transferred nor parsed again.  Concurrent
+/// lookups for a user that isn't cached share a single request to the XDMS.
+/// When the cache is full, the least recently used user is evicted.
+class SimservsCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param xdm_connection    - The connection to the XDMS.
+  /// @param max_size          - The maximum number of users to cache.
+  /// @param ttl               - How long documents are used for before
+  ///                            being revalidated (in seconds).
+  /// @param hits_tbl          - Statistics tables counting lookups answered
+  /// @param misses_tbl          without contacting the XDMS, lookups that
+  /// @param revalidations_tbl   fetched the document, and lookups where the
+  ///                            XDMS confirmed that the cached document was
+  ///                            still current.
+  SimservsCache(XDMConnection* xdm_connection,
+                int max_size,
+                int ttl,
+                SNMP::CounterTable* hits_tbl,
+                SNMP::CounterTable* misses_tbl,
+                SNMP::CounterTable* revalidations_tbl);
+  virtual ~SimservsCache();
+
+  /// Gets a user's simservs configuration.  Users with no simservs document
+  /// get a configuration with all services disabled.
+  ///
+  /// @return - The configuration, or NULL if it couldn't be retrieved.
+  std::shared_ptr<const simservs> get(const std::string& public_id,
+                                      SAS::TrailId trail);
+
+  /// The longest time that a lookup waits for another thread's request to
+  /// the XDMS for the same user, before making its own request.
+  static const int MAX_WAIT_MS = 1000;
+
+private:
+  struct Entry
+  {
+    // Whether a thread is currently fetching this user's document.
+    bool pending;
+
+    std::shared_ptr<const simservs> services;
+    std::string etag;
+
+    // When the document must be revalidated.  This is 0 if the last request
+    // to the XDMS failed.
+    unsigned long expiry_ms;
+
+    // The entry's position in the LRU list.
+    std::list<std::string>::iterator lru;
+  };
+
+  /// Fetches a user's document from the XDMS, revalidating the cached copy
+  /// if there is one.
+  ///
+  /// @param cached   - The cached copy of the document, if any.
+  /// @param services - Filled in with the current document.  If the request
+  ///                   fails, this is the cached copy (if any).
+  /// @param etag     - The ETag of the cached copy, updated with the ETag of
+  ///                   the current document.
+  /// @returns        - Whether the XDMS answered the request.
+  bool fetch(const std::string& public_id,
+             const std::shared_ptr<const simservs>& cached,
+             std::shared_ptr<const simservs>& services,
+             std::string& etag,
+             SAS::TrailId trail);
+
+  /// Stores the result of a request to the XDMS, and wakes any threads
+  /// waiting for it.
+  void complete_fetch(const std::string& public_id,
+                      const std::shared_ptr<const simservs>& services,
+                      const std::string& etag,
+                      bool fetched);
+
+  /// Makes space for a new entry by evicting the least recently used entries
+  /// that aren't being fetched.  Must be called with the lock held.
+  void evict_entries();
+
+  static unsigned long now_ms();
+
+  XDMConnection* _xdmc;
+  size_t _max_size;
+  unsigned long _ttl_ms;
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+  SNMP::CounterTable* _revalidations_tbl;
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  std::unordered_map<std::string, Entry> _cache;
+
+  /// Public IDs in the cache, most recently used first.
+  std::list<std::string> _lru;
+};
+
+#endif
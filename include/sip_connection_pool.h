@@ -20,6 +20,7 @@ extern "C" {
 #include <map>
 #include <string>
 #include <random>
+#include <atomic>
 
 #include "snmp_ip_count_table.h"
 
@@ -32,13 +33,41 @@ public:
                  pj_pool_t* pool,
                  pjsip_endpoint* endpt,
                  pjsip_tpfactory* tp_factory,
-                 SNMP::IPCountTable* sprout_count_tbl);
+                 SNMP::IPCountTable* sprout_count_tbl,
+                 SNMP::IPCountTable* requests_tbl = NULL);
   ~SIPConnectionPool();
 
   void init();
 
+  /// Returns a connected transport to the target, with a reference added,
+  /// or NULL if there are no connected transports.  The transport chosen is
+  /// the one with the fewest requests awaiting a response (and of those, the
+  /// fewest bytes of requests).
   pjsip_transport* get_connection();
 
+  /// Records that a request of the specified size has been sent on a
+  /// transport returned by get_connection, and is awaiting a final response.
+  /// The caller must hold a reference to the transport until it calls
+  /// request_complete, so that the transport can't be destroyed and its
+  /// address reused by a new connection in the meantime.  Calls for
+  /// transports that aren't (or are no longer) in the pool aren't counted
+  /// against any slot.
+  void request_sent(pjsip_transport* tp, int bytes);
+
+  /// Records that a request passed to request_sent has completed.
+  void request_complete(pjsip_transport* tp, int bytes);
+
+  /// The load on a single connection in the pool.
+  struct ConnectionLoad
+  {
+    std::string remote;
+    int requests;
+    long bytes;
+  };
+
+  /// Returns the load on each connected transport in the pool.
+  std::vector<ConnectionLoad> get_connection_load();
+
   // Callback static function passed to PJSIP
   static void transport_state(pjsip_transport* tp,
                               pjsip_transport_state state,
@@ -56,6 +85,8 @@ private:
   void recycle_connections();
   void increment_connection_count(pjsip_transport *);
   void decrement_connection_count(pjsip_transport *);
+  int find_slot(pjsip_transport* tp);
+  void log_connection_load();
 
   pjsip_host_port _target;
   int _num_connections;
@@ -80,20 +111,41 @@ private:
   /// Structure to keep track of the connection in a slot in the hash.  tp
   /// is set as soon as the connection is started, but it is disconnected
   /// until we get a notification from PJSIP that the connection is connected.
+  ///
+  /// tp and connected are only changed with both _tp_hash_lock and the
+  /// slot's lock held, but can be read without either.  The slot's lock is
+  /// only needed to add a reference to tp, to make sure it isn't released
+  /// from the slot (and destroyed) at the same time.
   typedef struct tp_hash_slot
   {
-    pjsip_transport* tp;
+    pthread_mutex_t lock;
+    std::atomic<pjsip_transport*> tp;
     pjsip_tp_state_listener_key *listener_key;
-    pj_bool_t connected;
+    std::atomic_bool connected;
     int recycle_time;
+
+    /// The number of requests sent on the connection that are awaiting a
+    /// final response, and their total size.
+    std::atomic_int requests;
+    std::atomic_long bytes;
   } tp_hash_slot;
 
   pthread_mutex_t _tp_hash_lock;
   std::vector<tp_hash_slot> _tp_hash;
   std::map<pjsip_transport*, int> _tp_map;
 
+  /// Slot at which get_connection starts its search, advanced on each call
+  /// so that connections with equal load are used in turn.
+  std::atomic_uint _next_slot;
+
   // Statistics
   SNMP::IPCountTable* _sprout_count_tbl;
+
+  /// Requests awaiting a final response, by remote host.  This is optional,
+  /// and is updated under _requests_tbl_lock because rows are created and
+  /// removed as the counts move to and from zero.
+  SNMP::IPCountTable* _requests_tbl;
+  pthread_mutex_t _requests_tbl_lock;
 };
 
 #endif // CONNECTION_POOL_H__
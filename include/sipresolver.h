@@ -12,7 +12,10 @@
 #ifndef SIPRESOLVER_H__
 #define SIPRESOLVER_H__
 
+#include <functional>
+
 #include "baseresolver.h"
+#include "async_lookup_pool.h"
 #include "sas.h"
 
 class SIPResolver : public BaseResolver
@@ -31,10 +34,38 @@ public:
                int allowed_host_state,
                SAS::TrailId trail = 0);
 
+  typedef std::function<void(const std::vector<AddrInfo>&)> ResolveCallback;
+
+  /// Resolves a target without blocking the calling thread on DNS.  If the
+  /// target needs DNS lookups and asynchronous resolution is enabled, the
+  /// lookups are made on a resolver thread and the callback is later called
+  /// on that thread with the results.  Concurrent requests to resolve the
+  /// same target share a single set of DNS queries, but each is logged to its
+  /// own trail and makes its own choice between SRV targets.
+  ///
+  /// @returns       - true if the callback will be called, false if the target
+  ///                  has been resolved synchronously into targets.
+  bool resolve_async(const std::string& name,
+                     int af,
+                     int port,
+                     int transport,
+                     int retries,
+                     std::vector<AddrInfo>& targets,
+                     int allowed_host_state,
+                     SAS::TrailId trail,
+                     const ResolveCallback& callback);
+
+  /// Starts the threads used for asynchronous resolution.  Until this is
+  /// called, resolve_async resolves synchronously.
+  void start_async_threads(int num_threads);
+
   /// Default duration to blacklist hosts after we fail to connect to them.
   static const int DEFAULT_BLACKLIST_DURATION = 30;
 
   std::string get_transport_str(int transport);
+
+private:
+  AsyncLookupPool<std::vector<AddrInfo> >* _async_pool;
 };
 
 #endif
@@ -20,6 +20,7 @@ extern "C" {
 }
 
 #include <list>
+#include <functional>
 #include "baseresolver.h"
 #include "snmp_success_fail_count_by_request_type_table.h"
 #include "fork_error_state.h"
@@ -36,6 +37,10 @@ class SproutletProxy;
 /// Typedefs for Sproutlet-specific types
 typedef intptr_t TimerID;
 
+/// Function returned when a SproutletTsx suspends, used to resume it.  It is
+/// passed the processing to run when the transaction resumes.
+typedef std::function<void(const std::function<void()>&)> ResumeFn;
+
 struct ForkState
 {
   pjsip_tsx_state_e tsx_state;
@@ -241,6 +246,18 @@ public:
   ///
   virtual bool timer_running(TimerID id) = 0;
 
+  /// Suspends the transaction while the Sproutlet waits for an asynchronous
+  /// operation (such as a query to Homestead) to complete.  The returned
+  /// function must be called exactly once, from any thread, with the
+  /// processing to do when the operation completes.  That processing is run
+  /// on a worker thread in the context of the transaction, just like the
+  /// handling of a received message, and may send requests and responses.
+  /// The transaction isn't destroyed while it is suspended.
+  ///
+  /// @returns             - The function that resumes the transaction.
+  ///
+  virtual ResumeFn suspend() = 0;
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -578,6 +595,16 @@ protected:
   bool timer_running(TimerID id)
     {return _helper->timer_running(id);}
 
+  /// Suspends the transaction while the Sproutlet waits for an asynchronous
+  /// operation to complete.  The returned function must be called exactly
+  /// once, from any thread, with the processing to do when the operation
+  /// completes - see SproutletTsxHelper::suspend.
+  ///
+  /// @returns             - The function that resumes the transaction.
+  ///
+  ResumeFn suspend()
+    {return _helper->suspend();}
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -21,6 +21,7 @@
 #include "sproutlet.h"
 #include "snmp_sip_request_types.h"
 #include "sproutlet_options.h"
+#include "perfect_hash_map.h"
 
 class SproutletWrapper;
 
@@ -176,6 +177,30 @@ protected:
     bool cancel_timer(TimerID id);
     bool timer_running(TimerID id);
 
+    ResumeFn suspend(SproutletWrapper* tsx);
+    void process_resume(SproutletWrapper* tsx, const std::function<void()>& fn);
+
+    /// Callback used to resume a suspended Sproutlet on a worker thread.
+    class ResumeCallback : public PJUtils::Callback
+    {
+    public:
+      ResumeCallback(UASTsx* uas_tsx,
+                     SproutletWrapper* tsx,
+                     const std::function<void()>& fn) :
+        _uas_tsx(uas_tsx),
+        _tsx(tsx),
+        _fn(fn)
+      {
+      }
+
+      void run() { _uas_tsx->process_resume(_tsx, _fn); }
+
+    private:
+      UASTsx* _uas_tsx;
+      SproutletWrapper* _tsx;
+      std::function<void()> _fn;
+    };
+
     void tx_response(SproutletWrapper* sproutlet,
                      pjsip_tx_data* rsp);
 
@@ -238,6 +263,11 @@ protected:
     /// The UASTsx will persist while there are pending timers.
     std::set<pj_timer_entry*> _pending_timers;
 
+    /// The number of child sproutlet tsxs that are suspended waiting for an
+    /// asynchronous operation.  The UASTsx will persist until they have all
+    /// resumed.
+    int _suspended_tsxs;
+
     friend class SproutletWrapper;
   };
 
@@ -246,8 +276,15 @@ protected:
 
   std::unordered_set<std::string> _host_aliases;
 
+  /// The root URI's host and the host aliases, for checking whether a host is
+  /// local without copying it out of the message.
+  PerfectHashMap<bool> _local_hosts;
+
   std::map<std::string, Sproutlet*> _services;
 
+  /// Lookup table built from _services, used when routing requests.
+  PerfectHashMap<Sproutlet*> _service_table;
+
   std::map<int, Sproutlet*> _ports;
 
   std::list<Sproutlet*> _sproutlets;
@@ -302,6 +339,7 @@ public:
   bool schedule_timer(void* context, TimerID& id, int duration);
   void cancel_timer(TimerID id);
   bool timer_running(TimerID id);
+  ResumeFn suspend();
   SAS::TrailId trail() const;
   bool is_uri_reflexive(const pjsip_uri*) const;
   pjsip_sip_uri* get_reflexive_uri(pj_pool_t*) const;
@@ -318,6 +356,7 @@ private:
   void rx_error(int status_code);
   void rx_fork_error(ForkErrorState fork_error, int fork_id);
   void on_timer_pop(TimerID id, void* context);
+  void on_resume(const std::function<void()>& fn);
   void register_tdata(pjsip_tx_data* tdata);
   void deregister_tdata(pjsip_tx_data* tdata);
 
@@ -394,6 +433,10 @@ private:
   /// until all these timers have popped or been cancelled.
   std::set<TimerID> _pending_timers;
 
+  /// The number of times this SproutletWrapper has been suspended and not yet
+  /// resumed.  It won't be deleted while this is non-zero.
+  int _suspends;
+
   SAS::TrailId _trail_id;
 
   friend class SproutletProxy::UASTsx;
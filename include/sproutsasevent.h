@@ -139,6 +139,7 @@ namespace SASEvent
   const int HTTP_HOMESTEAD_AUTH_STATUS = SPROUT_BASE + 0x0000A4;
   const int HTTP_HOMESTEAD_LOCATION = SPROUT_BASE + 0x0000A5;
   const int HTTP_HOMESTEAD_BAD_IDENTITY = SPROUT_BASE + 0x0000A6;
+  const int HOMESTEAD_REG_DATA_CACHED = SPROUT_BASE + 0x0000A7;
 
   const int IFC_INVALID = SPROUT_BASE + 0x0000C0;
   const int IFC_INVALID_NOAS = SPROUT_BASE + 0x0000C1;
@@ -186,6 +187,7 @@ namespace SASEvent
   const int NO_AS_CHAIN_ROUTE = SPROUT_BASE + 0x0000EB;
 
   const int NO_CCFS_FOR_ACR = SPROUT_BASE + 0xF0;
+  const int ACR_DROPPED_OVERLOAD = SPROUT_BASE + 0xF1;
 
   const int AUTHENTICATION_NC_NOT_SUPP = SPROUT_BASE + 0x0100;
   const int AUTHENTICATION_NC_TOO_LOW = SPROUT_BASE + 0x0101;
@@ -206,6 +208,7 @@ namespace SASEvent
 
   const int BEGIN_OPTIONS_MODULE = SPROUT_BASE + 0x0124;
   const int BEGIN_THREAD_DISPATCHER = SPROUT_BASE + 0x0125;
+  const int WORKER_QUEUE_OVERLOAD = SPROUT_BASE + 0x0126;
 
   const int AMBIGUOUS_WILDCARD_MATCH = SPROUT_BASE + 0x0130;
   const int NO_MATCHING_SERVICE_PROFILE = SPROUT_BASE + 0x0131;
@@ -0,0 +1,110 @@
+/**
+ * @file striped_lock.h Set of locks indexed by string keys.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef STRIPED_LOCK_H__
+#define STRIPED_LOCK_H__
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "snmp_counter_table.h"
+
+/// @class StripedLock
+///
+/// A fixed set of mutexes, each guarding all the keys that hash to it.  This
+/// serializes work on the same key within this process without needing a
+/// lock per key.  Unrelated keys that share a stripe are also serialized, so
+/// locks should only be held briefly.
+///
+/// The mutexes are recursive, so a thread can safely lock a key whose stripe
+/// it already holds.
+///
+/// Stripes should only be held around work on the local store.  Code that may
+/// be called with a stripe held uses a StripedLock::Release around remote
+/// reads and network sends.
+class StripedLock
+{
+public:
+  /// Constructor.
+  ///
+  /// @param num_stripes    - The number of mutexes.
+  /// @param contention_tbl - Statistics table counting the times a thread had
+  ///                         to wait for a lock held by another thread.
+  StripedLock(size_t num_stripes = DEFAULT_STRIPES,
+              SNMP::CounterTable* contention_tbl = NULL);
+
+  /// Destructor.
+  ~StripedLock();
+
+  /// Locks the stripe for the specified key, waiting for any other thread
+  /// that holds it.
+  void lock(const std::string& key);
+
+  /// Unlocks the stripe for the specified key.
+  void unlock(const std::string& key);
+
+  /// @class StripedLock::Guard
+  ///
+  /// Holds the lock for a key for the lifetime of the guard.
+  class Guard
+  {
+  public:
+    Guard(StripedLock* lock, const std::string& key) :
+      _lock(lock),
+      _key(key)
+    {
+      _lock->lock(_key);
+    }
+
+    ~Guard()
+    {
+      _lock->unlock(_key);
+    }
+
+  private:
+    Guard(const Guard&);
+    Guard& operator=(const Guard&);
+
+    StripedLock* _lock;
+    std::string _key;
+  };
+
+  /// @class StripedLock::Release
+  ///
+  /// Releases every stripe the calling thread holds (in any StripedLock) for
+  /// the lifetime of the object, and takes them again afterwards.  Anything
+  /// another thread changes in the meantime is caught by the store's
+  /// compare-and-swap.
+  class Release
+  {
+  public:
+    Release();
+    ~Release();
+
+  private:
+    Release(const Release&);
+    Release& operator=(const Release&);
+
+    // The stripes that were released, in the order they were taken.
+    std::vector<pthread_mutex_t*> _released;
+  };
+
+  static const size_t DEFAULT_STRIPES = 256;
+
+private:
+  pthread_mutex_t* stripe(const std::string& key);
+
+  std::vector<pthread_mutex_t> _stripes;
+  SNMP::CounterTable* _contention_tbl;
+};
+
+#endif
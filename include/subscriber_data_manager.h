@@ -21,6 +21,8 @@ extern "C" {
 #include <string>
 #include <list>
 #include <map>
+#include <functional>
+#include <atomic>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -31,6 +33,11 @@ extern "C" {
 #include "associated_uris.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/document.h"
+#include "snmp_event_accumulator_table.h"
+#include "async_lookup_pool.h"
+#include "striped_lock.h"
+#include "timer_wheel.h"
+#include "snmp_counter_table.h"
 
 // We need to declare the parts of NotifyUtils needed below to avoid a
 // circular dependency between this and notify_utils.h
@@ -47,6 +54,38 @@ public:
   /// Addresses that are registered for this address of record.
   class AoR
   {
+  private:
+    /// @class SubscriberDataManager::AoR::MemberState
+    ///
+    /// Bookkeeping for a binding or subscription.  Bindings and subscriptions
+    /// are shared between copies of an AoR until one of the copies changes
+    /// them, and keep their serialized form for as long as they are unchanged
+    /// from the store.  Copying or assigning a binding or subscription always
+    /// gives an unshared, changed object, so this state is never copied.
+    class MemberState
+    {
+    public:
+      MemberState() : _refs(1), _changed(true) {}
+      MemberState(const MemberState& other) : _refs(1), _changed(true) {}
+
+      MemberState& operator=(const MemberState& other)
+      {
+        _changed = true;
+        _json.clear();
+        return *this;
+      }
+
+      /// The number of AoRs holding the object.
+      std::atomic<int> _refs;
+
+      /// Whether the object may have changed since it was read from the store.
+      bool _changed;
+
+      /// The object serialized as JSON.  Only filled in while the object is
+      /// unchanged.
+      std::string _json;
+    };
+
   public:
     /// @class SubscriberDataManager::AoR::Binding
     ///
@@ -115,6 +154,17 @@ public:
       // @return      - Nothing. If this function fails (because the JSON is not
       //                semantically valid) this method throws JsonFormError.
       void from_json(const rapidjson::Value& b_obj);
+
+      /// Append the binding serialized as JSON to a string.  If the binding
+      /// is unchanged from the store, this reuses the result of any earlier
+      /// call.
+      void append_json(std::string& out) const;
+
+    private:
+      mutable MemberState _state;
+
+      friend class AoR;
+      friend class SubscriberDataManager;
     };
 
     /// @class SubscriberDataManager::AoR::Subscription
@@ -167,6 +217,17 @@ public:
       // @return      - Nothing. If this function fails (because the JSON is not
       //                semantically valid) this method throws JsonFormError.
       void from_json(const rapidjson::Value& s_obj);
+
+      /// Append the subscription serialized as JSON to a string.  If the
+      /// subscription is unchanged from the store, this reuses the result of
+      /// any earlier call.
+      void append_json(std::string& out) const;
+
+    private:
+      mutable MemberState _state;
+
+      friend class AoR;
+      friend class SubscriberDataManager;
    };
 
     /// Default Constructor.
@@ -189,6 +250,8 @@ public:
 
     /// Retrieve a binding by Binding ID, creating an empty one if necessary.
     /// The created binding is completely empty, even the Contact URI field.
+    /// The caller may change the returned binding, so if it is shared with
+    /// another copy of the AoR, this AoR is given its own copy first.
     Binding* get_binding(const std::string& binding_id);
 
     /// Removes any binding that had the given ID.  If there is no such binding,
@@ -196,6 +259,7 @@ public:
     void remove_binding(const std::string& binding_id);
 
     /// Retrieve a subscription by To tag, creating an empty one if necessary.
+    /// As with get_binding, the caller may change the returned subscription.
     Subscription* get_subscription(const std::string& to_tag);
 
     /// Remove a subscription for the specified To tag.  If there is no
@@ -206,10 +270,13 @@ public:
     void clear_bindings();
 
     /// Binding ID -> Binding.  First is sometimes the contact URI, but not always.
-    /// Second is a pointer to an object owned by this object.
+    /// Second is a pointer to an object owned by this object, and possibly
+    /// shared with copies of it.  Bindings must therefore only be changed
+    /// through get_binding.
     typedef std::map<std::string, Binding*> Bindings;
 
-    /// To tag -> Subscription.
+    /// To tag -> Subscription.  As with bindings, subscriptions must only be
+    /// changed through get_subscription.
     typedef std::map<std::string, Subscription*> Subscriptions;
 
     /// Retrieve all the bindings.
@@ -227,7 +294,8 @@ public:
     // Return the expiry time of the binding or subscription due to expire next.
     int get_next_expires();
 
-    /// Copy all bindings and subscriptions to this AoR
+    /// Copy all bindings and subscriptions to this AoR.  They are shared
+    /// with the source AoR until either AoR changes them.
     ///
     /// @param source_aor           Source AoR for the copy
     void copy_subscriptions_and_bindings(SubscriberDataManager::AoR* source_aor);
@@ -264,6 +332,45 @@ public:
     // SIP URI for this AoR
     std::string _uri;
 
+    /// Takes a reference to a binding or subscription held by another AoR.
+    template <class T> static T* share(T* member)
+    {
+      member->_state._refs++;
+      return member;
+    }
+
+    /// Releases a binding or subscription, deleting it if no other AoR holds
+    /// it.
+    template <class T> static void release(T* member)
+    {
+      if (--member->_state._refs == 0)
+      {
+        delete member;
+      }
+    }
+
+    /// Prepares a binding or subscription held by this AoR to be changed,
+    /// replacing it with a copy if it is shared.
+    template <class T> static T* change(T*& member)
+    {
+      if (member->_state._refs > 1)
+      {
+        T* copy = new T(*member);
+        release(member);
+        member = copy;
+      }
+      else
+      {
+        member->_state._changed = true;
+        member->_state._json.clear();
+      }
+
+      return member;
+    }
+
+    /// Marks all the bindings and subscriptions as unchanged from the store.
+    void mark_unchanged();
+
     /// Store code is allowed to manipulate bindings and subscriptions directly.
     friend class SubscriberDataManager;
   };
@@ -315,19 +422,26 @@ public:
     friend class SubscriberDataManager;
   };
 
-  /// Class used by the SubscriberDataManager to serialize AoRs from C++
-  /// objects to the JSON format used in the store, and deserialize them.
-  class JsonSerializerDeserializer
+  /// Formats in which AoRs can be written to the store.
+  enum SerializationFormat
+  {
+    JSON,
+    BINARY
+  };
+
+  /// Interface used by the SubscriberDataManager to serialize AoRs from C++
+  /// objects to the format used in the store, and deserialize them.
+  class SerializerDeserializer
   {
   public:
     /// Destructor.
-    ~JsonSerializerDeserializer() {}
+    virtual ~SerializerDeserializer() {}
 
     /// Serialize an AoR object to the format used in the store.
     ///
     /// @param aor_data - The AoR object to serialize.
     /// @return         - The serialized form.
-    std::string serialize_aor(AoR* aor_data);
+    virtual std::string serialize_aor(AoR* aor_data) = 0;
 
     /// Deserialize some data from the store into an AoR object.
     ///
@@ -337,8 +451,42 @@ public:
     ///
     /// @return       - An AoR object, or NULL if the data could not be
     ///                 deserialized (e.g. because it is corrupt).
+    virtual AoR* deserialize_aor(const std::string& aor_id,
+                                 const std::string& s) = 0;
+
+    /// @return - The name of the format, for logging.
+    virtual std::string name() = 0;
+  };
+
+  /// (De)serializer for the JSON store format.
+  class JsonSerializerDeserializer : public SerializerDeserializer
+  {
+  public:
+    /// Destructor.
+    ~JsonSerializerDeserializer() {}
+
+    std::string serialize_aor(AoR* aor_data);
     AoR* deserialize_aor(const std::string& aor_id,
                          const std::string& s);
+    std::string name() { return "JSON"; }
+  };
+
+  /// (De)serializer for the binary store format.  This is more compact and
+  /// quicker to encode and decode than JSON.  Strings are length-prefixed,
+  /// and a string that appears more than once in an AoR (such as a path
+  /// header or private ID shared by several bindings) is only written once.
+  /// The data starts with a marker byte that can't start a JSON document,
+  /// followed by a version number.
+  class BinarySerializerDeserializer : public SerializerDeserializer
+  {
+  public:
+    /// Destructor.
+    ~BinarySerializerDeserializer() {}
+
+    std::string serialize_aor(AoR* aor_data);
+    AoR* deserialize_aor(const std::string& aor_id,
+                         const std::string& s);
+    std::string name() { return "binary"; }
   };
 
   /// Provides the interface to the data store. This is responsible for
@@ -348,8 +496,8 @@ public:
   class Connector
   {
     Connector(Store* data_store,
-              JsonSerializerDeserializer*& serializer,
-              std::vector<JsonSerializerDeserializer*>& deserializers);
+              SerializerDeserializer*& serializer,
+              std::vector<SerializerDeserializer*>& deserializers);
 
     ~Connector();
 
@@ -371,8 +519,8 @@ public:
     friend class SubscriberDataManager;
 
   private:
-    JsonSerializerDeserializer* _serializer;
-    std::vector<JsonSerializerDeserializer*> _deserializers;
+    SerializerDeserializer* _serializer;
+    std::vector<SerializerDeserializer*> _deserializers;
   };
 
   /// @class SubscriberDataManager::ChronosTimerRequestSender
@@ -406,6 +554,12 @@ public:
   private:
     ChronosConnection* _chronos_conn;
 
+    // If set, AoR expiry is timed on this wheel, and the Chronos timers are
+    // only a backstop in case this node fails.  They are set this many
+    // seconds after the AoR's next expiry.
+    TimerWheel* _timer_wheel;
+    int _backstop_delay;
+
     /// Build the tag info map from an AoR
     virtual void build_tag_info(AoR* aor,
                                 std::map<std::string, uint32_t>& tag_map);
@@ -488,10 +642,21 @@ public:
   /// @param analytics_logger   - AnalyticsLogger for reporting registration events.
   /// @param is_primary         - Whether the underlying data store is the local
   ///                             store or remote
+  /// @param serialization_format
+  ///                           - The format to write AoRs to the store in.
+  ///                             AoRs in any format can be read.
+  /// @param lock_contention_tbl
+  ///                           - Statistics table counting writes that waited
+  ///                             for another thread writing the same AoR.
+  /// @param cas_retries_tbl    - Statistics table counting writes that failed
+  ///                             because the AoR had changed in the store.
   SubscriberDataManager(Store* data_store,
                         ChronosConnection* chronos_connection,
                         AnalyticsLogger* analytics_logger,
-                        bool is_primary);
+                        bool is_primary,
+                        SerializationFormat serialization_format = JSON,
+                        SNMP::CounterTable* lock_contention_tbl = NULL,
+                        SNMP::CounterTable* cas_retries_tbl = NULL);
 
   /// Destructor.
   virtual ~SubscriberDataManager();
@@ -525,7 +690,68 @@ public:
                                      SAS::TrailId trail,
                                      bool& all_bindings_expired = unused_bool);
 
+  /// Returns the lock that serializes writes to each AoR in this store from
+  /// this process.  Callers should hold the AoR's lock across their whole
+  /// read-modify-write loop, so that the store's CAS only has to resolve
+  /// races with other nodes.
+  StripedLock* write_lock() { return &_write_lock; }
+
+  /// Predicate deciding whether an AoR read by get_aor_data_from_any is
+  /// usable (for example, whether it contains any bindings).
+  typedef std::function<bool(AoRPair*)> AoRFilter;
+
+  /// Starts threads for reading AoRs from this store, so that it can be read
+  /// in parallel with other stores by get_aor_data_from_any.
+  ///
+  /// @param num_threads  The number of reading threads.
+  /// @param deadline_ms  The longest time to wait for a read from this store.
+  /// @param latency_tbl  Statistics table for the time taken to read an AoR
+  ///                     from this store.  May be NULL.
+  /// @param max_queued_reads
+  ///                     The most reads that can be waiting for a thread.
+  ///                     Once this many are waiting the store isn't read.
+  void start_parallel_reads(int num_threads,
+                            int deadline_ms,
+                            SNMP::EventAccumulatorTable* latency_tbl = NULL,
+                            int max_queued_reads = DEFAULT_MAX_QUEUED_READS);
+
+  /// The default limit on the reads waiting for a thread in each store.
+  static const int DEFAULT_MAX_QUEUED_READS = 100;
+
+  /// Times the expiry of the AoRs written through this store on a local
+  /// timer wheel, rather than relying on a Chronos timer pop for each one.
+  /// Chronos timers are still set, so that another node expires the AoRs if
+  /// this one fails, but they pop later than the local timers and are only
+  /// updated when an AoR's next expiry changes.
+  ///
+  /// @param timer_wheel    The wheel to time AoR expiry on.  The caller must
+  ///                       process the AoRs whose timers pop.
+  /// @param backstop_delay How long (in seconds) after an AoR's next expiry
+  ///                       its Chronos timer is set for.
+  void enable_local_expiry(TimerWheel* timer_wheel, int backstop_delay);
+
+  /// Reads an AoR from each of a set of stores (typically the remote stores)
+  /// and returns the first usable one read, or NULL if none of the stores
+  /// return a usable AoR.  Stores with reading threads are all read at once,
+  /// and the wait for them is bounded by the longest of their deadlines.
+  /// Stores with too many reads already queued are skipped, and reads still
+  /// queued when the wait ends are never made.  Any other stores are read in
+  /// turn on the calling thread.  The result is owned by the caller and must
+  /// be freed with delete.
+  ///
+  /// @param sdms         The stores to read.
+  /// @param aor_id       The AoR to retrieve.
+  /// @param usable       Decides whether an AoR is usable.
+  /// @param trail        SAS trail.
+  static AoRPair* get_aor_data_from_any(const std::vector<SubscriberDataManager*>& sdms,
+                                        const std::string& aor_id,
+                                        const AoRFilter& usable,
+                                        SAS::TrailId trail);
+
 private:
+  /// State shared between a call to get_aor_data_from_any and its reads.
+  struct ParallelRead;
+
   // Expire any out of date bindings in the current AoR
   //
   // @param aor_pair  The AoRPair to expire
@@ -583,6 +809,15 @@ private:
   ChronosTimerRequestSender* _chronos_timer_request_sender;
   NotifySender* _notify_sender;
   bool _primary_sdm;
+
+  // Threads reading AoRs for get_aor_data_from_any.  NULL if this store is
+  // read on the calling thread.
+  AsyncLookupPool<AoRPair*>* _read_pool;
+  int _read_deadline_ms;
+  SNMP::EventAccumulatorTable* _read_latency_tbl;
+
+  StripedLock _write_lock;
+  SNMP::CounterTable* _cas_retries_tbl;
 };
 
 
@@ -17,24 +17,64 @@ extern "C" {
 #include <pjsip.h>
 }
 
+#include <vector>
+
+#include "pjutils.h"
 #include "load_monitor.h"
 #include "snmp_event_accumulator_table.h"
 #include "snmp_event_accumulator_by_scope_table.h"
+#include "snmp_counter_by_scope_table.h"
 #include "exception_handler.h"
 
+// Classes of event on the worker thread queues.  Each class is assigned one of
+// NUM_WORKER_PRIORITIES priorities (0 being the highest).
+enum WorkerEventClass
+{
+  RESPONSE_EVENT,
+  IN_DIALOG_EVENT,
+  CALLBACK_EVENT,
+  NEW_REQUEST_EVENT,
+  NUM_WORKER_EVENT_CLASSES
+};
+
+const int NUM_WORKER_PRIORITIES = 3;
+
+// If sharded_queues_arg is set, each worker thread has its own queue, with
+// SIP messages assigned to queues by Call-ID.  If max_queue_depth_arg is
+// non-zero, new INVITEs and REGISTERs, and other out-of-dialog requests from
+// connections sending more than their share, are rejected once the queues hold
+// that many events.
+// event_priorities_arg gives the priority of each class of event, and
+// priority_latency_tbls_arg the latency table for each priority.  If the
+// queues are sharded, shard_latency_tbls_arg and shard_queue_size_tbls_arg
+// give the latency and queue size tables for each queue.
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
+                                   bool sharded_queues_arg,
+                                   int max_queue_depth_arg,
+                                   const std::vector<int>& event_priorities_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_tbl_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& priority_latency_tbls_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_tbl_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& shard_latency_tbls_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& shard_queue_size_tbls_arg,
+                                   SNMP::CounterByScopeTable* overload_counter_arg,
                                    LoadMonitor* load_monitor_arg,
                                    ExceptionHandler* exception_handler_arg);
 
 void unregister_thread_dispatcher(void);
 
 pj_status_t start_worker_threads();
-pj_status_t stop_worker_threads();
+void stop_worker_threads();
 
-// Add a Callback object to the queue, to be run on a worker thread.
-// This MUST be called from the main PJSIP transport thread.
+// Add a Callback object to the queue, to be run on a worker thread.  This
+// may be called from any thread.
 void add_callback_to_queue(PJUtils::Callback*);
 
+#ifdef UNIT_TEST
+// Runs the queued callbacks on the calling thread, returning how many were
+// run.  The UTs don't start the worker threads, so this is the only way
+// callbacks are run there.
+int run_queued_callbacks();
+#endif
+
 #endif
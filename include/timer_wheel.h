@@ -0,0 +1,125 @@
+/**
+ * @file timer_wheel.h Hierarchical timer wheel for expiring keyed state.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef TIMER_WHEEL_H__
+#define TIMER_WHEEL_H__
+
+#include <string>
+#include <list>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <pthread.h>
+
+#include "snmp_counter_table.h"
+
+/// @class TimerWheel
+///
+/// Times the expiry of a large number of keys (such as AoRs) with one-second
+/// resolution, using a hierarchical timing wheel so that setting, moving and
+/// cancelling a timer are all constant time however many timers there are.
+///
+/// Each key has at most one timer - setting the timer for a key that already
+/// has one moves it.  When timers pop, their keys are passed to a callback in
+/// batches.  Popped timers are not repeated.
+class TimerWheel
+{
+public:
+  typedef std::function<void(const std::vector<std::string>&)> PopCallback;
+
+  /// Constructor.
+  ///
+  /// @param callback       - Called with the keys of timers that have popped.
+  ///                         It is called on the wheel's own thread, so
+  ///                         should hand the keys off rather than process
+  ///                         them itself.
+  /// @param max_batch_size - The most keys passed to one call of callback.
+  /// @param pops_tbl       - Statistics table counting timer pops.
+  TimerWheel(const PopCallback& callback,
+             int max_batch_size,
+             SNMP::CounterTable* pops_tbl = NULL);
+
+  /// Destructor.  Stops the wheel's thread if it is running.
+  virtual ~TimerWheel();
+
+  /// Starts a thread that pops timers as they become due.
+  void start();
+
+  /// Stops the wheel's thread, if it is running.  Timers can still be set and
+  /// cancelled, but no longer pop.
+  void stop();
+
+  /// Sets the timer for a key.
+  ///
+  /// @param key    - The key.
+  /// @param expiry - When the timer should pop, in seconds since the epoch.
+  void set(const std::string& key, int expiry);
+
+  /// Cancels the timer for a key, if it has one.
+  void cancel(const std::string& key);
+
+  /// Returns the number of timers that are set.
+  size_t size();
+
+  /// Pops all the timers due at or before a time, and runs the callback for
+  /// them.  The wheel's thread calls this once a second.
+  ///
+  /// @param now - The current time, in seconds since the epoch.
+  void pop(int now);
+
+private:
+  // The innermost level of the wheel has a slot for each second, and each
+  // outer level has a slot for each revolution of the level inside it.
+  // Timers due further ahead than the outermost level covers are kept in its
+  // last slot, and placed properly when they come within range.
+  static const int INNER_BITS = 8;
+  static const int OUTER_BITS = 6;
+  static const int NUM_OUTER_LEVELS = 3;
+  static const int NUM_LEVELS = NUM_OUTER_LEVELS + 1;
+
+  struct Timer
+  {
+    int expiry;
+    std::list<std::string>* slot;
+    std::list<std::string>::iterator slot_it;
+  };
+
+  /// Adds a timer to the right slot for its expiry.  Must be called with the
+  /// lock held.
+  void insert(const std::string& key, Timer& timer);
+
+  /// Moves the timers in a slot of an outer level to inner levels.  Returns
+  /// the index of the slot.  Must be called with the lock held.
+  int cascade(int level);
+
+  /// Returns the bit offset of a level's slot index within a time.
+  static int level_shift(int level);
+
+  static void* tick_thread_fn(void* p);
+  void tick_thread();
+
+  PopCallback _callback;
+  size_t _max_batch_size;
+  SNMP::CounterTable* _pops_tbl;
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  bool _terminating;
+  bool _started;
+  pthread_t _thread;
+
+  // The next second that hasn't been popped yet.
+  int _current;
+  std::vector<std::vector<std::list<std::string>>> _levels;
+  std::unordered_map<std::string, Timer> _timers;
+};
+
+#endif
@@ -18,7 +18,7 @@
 #include <websocketpp/websocketpp.hpp>
 
 extern pjsip_module mod_ws_transport;
-extern pj_status_t init_websockets(unsigned short port);
+extern pj_status_t init_websockets(unsigned short port, int num_threads);
 extern void  destroy_websockets();
 
 #endif
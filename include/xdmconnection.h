@@ -23,6 +23,10 @@
 #include "snmp_ip_count_table.h"
 #include "snmp_event_accumulator_table.h"
 
+#ifndef HTTP_NOT_MODIFIED
+#define HTTP_NOT_MODIFIED 304
+#endif
+
 class XDMConnection
 {
 public:
@@ -36,6 +40,22 @@ public:
 
   bool get_simservs(const std::string& user, std::string& xml_data, const std::string& password, SAS::TrailId trail);
 
+  /// Fetches a user's simservs document unless it matches the copy the
+  /// caller already has.
+  ///
+  /// @param user     - The user whose document to fetch.
+  /// @param xml_data - Filled in with the document if it is returned.
+  /// @param etag     - On entry, the ETag of the caller's copy of the
+  ///                   document, or empty if it has none.  Updated with the
+  ///                   ETag of the returned document.
+  /// @returns        - HTTP_OK if the document was returned,
+  ///                   HTTP_NOT_MODIFIED if the caller's copy is still
+  ///                   current, or the error code of the request.
+  virtual HTTPCode get_simservs_if_modified(const std::string& user,
+                                            std::string& xml_data,
+                                            std::string& etag,
+                                            SAS::TrailId trail);
+
 private:
   HttpConnection* _http;
   SNMP::EventAccumulatorTable* _latency_tbl;
@@ -10,6 +10,11 @@
  */
 
 #include <boost/lexical_cast.hpp>
+#include <random>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
 
 #include "log.h"
 #include "pjutils.h"
@@ -47,8 +52,7 @@ AsChain::AsChain(AsChainTable* as_chain_table,
   _acr(acr),
   _fallback_ifcs({}),
   _ifc_configuration(ifc_configuration),
-  _using_standard_ifcs(true),
-  _root(NULL)
+  _using_standard_ifcs(true)
 {
   TRC_DEBUG("Creating AsChain %p with %d iFCs and adding to map", this, ifcs.size());
   _as_chain_table->register_(this, _odi_tokens);
@@ -65,8 +69,7 @@ AsChain::AsChain(AsChainTable* as_chain_table,
 
   if ((fifc_service) && (_ifc_configuration._apply_fallback_ifcs))
   {
-    _root = new rapidxml::xml_document<>;
-    _fallback_ifcs = fifc_service->get_fallback_ifcs(_root);
+    _fallback_ifcs = fifc_service->get_fallback_ifcs();
   }
 }
 
@@ -97,8 +100,6 @@ AsChain::~AsChain()
   }
 
   _as_chain_table->unregister(_odi_tokens);
-
-  delete _root; _root = NULL;
 }
 
 
@@ -279,9 +280,9 @@ void AsChainLink::get_next_application_server(pjsip_msg* msg,
                                               bool& got_dummy_as,
                                               SAS::TrailId msg_trail)
 {
-  std::vector<Ifc> ifcs = _as_chain->_using_standard_ifcs ?
-                          _as_chain->_ifcs.ifcs_list() :
-                          _as_chain->_fallback_ifcs;
+  const std::vector<Ifc>& ifcs = _as_chain->_using_standard_ifcs ?
+                                 _as_chain->_ifcs.ifcs_list() :
+                                 _as_chain->_fallback_ifcs;
   got_dummy_as = false;
 
   while (!complete())
@@ -345,49 +346,104 @@ void AsChainLink::on_response(int status_code)
 }
 
 
+std::string AsChainLink::next_odi_token() const
+{
+  return AsChainTable::token_to_string(_as_chain->_odi_tokens[_index + 1]);
+}
+
+
 AsChainTable::AsChainTable()
 {
-  pthread_mutex_init(&_lock, NULL);
+  for (size_t ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_mutex_init(&_shards[ii].lock, NULL);
+  }
 }
 
 
 AsChainTable::~AsChainTable()
 {
-  pthread_mutex_destroy(&_lock);
+  for (size_t ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_mutex_destroy(&_shards[ii].lock);
+  }
 }
 
 
 /// Create the tokens for the given AsChain, and register them to
 /// point at the next step in each case.
-void AsChainTable::register_(AsChain* as_chain, std::vector<std::string>& tokens)
+void AsChainTable::register_(AsChain* as_chain, std::vector<OdiToken>& tokens)
 {
   size_t len = as_chain->size() + 1;
-  pthread_mutex_lock(&_lock);
 
   for (size_t i = 0; i < len; i++)
   {
-    std::string token;
-    Utils::create_random_token(TOKEN_LENGTH, token);
+    OdiToken token;
+    bool inserted;
+
+    do
+    {
+      // Tokens are random, so should never clash, but make sure.
+      token = new_token();
+      Shard& s = shard(token);
+      pthread_mutex_lock(&s.lock);
+      inserted = s.map.emplace(token, AsChainLink(as_chain, i)).second;
+      pthread_mutex_unlock(&s.lock);
+    }
+    while (!inserted);
+
     tokens.push_back(token);
-    _odi_token_map[token] = AsChainLink(as_chain, i);
   }
-
-  pthread_mutex_unlock(&_lock);
 }
 
 
-void AsChainTable::unregister(std::vector<std::string>& tokens)
+void AsChainTable::unregister(std::vector<OdiToken>& tokens)
 {
-  pthread_mutex_lock(&_lock);
-
-  for (std::vector<std::string>::iterator it = tokens.begin();
+  for (std::vector<OdiToken>::iterator it = tokens.begin();
        it != tokens.end();
        ++it)
   {
-    _odi_token_map.erase(*it);
+    Shard& s = shard(*it);
+    pthread_mutex_lock(&s.lock);
+    s.map.erase(*it);
+    pthread_mutex_unlock(&s.lock);
+  }
+}
+
+
+std::string AsChainTable::token_to_string(OdiToken token)
+{
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, token);
+  return std::string(buf);
+}
+
+
+bool AsChainTable::string_to_token(const std::string& str, OdiToken& token)
+{
+  if (str.length() != 16)
+  {
+    return false;
   }
 
-  pthread_mutex_unlock(&_lock);
+  for (size_t ii = 0; ii < str.length(); ++ii)
+  {
+    if (!isxdigit((unsigned char)str[ii]))
+    {
+      return false;
+    }
+  }
+
+  token = strtoull(str.c_str(), NULL, 16);
+  return true;
+}
+
+
+OdiToken AsChainTable::new_token()
+{
+  // Each thread has its own generator, so generating tokens doesn't contend.
+  static thread_local std::mt19937_64 generator(std::random_device{}());
+  return generator();
 }
 
 
@@ -425,14 +481,21 @@ void AsChain::reset_chain(bool using_standard_ifcs)
 //
 // If the returned link is_set(), caller MUST call release() when it
 // is finished with the link.
-AsChainLink AsChainTable::lookup(const std::string& token)
+AsChainLink AsChainTable::lookup(const std::string& token_str)
 {
-  pthread_mutex_lock(&_lock);
-  std::map<std::string, AsChainLink>::const_iterator it =
-                                                    _odi_token_map.find(token);
-  if (it == _odi_token_map.end())
+  OdiToken token;
+  if (!string_to_token(token_str, token))
+  {
+    return AsChainLink(NULL, 0);
+  }
+
+  Shard& s = shard(token);
+  pthread_mutex_lock(&s.lock);
+  std::unordered_map<OdiToken, AsChainLink>::const_iterator it =
+                                                          s.map.find(token);
+  if (it == s.map.end())
   {
-    pthread_mutex_unlock(&_lock);
+    pthread_mutex_unlock(&s.lock);
     return AsChainLink(NULL, 0);
   }
   else
@@ -444,13 +507,13 @@ AsChainLink AsChainTable::lookup(const std::string& token)
       // Flag that the AS corresponding to the previous link in the chain has
       // effectively responded.
       as_chain_link._as_chain->_responsive[as_chain_link._index - 1] = true;
-      pthread_mutex_unlock(&_lock);
+      pthread_mutex_unlock(&s.lock);
       return as_chain_link;
     } else {
       // Failed to increment the count - AS chain must be in the process of
       // being destroyed.  Pretend we didn't find it.
       // LCOV_EXCL_START - Can't hit this window condition in UT.
-      pthread_mutex_unlock(&_lock);
+      pthread_mutex_unlock(&s.lock);
       return AsChainLink(NULL, 0);
       // LCOV_EXCL_STOP
     }
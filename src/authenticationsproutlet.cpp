@@ -540,18 +540,10 @@ AuthenticationVector* AuthenticationSproutletTsx::get_av_from_store(const std::s
   return av;
 }
 
-void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* credentials,
-                                                  pj_bool_t stale,
-                                                  std::string resync,
-                                                  pjsip_msg* req,
-                                                  pjsip_msg* rsp)
+/// Returns the authorization type to request from the HSS for the credentials
+/// (which may be NULL).
+std::string AuthenticationSproutletTsx::get_auth_type(pjsip_digest_credential* credentials)
 {
-  // Get the public and private identities from the request.
-  std::string impi;
-  std::string impu_for_hss;
-  bool av_source_unavailable = false;
-  ImpiStore::Impi* impi_obj = nullptr;
-
   // Set up the authorization type, following Annex P.4 of TS 33.203.  Currently
   // only support AKA and SIP Digest, so only implement the subset of steps
   // required to distinguish between the two.
@@ -578,6 +570,22 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
     }
   }
 
+  return auth_type;
+}
+
+void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* credentials,
+                                                  pj_bool_t stale,
+                                                  std::string resync,
+                                                  pjsip_msg* req,
+                                                  pjsip_msg* rsp)
+{
+  // Get the public and private identities from the request.
+  std::string impi;
+  std::string impu_for_hss;
+  bool av_source_unavailable = false;
+  ImpiStore::Impi* impi_obj = nullptr;
+  std::string auth_type = get_auth_type(credentials);
+
   // Get an authentication vector to challenge this request.
   AuthenticationVector* av = NULL;
 
@@ -641,6 +649,106 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
     }
   }
 
+  add_challenge(av,
+                av_source_unavailable,
+                impi,
+                impu_for_hss,
+                impi_obj,
+                stale,
+                req,
+                rsp);
+}
+
+/// Challenges a REGISTER (or a request being authenticated like a REGISTER)
+/// without blocking while the authentication vector is fetched from the HSS.
+/// The transaction is suspended until the HSS responds, and then the
+/// challenge is added to the response and the response is sent.  Returns
+/// false if the challenge must be created synchronously instead.
+bool AuthenticationSproutletTsx::create_challenge_async(pjsip_digest_credential* credentials,
+                                                        pj_bool_t stale,
+                                                        std::string resync,
+                                                        pjsip_msg* req,
+                                                        pjsip_msg* rsp,
+                                                        ACR* acr)
+{
+  if ((!_authentication->_hss->async_enabled()) ||
+      ((req->line.req.method.id != PJSIP_REGISTER_METHOD) &&
+       (!PJUtils::is_param_in_route_hdr(route_hdr(), &STR_AUTO_REG))))
+  {
+    return false;
+  }
+
+  std::string impi;
+  std::string impu_for_hss;
+  PJUtils::get_impi_and_impu(req, impi, impu_for_hss);
+  TRC_DEBUG("Get AV asynchronously from HSS for impi=%s impu=%s",
+            impi.c_str(), impu_for_hss.c_str());
+
+  ResumeFn resume = suspend();
+
+  bool queued = _authentication->_hss->get_auth_vector_async(
+    impi,
+    impu_for_hss,
+    get_auth_type(credentials),
+    resync,
+    _scscf_uri,
+    trail(),
+    [this, resume, impi, impu_for_hss, stale, req, rsp, acr]
+      (HTTPCode http_code, rapidjson::Document* doc)
+    {
+      // This runs on the HSS query thread, so hand the vector back to the
+      // transaction's thread to build the challenge.
+      resume([this, impi, impu_for_hss, stale, req, rsp, acr, http_code, doc]()
+      {
+        bool av_source_unavailable = ((http_code == HTTP_SERVER_UNAVAILABLE) ||
+                                      (http_code == HTTP_GATEWAY_TIMEOUT));
+        AuthenticationVector* av = NULL;
+
+        if (doc != NULL)
+        {
+          av = verify_auth_vector(doc, impi);
+        }
+        delete doc;
+
+        add_challenge(av,
+                      av_source_unavailable,
+                      impi,
+                      impu_for_hss,
+                      NULL,
+                      stale,
+                      req,
+                      rsp);
+        send_auth_response(acr, req, rsp);
+      });
+    });
+
+  if (!queued)
+  {
+    // The query couldn't be queued, so resume the transaction straight away
+    // and create the challenge synchronously.
+    resume([this, credentials, stale, resync, req, rsp, acr]()
+    {
+      create_challenge(credentials, stale, resync, req, rsp);
+      send_auth_response(acr, req, rsp);
+    });
+  }
+
+  return true;
+}
+
+/// Adds a challenge built from the authentication vector to the response,
+/// and writes the challenge to the IMPI store.  If there is no vector, the
+/// response is changed to an error instead.  Takes ownership of the vector
+/// and the IMPI object (either of which may be NULL).
+void AuthenticationSproutletTsx::add_challenge(AuthenticationVector* av,
+                                               bool av_source_unavailable,
+                                               const std::string& impi,
+                                               const std::string& impu_for_hss,
+                                               ImpiStore::Impi* impi_obj,
+                                               pj_bool_t stale,
+                                               pjsip_msg* req,
+                                               pjsip_msg* rsp)
+{
   if (av != NULL)
   {
     // Retrieved a valid authentication vector, so generate the challenge.
@@ -1180,6 +1288,14 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     }
 
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
+
+    if (create_challenge_async(credentials, stale, resync, req, rsp, acr))
+    {
+      // The challenge is added and the response sent once the HSS returns
+      // the authentication vector.
+      return;
+    }
+
     create_challenge(credentials, stale, resync, req, rsp);
   }
   else
@@ -1204,11 +1320,23 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
       std::string impu;
 
       PJUtils::get_impi_and_impu(req, impi, impu);
-      _authentication->_hss->update_registration_state(impu,
-                                                  impi,
-                                                  HSSConnection::AUTH_FAIL,
-                                                  _scscf_uri,
-                                                  trail());
+
+      // The response doesn't depend on what Homestead says, so where we can
+      // we send the update without waiting for it to complete.
+      if (!_authentication->_hss->update_registration_state_async(
+                                      impu,
+                                      impi,
+                                      HSSConnection::AUTH_FAIL,
+                                      _scscf_uri,
+                                      trail(),
+                                      [](HTTPCode, std::shared_ptr<HSSConnection::RegData>) {}))
+      {
+        _authentication->_hss->update_registration_state(impu,
+                                                    impi,
+                                                    HSSConnection::AUTH_FAIL,
+                                                    _scscf_uri,
+                                                    trail());
+      }
     }
 
     if (_authentication->_analytics != NULL)
@@ -1220,6 +1348,15 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
   }
 
+  send_auth_response(acr, req, rsp);
+}
+
+/// Sends the response to a request that has failed authentication, and the
+/// ACR for it.
+void AuthenticationSproutletTsx::send_auth_response(ACR* acr,
+                                                    pjsip_msg* req,
+                                                    pjsip_msg* rsp)
+{
   // Send the ACR.
   acr->tx_response(rsp);
   acr->send();
@@ -1299,6 +1436,10 @@ Store::Status AuthenticationSproutlet::
   const std::string nonce = auth_challenge->nonce;
   ImpiStore::Impi* current_impi_obj = impi_obj;
 
+  // Serialize with other threads updating this IMPI, so that the loop only
+  // retries when another node has updated it.
+  StripedLock::Guard write_guard(store->write_lock(), impi);
+
   do
   {
     if (current_impi_obj == NULL)
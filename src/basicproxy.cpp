@@ -29,6 +29,7 @@ extern "C" {
 #include "constants.h"
 #include "basicproxy.h"
 #include "uri_classifier.h"
+#include "thread_dispatcher.h"
 
 
 BasicProxy::BasicProxy(pjsip_endpoint* endpt,
@@ -1533,7 +1534,10 @@ BasicProxy::UACTsx::UACTsx(BasicProxy* proxy,
   _trail(0),
   _pending_destroy(false),
   _context_count(0),
-  _stateless_proxy(false)
+  _stateless_proxy(false),
+  _resolving(false),
+  _send_pending(false),
+  _cancelled(false)
 {
   // Don't put any initialization that can fail here, implement in init()
   // instead.
@@ -1636,10 +1640,40 @@ pj_status_t BasicProxy::UACTsx::init(pjsip_tx_data* tdata,
   _tdata = tdata;
   pjsip_tx_data_add_ref(_tdata);
 
-  if (tdata->tp_sel.type != PJSIP_TPSELECTOR_TRANSPORT)
+  if ((tdata->tp_sel.type != PJSIP_TPSELECTOR_TRANSPORT) &&
+      (tdata->msg->line.req.method.id != PJSIP_ACK_METHOD))
   {
     // Resolve the next hop destination for this request to a set of target
-    // servers (IP address/port/transport tuples).
+    // servers (IP address/port/transport tuples).  If this needs DNS lookups,
+    // don't block this thread waiting for them - the results are passed back
+    // to a worker thread through the callback queue, and sending the request
+    // waits until then.  Hold a context count so that we aren't destroyed
+    // while the resolution is in progress.
+    _resolving = true;
+    _context_count++;
+
+    UACTsx* uac_tsx = this;
+    if (!PJUtils::resolve_next_hop_async(
+           tdata,
+           0,
+           _servers,
+           allowed_host_state,
+           trail(),
+           [uac_tsx](const std::vector<AddrInfo>& servers)
+           {
+             add_callback_to_queue(new ResolvedCallback(uac_tsx, servers));
+           }))
+    {
+      // The next hop was resolved straight away.
+      _resolving = false;
+      _context_count--;
+    }
+  }
+  else if (tdata->tp_sel.type != PJSIP_TPSELECTOR_TRANSPORT)
+  {
+    // ACKs don't have a PJSIP transaction (or lock) to protect them while
+    // waiting for an asynchronous resolution, so always resolve them
+    // synchronously.
     PJUtils::resolve_next_hop(tdata, 0, _servers, allowed_host_state, trail());
   }
 
@@ -1657,11 +1691,89 @@ pj_status_t BasicProxy::UACTsx::init(pjsip_tx_data* tdata,
 }
 
 
+/// Handles the results of an asynchronous resolution of the next hop.
+void BasicProxy::UACTsx::on_resolved(const std::vector<AddrInfo>& servers)
+{
+  enter_context();
+
+  // Release the context count taken when the resolution started.
+  _context_count--;
+  _resolving = false;
+  _servers = servers;
+
+  TRC_DEBUG("%s - next hop resolved to %zu servers", name(), _servers.size());
+
+  if (_cancelled)
+  {
+    // The request was cancelled while the next hop was being resolved, so
+    // don't send it.
+    _send_pending = false;
+
+    if (!_pending_destroy)
+    {
+      end_unsent_request();
+    }
+  }
+  else if ((_send_pending) &&
+           (!_pending_destroy) &&
+           (_uas_tsx != NULL))
+  {
+    // The request was waiting for the resolution, so send it now.
+    _send_pending = false;
+    send_request();
+  }
+
+  exit_context();
+}
+
+
+/// Ends a UAC transaction whose request was cancelled before it was sent.
+/// The UAS transaction is given a 487 response in place of the one the
+/// downstream node would have sent.
+void BasicProxy::UACTsx::end_unsent_request()
+{
+  TRC_DEBUG("%s - request cancelled before it was sent", name());
+
+  if (_uas_tsx != NULL)
+  {
+    pjsip_tx_data* rsp;
+    pj_status_t status = PJUtils::create_response(stack_data.endpt,
+                                                  _tdata,
+                                                  PJSIP_SC_REQUEST_TERMINATED,
+                                                  NULL,
+                                                  &rsp);
+    if (status == PJ_SUCCESS)
+    {
+      // Remove the top Via header (we must do this as we built the response
+      // from a request where we've added an extra Via).
+      pjsip_msg_find_remove_hdr(rsp->msg, PJSIP_H_VIA, NULL);
+      _uas_tsx->on_new_client_response(this, rsp);
+    }
+  }
+
+  // The request was never passed to PJSIP, so release it here as we do when
+  // sending fails.  The PJSIP transaction is terminated when this object is
+  // destroyed.
+  pjsip_tx_data_dec_ref(_tdata);
+  _pending_destroy = true;
+}
+
+
 /// Sends the initial request on this UAC transaction.
 void BasicProxy::UACTsx::send_request()
 {
   enter_context();
 
+  if (_resolving)
+  {
+    // We're still resolving the next hop, so send the request once that
+    // completes.
+    TRC_DEBUG("%s - waiting for next hop resolution", name());
+    _send_pending = true;
+    exit_context();
+    return;
+  }
+
   pj_status_t status = PJ_SUCCESS;
 
   TRC_DEBUG("Sending request for %s",
@@ -1757,7 +1869,15 @@ void BasicProxy::UACTsx::send_request()
 /// Reason header.
 void BasicProxy::UACTsx::cancel_pending_tsx(int st_code)
 {
-  if (_tsx != NULL)
+  if ((_resolving) || (_send_pending))
+  {
+    // The request hasn't been sent yet because the next hop is still being
+    // resolved, so there is nothing to CANCEL downstream.  Just make sure the
+    // request isn't sent once the resolution completes.
+    TRC_DEBUG("%s - cancelled while resolving the next hop", name());
+    _cancelled = true;
+  }
+  else if (_tsx != NULL)
   {
     enter_context();
 
@@ -23,7 +23,21 @@
 #include "pjutils.h"
 #include "sprout_pd_definitions.h"
 
+const BgcfService::RoutePtr BgcfService::NO_ROUTE(new std::vector<std::string>());
+
+BgcfService::RouteEntry::RouteEntry(const std::vector<std::string>& uris) :
+  route(new std::vector<std::string>(uris))
+{
+  for (std::vector<std::string>::const_iterator ii = uris.begin();
+       ii != uris.end();
+       ++ii)
+  {
+    route_string = route_string + *ii + ";";
+  }
+}
+
 BgcfService::BgcfService(std::string configuration) :
+  _routes(new RoutingTables()),
   _configuration(configuration),
   _updater(NULL)
 {
@@ -77,8 +91,7 @@ void BgcfService::update_routes()
 
   try
   {
-    std::map<std::string, std::vector<std::string>> new_domain_routes;
-    std::map<std::string, std::vector<std::string>> new_number_routes;
+    std::shared_ptr<RoutingTables> new_routes(new RoutingTables());
 
     JSON_ASSERT_CONTAINS(doc, "routes");
     JSON_ASSERT_ARRAY(doc["routes"]);
@@ -116,14 +129,15 @@ void BgcfService::update_routes()
         if ((*routes_it).HasMember("domain"))
         {
           routing_value = (*routes_it)["domain"].GetString();
-          new_domain_routes.insert(std::make_pair(routing_value, route_vec));
+          new_routes->domain_routes.insert(
+                    std::make_pair(routing_value, RouteEntry(route_vec)));
         }
         else
         {
           routing_value = (*routes_it)["number"].GetString();
-          new_number_routes.insert(
-                    std::make_pair(PJUtils::remove_visual_separators(routing_value),
-                                   route_vec));
+          new_routes->number_routes.insert(
+                    PJUtils::remove_visual_separators(routing_value),
+                    RouteEntry(route_vec));
         }
 
         route_vec.clear();
@@ -137,10 +151,10 @@ void BgcfService::update_routes()
       }
     }
 
-    // Take a write lock on the mutex in RAII style
-    boost::lock_guard<boost::shared_mutex> write_lock(_routes_rw_lock);
-    _domain_routes = new_domain_routes;
-    _number_routes = new_number_routes;
+    // Swap in the new routes.  Any lookups in progress keep a reference to
+    // the old tables, which are freed when the last of them completes.
+    std::shared_ptr<const RoutingTables> routes = new_routes;
+    std::atomic_store(&_routes, routes);
   }
   catch (JsonFormatError err)
   {
@@ -156,112 +170,83 @@ BgcfService::~BgcfService()
   _updater = NULL;
 }
 
-std::vector<std::string> BgcfService::get_route_from_domain(
+BgcfService::RoutePtr BgcfService::get_route_from_domain(
                                                 const std::string &domain,
                                                 SAS::TrailId trail) const
 {
   TRC_DEBUG("Getting route for URI domain %s via BGCF lookup", domain.c_str());
 
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_routes_rw_lock);
+  // Take a reference to the current routes, so they can't be freed under us
+  // if the configuration is reloaded.
+  std::shared_ptr<const RoutingTables> routes = std::atomic_load(&_routes);
 
   // First try the specified domain.
-  std::map<std::string, std::vector<std::string>>::const_iterator i =
-                                                    _domain_routes.find(domain);
-  if (i != _domain_routes.end())
+  std::unordered_map<std::string, RouteEntry>::const_iterator i =
+                                           routes->domain_routes.find(domain);
+  if (i != routes->domain_routes.end())
   {
     TRC_INFO("Found route to domain %s", domain.c_str());
 
     SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_DOMAIN, 0);
     event.add_var_param(domain);
-    std::string route_string;
-
-    for (std::vector<std::string>::const_iterator ii = i->second.begin(); ii != i->second.end(); ++ii)
-    {
-      route_string = route_string + *ii + ";";
-    }
-
-    event.add_var_param(route_string);
+    event.add_var_param(i->second.route_string);
     SAS::report_event(event);
 
-    return i->second;
+    return i->second.route;
   }
 
   // Then try the default domain (*).
-  i = _domain_routes.find("*");
-  if (i != _domain_routes.end())
+  i = routes->domain_routes.find("*");
+  if (i != routes->domain_routes.end())
   {
     TRC_INFO("Found default route");
 
     SAS::Event event(trail, SASEvent::BGCF_DEFAULT_ROUTE_DOMAIN, 0);
     event.add_var_param(domain);
-    std::string route_string;
-
-    for (std::vector<std::string>::const_iterator ii = i->second.begin(); ii != i->second.end(); ++ii)
-    {
-      route_string = route_string + *ii + ";";
-    }
-
-    event.add_var_param(route_string);
+    event.add_var_param(i->second.route_string);
     SAS::report_event(event);
 
-    return i->second;
+    return i->second.route;
   }
 
   SAS::Event event(trail, SASEvent::BGCF_NO_ROUTE_DOMAIN, 0);
   event.add_var_param(domain);
   SAS::report_event(event);
 
-  return std::vector<std::string>();
+  return NO_ROUTE;
 }
 
-std::vector<std::string> BgcfService::get_route_from_number(
+BgcfService::RoutePtr BgcfService::get_route_from_number(
                                                 const std::string &number,
                                                 SAS::TrailId trail) const
 {
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_routes_rw_lock);
-
-  // The number routes map is ordered by length of key. Start from the end of
-  // the map to get the longest prefixes first.
-  for (std::map<std::string, std::vector<std::string>>::const_reverse_iterator it =
-        _number_routes.rbegin();
-       it != _number_routes.rend();
-       it++)
+  // Take a reference to the current routes, so they can't be freed under us
+  // if the configuration is reloaded.
+  std::shared_ptr<const RoutingTables> routes = std::atomic_load(&_routes);
+
+  // The prefixes have had their visual separators stripped, so do the same to
+  // the number (once) before looking for the longest matching prefix.
+  const std::string* prefix = NULL;
+  const RouteEntry* entry =
+    routes->number_routes.match(PJUtils::remove_visual_separators(number),
+                                &prefix);
+
+  if (entry != NULL)
   {
-    int len = std::min(number.size(), (*it).first.size());
-
-    if (PJUtils::remove_visual_separators(number).compare(0,
-                                                          len,
-                                                          (*it).first,
-                                                          0,
-                                                          len) == 0)
-    {
-      // Found a match, so return it
-      TRC_DEBUG("Match found. Number: %s, prefix: %s",
-                number.c_str(), (*it).first.c_str());
-
-      SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
-      event.add_var_param(number);
-      std::string route_string;
+    TRC_DEBUG("Match found. Number: %s, prefix: %s",
+              number.c_str(), prefix->c_str());
 
-      for (std::vector<std::string>::const_iterator ii = (*it).second.begin();
-                                                    ii != (*it).second.end();
-                                                    ++ii)
-      {
-        route_string = route_string + *ii + ";";
-      }
-
-      event.add_var_param(route_string);
-      SAS::report_event(event);
+    SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
+    event.add_var_param(number);
+    event.add_var_param(entry->route_string);
+    SAS::report_event(event);
 
-      return (*it).second;
-    }
+    return entry->route;
   }
 
   SAS::Event event(trail, SASEvent::BGCF_NO_ROUTE_NUMBER, 0);
   event.add_var_param(number);
   SAS::report_event(event);
 
-  return std::vector<std::string>();
+  return NO_ROUTE;
 }
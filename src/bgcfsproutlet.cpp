@@ -58,7 +58,7 @@ SproutletTsx* BGCFSproutlet::get_tsx(SproutletHelper* helper,
 ///
 /// @return            - The URIs to route the message on to (in order).
 /// @param domain      - The domain to find a route for.
-std::vector<std::string> BGCFSproutlet::get_route_from_domain(
+BgcfService::RoutePtr BGCFSproutlet::get_route_from_domain(
                                                   const std::string &domain,
                                                   SAS::TrailId trail) const
 {
@@ -69,7 +69,7 @@ std::vector<std::string> BGCFSproutlet::get_route_from_domain(
 ///
 /// @return            - The URIs to route the message on to (in order).
 /// @param domain      - The domain to find a route for.
-std::vector<std::string> BGCFSproutlet::get_route_from_number(
+BgcfService::RoutePtr BGCFSproutlet::get_route_from_number(
                                                   const std::string &number,
                                                   SAS::TrailId trail) const
 {
@@ -112,7 +112,7 @@ void BGCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
   _acr = _bgcf->get_acr(trail());
   _acr->rx_request(req);
 
-  std::vector<std::string> bgcf_routes;
+  BgcfService::RoutePtr bgcf_routes;
   std::string routing_value;
   bool routing_with_number = false;
   PJUtils::update_request_uri_np_data(req,
@@ -130,7 +130,7 @@ void BGCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
 
     // If there are no matching routes, just route based on the domain - this
     // only matches any wild card routing set up
-    if (bgcf_routes.empty())
+    if (bgcf_routes->empty())
     {
       routing_value = "";
       bgcf_routes = _bgcf->get_route_from_domain(routing_value, trail());
@@ -150,7 +150,7 @@ void BGCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
 
     // If there are no matching routes, just route based on the domain - this
     // only matches any wild card routing set up
-    if (bgcf_routes.empty())
+    if (bgcf_routes->empty())
     {
       routing_value = "";
       bgcf_routes = _bgcf->get_route_from_domain(routing_value, trail());
@@ -168,14 +168,14 @@ void BGCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     bgcf_routes = _bgcf->get_route_from_domain(routing_value, trail());
   }
 
-  if (!bgcf_routes.empty())
+  if (!bgcf_routes->empty())
   {
     // The BGCF should be in control of what routes get added - delete existing
     // ones first.
     PJUtils::remove_hdr(req, &STR_ROUTE);
 
-    for (std::vector<std::string>::iterator ii = bgcf_routes.begin();
-         ii != bgcf_routes.end();
+    for (std::vector<std::string>::const_iterator ii = bgcf_routes->begin();
+         ii != bgcf_routes->end();
          ++ii)
     {
       pjsip_uri* route_uri = PJUtils::uri_from_string(*ii, get_pool(req), PJ_TRUE);
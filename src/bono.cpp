@@ -121,6 +121,7 @@ static pjsip_uri* upstream_proxy;
 static SIPConnectionPool* upstream_conn_pool = NULL;
 
 static SNMP::IPCountTable* sprout_ip_tbl = NULL;
+static SNMP::IPCountTable* sprout_requests_tbl = NULL;
 static SNMP::U32Scalar* flow_count = NULL;
 
 static FlowTable* flow_table;
@@ -2615,6 +2616,8 @@ UACTransaction::UACTransaction(UASTransaction* uas_data,
   _from_store(false),
   _aor(),
   _binding_id(),
+  _transport(NULL),
+  _tx_bytes(0),
   _servers(),
   _current_server(0),
   _pending_destroy(false),
@@ -2639,6 +2642,8 @@ UACTransaction::~UACTransaction()
 {
   pj_assert(_context_count == 0);
 
+  upstream_request_complete();
+
   if (_tsx != NULL)
   {
     _tsx->mod_data[mod_tu.id] = NULL;
@@ -2864,11 +2869,43 @@ void UACTransaction::send_request()
       pj_time_val delay = {_liveness_timeout, 0};
       pjsip_endpt_schedule_timer(stack_data.endpt, &_liveness_timer, &delay);
     }
+
+    if ((upstream_conn_pool != NULL) &&
+        (_tdata->tp_sel.type == PJSIP_TPSELECTOR_TRANSPORT) &&
+        (_tsx != NULL) &&
+        (_tsx->state < PJSIP_TSX_STATE_COMPLETED))
+    {
+      // Count the request towards the load on its connection until it
+      // completes (this is ignored if the transport isn't from the pool).
+      // Hold a reference to the transport until then, so it can't be
+      // destroyed and a new pool connection allocated at the same address.
+      _transport = _tdata->tp_sel.u.transport;
+      pjsip_transport_add_ref(_transport);
+      _tx_bytes = _tdata->buf.cur - _tdata->buf.start;
+      upstream_conn_pool->request_sent(_transport, _tx_bytes);
+    }
   }
 
   exit_context();
 }
 
+
+// Tells the upstream connection pool that the request on this transaction
+// has completed, if it hasn't been told already.
+void UACTransaction::upstream_request_complete()
+{
+  if (_transport != NULL)
+  {
+    if (upstream_conn_pool != NULL)
+    {
+      upstream_conn_pool->request_complete(_transport, _tx_bytes);
+    }
+
+    pjsip_transport_dec_ref(_transport);
+    _transport = NULL;
+  }
+}
+
 // Cancels the pending transaction, using the specified status code in the
 // Reason header.
 void UACTransaction::cancel_pending_tsx(int st_code)
@@ -2931,6 +2968,14 @@ void UACTransaction::on_tsx_state(pjsip_event* event)
 {
   enter_context();
 
+  if ((event->body.tsx_state.tsx == _tsx) &&
+      (_tsx->state >= PJSIP_TSX_STATE_COMPLETED))
+  {
+    // The request has had a final response (or has failed), so no longer
+    // counts towards the load on its connection.
+    upstream_request_complete();
+  }
+
   // Handle incoming responses (provided the UAS transaction hasn't
   // terminated or been cancelled.
   TRC_DEBUG("%s - uac_data = %p, uas_data = %p", name(), this, _uas_data);
@@ -3266,13 +3311,16 @@ pj_status_t init_stateful_proxy(SubscriberDataManager* reg_sdm,
     pool_target.port = upstream_proxy_port;
     sprout_ip_tbl = SNMP::IPCountTable::create("bono_connected_sprouts",
                                                ".1.2.826.0.1.1578918.9.2.3.1");
+    sprout_requests_tbl = SNMP::IPCountTable::create("bono_sprout_outstanding_requests",
+                                                     ".1.2.826.0.1.1578918.9.2.12.1");
     upstream_conn_pool = new SIPConnectionPool(&pool_target,
         upstream_proxy_connections,
         upstream_proxy_recycle,
         stack_data.pool,
         stack_data.endpt,
         stack_data.pcscf_trusted_tcp_factory,
-        sprout_ip_tbl);
+        sprout_ip_tbl,
+        sprout_requests_tbl);
     upstream_conn_pool->init();
   }
 
@@ -3364,6 +3412,7 @@ void destroy_stateful_proxy()
   // connections.
   delete upstream_conn_pool; upstream_conn_pool = NULL;
   delete sprout_ip_tbl; sprout_ip_tbl = NULL;
+  delete sprout_requests_tbl; sprout_requests_tbl = NULL;
 
   // Destroy the flow table.
   delete flow_count;
@@ -79,7 +79,7 @@ HTTPCode ChronosAoRTimeoutTask::parse_response(std::string body)
 
 void ChronosAoRTimeoutTask::handle_response()
 {
-  process_aor_timeout(_aor_id);
+  process_aor_timeout(_cfg, _aor_id, trail());
 }
 
 void ChronosAuthTimeoutTask::run()
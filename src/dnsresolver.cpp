@@ -11,7 +11,9 @@
 
 ///
 
+#include <algorithm>
 #include <fstream>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -29,7 +31,8 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
                          _trail(0),
                          _domain(""),
                          _status(ARES_SUCCESS),
-                         _naptr_reply(NULL)
+                         _naptr_reply(NULL),
+                         _ttl(-1)
 {
   // Set options to ensure we always get a response as quickly as possible -
   // we are on the call path!
@@ -104,18 +107,20 @@ void DNSResolver::destroy(DNSResolver* resolver)
 }
 
 
-int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
   send_naptr_query(domain, trail);
   wait_for_response();
 
   // Save off the results...
   naptr_reply = _naptr_reply;
+  ttl = _ttl;
   int status = _status;
   // ...and then clear out our state.
   _trail = 0;
   _domain = "";
   _naptr_reply = NULL;
+  _ttl = -1;
   _status = ARES_SUCCESS;
 
   return status;
@@ -231,6 +236,7 @@ void DNSResolver::ares_callback(int status,
                                 int alen)
 {
   _status = status;
+  _ttl = parse_ttl(status, abuf, alen);
   if (status == ARES_SUCCESS)
   {
     // Log that we've succeeded.
@@ -259,6 +265,110 @@ void DNSResolver::ares_callback(int status,
 }
 
 
+// Skips over a (possibly compressed) domain name in a DNS message.
+static bool skip_name(const unsigned char*& aptr,
+                      const unsigned char* abuf,
+                      int alen)
+{
+  char* name = NULL;
+  long len = 0;
+
+  if (ares_expand_name(aptr, abuf, alen, &name, &len) != ARES_SUCCESS)
+  {
+    return false;
+  }
+
+  ares_free_string(name);
+  aptr += len;
+  return true;
+}
+
+
+int DNSResolver::parse_ttl(int status, const unsigned char* abuf, int alen)
+{
+  // c-ares doesn't return the TTLs of NAPTR records, so we have to find them
+  // in the raw response.  For a successful query, the result can be cached
+  // for the lowest TTL of the NAPTR records in the answer.  For a query for a
+  // name that doesn't exist, the negative caching TTL is the lower of the
+  // TTL and MINIMUM fields of the SOA record in the authority section (see
+  // RFC 2308).  No other results can be cached.
+  if ((abuf == NULL) ||
+      (alen < NS_HFIXEDSZ) ||
+      ((status != ARES_SUCCESS) && (status != ARES_ENOTFOUND)))
+  {
+    return -1;
+  }
+
+  const unsigned char* aend = abuf + alen;
+  const unsigned char* aptr = abuf + 4;
+  unsigned int qdcount;
+  unsigned int ancount;
+  unsigned int nscount;
+  NS_GET16(qdcount, aptr);
+  NS_GET16(ancount, aptr);
+  NS_GET16(nscount, aptr);
+  aptr = abuf + NS_HFIXEDSZ;
+
+  // Skip over the question section.
+  for (unsigned int ii = 0; ii < qdcount; ii++)
+  {
+    if ((!skip_name(aptr, abuf, alen)) || (aptr + NS_QFIXEDSZ > aend))
+    {
+      return -1;
+    }
+    aptr += NS_QFIXEDSZ;
+  }
+
+  int64_t ttl = -1;
+  unsigned int rrcount = (status == ARES_SUCCESS) ? ancount : ancount + nscount;
+
+  for (unsigned int ii = 0; ii < rrcount; ii++)
+  {
+    if ((!skip_name(aptr, abuf, alen)) || (aptr + NS_RRFIXEDSZ > aend))
+    {
+      return -1;
+    }
+
+    unsigned int type;
+    uint32_t rr_ttl;
+    unsigned int rdlength;
+    NS_GET16(type, aptr);
+    aptr += NS_INT16SZ; // Skip the class.
+    NS_GET32(rr_ttl, aptr);
+    NS_GET16(rdlength, aptr);
+
+    if (aptr + rdlength > aend)
+    {
+      return -1;
+    }
+
+    // TTLs with the top bit set are treated as zero (RFC 2181, section 8).
+    int64_t rr_ttl_secs = (rr_ttl & 0x80000000) ? 0 : rr_ttl;
+
+    if ((status == ARES_SUCCESS) && (type == ns_t_naptr))
+    {
+      ttl = (ttl < 0) ? rr_ttl_secs : std::min(ttl, rr_ttl_secs);
+    }
+    else if ((status == ARES_ENOTFOUND) &&
+             (ii >= ancount) &&
+             (type == ns_t_soa) &&
+             (rdlength >= 4))
+    {
+      // The MINIMUM field is the last 32 bits of the SOA record.
+      const unsigned char* minptr = aptr + rdlength - 4;
+      uint32_t minimum;
+      NS_GET32(minimum, minptr);
+      int64_t minimum_secs = (minimum & 0x80000000) ? 0 : minimum;
+      ttl = std::min(rr_ttl_secs, minimum_secs);
+    }
+
+    aptr += rdlength;
+  }
+
+  return (int)ttl;
+}
+
+
 DNSResolver* DNSResolverFactory::new_resolver(const std::vector<struct IP46Address>& servers) const
 {
   return new DNSResolver(servers);
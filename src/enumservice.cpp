@@ -15,6 +15,8 @@
 #include "json_parse_utils.h"
 #include <fstream>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -94,6 +96,7 @@ bool EnumService::parse_regex_replace(const std::string& regex_replace, boost::r
 
 
 JSONEnumService::JSONEnumService(std::string configuration):
+  _number_prefixes(new NumberPrefixTrie()),
   _configuration(configuration),
   _updater(NULL)
 {
@@ -147,8 +150,7 @@ void JSONEnumService::update_enum()
 
   try
   {
-    std::vector<NumberPrefix> new_number_prefixes;
-    std::map<std::string, NumberPrefix> new_prefix_regex_map;
+    std::shared_ptr<NumberPrefixTrie> new_number_prefixes(new NumberPrefixTrie());
 
     JSON_ASSERT_CONTAINS(doc, "number_blocks");
     JSON_ASSERT_ARRAY(doc["number_blocks"]);
@@ -173,11 +175,10 @@ void JSONEnumService::update_enum()
 
         if (parse_regex_replace(regex, pfix.match, pfix.replace))
         {
-          // Create an array in order of entries in json file, and a map
-          // (automatically sorted in order of key length) so we can later
-          // match numbers to the most specific prefixes
-          new_number_prefixes.push_back(pfix);
-          new_prefix_regex_map.insert(std::make_pair(prefix, pfix));
+          // Add the prefix to the trie so we can later match numbers to the
+          // most specific prefix.  If the prefix is repeated, the first entry
+          // in the file wins.
+          new_number_prefixes->insert(prefix, pfix);
           TRC_STATUS("  Adding number prefix %s, regex=%s",
                      pfix.prefix.c_str(), regex.c_str());
         }
@@ -196,10 +197,10 @@ void JSONEnumService::update_enum()
       }
     }
 
-    // Take a write lock on the mutex in RAII style
-    boost::lock_guard<boost::shared_mutex> write_lock(_number_prefixes_rw_lock);
-    _number_prefixes = new_number_prefixes;
-    _prefix_regex_map = new_prefix_regex_map;
+    // Swap in the new prefixes.  Any lookups in progress keep a reference to
+    // the old trie, which is freed when the last of them completes.
+    std::shared_ptr<const NumberPrefixTrie> number_prefixes = new_number_prefixes;
+    std::atomic_store(&_number_prefixes, number_prefixes);
   }
   catch (JsonFormatError err)
   {
@@ -230,10 +231,17 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 
   std::string aus = user_to_aus(user);
 
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_number_prefixes_rw_lock);
+  // Take a reference to the current prefixes, so they can't be freed under
+  // us if the configuration is reloaded.
+  std::shared_ptr<const NumberPrefixTrie> number_prefixes =
+                                           std::atomic_load(&_number_prefixes);
 
-  const struct NumberPrefix* pfix = prefix_match(aus);
+  // The prefixes have had their visual separators stripped, so do the same to
+  // the number (once) before looking for the most specific matching prefix.
+  const std::string* matched_prefix = NULL;
+  const struct NumberPrefix* pfix =
+     number_prefixes->match(PJUtils::remove_visual_separators(aus),
+                            &matched_prefix);
 
   if (pfix == NULL)
   {
@@ -244,6 +252,8 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
     return uri;
   }
 
+  TRC_DEBUG("Number %s matches prefix %s", aus.c_str(), matched_prefix->c_str());
+
   // Apply the regular expression to the user string to generate a new
   // URI.
   try
@@ -270,44 +280,24 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 }
 
 
-// This function returns a pointer to a struct that may be destroyed by the
-// updater. Callers must therefore ensure that they have the read lock before
-// calling this function and only release the lock once they no longer need
-// the object.
-const JSONEnumService::NumberPrefix* JSONEnumService::prefix_match(const std::string& number) const
-{
-  // Iterate through map in reverse order (already sorted by key length during 
-  // construction) to find the most specific matching prefix
-  for (std::map<std::string, NumberPrefix>::const_reverse_iterator it = 
-                                                     _prefix_regex_map.rbegin();
-       it != _prefix_regex_map.rend();
-       it++)
-  {
-    int len = std::min(number.size(), (*it).first.size());
-
-    TRC_DEBUG("Comparing first %d numbers of %s against prefix %s",
-              len, number.c_str(), (*it).first.c_str());
-
-    if (PJUtils::remove_visual_separators(number).
-                                      compare(0, len, (*it).first, 0, len) == 0)
-    {
-      // Found a match, so return it. 
-      TRC_DEBUG("Match found");
-      return &((*it).second);
-    }
-  }
-
-  return NULL;
-}
-
 DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
                                const std::string& dns_suffix,
                                const DNSResolverFactory* resolver_factory,
                                CommunicationMonitor* comm_monitor) :
                                _dns_suffix(dns_suffix),
                                _resolver_factory(resolver_factory),
-                               _comm_monitor(comm_monitor)
+                               _comm_monitor(comm_monitor),
+                               _cache_max_size(0),
+                               _cache_hits_tbl(NULL),
+                               _cache_misses_tbl(NULL)
 {
+  pthread_mutex_init(&_cache_lock, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_cache_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
   // Initialize the ares library.  This might have already been done by curl
   // but it's safe to do it twice.
   ares_library_init(ARES_LIB_INIT_ALL);
@@ -369,6 +359,20 @@ DNSEnumService::~DNSEnumService()
 
   delete _resolver_factory;
   _resolver_factory = NULL;
+
+  pthread_cond_destroy(&_cache_cond);
+  pthread_mutex_destroy(&_cache_lock);
+}
+
+
+void DNSEnumService::enable_cache(int max_size,
+                                  SNMP::CounterTable* hits_tbl,
+                                  SNMP::CounterTable* misses_tbl)
+{
+  TRC_STATUS("Caching NAPTR responses for up to %d ENUM domains", max_size);
+  _cache_max_size = (max_size > 0) ? max_size : 0;
+  _cache_hits_tbl = hits_tbl;
+  _cache_misses_tbl = misses_tbl;
 }
 
 
@@ -397,24 +401,24 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   bool complete = false;
   bool failed = false;
   bool server_failed = false;
+  bool any_queries = false;
   int dns_queries = 0;
   while ((!complete) &&
          (!failed) &&
          (dns_queries < MAX_DNS_QUERIES))
   {
-    // Translate the key into a domain and issue a query for it.
+    // Translate the key into a domain and get the rules for it.
     std::string domain = key_to_domain(string);
-    struct ares_naptr_reply* naptr_reply = NULL;
-    int status = resolver->perform_naptr_query(domain, naptr_reply, trail);
+    RulesPtr rules;
+    bool queried = false;
+    int status = get_rules(domain, resolver, rules, queried, trail);
+    any_queries = any_queries || queried;
     if (status == ARES_SUCCESS)
     {
-      // Parse the reply into a sorted list of rules.
-      std::vector<Rule> rules;
-      parse_naptr_reply(naptr_reply, rules);
       // Now spin through the rules, looking for the first match.
       std::vector<DNSEnumService::Rule>::const_iterator rule;
-      for (rule = rules.begin();
-           rule != rules.end();
+      for (rule = rules->begin();
+           rule != rules->end();
            ++rule)
       {
         if (rule->matches(string))
@@ -440,7 +444,7 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
       }
       // If we didn't find a match (and so hit the end of the list), consider
       // this a failure.
-      failed = failed || (rule == rules.end());
+      failed = failed || (rule == rules->end());
     }
     else if (status == ARES_ENOTFOUND)
     {
@@ -455,14 +459,6 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
       server_failed = true;
     }
 
-
-    // Free off the NAPTR reply if we have one.
-    if (naptr_reply != NULL)
-    {
-      resolver->free_naptr_reply(naptr_reply);
-      naptr_reply = NULL;
-    }
-
     dns_queries++;
   }
 
@@ -486,8 +482,9 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   }
 
   // Report state of last communication attempt (which may potentially set/clear
-  // an associated alarm).
-  if (_comm_monitor)
+  // an associated alarm).  If all the rules came from the cache, we haven't
+  // communicated with the server.
+  if ((_comm_monitor) && (any_queries))
   {
     if (server_failed)
     {
@@ -503,6 +500,270 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
 }
 
 
+int DNSEnumService::get_rules(const std::string& domain,
+                              DNSResolver* resolver,
+                              RulesPtr& rules,
+                              bool& queried,
+                              SAS::TrailId trail) const
+{
+  int ttl = -1;
+
+  if (_cache_max_size == 0)
+  {
+    queried = true;
+    return query_rules(domain, resolver, rules, ttl, trail);
+  }
+
+  pthread_mutex_lock(&_cache_lock);
+
+  std::unordered_map<std::string, CacheEntry>::iterator it = _cache.find(domain);
+
+  if ((it != _cache.end()) && (it->second.pending))
+  {
+    // Another thread is already querying for this domain, so wait for it to
+    // finish and use its result.  The entry can't be removed while we are
+    // waiting on it, so we can keep a reference to it.
+    CacheEntry& entry = it->second;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += MAX_WAIT_MS / 1000;
+    deadline.tv_nsec += (MAX_WAIT_MS % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    ++entry.waiters;
+    int rc = 0;
+    while ((entry.pending) && (rc != ETIMEDOUT))
+    {
+      rc = pthread_cond_timedwait(&_cache_cond, &_cache_lock, &deadline);
+    }
+    --entry.waiters;
+
+    if (entry.pending)
+    {
+      // The other thread's query is taking too long, so make our own query,
+      // leaving the entry for the other thread to update.
+      TRC_DEBUG("Timed out waiting for NAPTR query for %s", domain.c_str());
+      pthread_mutex_unlock(&_cache_lock);
+
+      if (_cache_misses_tbl != NULL)
+      {
+        _cache_misses_tbl->increment();
+      }
+
+      queried = true;
+      return query_rules(domain, resolver, rules, ttl, trail);
+    }
+
+    int status = entry.status;
+    rules = entry.rules;
+
+    // If the query failed, this lookup didn't get a usable result from the
+    // cache either, so counts as a miss.
+    bool failed = ((status != ARES_SUCCESS) && (status != ARES_ENOTFOUND));
+    TRC_DEBUG("Shared NAPTR query for %s completed with status %d",
+              domain.c_str(), status);
+
+    // Results that aren't cached are kept only until the last thread waiting
+    // for them has read them.
+    if ((entry.expiry_ms == 0) && (entry.waiters == 0))
+    {
+      erase_cache_entry(_cache.find(domain));
+    }
+
+    pthread_mutex_unlock(&_cache_lock);
+
+    SNMP::CounterTable* tbl = (failed) ? _cache_misses_tbl : _cache_hits_tbl;
+    if (tbl != NULL)
+    {
+      tbl->increment();
+    }
+
+    return status;
+  }
+
+  unsigned long now = now_ms();
+
+  if ((it != _cache.end()) && (it->second.expiry_ms > now))
+  {
+    TRC_DEBUG("Found cached NAPTR result for %s", domain.c_str());
+    int status = it->second.status;
+    rules = it->second.rules;
+    _cache_lru.splice(_cache_lru.begin(), _cache_lru, it->second.lru);
+    pthread_mutex_unlock(&_cache_lock);
+
+    if (_cache_hits_tbl != NULL)
+    {
+      _cache_hits_tbl->increment();
+    }
+
+    return status;
+  }
+
+  // We need to query for this domain.  Mark the entry as pending first, so
+  // that other threads wanting the same domain wait for us.
+  if (it != _cache.end())
+  {
+    _cache_lru.splice(_cache_lru.begin(), _cache_lru, it->second.lru);
+  }
+  else
+  {
+    if (_cache.size() >= _cache_max_size)
+    {
+      evict_cache_entries();
+    }
+
+    it = _cache.insert(std::make_pair(domain, CacheEntry())).first;
+    it->second.waiters = 0;
+    _cache_lru.push_front(domain);
+    it->second.lru = _cache_lru.begin();
+  }
+
+  it->second.pending = true;
+  it->second.rules.reset();
+  pthread_mutex_unlock(&_cache_lock);
+
+  if (_cache_misses_tbl != NULL)
+  {
+    _cache_misses_tbl->increment();
+  }
+
+  queried = true;
+  int status = ARES_SUCCESS;
+
+  try
+  {
+    status = query_rules(domain, resolver, rules, ttl, trail);
+  }
+  catch (...)
+  {
+    // Don't leave other threads waiting for a query that won't complete.
+    complete_query(domain, ARES_ESERVFAIL, RulesPtr(), 0);
+    throw;
+  }
+
+  // Only successful results and domains that don't exist are cached.  Other
+  // failures are passed to threads that were waiting for them, but the next
+  // lookup queries again.
+  if ((status == ARES_ENOTFOUND) && (ttl < 0))
+  {
+    ttl = DEFAULT_NEGATIVE_TTL;
+  }
+  else if ((status != ARES_SUCCESS) && (status != ARES_ENOTFOUND))
+  {
+    ttl = 0;
+  }
+
+  if (ttl < 0)
+  {
+    ttl = 0;
+  }
+  else if (ttl > MAX_CACHE_TTL)
+  {
+    ttl = MAX_CACHE_TTL;
+  }
+
+  complete_query(domain, status, rules, ttl);
+
+  return status;
+}
+
+
+void DNSEnumService::complete_query(const std::string& domain,
+                                    int status,
+                                    const RulesPtr& rules,
+                                    int ttl) const
+{
+  TRC_DEBUG("Caching NAPTR result for %s for %ds", domain.c_str(), ttl);
+  pthread_mutex_lock(&_cache_lock);
+
+  // Pending entries are never removed, so the entry must still be there.
+  std::unordered_map<std::string, CacheEntry>::iterator it = _cache.find(domain);
+  CacheEntry& entry = it->second;
+  entry.pending = false;
+  entry.status = status;
+  entry.rules = rules;
+  entry.expiry_ms = (ttl > 0) ? now_ms() + (unsigned long)ttl * 1000 : 0;
+
+  if ((entry.expiry_ms == 0) && (entry.waiters == 0))
+  {
+    // Nobody else wants this result, and it isn't to be cached.
+    erase_cache_entry(it);
+  }
+
+  pthread_cond_broadcast(&_cache_cond);
+  pthread_mutex_unlock(&_cache_lock);
+}
+
+
+int DNSEnumService::query_rules(const std::string& domain,
+                                DNSResolver* resolver,
+                                RulesPtr& rules,
+                                int& ttl,
+                                SAS::TrailId trail) const
+{
+  struct ares_naptr_reply* naptr_reply = NULL;
+  int status = resolver->perform_naptr_query(domain, naptr_reply, ttl, trail);
+
+  if (status == ARES_SUCCESS)
+  {
+    // Parse the reply into a sorted list of rules.
+    std::vector<Rule>* parsed_rules = new std::vector<Rule>();
+    parse_naptr_reply(naptr_reply, *parsed_rules);
+    rules.reset(parsed_rules);
+  }
+
+  // Free off the NAPTR reply if we have one.
+  if (naptr_reply != NULL)
+  {
+    resolver->free_naptr_reply(naptr_reply);
+    naptr_reply = NULL;
+  }
+
+  return status;
+}
+
+
+void DNSEnumService::evict_cache_entries() const
+{
+  // Entries that are being queried or read must stay, as other threads are
+  // using them.
+  std::list<std::string>::iterator lru_it = _cache_lru.end();
+
+  while ((_cache.size() >= _cache_max_size) && (lru_it != _cache_lru.begin()))
+  {
+    --lru_it;
+    std::unordered_map<std::string, CacheEntry>::iterator it = _cache.find(*lru_it);
+
+    if ((!it->second.pending) && (it->second.waiters == 0))
+    {
+      TRC_DEBUG("Evicting NAPTR result for %s", lru_it->c_str());
+      lru_it = _cache_lru.erase(lru_it);
+      _cache.erase(it);
+    }
+  }
+}
+
+
+void DNSEnumService::erase_cache_entry(std::unordered_map<std::string, CacheEntry>::iterator it) const
+{
+  _cache_lru.erase(it->second.lru);
+  _cache.erase(it);
+}
+
+
+unsigned long DNSEnumService::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((unsigned long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+
 std::string DNSEnumService::key_to_domain(const std::string& key) const
 {
   // First strip all non-numeric characters from the key.
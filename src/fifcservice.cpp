@@ -16,11 +16,11 @@
 #include "sprout_pd_definitions.h"
 #include "utils.h"
 #include "xml_utils.h"
-#include "rapidxml/rapidxml_print.hpp"
 
 FIFCService::FIFCService(Alarm* alarm,
                          std::string configuration):
   _alarm(alarm),
+  _fallback_ifcs(new std::vector<Ifc>()),
   _configuration(configuration),
   _updater(NULL)
 {
@@ -32,7 +32,6 @@ FIFCService::FIFCService(Alarm* alarm,
 FIFCService::~FIFCService()
 {
   delete _updater; _updater = NULL;
-  _fallback_ifcs.clear();
   delete _alarm; _alarm = NULL;
 }
 
@@ -68,8 +67,9 @@ void FIFCService::update_fifcs()
     return;
   }
 
-  // Now parse the document.
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  // Now parse the document. The iFCs we store point into this document, so
+  // they keep it alive until they are no longer in use.
+  std::shared_ptr<rapidxml::xml_document<> > root(new rapidxml::xml_document<>);
 
   // Check the file contains valid xml.
   try
@@ -83,7 +83,6 @@ void FIFCService::update_fifcs()
               err.what());
     CL_SPROUT_FIFC_FILE_INVALID_XML.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
@@ -94,19 +93,16 @@ void FIFCService::update_fifcs()
               "invalid (missing FallbackIFCsSet block)");
     CL_SPROUT_FIFC_FILE_MISSING_FALLBACK_IFCS_SET.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
   // If we have reached this point, we are definitely going to update the current
   // fallback ifc list.
-  // Take a lock while we do so.
-  boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
+  // Build the new list without the lock, then swap it in below.
   bool any_errors = false;
-  _fallback_ifcs.clear();
 
   // Parse any iFCs that are present.
-  std::multimap<int32_t, std::string> ifc_map;
+  std::multimap<int32_t, Ifc> ifc_map;
   rapidxml::xml_node<>* fifc_set = root->first_node(FIFCService::FALLBACK_IFCS_SET);
   rapidxml::xml_node<>* ifc = NULL;
   for (ifc = fifc_set->first_node(RegDataXMLUtils::IFC);
@@ -134,19 +130,24 @@ void FIFCService::update_fifcs()
     }
     // Creating the iFC always passes, and the iFC isn't validated any
     // further at this stage.
-    std::string ifc_str;
-    rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-    ifc_map.insert(std::make_pair(priority, ifc_str));
+    ifc_map.insert(std::make_pair(priority, Ifc(ifc, root)));
   }
 
-  std::vector<std::string> ifcs_vec;
-  for (std::pair<int32_t, std::string> ifc_pair : ifc_map)
+  std::shared_ptr<std::vector<Ifc> > ifcs_vec(new std::vector<Ifc>());
+  for (const std::pair<const int32_t, Ifc>& ifc_pair : ifc_map)
   {
-    ifcs_vec.push_back(ifc_pair.second);
+    ifcs_vec->push_back(ifc_pair.second);
   }
 
-  TRC_DEBUG("Adding %lu fallback iFC(s)", ifcs_vec.size());
-  _fallback_ifcs = ifcs_vec;
+  TRC_DEBUG("Adding %lu fallback iFC(s)", ifcs_vec->size());
+
+  // Swap in the new list. Requests that already have iFCs from the old list
+  // keep its document alive until they're done.
+  std::shared_ptr<const std::vector<Ifc> > old_ifcs = ifcs_vec;
+  {
+    boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
+    _fallback_ifcs.swap(old_ifcs);
+  }
 
   if (any_errors)
   {
@@ -157,22 +158,14 @@ void FIFCService::update_fifcs()
     clear_alarm();
   }
 
-  delete root; root = NULL;
   return;
 }
 
-std::vector<Ifc> FIFCService::get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const
+std::vector<Ifc> FIFCService::get_fallback_ifcs() const
 {
   // Take a read lock on the mutex in RAII style
   boost::shared_lock<boost::shared_mutex> read_lock(_sets_rw_lock);
-
-  std::vector<Ifc> ifc_vec;
-  for (std::string ifc : _fallback_ifcs)
-  {
-    ifc_vec.push_back(Ifc(ifc, ifc_doc));
-  }
-
-  return ifc_vec;
+  return *_fallback_ifcs;
 }
 
 void FIFCService::set_alarm()
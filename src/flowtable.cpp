@@ -18,6 +18,7 @@ extern "C" {
 // Common STL includes.
 #include <cassert>
 #include <map>
+#include <unordered_map>
 #include <string>
 
 #include "log.h"
@@ -27,13 +28,20 @@ extern "C" {
 #include "flowtable.h"
 
 FlowTable::FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count) :
-  _tp2flow_map(),
-  _tk2flow_map(),
+  _tp2flow_shards(NUM_SHARDS),
+  _tk2flow_shards(NUM_SHARDS),
+  _flow_count(0),
   _conn_count(connection_count),
   _quiescing(false),
   _qm(qm)
 {
-  pthread_mutex_init(&_flow_map_lock, NULL);
+  for (size_t ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_rwlock_init(&_tp2flow_shards[ii].lock, NULL);
+    pthread_rwlock_init(&_tk2flow_shards[ii].lock, NULL);
+  }
+
+  pthread_mutex_init(&_count_lock, NULL);
   report_flow_count();
 }
 
@@ -41,14 +49,49 @@ FlowTable::FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count) :
 FlowTable::~FlowTable()
 {
   // Delete all the existing flows.
-  for (std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.begin();
-       i != _tp2flow_map.end();
-       ++i)
+  for (size_t ii = 0; ii < NUM_SHARDS; ++ii)
   {
-    delete i->second;
+    AddrShard& shard = _tp2flow_shards[ii];
+
+    for (std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.map.begin();
+         i != shard.map.end();
+         ++i)
+    {
+      delete i->second;
+    }
+
+    pthread_rwlock_destroy(&_tp2flow_shards[ii].lock);
+    pthread_rwlock_destroy(&_tk2flow_shards[ii].lock);
   }
 
-  pthread_mutex_destroy(&_flow_map_lock);
+  pthread_mutex_destroy(&_count_lock);
+}
+
+
+/// Hashes the transport type and remote address (family, IP address and
+/// port) using FNV-1a.
+size_t FlowTable::FlowKey::hash() const
+{
+  uint32_t h = 2166136261u;
+  uint32_t fields[3] = {(uint32_t)_type,
+                        (uint32_t)_raddr.addr.sa_family,
+                        (uint32_t)pj_sockaddr_get_port(&_raddr)};
+  const uint8_t* p = (const uint8_t*)fields;
+
+  for (size_t ii = 0; ii < sizeof(fields); ++ii)
+  {
+    h = (h ^ p[ii]) * 16777619u;
+  }
+
+  p = (const uint8_t*)pj_sockaddr_get_addr(&_raddr);
+  unsigned len = pj_sockaddr_get_addr_len(&_raddr);
+
+  for (unsigned ii = 0; ii < len; ++ii)
+  {
+    h = (h ^ p[ii]) * 16777619u;
+  }
+
+  return h;
 }
 
 
@@ -64,35 +107,51 @@ Flow* FlowTable::find_create_flow(pjsip_transport* transport, const pj_sockaddr*
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
-
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  AddrShard& shard = addr_shard(key);
 
-  if (i == _tp2flow_map.end())
-  {
-    // No matching flow, so create a new one.
-    flow = new Flow(this, transport, raddr);
+  pthread_rwlock_wrlock(&shard.lock);
 
-    // Add the new flow to the maps.
-    _tp2flow_map.insert(std::make_pair(key, flow));
-    _tk2flow_map.insert(std::make_pair(flow->token(), flow));
-
-    TRC_DEBUG("Added flow record %p", flow);
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.map.find(key);
 
-    report_flow_count();
-  }
-  else
+  if ((i != shard.map.end()) && (i->second->inc_ref_if_live()))
   {
     // Found a matching flow, so return this one.
     flow = i->second;
 
     TRC_DEBUG("Found flow record %p", flow);
   }
+  else
+  {
+    // No matching flow (or the matching flow has lost its last reference and
+    // is about to be removed), so create a new one.  This takes the place of
+    // any old flow in the map.
+    flow = new Flow(this, transport, raddr);
 
-  // Add a reference to the flow.
-  flow->inc_ref();
+    // Add a reference for the caller, on top of the one held by the table.
+    flow->inc_ref_if_live();
 
-  pthread_mutex_unlock(&_flow_map_lock);
+    if (i != shard.map.end())
+    {
+      i->second = flow;
+    }
+    else
+    {
+      shard.map.insert(std::make_pair(key, flow));
+    }
+
+    TokenShard& tk_shard = token_shard(flow->token());
+    pthread_rwlock_wrlock(&tk_shard.lock);
+    tk_shard.map.insert(std::make_pair(flow->token(), flow));
+    pthread_rwlock_unlock(&tk_shard.lock);
+
+    ++_flow_count;
+
+    TRC_DEBUG("Added flow record %p", flow);
+
+    report_flow_count();
+  }
+
+  pthread_rwlock_unlock(&shard.lock);
 
   return flow;
 }
@@ -110,22 +169,23 @@ Flow* FlowTable::find_flow(pjsip_transport* transport, const pj_sockaddr* raddr)
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
+  AddrShard& shard = addr_shard(key);
+
+  pthread_rwlock_rdlock(&shard.lock);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.map.find(key);
 
-  if (i != _tp2flow_map.end())
+  // Only return the flow if we can add a reference to it - if not, it is
+  // about to be removed.
+  if ((i != shard.map.end()) && (i->second->inc_ref_if_live()))
   {
     // Found a matching flow, so return this one.
     flow = i->second;
 
-    // Increment the reference count on the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_rwlock_unlock(&shard.lock);
 
   return flow;
 }
@@ -138,28 +198,29 @@ Flow* FlowTable::find_flow(const std::string& token)
 
   TRC_DEBUG("Find flow for flow token %s", token.c_str());
 
-  pthread_mutex_lock(&_flow_map_lock);
+  TokenShard& shard = token_shard(token);
+
+  pthread_rwlock_rdlock(&shard.lock);
 
-  std::map<std::string, Flow*>::iterator i = _tk2flow_map.find(token);
-  if (i != _tk2flow_map.end())
+  std::unordered_map<std::string, Flow*>::iterator i = shard.map.find(token);
+  if ((i != shard.map.end()) && (i->second->inc_ref_if_live()))
   {
     // Found a flow matching the token.
     flow = i->second;
 
-    // Add a reference to the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_rwlock_unlock(&shard.lock);
 
   return flow;
 }
 
 void FlowTable::check_quiescing_state()
 {
-  if (_tp2flow_map.empty() && is_quiescing() && (_qm != NULL))
+  pthread_mutex_lock(&_count_lock);
+
+  if ((_flow_count == 0) && is_quiescing() && (_qm != NULL))
   {
     TRC_DEBUG("Flow map is empty and we are quiescing - start transaction-based quiescing");
     _qm->flows_gone();
@@ -167,58 +228,64 @@ void FlowTable::check_quiescing_state()
   else
   {
     TRC_DEBUG("Checked quiescing state: flow_map is %s, is_quiescing() result is %s, _qm (QuiescingManager reference) is %s",
-              _tp2flow_map.empty() ? "empty" : "not empty",
+              (_flow_count == 0) ? "empty" : "not empty",
               is_quiescing()? "true" : "false",
               (_qm == NULL) ? "NULL" : "not NULL");
   }
+
+  pthread_mutex_unlock(&_count_lock);
 }
 
 void FlowTable::remove_flow(Flow* flow)
 {
-  pthread_mutex_lock(&_flow_map_lock);
-
   TRC_DEBUG("Remove flow %p", flow);
 
   FlowKey key(flow->transport()->key.type, flow->remote_addr());
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
-  if (i != _tp2flow_map.end())
-  {
-    _tp2flow_map.erase(i);
-  }
+  // The flow may already have been replaced in the map by a new flow for the
+  // same address, in which case leave the new one alone.
+  AddrShard& shard = addr_shard(key);
+  pthread_rwlock_wrlock(&shard.lock);
 
-  std::map<std::string, Flow*>::iterator j = _tk2flow_map.find(flow->token());
-  if (j != _tk2flow_map.end())
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.map.find(key);
+  if ((i != shard.map.end()) && (i->second == flow))
   {
-    _tk2flow_map.erase(j);
+    shard.map.erase(i);
   }
 
-  report_flow_count();
+  pthread_rwlock_unlock(&shard.lock);
+
+  TokenShard& tk_shard = token_shard(flow->token());
+  pthread_rwlock_wrlock(&tk_shard.lock);
+  tk_shard.map.erase(flow->token());
+  pthread_rwlock_unlock(&tk_shard.lock);
 
+  // No lookup can find the flow now, so it is safe to delete it.
   delete flow;
 
-  check_quiescing_state();
+  --_flow_count;
+  report_flow_count();
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  check_quiescing_state();
 }
 
 void FlowTable::report_flow_count()
 {
-  TRC_DEBUG("Reporting current flow count: %d", _tp2flow_map.size());
-  _conn_count->value = _tp2flow_map.size();
+  pthread_mutex_lock(&_count_lock);
+  long count = _flow_count;
+  TRC_DEBUG("Reporting current flow count: %ld", count);
+  _conn_count->value = count;
+  pthread_mutex_unlock(&_count_lock);
 }
 
 void FlowTable::quiesce()
 {
   TRC_DEBUG("FlowTable was kicked to quiesce");
   _quiescing = true;
-  pthread_mutex_lock(&_flow_map_lock);
 
   // If we have no flows, quiesce now - otherwise we do this in
   // remove_flow when the last flow disappears
   check_quiescing_state();
-
-  pthread_mutex_unlock(&_flow_map_lock);
 }
 
 void FlowTable::unquiesce()
@@ -249,7 +316,7 @@ Flow::Flow(FlowTable* flow_table, pjsip_transport* transport, const pj_sockaddr*
   _dialogs(0)
 {
   // Create the lock for protecting the authorized_ids and default_id.
-  pthread_mutex_init(&_flow_lock, NULL);
+  pthread_rwlock_init(&_flow_lock, NULL);
 
   // Create a random base64 encoded token for the flow.
   Utils::create_random_token(Flow::TOKEN_LENGTH, _token);
@@ -298,7 +365,7 @@ Flow::~Flow()
     _timer.id = 0;
   }
 
-  pthread_mutex_destroy(&_flow_lock);
+  pthread_rwlock_destroy(&_flow_lock);
 }
 
 
@@ -322,7 +389,7 @@ std::string Flow::asserted_identity(pjsip_uri* preferred_identity)
   std::string aor = PJUtils::public_id_from_uri((pjsip_uri*)pjsip_uri_get_uri(preferred_identity));
   std::string id;
 
-  pthread_mutex_lock(&_flow_lock);
+  pthread_rwlock_rdlock(&_flow_lock);
 
   auth_id_map::const_iterator i = _authorized_ids.find(aor);
 
@@ -332,7 +399,7 @@ std::string Flow::asserted_identity(pjsip_uri* preferred_identity)
     id = i->second.name_addr;
   }
 
-  pthread_mutex_unlock(&_flow_lock);
+  pthread_rwlock_unlock(&_flow_lock);
 
   return id;
 }
@@ -343,11 +410,11 @@ std::string Flow::asserted_identity(pjsip_uri* preferred_identity)
 /// identities are authorized on this flow.
 std::string Flow::default_identity()
 {
-  pthread_mutex_lock(&_flow_lock);
+  pthread_rwlock_rdlock(&_flow_lock);
 
   std::string id = _default_id;
 
-  pthread_mutex_unlock(&_flow_lock);
+  pthread_rwlock_unlock(&_flow_lock);
 
   return id;
 }
@@ -358,7 +425,7 @@ std::string Flow::service_route(const std::string& identity)
 {
   std::string route;
 
-  pthread_mutex_lock(&_flow_lock);
+  pthread_rwlock_rdlock(&_flow_lock);
 
   auth_id_map::const_iterator i = _authorized_ids.find(identity);
 
@@ -368,7 +435,7 @@ std::string Flow::service_route(const std::string& identity)
     route = i->second.service_route;
   }
 
-  pthread_mutex_unlock(&_flow_lock);
+  pthread_rwlock_unlock(&_flow_lock);
 
   return route;
 }
@@ -387,7 +454,7 @@ void Flow::set_identity(const pjsip_uri* uri,
 
   TRC_DEBUG("Setting identity %s on flow %p, expires = %d", aor.c_str(), this, expires);
 
-  pthread_mutex_lock(&_flow_lock);
+  pthread_rwlock_wrlock(&_flow_lock);
 
   // Convert the expiry time to an absolute time.
   expires += now;
@@ -462,7 +529,7 @@ void Flow::set_identity(const pjsip_uri* uri,
     // so would be no more efficient.
   }
 
-  pthread_mutex_unlock(&_flow_lock);
+  pthread_rwlock_unlock(&_flow_lock);
 }
 
 
@@ -474,7 +541,7 @@ void Flow::expiry_timer()
   // a single flow to have a large number of identities.  This may not be
   // a valid assumption if a downstream SBC or AGCF muxes a large number of
   // clients over a single flow.
-  pthread_mutex_lock(&_flow_lock);
+  pthread_rwlock_wrlock(&_flow_lock);
 
   int now = time(NULL);
   int min_expires = 0;
@@ -530,7 +597,7 @@ void Flow::expiry_timer()
     restart_timer(EXPIRY_TIMER, min_expires - now);
   }
 
-  pthread_mutex_unlock(&_flow_lock);
+  pthread_rwlock_unlock(&_flow_lock);
 }
 
 
@@ -566,12 +633,25 @@ void Flow::restart_timer(int id, int timeout)
 }
 
 
-/// Increment the reference count on the flow.  This is always called when
-/// the flowtable lock is held, so no need to lock.
-void Flow::inc_ref()
+/// Increments the reference count on the flow, unless it has already dropped
+/// to zero (in which case the flow is being removed, and must not be used).
+/// Returns whether a reference was added.
+bool Flow::inc_ref_if_live()
 {
-  ++_refs;
-  TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
+  int refs = _refs;
+
+  do
+  {
+    if (refs == 0)
+    {
+      TRC_DEBUG("Flow %p is being removed", this);
+      return false;
+    }
+  }
+  while (!_refs.compare_exchange_weak(refs, refs + 1));
+
+  TRC_DEBUG("Reference count now %d for flow %p", refs + 1, this);
+  return true;
 }
 
 
@@ -579,17 +659,15 @@ void Flow::inc_ref()
 /// to zero.
 void Flow::dec_ref()
 {
-  pthread_mutex_lock(&_flow_table->_flow_map_lock);
+  int refs = --_refs;
 
-  if ((--_refs) == 0)
+  if (refs == 0)
   {
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
     _flow_table->remove_flow(this);
   }
   else
   {
-    TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
+    TRC_DEBUG("Reference count now %d for flow %p", refs, this);
   }
 }
 
@@ -66,37 +66,24 @@ static bool sdm_access_common(SubscriberDataManager::AoRPair** aor_pair,
     }
     else
     {
-      std::vector<SubscriberDataManager*>::iterator it = remote_sdms.begin();
-      SubscriberDataManager::AoRPair* local_backup_aor_pair = NULL;
-
-      while ((it != remote_sdms.end()) && (!found_binding))
-      {
-        if ((*it)->has_servers())
-        {
-          local_backup_aor_pair = (*it)->get_aor_data(aor_id, trail);
-
-          if ((local_backup_aor_pair != NULL) &&
-              (local_backup_aor_pair->current_contains_bindings()))
+      SubscriberDataManager::AoRPair* local_backup_aor_pair =
+        SubscriberDataManager::get_aor_data_from_any(
+          remote_sdms,
+          aor_id,
+          [](SubscriberDataManager::AoRPair* aor_pair)
           {
-            found_binding = true;
-            backup_aor_pair = local_backup_aor_pair;
-
-            // Flag that we have allocated the memory for the backup pair so
-            // that we can tidy it up later.
-            backup_aor_pair_alloced = true;
-          }
-        }
+            return aor_pair->current_contains_bindings();
+          },
+          trail);
 
-        if (!found_binding)
-        {
-          ++it;
+      if (local_backup_aor_pair != NULL)
+      {
+        found_binding = true;
+        backup_aor_pair = local_backup_aor_pair;
 
-          if (local_backup_aor_pair != NULL)
-          {
-            delete local_backup_aor_pair;
-            local_backup_aor_pair = NULL;
-          }
-        }
+        // Flag that we have allocated the memory for the backup pair so
+        // that we can tidy it up later.
+        backup_aor_pair_alloced = true;
       }
     }
 
@@ -215,7 +202,9 @@ void DeregistrationTask::run()
   delete this;
 }
 
-void AoRTimeoutTask::process_aor_timeout(std::string aor_id)
+void AoRTimeoutTask::process_aor_timeout(const Config* cfg,
+                                         std::string aor_id,
+                                         SAS::TrailId trail)
 {
   bool all_bindings_expired = false;
   TRC_DEBUG("Handling timer pop for AoR id: %s", aor_id.c_str());
@@ -223,22 +212,23 @@ void AoRTimeoutTask::process_aor_timeout(std::string aor_id)
   // Determine the set of IMPUs in the Implicit Registration Set
   AssociatedURIs associated_uris = {};
   std::map<std::string, Ifcs> ifc_map;
-  get_reg_data(_cfg->_hss, aor_id, associated_uris, ifc_map, trail());
+  get_reg_data(cfg->_hss, aor_id, associated_uris, ifc_map, trail);
 
-  SubscriberDataManager::AoRPair* aor_pair = set_aor_data(_cfg->_sdm,
+  SubscriberDataManager::AoRPair* aor_pair = set_aor_data(cfg->_sdm,
                                                           aor_id,
                                                           &associated_uris,
                                                           NULL,
-                                                          _cfg->_remote_sdms,
-                                                          all_bindings_expired);
+                                                          cfg->_remote_sdms,
+                                                          all_bindings_expired,
+                                                          trail);
 
   if (aor_pair != NULL)
   {
     // If we have any remote stores, try to store this in them too.  We don't worry
     // about failures in this case.
     // LCOV_EXCL_START
-    for (std::vector<SubscriberDataManager*>::const_iterator sdm = _cfg->_remote_sdms.begin();
-         sdm != _cfg->_remote_sdms.end();
+    for (std::vector<SubscriberDataManager*>::const_iterator sdm = cfg->_remote_sdms.begin();
+         sdm != cfg->_remote_sdms.end();
          ++sdm)
     {
       if ((*sdm)->has_servers())
@@ -250,7 +240,8 @@ void AoRTimeoutTask::process_aor_timeout(std::string aor_id)
                                                                      &associated_uris,
                                                                      aor_pair,
                                                                      {},
-                                                                     ignored);
+                                                                     ignored,
+                                                                     trail);
         delete remote_aor_pair;
       }
     }
@@ -259,18 +250,18 @@ void AoRTimeoutTask::process_aor_timeout(std::string aor_id)
     if (all_bindings_expired)
     {
       TRC_DEBUG("All bindings have expired based on an AoR Timeout - triggering deregistration at the HSS");
-      SAS::Event event(trail(), SASEvent::REGISTRATION_EXPIRED, 0);
+      SAS::Event event(trail, SASEvent::REGISTRATION_EXPIRED, 0);
       event.add_var_param(aor_id);
       SAS::report_event(event);
 
       // Get the S-CSCF URI off the AoR to put on the SAR.
       SubscriberDataManager::AoR* aor = aor_pair->get_current();
 
-      _cfg->_hss->update_registration_state(aor_id, "", HSSConnection::DEREG_TIMEOUT, aor->_scscf_uri, trail());
+      cfg->_hss->update_registration_state(aor_id, "", HSSConnection::DEREG_TIMEOUT, aor->_scscf_uri, trail);
     }
     else
     {
-      SAS::Event event(trail(), SASEvent::SOME_BINDINGS_EXPIRED, 0);
+      SAS::Event event(trail, SASEvent::SOME_BINDINGS_EXPIRED, 0);
       event.add_var_param(aor_id);
       SAS::report_event(event);
     }
@@ -284,7 +275,26 @@ void AoRTimeoutTask::process_aor_timeout(std::string aor_id)
   }
 
   delete aor_pair;
-  report_sip_all_register_marker(trail(), aor_id);
+  report_sip_all_register_marker(trail, aor_id);
+}
+
+void AoRExpiryCallback::run()
+{
+  for (std::vector<std::string>::const_iterator it = _aor_ids.begin();
+       it != _aor_ids.end();
+       ++it)
+  {
+    // Each AoR gets its own trail, as it would for a timer pop from Chronos.
+    SAS::TrailId trail = SAS::new_trail(1u);
+
+    SAS::Marker start_marker(trail, MARKER_ID_START, 1u);
+    SAS::report_marker(start_marker);
+
+    AoRTimeoutTask::process_aor_timeout(_cfg, *it, trail);
+
+    SAS::Marker end_marker(trail, MARKER_ID_END, 1u);
+    SAS::report_marker(end_marker);
+  }
 }
 
 SubscriberDataManager::AoRPair* AoRTimeoutTask::set_aor_data(
@@ -293,11 +303,16 @@ SubscriberDataManager::AoRPair* AoRTimeoutTask::set_aor_data(
                           AssociatedURIs* associated_uris,
                           SubscriberDataManager::AoRPair* previous_aor_pair,
                           std::vector<SubscriberDataManager*> remote_sdms,
-                          bool& all_bindings_expired)
+                          bool& all_bindings_expired,
+                          SAS::TrailId trail)
 {
   SubscriberDataManager::AoRPair* aor_pair = NULL;
   Store::Status set_rc;
 
+  // Serialize with other threads updating this AoR, so that the loop only
+  // retries when another node has updated it.
+  StripedLock::Guard write_guard(current_sdm->write_lock(), aor_id);
+
   do
   {
     if (!sdm_access_common(&aor_pair,
@@ -305,7 +320,7 @@ SubscriberDataManager::AoRPair* AoRTimeoutTask::set_aor_data(
                            current_sdm,
                            remote_sdms,
                            previous_aor_pair,
-                           trail()))
+                           trail))
     {
       break;
     }
@@ -313,7 +328,7 @@ SubscriberDataManager::AoRPair* AoRTimeoutTask::set_aor_data(
     set_rc = current_sdm->set_aor_data(aor_id,
                                        associated_uris,
                                        aor_pair,
-                                       trail(),
+                                       trail,
                                        all_bindings_expired);
     if (set_rc != Store::OK)
     {
@@ -465,6 +480,8 @@ void DeregistrationTask::delete_impi_from_store(ImpiStore* store,
   Store::Status store_rc = Store::OK;
   ImpiStore::Impi* impi_obj = NULL;
 
+  StripedLock::Guard write_guard(store->write_lock(), impi);
+
   do
   {
     // Free any IMPI we had from the last loop iteration.
@@ -505,60 +522,67 @@ SubscriberDataManager::AoRPair* DeregistrationTask::deregister_bindings(
   std::map<std::string, Ifcs> ifc_map;
   got_ifcs = get_reg_data(_cfg->_hss, aor_id, associated_uris, ifc_map, trail());
 
-  do
+  // Serialize with other threads updating this AoR while we remove the
+  // bindings.  The lock is released before deregistering with application
+  // servers.
   {
-    if (!sdm_access_common(&aor_pair,
-                           aor_id,
-                           current_sdm,
-                           remote_sdms,
-                           previous_aor_pair,
-                           trail()))
-    {
-      break;
-    }
-
-    std::vector<std::string> binding_ids;
+    StripedLock::Guard write_guard(current_sdm->write_lock(), aor_id);
 
-    for (SubscriberDataManager::AoR::Bindings::const_iterator i =
-           aor_pair->get_current()->bindings().begin();
-         i != aor_pair->get_current()->bindings().end();
-         ++i)
+    do
     {
-      // Get a list of the bindings to iterate over
-      binding_ids.push_back(i->first);
-    }
+      if (!sdm_access_common(&aor_pair,
+                             aor_id,
+                             current_sdm,
+                             remote_sdms,
+                             previous_aor_pair,
+                             trail()))
+      {
+        break;
+      }
 
-    for (std::vector<std::string>::const_iterator i = binding_ids.begin();
-         i != binding_ids.end();
-         ++i)
-    {
-      std::string b_id = *i;
-      SubscriberDataManager::AoR::Binding* b =
-                                  aor_pair->get_current()->get_binding(b_id);
+      std::vector<std::string> binding_ids;
 
-      if (private_id.empty() || private_id == b->_private_id)
+      for (SubscriberDataManager::AoR::Bindings::const_iterator i =
+             aor_pair->get_current()->bindings().begin();
+           i != aor_pair->get_current()->bindings().end();
+           ++i)
       {
-        if (!b->_private_id.empty())
+        // Get a list of the bindings to iterate over
+        binding_ids.push_back(i->first);
+      }
+
+      for (std::vector<std::string>::const_iterator i = binding_ids.begin();
+           i != binding_ids.end();
+           ++i)
+      {
+        std::string b_id = *i;
+        SubscriberDataManager::AoR::Binding* b =
+                                    aor_pair->get_current()->get_binding(b_id);
+
+        if (private_id.empty() || private_id == b->_private_id)
         {
-          // Record the IMPIs that we need to delete as a result of deleting
-          // this binding.
-          impis_to_delete.insert(b->_private_id);
+          if (!b->_private_id.empty())
+          {
+            // Record the IMPIs that we need to delete as a result of deleting
+            // this binding.
+            impis_to_delete.insert(b->_private_id);
+          }
+          aor_pair->get_current()->remove_binding(b_id);
         }
-        aor_pair->get_current()->remove_binding(b_id);
       }
-    }
 
-    set_rc = current_sdm->set_aor_data(aor_id,
-                                       &associated_uris,
-                                       aor_pair,
-                                       trail(),
-                                       all_bindings_expired);
-    if (set_rc != Store::OK)
-    {
-      delete aor_pair; aor_pair = NULL;
+      set_rc = current_sdm->set_aor_data(aor_id,
+                                         &associated_uris,
+                                         aor_pair,
+                                         trail(),
+                                         all_bindings_expired);
+      if (set_rc != Store::OK)
+      {
+        delete aor_pair; aor_pair = NULL;
+      }
     }
+    while (set_rc == Store::DATA_CONTENTION);
   }
-  while (set_rc == Store::DATA_CONTENTION);
 
   if (private_id == "")
   {
@@ -43,7 +43,8 @@ HSSConnection::HSSConnection(const std::string& server,
                              SNMP::EventAccumulatorTable* homestead_uar_latency_tbl,
                              SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                              CommunicationMonitor* comm_monitor,
-                             SIFCService* sifc_service) :
+                             SIFCService* sifc_service,
+                             RegDataCache* reg_data_cache) :
   _http(new HttpConnection(server,
                            false,
                            resolver,
@@ -56,13 +57,19 @@ HSSConnection::HSSConnection(const std::string& server,
   _sar_latency_tbl(homestead_sar_latency_tbl),
   _uar_latency_tbl(homestead_uar_latency_tbl),
   _lir_latency_tbl(homestead_lir_latency_tbl),
-  _sifc_service(sifc_service)
+  _sifc_service(sifc_service),
+  _reg_data_cache(reg_data_cache),
+  _async_pool(NULL)
 {
 }
 
 
 HSSConnection::~HSSConnection()
 {
+  // Complete any outstanding asynchronous queries before tearing down the
+  // connection they use.
+  delete _async_pool; _async_pool = NULL;
+
   delete _http;
   _http = NULL;
 }
@@ -700,6 +707,43 @@ HTTPCode HSSConnection::update_registration_state(const std::string& public_user
   event.add_var_param(type);
   SAS::report_event(event);
 
+  // Any cached registration data is about to be out of date.  We only cache
+  // the new data if Homestead was allowed to use its own cache (otherwise the
+  // state is changing under us) and the subscriber is still registered.
+  bool cache_reg_data = false;
+  uint64_t cache_generation = 0;
+
+  if (_reg_data_cache != NULL)
+  {
+    if ((cache_allowed) && (type == CALL))
+    {
+      // A call to a registered subscriber doesn't change its state, so if we
+      // have its data cached there's no need to ask Homestead.
+      std::shared_ptr<const RegDataCache::RegData> data =
+                                    _reg_data_cache->get(public_user_identity);
+
+      if ((data) && (data->regstate == RegDataXMLUtils::STATE_REGISTERED))
+      {
+        TRC_DEBUG("Using cached registration data for %s",
+                  public_user_identity.c_str());
+        SAS::Event cached(trail, SASEvent::HOMESTEAD_REG_DATA_CACHED, 0);
+        cached.add_var_param(public_user_identity);
+        SAS::report_event(cached);
+
+        regstate = data->regstate;
+        ifcs_map = data->ifcs_map;
+        associated_uris = data->associated_uris;
+        aliases = data->aliases;
+        ccfs = data->ccfs;
+        ecfs = data->ecfs;
+        return HTTP_OK;
+      }
+    }
+
+    cache_generation = _reg_data_cache->invalidate(public_user_identity);
+    cache_reg_data = ((cache_allowed) && ((type == REG) || (type == CALL)));
+  }
+
   std::string path = "/impu/" + Utils::url_escape(public_user_identity) + "/reg-data";
   if (!private_user_identity.empty())
   {
@@ -746,17 +790,49 @@ HTTPCode HSSConnection::update_registration_state(const std::string& public_user
     return http_code;
   }
 
-  return decode_homestead_xml(public_user_identity,
-                              root,
-                              regstate,
-                              ifcs_map,
-                              associated_uris,
-                              aliases,
-                              ccfs,
-                              ecfs,
-                              _sifc_service,
-                              false,
-                              trail) ? HTTP_OK : HTTP_SERVER_ERROR;
+  if (!decode_homestead_xml(public_user_identity,
+                            root,
+                            regstate,
+                            ifcs_map,
+                            associated_uris,
+                            aliases,
+                            ccfs,
+                            ecfs,
+                            _sifc_service,
+                            false,
+                            trail))
+  {
+    return HTTP_SERVER_ERROR;
+  }
+
+  if (cache_reg_data)
+  {
+    // Homestead has just told us the current state of the subscriber, so
+    // refresh the cache (unless another registration has happened since).
+    // The implicit registration set may have changed, so discard anything
+    // cached for the other IMPUs in it.
+    RegDataCache::RegData data;
+    data.regstate = regstate;
+    data.ifcs_map = ifcs_map;
+    data.associated_uris = associated_uris;
+    data.aliases = aliases;
+    data.ccfs = ccfs;
+    data.ecfs = ecfs;
+    _reg_data_cache->put(public_user_identity, data, cache_generation, true);
+  }
+  else if ((_reg_data_cache != NULL) &&
+           ((type == DEREG_USER) ||
+            (type == DEREG_ADMIN) ||
+            (type == DEREG_TIMEOUT) ||
+            (type == AUTH_TIMEOUT) ||
+            (type == AUTH_FAIL)))
+  {
+    // The whole implicit registration set has been deregistered.  The other
+    // IMPUs in it may be cached even if this one wasn't.
+    _reg_data_cache->invalidate_irs(associated_uris);
+  }
+
+  return HTTP_OK;
 }
 
 HTTPCode HSSConnection::get_registration_data(const std::string& public_user_identity,
@@ -791,6 +867,33 @@ HTTPCode HSSConnection::get_registration_data(const std::string& public_user_ide
   event.add_var_param(public_user_identity);
   SAS::report_event(event);
 
+  uint64_t cache_generation = 0;
+
+  if (_reg_data_cache != NULL)
+  {
+    // Read the generation before the cache, so that if the data is
+    // invalidated after we miss the cache we don't cache the response.
+    cache_generation = _reg_data_cache->generation(public_user_identity);
+    std::shared_ptr<const RegDataCache::RegData> data =
+                                    _reg_data_cache->get(public_user_identity);
+
+    if (data)
+    {
+      TRC_DEBUG("Using cached registration data for %s",
+                public_user_identity.c_str());
+      SAS::Event cached(trail, SASEvent::HOMESTEAD_REG_DATA_CACHED, 0);
+      cached.add_var_param(public_user_identity);
+      SAS::report_event(cached);
+
+      regstate = data->regstate;
+      ifcs_map = data->ifcs_map;
+      associated_uris = data->associated_uris;
+      ccfs = data->ccfs;
+      ecfs = data->ecfs;
+      return HTTP_OK;
+    }
+  }
+
   std::string path = "/impu/" + Utils::url_escape(public_user_identity) + "/reg-data";
 
   TRC_DEBUG("Making Homestead request for %s", path.c_str());
@@ -825,18 +928,35 @@ HTTPCode HSSConnection::get_registration_data(const std::string& public_user_ide
   // Return whether the XML was successfully decoded. The XML can be decoded and
   // not return any iFCs (when the subscriber isn't registered), so a successful
   // response shouldn't be taken as a guarantee of iFCs.
-  std::vector<std::string> unused_aliases;
-  return decode_homestead_xml(public_user_identity,
-                              root,
-                              regstate,
-                              ifcs_map,
-                              associated_uris,
-                              unused_aliases,
-                              ccfs,
-                              ecfs,
-                              _sifc_service,
-                              true,
-                              trail) ? HTTP_OK : HTTP_SERVER_ERROR;
+  std::vector<std::string> aliases;
+  if (!decode_homestead_xml(public_user_identity,
+                            root,
+                            regstate,
+                            ifcs_map,
+                            associated_uris,
+                            aliases,
+                            ccfs,
+                            ecfs,
+                            _sifc_service,
+                            true,
+                            trail))
+  {
+    return HTTP_SERVER_ERROR;
+  }
+
+  if (_reg_data_cache != NULL)
+  {
+    RegDataCache::RegData data;
+    data.regstate = regstate;
+    data.ifcs_map = ifcs_map;
+    data.associated_uris = associated_uris;
+    data.aliases = aliases;
+    data.ccfs = ccfs;
+    data.ecfs = ecfs;
+    _reg_data_cache->put(public_user_identity, data, cache_generation);
+  }
+
+  return HTTP_OK;
 }
 
 
@@ -935,3 +1055,141 @@ HTTPCode HSSConnection::get_location_data(const std::string& public_user_identit
 
   return rc;
 }
+
+void HSSConnection::start_async_threads(int num_threads)
+{
+  TRC_STATUS("Starting %d asynchronous HSS query threads", num_threads);
+  _async_pool = new AsyncLookupPool<HTTPCode>(num_threads);
+}
+
+bool HSSConnection::get_auth_vector_async(const std::string& private_user_id,
+                                          const std::string& public_user_id,
+                                          const std::string& auth_type,
+                                          const std::string& resync_auth,
+                                          const std::string& server_name,
+                                          SAS::TrailId trail,
+                                          const AuthVectorCallback& callback)
+{
+  if (_async_pool == NULL)
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Queue asynchronous auth vector query for %s",
+            private_user_id.c_str());
+
+  std::shared_ptr<rapidjson::Document*> doc =
+                       std::make_shared<rapidjson::Document*>((rapidjson::Document*)NULL);
+
+  _async_pool->submit(
+    [=]()
+    {
+      return get_auth_vector(private_user_id,
+                             public_user_id,
+                             auth_type,
+                             resync_auth,
+                             server_name,
+                             *doc,
+                             trail);
+    },
+    [=](const HTTPCode& http_code)
+    {
+      callback(http_code, *doc);
+    });
+
+  return true;
+}
+
+bool HSSConnection::update_registration_state_async(const std::string& public_user_identity,
+                                                    const std::string& private_user_identity,
+                                                    const std::string& type,
+                                                    const std::string& server_name,
+                                                    SAS::TrailId trail,
+                                                    const RegDataCallback& callback)
+{
+  return update_registration_state_async(public_user_identity,
+                                         private_user_identity,
+                                         type,
+                                         server_name,
+                                         true,
+                                         "",
+                                         trail,
+                                         callback);
+}
+
+bool HSSConnection::update_registration_state_async(const std::string& public_user_identity,
+                                                    const std::string& private_user_identity,
+                                                    const std::string& type,
+                                                    const std::string& server_name,
+                                                    bool cache_allowed,
+                                                    const std::string& wildcard,
+                                                    SAS::TrailId trail,
+                                                    const RegDataCallback& callback)
+{
+  if (_async_pool == NULL)
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Queue asynchronous registration state update for %s",
+            public_user_identity.c_str());
+
+  std::shared_ptr<RegData> data = std::make_shared<RegData>();
+
+  _async_pool->submit(
+    [=]()
+    {
+      return update_registration_state(public_user_identity,
+                                       private_user_identity,
+                                       type,
+                                       data->regstate,
+                                       server_name,
+                                       data->service_profiles,
+                                       data->associated_uris,
+                                       data->aliases,
+                                       data->ccfs,
+                                       data->ecfs,
+                                       cache_allowed,
+                                       wildcard,
+                                       trail);
+    },
+    [=](const HTTPCode& http_code)
+    {
+      callback(http_code, data);
+    });
+
+  return true;
+}
+
+bool HSSConnection::get_registration_data_async(const std::string& public_user_identity,
+                                                SAS::TrailId trail,
+                                                const RegDataCallback& callback)
+{
+  if (_async_pool == NULL)
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Queue asynchronous registration data query for %s",
+            public_user_identity.c_str());
+
+  std::shared_ptr<RegData> data = std::make_shared<RegData>();
+
+  _async_pool->submit(
+    [=]()
+    {
+      return get_registration_data(public_user_identity,
+                                   data->regstate,
+                                   data->service_profiles,
+                                   data->associated_uris,
+                                   data->ccfs,
+                                   data->ecfs,
+                                   trail);
+    },
+    [=](const HTTPCode& http_code)
+    {
+      callback(http_code, data);
+    });
+
+  return true;
+}
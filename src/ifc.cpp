@@ -11,6 +11,7 @@
 
 #include <boost/regex.hpp>
 #include <cassert>
+#include <unordered_map>
 
 extern "C" {
 #include <pjlib-util.h>
@@ -44,188 +45,596 @@ using namespace rapidxml;
 #define ORIGINATING_UNREGISTERED 3
 #define ORIGINATING_CDIV 4
 
-Ifc::Ifc(std::string ifc_str,
-         rapidxml::xml_document<>* ifc_doc) :
-  _ifc(NULL)
+/// An error found while compiling an iFC.  The error is not reported when it
+/// is found, but at the point in the evaluation of the iFC where it would be
+/// hit when evaluating the XML directly, so that SAS logging and the result
+/// of the evaluation are the same.
+struct IfcError
 {
-  rapidxml::xml_document<>* new_document = new rapidxml::xml_document<>();
+  IfcError() : set(false), sas_invalid(false) {}
 
-  // We must use a new XML document to parse the string (as it's destructive).
-  // We allocate the string from the passed in document, and then clone the
-  // node into that document, ensuring that the passed in document owns
-  // everything associated with the IFC.
-  char* xml_str = ifc_doc->allocate_string(ifc_str.c_str());
-  new_document->parse<0>(xml_str);
-  _ifc = ifc_doc->clone_node(new_document->first_node());
+  void assign(const std::string& error_text, bool report_invalid)
+  {
+    set = true;
+    text = error_text;
+    sas_invalid = report_invalid;
+  }
+
+  // Throws the error (as an xml_error), logging an invalid iFC event to SAS
+  // first if required.
+  void raise(const std::string& server_name, SAS::TrailId trail) const
+  {
+    if (sas_invalid)
+    {
+      SAS::Event event(trail, SASEvent::IFC_INVALID, 0);
+      event.add_var_param(server_name);
+      event.add_var_param(text);
+      SAS::report_event(event);
+    }
+
+    throw xml_error(text.c_str());
+  }
+
+  bool set;
+  bool sas_invalid;
+  std::string text;
+};
+
+/// A Service Point Trigger, compiled from its XML representation.
+struct CompiledSpt
+{
+  enum SptClass
+  {
+    METHOD,
+    SIP_HEADER,
+    SESSION_CASE,
+    REQUEST_URI,
+    SESSION_DESCRIPTION,
+    UNIMPLEMENTED
+  };
+
+  CompiledSpt() :
+    spt_class(UNIMPLEMENTED),
+    negated(false),
+    is_register(false),
+    has_reg_extension(false),
+    has_content(false),
+    session_case(0)
+  {}
+
+  SptClass spt_class;
+  std::string class_name;
+
+  // Whether the result is negated (and any error parsing ConditionNegated,
+  // which is hit before the SPT is evaluated).
+  bool negated;
+  IfcError negated_error;
+
+  // Any error hit at the start of evaluating the SPT.
+  IfcError error;
+
+  // The groups this SPT belongs to (and any error parsing a group, which is
+  // hit after the SPT is evaluated).
+  std::vector<int32_t> groups;
+  IfcError group_error;
+
+  // Method class.  If the method is REGISTER, the registration types (and
+  // any error parsing the one after the last good one).
+  std::string method;
+  bool is_register;
+  bool has_reg_extension;
+  std::vector<int> reg_types;
+  IfcError reg_type_error;
+
+  // SIPHeader, RequestURI and SessionDescription classes.  The content
+  // regex is only compiled by the XML evaluation when a header or line
+  // matches, so an error compiling it is only hit at that point.
+  boost::regex regex;
+  bool has_content;
+  boost::regex content_regex;
+  IfcError content_error;
+
+  // SessionCase class.
+  int session_case;
+};
+
+/// An iFC compiled from its XML representation.  Evaluating a compiled iFC
+/// does not walk the XML or compile any regular expressions.  Compiled iFCs
+/// are immutable, so are shared between all Ifc objects with identical XML.
+class CompiledIfc
+{
+public:
+  CompiledIfc(xml_node<>* ifc, const std::string& ifc_str);
+
+  bool filter_matches(const SessionCase& session_case,
+                      bool is_registered,
+                      bool is_initial_registration,
+                      pjsip_msg* msg,
+                      SAS::TrailId trail) const;
+
+  const AsInvocation& as_invocation() const { return _as_invocation; }
+
+  /// Returns the compiled form of the passed iFC, from the cache if an
+  /// identical iFC has been compiled before.
+  static std::shared_ptr<const CompiledIfc> get(xml_node<>* ifc);
+
+private:
+  void compile_as(xml_node<>* ifc);
+  void compile_spt(xml_node<>* spt, CompiledSpt& compiled);
+  void compile_spt_class(xml_node<>* node, CompiledSpt& compiled);
+
+  bool spt_matches(const SessionCase& session_case,
+                   bool is_registered,
+                   bool is_initial_registration,
+                   pjsip_msg* msg,
+                   const CompiledSpt& spt,
+                   SAS::TrailId trail) const;
+
+  // The XML of the iFC, for SAS logging.
+  std::string _ifc_str;
+
+  // Errors in the ApplicationServer element, which are reported with an
+  // IFC_INVALID_NOAS event.
+  bool _as_invalid;
+  std::string _as_error;
+  std::string _server_name;
+  AsInvocation _as_invocation;
+
+  bool _has_profile_part_indicator;
+  bool _profile_part_reg;
+  IfcError _profile_part_error;
+
+  bool _has_trigger;
+  bool _cnf;
+  IfcError _cnf_error;
+  std::vector<CompiledSpt> _spts;
+
+  // Cache of compiled iFCs, keyed by the XML of the iFC.  When the cache is
+  // full it is emptied - any compiled iFCs in use are kept alive by the Ifc
+  // objects that reference them.
+  static const size_t MAX_CACHED_IFCS = 10000;
+  static pthread_mutex_t _cache_lock;
+  static std::unordered_map<std::string, std::shared_ptr<const CompiledIfc>> _cache;
+};
+
+pthread_mutex_t CompiledIfc::_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+std::unordered_map<std::string, std::shared_ptr<const CompiledIfc>> CompiledIfc::_cache;
+
+std::shared_ptr<const CompiledIfc> CompiledIfc::get(xml_node<>* ifc)
+{
+  std::string ifc_str;
+  rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
 
-  delete new_document;
+  pthread_mutex_lock(&_cache_lock);
+  std::unordered_map<std::string, std::shared_ptr<const CompiledIfc>>::const_iterator it =
+                                                          _cache.find(ifc_str);
+  if (it != _cache.end())
+  {
+    std::shared_ptr<const CompiledIfc> compiled = it->second;
+    pthread_mutex_unlock(&_cache_lock);
+    return compiled;
+  }
+  pthread_mutex_unlock(&_cache_lock);
+
+  // Compile the iFC without holding the lock.  If another thread compiles
+  // the same iFC at the same time, whichever finishes second just uses the
+  // other's.
+  std::shared_ptr<const CompiledIfc> compiled(new CompiledIfc(ifc, ifc_str));
+
+  pthread_mutex_lock(&_cache_lock);
+  if (_cache.size() >= MAX_CACHED_IFCS)
+  {
+    TRC_DEBUG("Compiled iFC cache is full - emptying it");
+    _cache.clear();
+  }
+  compiled = _cache.insert(std::make_pair(ifc_str, compiled)).first->second;
+  pthread_mutex_unlock(&_cache_lock);
+
+  return compiled;
 }
 
-void Ifc::invalid_ifc(std::string error,
-                      std::string server_name,
-                      int sas_event_id,
-                      int instance_id,
-                      SAS::TrailId trail)
+CompiledIfc::CompiledIfc(xml_node<>* ifc, const std::string& ifc_str) :
+  _ifc_str(ifc_str),
+  _as_invalid(false),
+  _has_profile_part_indicator(false),
+  _profile_part_reg(false),
+  _has_trigger(false),
+  _cnf(false)
 {
-  SAS::Event event(trail, sas_event_id, instance_id);
-  event.add_var_param(server_name);
-  event.add_var_param(error);
-  SAS::report_event(event);
-  throw xml_error(error.c_str());
+  compile_as(ifc);
+
+  xml_node<>* profile_part_indicator = ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
+  if (profile_part_indicator)
+  {
+    _has_profile_part_indicator = true;
+    try
+    {
+      _profile_part_reg = XMLUtils::parse_integer(profile_part_indicator,
+                                                  "ProfilePartIndicator",
+                                                  0,
+                                                  1) == 0;
+    }
+    catch (xml_error err)
+    {
+      _profile_part_error.assign(err.what(), false);
+    }
+  }
+
+  xml_node<>* trigger = ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
+  if (!trigger)
+  {
+    return;
+  }
+
+  _has_trigger = true;
+
+  try
+  {
+    _cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
+                                RegDataXMLUtils::CONDITION_TYPE_CNF);
+  }
+  catch (xml_error err)
+  {
+    _cnf_error.assign(err.what(), false);
+    return;
+  }
+
+  for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
+       spt;
+       spt = spt->next_sibling(RegDataXMLUtils::SPT))
+  {
+    _spts.push_back(CompiledSpt());
+    compile_spt(spt, _spts.back());
+  }
 }
 
-// Test if the SPT matches. Ignores grouping and negation, and just
-// evaluates the service point trigger in the node.
-// @return true if the SPT matches, false if not
-// @throw xml_error if there is a problem evaluating the trigger.
-bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
-                      bool is_registered,               //< The registration state
-                      bool is_initial_registration,
-                      pjsip_msg* msg,                   //< The message being matched
-                      xml_node<>* spt,                  //< The Service Point Trigger node
-                      std::string ifc_str,
-                      std::string server_name,
-                      SAS::TrailId trail)
+void CompiledIfc::compile_as(xml_node<>* ifc)
 {
+  xml_node<>* as = ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
+  if (as == NULL)
+  {
+    _as_invalid = true;
+    _as_error = "iFC missing ApplicationServer element";
+    return;
+  }
+
+  _server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
+  if (_server_name.empty())
+  {
+    _as_invalid = true;
+    _as_error = "iFC has no ServerName";
+    return;
+  }
+
+  // @@@ KSW Parse the URI and ensure it is parsable and a SIP URI
+  // here. If it's invalid, ignore it (seems the only sensible
+  // option).
+  //
+  // That means each AsInvocation would have to belong to a pool,
+  // though, and that's not easy in the current architecture.
+  _as_invocation.server_name = _server_name;
+
+  std::string default_handling =
+                          XMLUtils::get_first_node_value(as, RegDataXMLUtils::DEFAULT_HANDLING);
+  if (default_handling == "0")
+  {
+    // DefaultHandling is present and set to 0, which is SESSION_CONTINUED.
+    _as_invocation.default_handling = SESSION_CONTINUED;
+  }
+  else if (default_handling == "1")
+  {
+    // DefaultHandling is present and set to 1, which is SESSION_TERMINATED.
+    _as_invocation.default_handling = SESSION_TERMINATED;
+  }
+  else
+  {
+    // If the DefaultHandling attribute isn't present, or is malformed, default
+    // to SESSION_CONTINUED.
+    TRC_WARNING("Badly formed DefaultHandling element in iFC (%s), defaulting to SESSION_CONTINUED",
+                default_handling.c_str());
+    _as_invocation.default_handling = SESSION_CONTINUED;
+  }
+  _as_invocation.service_info = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVICE_INFO);
+
+  xml_node<>* as_ext = as->first_node(RegDataXMLUtils::EXTENSION);
+  if (as_ext)
+  {
+    _as_invocation.include_register_request =
+              XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_REQ);
+    _as_invocation.include_register_response =
+             XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_RSP);
+  }
+  else
+  {
+    _as_invocation.include_register_request = false;
+    _as_invocation.include_register_response = false;
+  }
+}
+
+void CompiledIfc::compile_spt(xml_node<>* spt, CompiledSpt& compiled)
+{
+  xml_node<>* neg_node = spt->first_node(RegDataXMLUtils::CONDITION_NEGATED);
+  try
+  {
+    compiled.negated = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+  }
+  catch (xml_error err)
+  {
+    compiled.negated_error.assign(err.what(), false);
+  }
+
   // Find the class node.
   xml_node<>* node = spt->first_node();
-  const char* name = NULL;
 
   for (; node; node = node->next_sibling())
   {
-    name = node->name();
+    const char* name = node->name();
 
     if ((strcmp(name, RegDataXMLUtils::CONDITION_NEGATED) != 0) &&
         (strcmp(name, RegDataXMLUtils::GROUP) != 0))
     {
       if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
       {
-        invalid_ifc("Missing class for service point trigger", server_name, SASEvent::IFC_INVALID, 0, trail);
-      }
-      else
-      {
-        break;
+        node = NULL;
       }
+      break;
     }
   }
 
   if (!node)
   {
-    invalid_ifc("Missing class for service point trigger", server_name, SASEvent::IFC_INVALID, 0, trail);
+    compiled.error.assign("Missing class for service point trigger", true);
+  }
+  else
+  {
+    compile_spt_class(node, compiled);
   }
 
-  // Now interpret the node depending on its class.
-  bool ret = false;
+  for (xml_node<>* group_node = spt->first_node(RegDataXMLUtils::GROUP);
+       group_node;
+       group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+  {
+    try
+    {
+      compiled.groups.push_back(XMLUtils::parse_integer(group_node,
+                                                        "Group ID",
+                                                        0,
+                                                        std::numeric_limits<int32_t>::max()));
+    }
+    catch (xml_error err)
+    {
+      compiled.group_error.assign(err.what(), false);
+      break;
+    }
+  }
+}
+
+void CompiledIfc::compile_spt_class(xml_node<>* node, CompiledSpt& compiled)
+{
+  const char* name = node->name();
+  compiled.class_name = name;
 
   if (strcmp(RegDataXMLUtils::METHOD, name) == 0)
   {
+    compiled.spt_class = CompiledSpt::METHOD;
+    compiled.method = node->value();
+    compiled.is_register = (compiled.method == "REGISTER");
+
     // If we have a REGISTER we may need to match on RegistrationType.
-    if ((strcmp("REGISTER", node->value()) == 0) &&
-        (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0))
+    xml_node<>* ext = node->next_sibling();
+    if ((compiled.is_register) &&
+        (ext) &&
+        (strcmp(ext->name(), RegDataXMLUtils::EXTENSION) == 0))
     {
-      ret = true;
-      node = node->next_sibling();
-      if (node)
+      compiled.has_reg_extension = true;
+
+      for (xml_node<>* reg_type_node = ext->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
+           reg_type_node;
+           reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
       {
-        name = node->name();
-        if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
+        try
         {
-          for (xml_node<>* reg_type_node = node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
-               reg_type_node;
-               reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
-          {
-            name = reg_type_node->name();
-            int reg_type = XMLUtils::parse_integer(reg_type_node,
-                                                   "registration type",
-                                                   0,
-                                                   2);
-
-            // Find expiry value from SIP message if it is present to determine
-            // whether we have a de-registration.  Set an arbitrary default value of
-            // an hour.
-            pj_bool_t dereg = PJUtils::is_deregistration(msg);
-
-            switch (reg_type)
-            {
-            case INITIAL_REGISTRATION:
-              ret = (is_initial_registration && !dereg);
-              break;
-            case REREGISTRATION:
-              ret = (!is_initial_registration && !dereg);
-              break;
-            case DEREGISTRATION:
-              ret = dereg;
-              break;
-            default:
-              // LCOV_EXCL_START Unreachable
-              TRC_WARNING("Impossible case %d", reg_type);
-              ret = false;
-              break;
-              // LCOV_EXCL_STOP
-            }
-
-            // If we've found a match, break out of the for loop.
-            if (ret)
-            {
-              break;
-            }
-          }
+          compiled.reg_types.push_back(XMLUtils::parse_integer(reg_type_node,
+                                                               "registration type",
+                                                               0,
+                                                               2));
+        }
+        catch (xml_error err)
+        {
+          compiled.reg_type_error.assign(err.what(), false);
+          break;
         }
       }
     }
-    else
-    {
-      ret = (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0);
-    }
   }
   else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
   {
+    compiled.spt_class = CompiledSpt::SIP_HEADER;
     xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
     xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex header_regex;
-    boost::regex content_regex;
-    pjsip_hdr* header = NULL;
 
     if (!spt_header)
     {
-      invalid_ifc("Missing Header element for SIPHeader service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
+      compiled.error.assign("Missing Header element for SIPHeader service point trigger", true);
+      return;
+    }
+
+    compiled.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
+                                  boost::regex_constants::icase |
+                                  boost::regex_constants::no_except);
+    if (compiled.regex.status())
+    {
+      compiled.error.assign("Invalid regular expression in Header element for SIPHeader service point trigger", true);
+      return;
+    }
+
+    if (spt_content)
+    {
+      compiled.has_content = true;
+      compiled.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                            boost::regex_constants::no_except);
+      if (compiled.content_regex.status())
+      {
+        compiled.content_error.assign("Invalid regular expression in Content element for SIPHeader service point trigger", true);
+      }
+    }
+  }
+  else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::SESSION_CASE;
+    try
+    {
+      compiled.session_case = XMLUtils::parse_integer(node, "session case", 0, 4);
+    }
+    catch (xml_error err)
+    {
+      compiled.error.assign(err.what(), false);
+    }
+  }
+  else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::REQUEST_URI;
+    compiled.regex = boost::regex(XMLUtils::get_text_or_cdata(node),
+                                  boost::regex_constants::no_except);
+    if (compiled.regex.status())
+    {
+      compiled.error.assign("Invalid regular expression in Request URI service point trigger", true);
+    }
+  }
+  else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
+  {
+    compiled.spt_class = CompiledSpt::SESSION_DESCRIPTION;
+    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
+    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
+
+    if (!spt_line)
+    {
+      compiled.error.assign("Missing Line element for SessionDescription service point trigger", true);
+      return;
     }
 
-    header_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
-                                boost::regex_constants::icase |
-                                boost::regex_constants::no_except);
-    if (header_regex.status())
+    compiled.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
+                                  boost::regex_constants::no_except);
+    if (compiled.regex.status())
     {
-      invalid_ifc("Invalid regular expression in Header element for SIPHeader service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
+      compiled.error.assign("Invalid regular expression in Line element for Session Description service point trigger", true);
+      return;
     }
 
-    for (header = msg->hdr.next; header != &msg->hdr; header = header->next)
+    if (spt_content)
+    {
+      compiled.has_content = true;
+      compiled.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                            boost::regex_constants::no_except);
+      if (compiled.content_regex.status())
+      {
+        compiled.content_error.assign("Invalid regular expression in Content element for Session Description service point trigger", true);
+      }
+    }
+  }
+  else
+  {
+    compiled.spt_class = CompiledSpt::UNIMPLEMENTED;
+  }
+}
+
+// Test if the SPT matches. Ignores grouping and negation, and just
+// evaluates the service point trigger.
+// @return true if the SPT matches, false if not
+// @throw xml_error if there is a problem evaluating the trigger.
+bool CompiledIfc::spt_matches(const SessionCase& session_case,  //< The session case
+                              bool is_registered,               //< The registration state
+                              bool is_initial_registration,
+                              pjsip_msg* msg,                   //< The message being matched
+                              const CompiledSpt& spt,           //< The Service Point Trigger
+                              SAS::TrailId trail) const
+{
+  if (spt.error.set)
+  {
+    spt.error.raise(_server_name, trail);
+  }
+
+  // Now interpret the node depending on its class.
+  bool ret = false;
+
+  switch (spt.spt_class)
+  {
+  case CompiledSpt::METHOD:
+    // If we have a REGISTER we may need to match on RegistrationType.
+    if ((spt.is_register) &&
+        (pj_strcmp2(&msg->line.req.method.name, spt.method.c_str()) == 0))
     {
-      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), header_regex))
+      ret = true;
+
+      if (spt.has_reg_extension)
       {
-        if (!spt_content)
+        // Find expiry value from SIP message if it is present to determine
+        // whether we have a de-registration.
+        pj_bool_t dereg = PJUtils::is_deregistration(msg);
+        bool matched = false;
+
+        for (std::vector<int>::const_iterator reg_type = spt.reg_types.begin();
+             reg_type != spt.reg_types.end();
+             ++reg_type)
+        {
+          switch (*reg_type)
+          {
+          case INITIAL_REGISTRATION:
+            ret = (is_initial_registration && !dereg);
+            break;
+          case REREGISTRATION:
+            ret = (!is_initial_registration && !dereg);
+            break;
+          case DEREGISTRATION:
+            ret = dereg;
+            break;
+          default:
+            // LCOV_EXCL_START Unreachable
+            TRC_WARNING("Impossible case %d", *reg_type);
+            ret = false;
+            break;
+            // LCOV_EXCL_STOP
+          }
+
+          // If we've found a match, break out of the for loop.
+          if (ret)
+          {
+            matched = true;
+            break;
+          }
+        }
+
+        if ((!matched) && (spt.reg_type_error.set))
+        {
+          spt.reg_type_error.raise(_server_name, trail);
+        }
+      }
+    }
+    else
+    {
+      ret = (pj_strcmp2(&msg->line.req.method.name, spt.method.c_str()) == 0);
+    }
+    break;
+
+  case CompiledSpt::SIP_HEADER:
+    for (pjsip_hdr* header = msg->hdr.next; header != &msg->hdr; header = header->next)
+    {
+      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), spt.regex))
+      {
+        if (!spt.has_content)
         {
           // We've found a matching header, and don't have to match on content
           ret = true;
         }
         else
         {
-          std::string header_value = PJUtils::get_header_value(header);
-          // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once
-          if (content_regex.status())
+          if (spt.content_error.set)
           {
-            content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                         boost::regex_constants::no_except);
-            if (content_regex.status())
-            {
-              invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
-                          server_name, SASEvent::IFC_INVALID, 0, trail);
-            }
+            spt.content_error.raise(_server_name, trail);
           }
 
-          if (boost::regex_search(header_value, content_regex))
+          std::string header_value = PJUtils::get_header_value(header);
+          if (boost::regex_search(header_value, spt.content_regex))
           {
             // We've found a matching header, and have matching content in one field
             ret = true;
@@ -238,11 +647,10 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         break;
       }
     }
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
-  {
-    int direction = XMLUtils::parse_integer(node, "session case", 0, 4);
-    switch (direction)
+    break;
+
+  case CompiledSpt::SESSION_CASE:
+    switch (spt.session_case)
     {
     case ORIGINATING_REGISTERED:
       ret = (session_case == SessionCase::Originating) && is_registered;
@@ -261,72 +669,46 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
       break;
     default:
       // LCOV_EXCL_START Unreachable
-      TRC_WARNING("Impossible case %d", direction);
+      TRC_WARNING("Impossible case %d", spt.session_case);
       ret = false;
       break;
     // LCOV_EXCL_STOP
     }
-  }
-  else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
-  {
-    boost::regex req_uri_regex;
-    std::string test_string;
-
-    if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
-    {
-      pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+    break;
 
-      // Match against the telephone-subscriber part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      test_string = PJUtils::pj_str_to_string(&req_uri->number);
-    }
-    else
+  case CompiledSpt::REQUEST_URI:
     {
-      pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // Compare against the hostport part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
+      std::string test_string;
 
-      if (req_uri->port != 0)
+      if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
       {
-        hostport += ":" + std::to_string(req_uri->port);
+        pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+        // Match against the telephone-subscriber part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        test_string = PJUtils::pj_str_to_string(&req_uri->number);
       }
+      else
+      {
+        pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
 
-      test_string = hostport;
-    }
+        // Compare against the hostport part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
 
-    req_uri_regex = boost::regex(XMLUtils::get_text_or_cdata(node),
-                                 boost::regex_constants::no_except);
-    if (req_uri_regex.status())
-    {
-      invalid_ifc("Invalid regular expression in Request URI service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
-    }
-    ret = boost::regex_search(test_string, req_uri_regex);
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
-  {
-    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
-    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex line_regex;
-    boost::regex content_regex;
-    char newline = '\n';
+        if (req_uri->port != 0)
+        {
+          hostport += ":" + std::to_string(req_uri->port);
+        }
 
-    if (!spt_line)
-    {
-      invalid_ifc("Missing Line element for SessionDescription service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
-    }
+        test_string = hostport;
+      }
 
-    line_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
-                              boost::regex_constants::no_except);
-    if (line_regex.status())
-    {
-      invalid_ifc("Invalid regular expression in Line element for Session Description service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
+      ret = boost::regex_search(test_string, spt.regex);
     }
+    break;
 
+  case CompiledSpt::SESSION_DESCRIPTION:
     // Check if the message body is SDP.
     if (msg->body &&
         (!pj_stricmp2(&msg->body->content_type.type, "application")) &&
@@ -337,29 +719,23 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         // Split the message body into each SDP line.
         std::stringstream sdp((char *)msg->body->data);
         std::string sdp_line;
+        char newline = '\n';
         while((std::getline(sdp, sdp_line, newline)) && (ret == false))
         {
           // Match the line regex on the first character of the SDP line.
           std::string sdp_identifier(1, sdp_line[0]);
-          if (boost::regex_search(sdp_identifier, line_regex))
+          if (boost::regex_search(sdp_identifier, spt.regex))
           {
-            if (!spt_content)
+            if (!spt.has_content)
             {
               // We've found a matching line type, and don't have to match on content.
               ret = true;
             }
             else
             {
-              // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once.
-              if (content_regex.status())
+              if (spt.content_error.set)
               {
-                content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                             boost::regex_constants::no_except);
-                if (content_regex.status())
-                {
-                  invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
-                              server_name, SASEvent::IFC_INVALID, 0, trail);
-                }
+                spt.content_error.raise(_server_name, trail);
               }
 
               // Check the second character of the line is an equals sign, and then
@@ -367,7 +743,7 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
               if (sdp_line.find_first_of("=") == 1)
               {
                 sdp_line.erase(0,2);
-                if (boost::regex_search(sdp_line, content_regex))
+                if (boost::regex_search(sdp_line, spt.content_regex))
                 {
                   // We've found a matching line.
                   ret = true;
@@ -382,14 +758,16 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         }
       }
     }
-  }
-  else
-  {
-    TRC_WARNING("Unimplemented iFC service point trigger class: %s", name);
+    break;
+
+  default:
+    TRC_WARNING("Unimplemented iFC service point trigger class: %s",
+                spt.class_name.c_str());
     ret = false;
+    break;
   }
 
-  TRC_DEBUG("SPT class %s: result %s", name, ret ? "true" : "false");
+  TRC_DEBUG("SPT class %s: result %s", spt.class_name.c_str(), ret ? "true" : "false");
   return ret;
 }
 
@@ -398,149 +776,127 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
 // B, C, and F in that document for details.
 //
 // @return true if the message matches, false if not.
-bool Ifc::filter_matches(const SessionCase& session_case,
-                         bool is_registered,
-                         bool is_initial_registration,
-                         pjsip_msg* msg,
-                         SAS::TrailId trail) const
+bool CompiledIfc::filter_matches(const SessionCase& session_case,
+                                 bool is_registered,
+                                 bool is_initial_registration,
+                                 pjsip_msg* msg,
+                                 SAS::TrailId trail) const
 {
-  std::string ifc_str;
-  rapidxml::print(std::back_inserter(ifc_str), *_ifc, 0);
-
   SAS::Event event(trail, SASEvent::IFC_TESTING, 0);
-  event.add_compressed_param(ifc_str, &SASEvent::PROFILE_SERVICE_PROFILE);
+  event.add_compressed_param(_ifc_str, &SASEvent::PROFILE_SERVICE_PROFILE);
   SAS::report_event(event);
-  std::string server_name;
 
   try
   {
-    xml_node<>* as = _ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
-    if (as == NULL)
+    if (_as_invalid)
     {
-      std::string error_msg = "iFC missing ApplicationServer element";
-
       SAS::Event event(trail, SASEvent::IFC_INVALID_NOAS, 0);
       SAS::report_event(event);
 
-      throw xml_error(error_msg);
+      throw xml_error(_as_error);
     }
 
-    server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
-    if (server_name.empty())
+    if (_has_profile_part_indicator)
     {
-      std::string error_msg = "iFC has no ServerName";
-
-      SAS::Event event(trail, SASEvent::IFC_INVALID_NOAS, 0);
-      SAS::report_event(event);
-
-      throw xml_error(error_msg);
-    }
+      if (_profile_part_error.set)
+      {
+        _profile_part_error.raise(_server_name, trail);
+      }
 
-    xml_node<>* profile_part_indicator = _ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
-    if (profile_part_indicator)
-    {
-      bool reg = XMLUtils::parse_integer(profile_part_indicator,
-                                         "ProfilePartIndicator",
-                                         0,
-                                         1) == 0;
-      if (reg != is_registered)
+      if (_profile_part_reg != is_registered)
       {
-        std::string reg_state = reg ? "reg" : "unreg";
+        std::string reg_state = _profile_part_reg ? "reg" : "unreg";
         std::string reason = "iFC ProfilePartIndicator " + reg_state + " doesn't match";
         TRC_DEBUG(reason.c_str());
 
         SAS::Event event(trail, SASEvent::IFC_NOT_MATCHED_PPI, 0);
-        event.add_var_param(server_name);
+        event.add_var_param(_server_name);
         SAS::report_event(event);
 
         return false;
       }
     }
 
-    // @@@ KSW Parse the URI and ensure it is parsable and a SIP URI
-    // here. If it's invalid, ignore it (seems the only sensible
-    // option).
-    //
-    // That means each AsInvocation would have to belong to a pool,
-    // though, and that's not easy in the current architecture.
-
-    xml_node<>* trigger = _ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
-    if (!trigger)
+    if (!_has_trigger)
     {
       TRC_DEBUG("iFC has no trigger point - unconditional match");  // 3GPP TS 29.228 sB.2.2
 
       SAS::Event event(trail, SASEvent::IFC_MATCHED, 0);
-      event.add_var_param(server_name);
+      event.add_var_param(_server_name);
       SAS::report_event(event);
 
       return true;
     }
 
-    bool cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
-                                    RegDataXMLUtils::CONDITION_TYPE_CNF);
+    if (_cnf_error.set)
+    {
+      _cnf_error.raise(_server_name, trail);
+    }
 
     // In CNF (conjunct-of-disjuncts, i.e., big-AND of ORs), as we
     // work through each SPT we OR it into its group(s). At the end,
     // we AND all the groups together. In DNF we do the converse.
     std::map<int32_t, bool> groups;
 
-    for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
-         spt;
-         spt = spt->next_sibling(RegDataXMLUtils::SPT))
+    for (std::vector<CompiledSpt>::const_iterator spt = _spts.begin();
+         spt != _spts.end();
+         ++spt)
     {
-      xml_node<>* neg_node = spt->first_node(RegDataXMLUtils::CONDITION_NEGATED);
-      bool neg = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+      if (spt->negated_error.set)
+      {
+        spt->negated_error.raise(_server_name, trail);
+      }
+
       bool val = spt_matches(session_case,
                              is_registered,
                              is_initial_registration,
                              msg,
-                             spt,
-                             ifc_str,
-                             server_name,
-                             trail) != neg;
-
-      for (xml_node<>* group_node = spt->first_node(RegDataXMLUtils::GROUP);
-           group_node;
-           group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+                             *spt,
+                             trail) != spt->negated;
+
+      for (std::vector<int32_t>::const_iterator group = spt->groups.begin();
+           group != spt->groups.end();
+           ++group)
       {
-        int32_t group = XMLUtils::parse_integer(group_node,
-                                                "Group ID",
-                                                0,
-                                                std::numeric_limits<int32_t>::max());
-        TRC_DEBUG("Add to group %d val %s", (int)group, val ? "true" : "false");
-        if (groups.find(group) == groups.end())
+        TRC_DEBUG("Add to group %d val %s", (int)*group, val ? "true" : "false");
+        if (groups.find(*group) == groups.end())
         {
-          groups[group] = val;
+          groups[*group] = val;
         }
         else
         {
-          groups[group] = cnf ? (groups[group] || val) : (groups[group] && val);
+          groups[*group] = _cnf ? (groups[*group] || val) : (groups[*group] && val);
         }
       }
+
+      if (spt->group_error.set)
+      {
+        spt->group_error.raise(_server_name, trail);
+      }
     }
 
-    bool ret = cnf;
+    bool ret = _cnf;
 
     for (std::map<int32_t, bool>::iterator it = groups.begin();
          it != groups.end();
          ++it)
     {
       TRC_DEBUG("Result group %d val %s", (int)it->first, it->second ? "true" : "false");
-      ret = cnf ? (ret && it->second) : (ret || it->second);
+      ret = _cnf ? (ret && it->second) : (ret || it->second);
     }
 
     if (ret)
     {
       TRC_DEBUG("iFC matches");
       SAS::Event event(trail, SASEvent::IFC_MATCHED, 0);
-      event.add_var_param(server_name);
+      event.add_var_param(_server_name);
       SAS::report_event(event);
     }
     else
     {
       TRC_DEBUG("iFC does not match");
       SAS::Event event(trail, SASEvent::IFC_NOT_MATCHED, 0);
-      event.add_var_param(server_name);
+      event.add_var_param(_server_name);
       SAS::report_event(event);
     }
 
@@ -556,61 +912,40 @@ bool Ifc::filter_matches(const SessionCase& session_case,
   }
 }
 
+Ifc::Ifc(rapidxml::xml_node<>* ifc) :
+  _ifc(ifc),
+  _compiled(CompiledIfc::get(ifc))
+{
+}
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc,
+         std::shared_ptr<rapidxml::xml_document<> > ifc_doc) :
+  _ifc(ifc),
+  _ifc_doc(ifc_doc),
+  _compiled(CompiledIfc::get(ifc))
+{
+}
+
+bool Ifc::filter_matches(const SessionCase& session_case,
+                         bool is_registered,
+                         bool is_initial_registration,
+                         pjsip_msg* msg,
+                         SAS::TrailId trail) const
+{
+  return _compiled->filter_matches(session_case,
+                                   is_registered,
+                                   is_initial_registration,
+                                   msg,
+                                   trail);
+}
+
 /// Return the AsInvocation corresponding to this iFC.
 //
 // Only safe to call if filter_matches has returned true (to validate
 // the iFC).
 AsInvocation Ifc::as_invocation() const
 {
-  xml_node<>* as = _ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
-  pj_assert(as != NULL);
-
-  AsInvocation as_invocation;
-  as_invocation.server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
-
-  // @@@ KSW Parse the URI and ensure it is parsable and a SIP URI
-  // here. If it's invalid, ignore it (seems the only sensible
-  // option).
-  //
-  // That means each AsInvocation would have to belong to a pool,
-  // though, and that's not easy in the current architecture.
-
-  std::string default_handling =
-                          XMLUtils::get_first_node_value(as, RegDataXMLUtils::DEFAULT_HANDLING);
-  if (default_handling == "0")
-  {
-    // DefaultHandling is present and set to 0, which is SESSION_CONTINUED.
-    as_invocation.default_handling = SESSION_CONTINUED;
-  }
-  else if (default_handling == "1")
-  {
-    // DefaultHandling is present and set to 1, which is SESSION_TERMINATED.
-    as_invocation.default_handling = SESSION_TERMINATED;
-  }
-  else
-  {
-    // If the DefaultHandling attribute isn't present, or is malformed, default
-    // to SESSION_CONTINUED.
-    TRC_WARNING("Badly formed DefaultHandling element in iFC (%s), defaulting to SESSION_CONTINUED",
-                default_handling.c_str());
-    as_invocation.default_handling = SESSION_CONTINUED;
-  }
-  as_invocation.service_info = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVICE_INFO);
-
-  xml_node<>* as_ext = as->first_node(RegDataXMLUtils::EXTENSION);
-  if (as_ext)
-  {
-    as_invocation.include_register_request =
-              XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_REQ);
-    as_invocation.include_register_response =
-             XMLUtils::does_child_node_exist(as_ext, RegDataXMLUtils::INC_REG_RSP);
-  }
-  else
-  {
-    as_invocation.include_register_request = false;
-    as_invocation.include_register_response = false;
-  };
-
+  const AsInvocation& as_invocation = _compiled->as_invocation();
   TRC_INFO("Found (triggered) server %s", as_invocation.server_name.c_str());
   return as_invocation;
 }
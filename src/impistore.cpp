@@ -340,8 +340,12 @@ int ImpiStore::Impi::get_expires()
   return expires;
 }
 
-ImpiStore::ImpiStore(Store* data_store) :
-  _data_store(data_store)
+ImpiStore::ImpiStore(Store* data_store,
+                     SNMP::CounterTable* lock_contention_tbl,
+                     SNMP::CounterTable* cas_retries_tbl) :
+  _data_store(data_store),
+  _write_lock(StripedLock::DEFAULT_STRIPES, lock_contention_tbl),
+  _cas_retries_tbl(cas_retries_tbl)
 {
 }
 
@@ -376,6 +380,10 @@ Store::Status ImpiStore::set_impi(Impi* impi,
     {
       TRC_ERROR("Failed to write IMPI for private_id %s", impi->impi.c_str());
     }
+    else if (_cas_retries_tbl != NULL)
+    {
+      _cas_retries_tbl->increment();
+    }
 
     SAS::Event event(trail, SASEvent::IMPISTORE_IMPI_SET_FAILURE, 0);
     event.add_var_param(impi->impi);
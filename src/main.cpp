@@ -62,6 +62,7 @@ extern "C" {
 #include "chronosconnection.h"
 #include "chronoshandlers.h"
 #include "handlers.h"
+#include "timer_wheel.h"
 #include "httpstack.h"
 #include "sproutlet.h"
 #include "sproutletproxy.h"
@@ -138,6 +139,25 @@ enum OptionTypes
   OPT_REJECT_IF_NO_MATCHING_IFCS,
   OPT_DUMMY_APP_SERVER,
   OPT_HTTP_ACR_LOGGING,
+  OPT_SHARDED_WORKER_QUEUES,
+  OPT_MAX_WORKER_QUEUE_DEPTH,
+  OPT_WORKER_QUEUE_PRIORITIES,
+  OPT_AOR_STORE_FORMAT,
+  OPT_HSS_REG_DATA_CACHE_SIZE,
+  OPT_HSS_REG_DATA_CACHE_TTL,
+  OPT_RALF_MAX_QUEUED_ACRS,
+  OPT_RALF_BATCH_SIZE,
+  OPT_RALF_BATCH_INTERVAL,
+  OPT_DNS_ASYNC_THREADS,
+  OPT_HSS_ASYNC_THREADS,
+  OPT_REMOTE_STORE_READ_THREADS,
+  OPT_REMOTE_STORE_READ_DEADLINE,
+  OPT_WEBRTC_THREADS,
+  OPT_ENUM_CACHE_SIZE,
+  OPT_SIMSERVS_CACHE_SIZE,
+  OPT_SIMSERVS_CACHE_TTL,
+  OPT_LOCAL_AOR_EXPIRY,
+  OPT_LOCAL_AOR_EXPIRY_BACKSTOP,
 };
 
 
@@ -226,6 +246,25 @@ const static struct pj_getopt_option long_opt[] =
   { "reject-if-no-matching-ifcs",   no_argument,       0, OPT_REJECT_IF_NO_MATCHING_IFCS},
   { "dummy-app-server",             required_argument, 0, OPT_DUMMY_APP_SERVER},
   { "http-acr-logging",             no_argument,       0, OPT_HTTP_ACR_LOGGING},
+  { "sharded-worker-queues",        no_argument,       0, OPT_SHARDED_WORKER_QUEUES},
+  { "max-worker-queue-depth",       required_argument, 0, OPT_MAX_WORKER_QUEUE_DEPTH},
+  { "worker-queue-priorities",      required_argument, 0, OPT_WORKER_QUEUE_PRIORITIES},
+  { "aor-store-format",             required_argument, 0, OPT_AOR_STORE_FORMAT},
+  { "hss-reg-data-cache-size",      required_argument, 0, OPT_HSS_REG_DATA_CACHE_SIZE},
+  { "hss-reg-data-cache-ttl",       required_argument, 0, OPT_HSS_REG_DATA_CACHE_TTL},
+  { "ralf-max-queued-acrs",         required_argument, 0, OPT_RALF_MAX_QUEUED_ACRS},
+  { "ralf-batch-size",              required_argument, 0, OPT_RALF_BATCH_SIZE},
+  { "ralf-batch-interval",          required_argument, 0, OPT_RALF_BATCH_INTERVAL},
+  { "dns-async-threads",            required_argument, 0, OPT_DNS_ASYNC_THREADS},
+  { "hss-async-threads",            required_argument, 0, OPT_HSS_ASYNC_THREADS},
+  { "remote-store-read-threads",    required_argument, 0, OPT_REMOTE_STORE_READ_THREADS},
+  { "remote-store-read-deadline",   required_argument, 0, OPT_REMOTE_STORE_READ_DEADLINE},
+  { "webrtc-threads",               required_argument, 0, OPT_WEBRTC_THREADS},
+  { "enum-cache-size",              required_argument, 0, OPT_ENUM_CACHE_SIZE},
+  { "simservs-cache-size",          required_argument, 0, OPT_SIMSERVS_CACHE_SIZE},
+  { "simservs-cache-ttl",           required_argument, 0, OPT_SIMSERVS_CACHE_TTL},
+  { "local-aor-expiry",             no_argument,       0, OPT_LOCAL_AOR_EXPIRY},
+  { "local-aor-expiry-backstop",    required_argument, 0, OPT_LOCAL_AOR_EXPIRY_BACKSTOP},
   { NULL,                           0,                 0, 0}
 };
 
@@ -244,6 +283,10 @@ const static int MIN_SESSION_EXPIRES = 90;
 static const std::string SPROUT_HTTP_MGMT_SOCKET_PATH = "/tmp/sprout-http-mgmt-socket";
 static const int NUM_HTTP_MGMT_THREADS = 5;
 
+// The most expired AoRs handed to a worker thread at a time when registration
+// expiry is timed locally.
+static const int LOCAL_AOR_EXPIRY_BATCH_SIZE = 100;
+
 static void usage(void)
 {
   puts("Options:\n"
@@ -254,6 +297,8 @@ static void usage(void)
        " -s, --scscf <port>         Enable S-CSCF function on the specified port\n"
        " -w, --webrtc-port N        Set local WebRTC listener port to N\n"
        "                            If not specified WebRTC support will be disabled\n"
+       "     --webrtc-threads N     Number of threads handling WebRTC (websocket) connections\n"
+       "                            (default: 1)\n"
        " -l, --localhost [<hostname>|<private hostname>,<public hostname>]\n"
        "                            Override the local host name with the specified\n"
        "                            hostname(s) or IP address(es).  If one name/address\n"
@@ -282,6 +327,13 @@ static void usage(void)
        "                            location of the memcached store in each site. One of the sites must\n"
        "                            be the local site. Remote sites for geo-redundant storage are optional.\n"
        "                            (If not provided, local store is used)\n"
+       "     --remote-store-read-threads N\n"
+       "                            Number of threads reading from each remote registration store, so\n"
+       "                            that the remote stores are read in parallel (default: 0, meaning\n"
+       "                            the remote stores are read one at a time)\n"
+       "     --remote-store-read-deadline N\n"
+       "                            Longest time (in milliseconds) to wait for the remote registration\n"
+       "                            stores when reading them in parallel (default: 500)\n"
        "     --impi-store <domain>  Specifies the location of the memcached store for storing\n"
        "                            authentication vectors. There is currently no geo-redundant storage\n"
        "                            for authentication vectors. If this option isn't provided, Sprout uses\n"
@@ -291,6 +343,16 @@ static void usage(void)
        "                            system name to identify this system to SAS.  If this option isn't\n"
        "                            specified SAS is disabled\n"
        " -H, --hss <server>         Name/IP address of the Homestead cluster\n"
+       "     --hss-reg-data-cache-size N\n"
+       "                            Maximum number of subscribers whose registration data is cached\n"
+       "                            locally, saving a request to Homestead each time it is needed\n"
+       "                            (default: 0, meaning the cache is disabled)\n"
+       "     --hss-reg-data-cache-ttl N\n"
+       "                            Time (in seconds) for which registration data is cached\n"
+       "                            (default: 30)\n"
+       "     --hss-async-threads N  Number of threads for querying Homestead without blocking the\n"
+       "                            worker threads (default: the number of worker threads; 0\n"
+       "                            means queries are made on the worker threads)\n"
        " -C, --record-routing-model <model>\n"
        "                            If 'pcscf', Sprout Record-Routes itself only on initiation of\n"
        "                            originating processing and completion of terminating\n"
@@ -300,13 +362,33 @@ static void usage(void)
        "                            If 'pcscf,icscf,as', it also Record-Routes between every AS.\n"
        " -G, --ralf <server>        Name/IP address of Ralf (Rf) billing server.\n"
        "     --ralf-threads N       Number of Ralf threads (default: 25)\n"
+       "     --ralf-max-queued-acrs N\n"
+       "                            Maximum number of ACRs waiting to be sent to Ralf.  Further ACRs\n"
+       "                            are dropped until the backlog clears (default: 10000)\n"
+       "     --ralf-batch-size N    Number of ACRs collected before they are handed to a Ralf thread\n"
+       "                            to send back-to-back (default: 1, meaning no batching)\n"
+       "     --ralf-batch-interval N\n"
+       "                            Longest time (in milliseconds) an ACR waits for its batch to fill\n"
+       "                            (default: 10)\n"
        " -X, --xdms <server>        Name/IP address of XDM server\n"
+       "     --simservs-cache-size N\n"
+       "                            Maximum number of subscribers whose simservs documents are cached\n"
+       "                            by the MMTel AS (default: 0, meaning the cache is disabled)\n"
+       "     --simservs-cache-ttl N\n"
+       "                            Time (in seconds) for which a cached simservs document is used\n"
+       "                            before it is revalidated with the XDM server (default: 30)\n"
        "     --dns-server <server>[,<server2>,<server3>]\n"
        "                            IP addresses of the DNS servers to use (defaults to 127.0.0.1)\n"
+       "     --dns-async-threads N  Number of threads for resolving next hops without blocking the\n"
+       "                            worker threads (default: 0, meaning next hops are resolved on\n"
+       "                            the worker threads)\n"
        " -E, --enum <server>[,<server2>,<server3>]\n"
        "                            IP addresses of ENUM server (can't be enabled at same\n"
        "                            time as -f)\n"
        " -x, --enum-suffix <suffix> Suffix appended to ENUM domains (default: .e164.arpa)\n"
+       "     --enum-cache-size N    Maximum number of ENUM domains whose NAPTR responses are cached\n"
+       "                            for the TTL of the records (default: 0, meaning the cache is\n"
+       "                            disabled)\n"
        " -f, --enum-file <file>     JSON ENUM config file (can't be enabled at same time as\n"
        "                            -E)\n"
        "     --default-tel-uri-translation\n"
@@ -345,6 +427,19 @@ static void usage(void)
        " -P, --pjsip-threads N      Number of PJSIP threads (default: 1)\n"
        " -B, --billing-cdf <server> Billing CDF server\n"
        " -W, --worker-threads N     Number of worker threads (default: 1)\n"
+       "     --sharded-worker-queues\n"
+       "                            Give each worker thread its own queue, with messages assigned to\n"
+       "                            queues by Call-ID and idle workers taking work from other queues\n"
+       "     --max-worker-queue-depth N\n"
+       "                            High-water mark for the worker thread queues.  Above this, new\n"
+       "                            INVITEs and REGISTERs, and other out-of-dialog requests from TCP\n"
+       "                            connections sending more than their share of the work, are\n"
+       "                            rejected with a 503\n"
+       "                            (default: 0, meaning no limit)\n"
+       "     --worker-queue-priorities <responses>,<in-dialog>,<callbacks>,<new-requests>\n"
+       "                            Priorities (0 to 2, with 0 the highest) of SIP responses, in-dialog\n"
+       "                            requests (including ACK, BYE and CANCEL), internal callbacks and\n"
+       "                            new requests on the worker thread queues (default: 0,0,1,2)\n"
        " -a, --analytics <directory>\n"
        "                            Generate analytics logs in specified directory\n"
        " -A, --authentication       Enable authentication\n"
@@ -439,6 +534,18 @@ static void usage(void)
        "     --dummy-app-server <app server URI>\n"
        "                            If any iFC has an application server that matches the one defined here, \n"
        "                            then the iFC is skipped over.\n"
+       "     --aor-store-format <json|binary>\n"
+       "                            The format in which registration data is written to the store.\n"
+       "                            Data in either format can always be read, so this should only be\n"
+       "                            set to binary once every node in the deployment supports it\n"
+       "                            (default: json)\n"
+       "     --local-aor-expiry     Time the expiry of registrations written by this node locally,\n"
+       "                            rather than waiting for Chronos to report it.  Chronos timers are\n"
+       "                            still set as a backstop, but are only updated when an AoR's next\n"
+       "                            expiry time changes\n"
+       "     --local-aor-expiry-backstop N\n"
+       "                            When registration expiry is timed locally, the delay (in seconds)\n"
+       "                            after an AoR's expiry before its Chronos timer pops (default: 60)\n"
        "     --http-acr-logging     Whether to include the bodies of ACR HTTP requests when they are logged \n"
        "                            to SAS\n"
        " -N, --plugin-option <plugin>,<name>,<value>\n"
@@ -774,6 +881,22 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       TRC_INFO("XDM server set to %s", pj_optarg);
       break;
 
+    case OPT_SIMSERVS_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->simservs_cache_size,
+                           simservs_cache_size,
+                           Simservs cache size);
+      }
+      break;
+
+    case OPT_SIMSERVS_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->simservs_cache_ttl,
+                           simservs_cache_ttl,
+                           Simservs cache TTL);
+      }
+      break;
+
     case 'G':
       options->ralf_server = std::string(pj_optarg);
       TRC_INFO("Ralf server set to %s", pj_optarg);
@@ -787,6 +910,30 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_RALF_MAX_QUEUED_ACRS:
+      {
+        VALIDATE_INT_PARAM(options->ralf_max_queued_acrs,
+                           ralf_max_queued_acrs,
+                           Maximum number of queued ACRs);
+      }
+      break;
+
+    case OPT_RALF_BATCH_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->ralf_batch_size,
+                           ralf_batch_size,
+                           Ralf ACR batch size);
+      }
+      break;
+
+    case OPT_RALF_BATCH_INTERVAL:
+      {
+        VALIDATE_INT_PARAM(options->ralf_batch_interval,
+                           ralf_batch_interval,
+                           Ralf ACR batch interval);
+      }
+      break;
+
     case 'E':
       options->enum_servers.clear();
       Utils::split_string(std::string(pj_optarg), ',', options->enum_servers, 0, false);
@@ -1006,6 +1153,22 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
                options->dns_servers.size());
     break;
 
+    case OPT_DNS_ASYNC_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->dns_async_threads,
+                           dns_async_threads,
+                           Number of asynchronous DNS threads);
+      }
+      break;
+
+    case OPT_ENUM_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->enum_cache_size,
+                           enum_cache_size,
+                           ENUM cache size);
+      }
+      break;
+
     case OPT_OVERRIDE_NPDI:
       options->override_npdi = true;
       TRC_INFO("Number portability lookups will be done on URIs containing the 'npdi' indicator");
@@ -1244,6 +1407,128 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       TRC_INFO("Bodies of ACR HTTP messages will be logged to SAS");
       break;
 
+    case OPT_SHARDED_WORKER_QUEUES:
+      options->sharded_worker_queues = true;
+      TRC_INFO("Each worker thread has its own message queue");
+      break;
+
+    case OPT_MAX_WORKER_QUEUE_DEPTH:
+      {
+        VALIDATE_INT_PARAM(options->max_worker_queue_depth,
+                           max_worker_queue_depth,
+                           Worker queue high-water mark);
+      }
+      break;
+
+    case OPT_HSS_REG_DATA_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->hss_reg_data_cache_size,
+                           hss_reg_data_cache_size,
+                           HSS registration data cache size);
+      }
+      break;
+
+    case OPT_HSS_REG_DATA_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->hss_reg_data_cache_ttl,
+                           hss_reg_data_cache_ttl,
+                           HSS registration data cache TTL);
+      }
+      break;
+
+    case OPT_HSS_ASYNC_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->hss_async_threads,
+                           hss_async_threads,
+                           Number of asynchronous HSS threads);
+      }
+      break;
+
+    case OPT_REMOTE_STORE_READ_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->remote_store_read_threads,
+                           remote_store_read_threads,
+                           Number of remote store read threads);
+      }
+      break;
+
+    case OPT_REMOTE_STORE_READ_DEADLINE:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->remote_store_read_deadline,
+                                    remote_store_read_deadline,
+                                    Remote store read deadline);
+      }
+      break;
+
+    case OPT_WEBRTC_THREADS:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->webrtc_threads,
+                                    webrtc_threads,
+                                    Number of WebRTC threads);
+      }
+      break;
+
+    case OPT_AOR_STORE_FORMAT:
+      if (strcmp(pj_optarg, "json") == 0)
+      {
+        options->aor_store_format = SubscriberDataManager::JSON;
+      }
+      else if (strcmp(pj_optarg, "binary") == 0)
+      {
+        options->aor_store_format = SubscriberDataManager::BINARY;
+      }
+      else
+      {
+        TRC_ERROR("Invalid value for aor_store_format: %s", pj_optarg);
+        return -1;
+      }
+      TRC_INFO("AoR store format set to %s", pj_optarg);
+      break;
+
+    case OPT_LOCAL_AOR_EXPIRY:
+      options->local_aor_expiry = true;
+      TRC_INFO("Registration expiry is timed locally");
+      break;
+
+    case OPT_LOCAL_AOR_EXPIRY_BACKSTOP:
+      {
+        VALIDATE_INT_PARAM(options->local_aor_expiry_backstop,
+                           local_aor_expiry_backstop,
+                           Local AoR expiry backstop delay);
+      }
+      break;
+
+    case OPT_WORKER_QUEUE_PRIORITIES:
+      {
+        std::vector<std::string> priority_strs;
+        Utils::split_string(std::string(pj_optarg), ',', priority_strs, 0, false);
+        std::vector<int> priorities;
+        bool valid = (priority_strs.size() == NUM_WORKER_EVENT_CLASSES);
+
+        for (std::vector<std::string>::iterator it = priority_strs.begin();
+             (valid) && (it != priority_strs.end());
+             ++it)
+        {
+          int priority;
+          valid = ((validated_atoi(it->c_str(), priority)) &&
+                   (priority >= 0) &&
+                   (priority < NUM_WORKER_PRIORITIES));
+          priorities.push_back(priority);
+        }
+
+        if (valid)
+        {
+          options->worker_queue_priorities = priorities;
+          TRC_INFO("Worker queue priorities set to %s", pj_optarg);
+        }
+        else
+        {
+          TRC_ERROR("Invalid value for worker_queue_priorities: %s", pj_optarg);
+          return -1;
+        }
+      }
+      break;
+
     case OPT_LISTEN_PORT:
       {
         int listen_port;
@@ -1426,6 +1711,9 @@ int main(int argc, char* argv[])
   opt.external_icscf_uri = "";
   opt.auth_enabled = PJ_FALSE;
   opt.enum_suffix = ".e164.arpa";
+  opt.enum_cache_size = 0;
+  opt.simservs_cache_size = 0;
+  opt.simservs_cache_ttl = 30;
   opt.default_tel_uri_translation = false;
 
   // If changing this default for reg_max_expires, note that
@@ -1445,6 +1733,7 @@ int main(int argc, char* argv[])
   opt.http_port = 9888;
   opt.http_threads = 1;
   opt.dns_servers.push_back("127.0.0.1");
+  opt.dns_async_threads = 0;
   opt.billing_cdf = "";
   opt.emerg_reg_accepted = PJ_FALSE;
   opt.max_call_list_length = 0;
@@ -1471,6 +1760,9 @@ int main(int argc, char* argv[])
   opt.session_terminated_timeout_ms = SCSCFSproutlet::DEFAULT_SESSION_TERMINATED_TIMEOUT;
   opt.stateless_proxies.clear();
   opt.ralf_threads = 25;
+  opt.ralf_max_queued_acrs = RalfProcessor::DEFAULT_MAX_QUEUED_ACRS;
+  opt.ralf_batch_size = 1;
+  opt.ralf_batch_interval = RalfProcessor::DEFAULT_BATCH_INTERVAL_MS;
   opt.non_register_auth_mode = NonRegisterAuthentication::NEVER;
   opt.force_third_party_register_body = false;
   opt.listen_port = 0;
@@ -1483,6 +1775,22 @@ int main(int argc, char* argv[])
   opt.reject_if_no_matching_ifcs = false;
   opt.dummy_app_server = "";
   opt.http_acr_logging = false;
+  opt.sharded_worker_queues = false;
+  opt.max_worker_queue_depth = 0;
+  opt.aor_store_format = SubscriberDataManager::JSON;
+  opt.local_aor_expiry = false;
+  opt.local_aor_expiry_backstop = 60;
+  opt.hss_reg_data_cache_size = 0;
+  opt.hss_reg_data_cache_ttl = 30;
+  opt.hss_async_threads = -1;
+  opt.remote_store_read_threads = 0;
+  opt.remote_store_read_deadline = 500;
+  opt.webrtc_threads = 1;
+  opt.worker_queue_priorities.resize(NUM_WORKER_EVENT_CLASSES);
+  opt.worker_queue_priorities[RESPONSE_EVENT] = 0;
+  opt.worker_queue_priorities[IN_DIALOG_EVENT] = 0;
+  opt.worker_queue_priorities[CALLBACK_EVENT] = 1;
+  opt.worker_queue_priorities[NEW_REQUEST_EVENT] = 2;
 
   status = init_logging_options(argc, argv, &opt);
 
@@ -1693,9 +2001,19 @@ int main(int argc, char* argv[])
   }
 
   SNMP::EventAccumulatorByScopeTable* latency_table;
+  std::vector<SNMP::EventAccumulatorByScopeTable*> priority_latency_tables;
+  std::vector<SNMP::EventAccumulatorByScopeTable*> shard_latency_tables;
+  std::vector<SNMP::EventAccumulatorByScopeTable*> shard_queue_size_tables;
   SNMP::EventAccumulatorByScopeTable* queue_size_table;
   SNMP::CounterByScopeTable* requests_counter;
   SNMP::CounterByScopeTable* overload_counter;
+  SNMP::EventAccumulatorTable* ralf_latency_table;
+  SNMP::CounterTable* ralf_dropped_table;
+  std::vector<SNMP::EventAccumulatorTable*> remote_store_latency_tables;
+  SNMP::CounterTable* aor_write_contention_table = NULL;
+  SNMP::CounterTable* aor_cas_retries_table = NULL;
+  SNMP::CounterTable* impi_write_contention_table = NULL;
+  SNMP::CounterTable* impi_cas_retries_table = NULL;
 
   SNMP::IPCountTable* homestead_cxn_count = NULL;
 
@@ -1705,6 +2023,14 @@ int main(int argc, char* argv[])
   SNMP::EventAccumulatorTable* homestead_uar_latency_table = NULL;
   SNMP::EventAccumulatorTable* homestead_lir_latency_table = NULL;
   SNMP::CounterTable* no_shared_ifcs_set_table = NULL;
+  SNMP::CounterTable* reg_data_cache_hits_table = NULL;
+  SNMP::CounterTable* reg_data_cache_misses_table = NULL;
+  SNMP::CounterTable* reg_data_cache_evictions_table = NULL;
+  RegDataCache* reg_data_cache = NULL;
+  SNMP::CounterTable* enum_cache_hits_table = NULL;
+  SNMP::CounterTable* enum_cache_misses_table = NULL;
+  SNMP::CounterTable* local_aor_expiries_table = NULL;
+  TimerWheel* aor_timer_wheel = NULL;
 
   SNMP::ContinuousAccumulatorByScopeTable* token_rate_table = NULL;
   SNMP::ScalarByScopeTable* smoothed_latency_scalar = NULL;
@@ -1718,10 +2044,29 @@ int main(int argc, char* argv[])
                                                                ".1.2.826.0.1.1578918.9.2.2");
     queue_size_table = SNMP::EventAccumulatorByScopeTable::create("bono_queue_size",
                                                                   ".1.2.826.0.1.1578918.9.2.6");
+    for (int ii = 0; ii < NUM_WORKER_PRIORITIES; ++ii)
+    {
+      priority_latency_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("bono_latency_priority_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.2.7." + std::to_string(ii + 1)));
+    }
+    for (int ii = 0; (opt.sharded_worker_queues) && (ii < opt.worker_threads); ++ii)
+    {
+      shard_latency_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("bono_latency_queue_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.2.10." + std::to_string(ii + 1)));
+      shard_queue_size_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("bono_queue_size_queue_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.2.11." + std::to_string(ii + 1)));
+    }
     requests_counter = SNMP::CounterByScopeTable::create("bono_incoming_requests",
                                                          ".1.2.826.0.1.1578918.9.2.4");
     overload_counter = SNMP::CounterByScopeTable::create("bono_rejected_overload",
                                                          ".1.2.826.0.1.1578918.9.2.5");
+    ralf_latency_table = SNMP::EventAccumulatorTable::create("bono_ralf_latency",
+                                                             ".1.2.826.0.1.1578918.9.2.8");
+    ralf_dropped_table = SNMP::CounterTable::create("bono_ralf_dropped_acrs",
+                                                    ".1.2.826.0.1.1578918.9.2.9");
   }
   else
   {
@@ -1729,10 +2074,43 @@ int main(int argc, char* argv[])
                                                                ".1.2.826.0.1.1578918.9.3.1");
     queue_size_table = SNMP::EventAccumulatorByScopeTable::create("sprout_queue_size",
                                                                   ".1.2.826.0.1.1578918.9.3.8");
+    for (int ii = 0; ii < NUM_WORKER_PRIORITIES; ++ii)
+    {
+      priority_latency_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("sprout_latency_priority_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.3.43." + std::to_string(ii + 1)));
+    }
+    for (int ii = 0; (opt.sharded_worker_queues) && (ii < opt.worker_threads); ++ii)
+    {
+      shard_latency_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("sprout_latency_queue_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.3.54." + std::to_string(ii + 1)));
+      shard_queue_size_tables.push_back(
+        SNMP::EventAccumulatorByScopeTable::create("sprout_queue_size_queue_" + std::to_string(ii),
+                                                   ".1.2.826.0.1.1578918.9.3.55." + std::to_string(ii + 1)));
+    }
     requests_counter = SNMP::CounterByScopeTable::create("sprout_incoming_requests",
                                                          ".1.2.826.0.1.1578918.9.3.6");
     overload_counter = SNMP::CounterByScopeTable::create("sprout_rejected_overload",
                                                          ".1.2.826.0.1.1578918.9.3.7");
+    ralf_latency_table = SNMP::EventAccumulatorTable::create("sprout_ralf_latency",
+                                                             ".1.2.826.0.1.1578918.9.3.44");
+    ralf_dropped_table = SNMP::CounterTable::create("sprout_ralf_dropped_acrs",
+                                                    ".1.2.826.0.1.1578918.9.3.45");
+    aor_write_contention_table = SNMP::CounterTable::create("sprout_aor_write_contention",
+                                                            ".1.2.826.0.1.1578918.9.3.47");
+    aor_cas_retries_table = SNMP::CounterTable::create("sprout_aor_cas_retries",
+                                                       ".1.2.826.0.1.1578918.9.3.48");
+    impi_write_contention_table = SNMP::CounterTable::create("sprout_impi_write_contention",
+                                                             ".1.2.826.0.1.1578918.9.3.49");
+    impi_cas_retries_table = SNMP::CounterTable::create("sprout_impi_cas_retries",
+                                                        ".1.2.826.0.1.1578918.9.3.50");
+    enum_cache_hits_table = SNMP::CounterTable::create("sprout_enum_cache_hits",
+                                                       ".1.2.826.0.1.1578918.9.3.51");
+    enum_cache_misses_table = SNMP::CounterTable::create("sprout_enum_cache_misses",
+                                                         ".1.2.826.0.1.1578918.9.3.52");
+    local_aor_expiries_table = SNMP::CounterTable::create("sprout_local_aor_expiries",
+                                                          ".1.2.826.0.1.1578918.9.3.53");
 
     homestead_cxn_count = SNMP::IPCountTable::create("sprout_homestead_cxn_count",
                                                      ".1.2.826.0.1.1578918.9.3.3.1");
@@ -1746,6 +2124,12 @@ int main(int argc, char* argv[])
                                                                  ".1.2.826.0.1.1578918.9.3.3.5");
     homestead_lir_latency_table = SNMP::EventAccumulatorTable::create("sprout_homestead_lir_latency",
                                                                  ".1.2.826.0.1.1578918.9.3.3.6");
+    reg_data_cache_hits_table = SNMP::CounterTable::create("sprout_homestead_reg_data_cache_hits",
+                                                           ".1.2.826.0.1.1578918.9.3.3.7");
+    reg_data_cache_misses_table = SNMP::CounterTable::create("sprout_homestead_reg_data_cache_misses",
+                                                             ".1.2.826.0.1.1578918.9.3.3.8");
+    reg_data_cache_evictions_table = SNMP::CounterTable::create("sprout_homestead_reg_data_cache_evictions",
+                                                                ".1.2.826.0.1.1578918.9.3.3.9");
     no_shared_ifcs_set_table = SNMP::CounterTable::create("no_shared_ifcs_set",
                                                           ".1.2.826.0.1.1578918.9.3.40");
     token_rate_table = SNMP::ContinuousAccumulatorByScopeTable::create("sprout_token_rate",
@@ -1830,6 +2214,11 @@ int main(int argc, char* argv[])
   dns_resolver = new DnsCachedResolver(opt.dns_servers, opt.dns_timeout);
   sip_resolver = new SIPResolver(dns_resolver, opt.sip_blacklist_duration);
 
+  if (opt.dns_async_threads > 0)
+  {
+    sip_resolver->start_async_threads(opt.dns_async_threads);
+  }
+
   // Create a new quiescing manager instance and register our completion handler
   // with it.
   quiescing_mgr = new QuiescingManager();
@@ -1898,7 +2287,12 @@ int main(int argc, char* argv[])
                                          !opt.http_acr_logging);
     ralf_processor = new RalfProcessor(ralf_connection,
                                        exception_handler,
-                                       opt.ralf_threads);
+                                       opt.ralf_threads,
+                                       opt.ralf_max_queued_acrs,
+                                       opt.ralf_batch_size,
+                                       opt.ralf_batch_interval,
+                                       ralf_latency_table,
+                                       ralf_dropped_table);
   }
   else
   {
@@ -1917,6 +2311,19 @@ int main(int argc, char* argv[])
                                              AlarmDef::SPROUT_SIFC_STATUS,
                                              AlarmDef::CRITICAL),
                                    no_shared_ifcs_set_table);
+
+    if (opt.hss_reg_data_cache_size > 0)
+    {
+      TRC_STATUS("Caching registration data for up to %d subscribers for %ds",
+                 opt.hss_reg_data_cache_size,
+                 opt.hss_reg_data_cache_ttl);
+      reg_data_cache = new RegDataCache(opt.hss_reg_data_cache_size,
+                                        opt.hss_reg_data_cache_ttl,
+                                        reg_data_cache_hits_table,
+                                        reg_data_cache_misses_table,
+                                        reg_data_cache_evictions_table);
+    }
+
     hss_connection = new HSSConnection(opt.hss_server,
                                        http_resolver,
                                        load_monitor,
@@ -1927,7 +2334,20 @@ int main(int argc, char* argv[])
                                        homestead_uar_latency_table,
                                        homestead_lir_latency_table,
                                        hss_comm_monitor,
-                                       sifc_service);
+                                       sifc_service,
+                                       reg_data_cache);
+
+    // Unless told otherwise, query Homestead asynchronously with as many
+    // threads as there are workers, so a slow HSS can't tie up every worker.
+    if (opt.hss_async_threads < 0)
+    {
+      opt.hss_async_threads = opt.worker_threads;
+    }
+
+    if (opt.hss_async_threads > 0)
+    {
+      hss_connection->start_async_threads(opt.hss_async_threads);
+    }
   }
 
   // Create FIFC service
@@ -1945,10 +2365,19 @@ int main(int argc, char* argv[])
   if (!opt.enum_servers.empty())
   {
     TRC_STATUS("Setting up the ENUM server(s)");
-    enum_service = new DNSEnumService(opt.enum_servers,
-                                      opt.enum_suffix,
-                                      new DNSResolverFactory(),
-                                      enum_comm_monitor);
+    DNSEnumService* dns_enum_service = new DNSEnumService(opt.enum_servers,
+                                                          opt.enum_suffix,
+                                                          new DNSResolverFactory(),
+                                                          enum_comm_monitor);
+
+    if (opt.enum_cache_size > 0)
+    {
+      dns_enum_service->enable_cache(opt.enum_cache_size,
+                                     enum_cache_hits_table,
+                                     enum_cache_misses_table);
+    }
+
+    enum_service = dns_enum_service;
   }
   else if (!opt.enum_file.empty())
   {
@@ -2002,7 +2431,8 @@ int main(int argc, char* argv[])
     pj_bool_t websockets_enabled = (opt.webrtc_port != 0);
     if (websockets_enabled)
     {
-      status = init_websockets((unsigned short)opt.webrtc_port);
+      status = init_websockets((unsigned short)opt.webrtc_port,
+                               opt.webrtc_threads);
       if (status != PJ_SUCCESS)
       {
         TRC_ERROR("Error initializing websockets, %s",
@@ -2103,7 +2533,10 @@ int main(int argc, char* argv[])
   local_sdm = new SubscriberDataManager(local_data_store,
                                         chronos_connection,
                                         analytics_logger,
-                                        true);
+                                        true,
+                                        opt.aor_store_format,
+                                        aor_write_contention_table,
+                                        aor_cas_retries_table);
 
 
   for (std::vector<Store*>::iterator it = remote_data_stores.begin();
@@ -2113,8 +2546,48 @@ int main(int argc, char* argv[])
     SubscriberDataManager* remote_sdm = new SubscriberDataManager(*it,
                                                                   chronos_connection,
                                                                   NULL,
-                                                                  false);
+                                                                  false,
+                                                                  opt.aor_store_format,
+                                                                  aor_write_contention_table,
+                                                                  aor_cas_retries_table);
     remote_sdms.push_back(remote_sdm);
+
+    if (opt.remote_store_read_threads > 0)
+    {
+      // Read the remote stores in parallel, tracking the latency of each.
+      int site = remote_sdms.size();
+      SNMP::EventAccumulatorTable* remote_store_latency_table =
+        SNMP::EventAccumulatorTable::create("sprout_remote_store_latency_" + std::to_string(site),
+                                            ".1.2.826.0.1.1578918.9.3.46." + std::to_string(site));
+      remote_store_latency_tables.push_back(remote_store_latency_table);
+      remote_sdm->start_parallel_reads(opt.remote_store_read_threads,
+                                       opt.remote_store_read_deadline,
+                                       remote_store_latency_table);
+    }
+  }
+
+  AoRTimeoutTask::Config aor_timeout_config(local_sdm,
+                                            remote_sdms,
+                                            hss_connection);
+
+  if (opt.local_aor_expiry)
+  {
+    // Time the expiry of the AoRs we write ourselves, expiring them in batches
+    // on the worker threads.  Chronos timers are kept as a backstop for AoRs
+    // we don't have timers for (e.g. following a restart).
+    TRC_STATUS("Timing registration expiry locally (backstop delay %d seconds)",
+               opt.local_aor_expiry_backstop);
+    aor_timer_wheel = new TimerWheel(
+      [&aor_timeout_config](const std::vector<std::string>& aor_ids)
+      {
+        add_callback_to_queue(new AoRExpiryCallback(&aor_timeout_config,
+                                                    aor_ids));
+      },
+      LOCAL_AOR_EXPIRY_BATCH_SIZE,
+      local_aor_expiries_table);
+    local_sdm->enable_local_expiry(aor_timer_wheel,
+                                   opt.local_aor_expiry_backstop);
+    aor_timer_wheel->start();
   }
 
   // Start the HTTP stack early as plugins might need to register handlers
@@ -2161,7 +2634,9 @@ int main(int argc, char* argv[])
                                                                       astaire_resolver,
                                                                       false,
                                                                       astaire_comm_monitor);
-    local_impi_store = new ImpiStore(local_impi_data_store);
+    local_impi_store = new ImpiStore(local_impi_data_store,
+                                     impi_write_contention_table,
+                                     impi_cas_retries_table);
 
     // Only set up remote IMPI stores if some have been configured, and we need
     // the IMPI store to be GR.
@@ -2180,7 +2655,9 @@ int main(int argc, char* argv[])
                                                                              true,
                                                                              remote_astaire_comm_monitor);
         remote_impi_data_stores.push_back(remote_data_store);
-        remote_impi_stores.push_back(new ImpiStore(remote_data_store));
+        remote_impi_stores.push_back(new ImpiStore(remote_data_store,
+                                                   impi_write_contention_table,
+                                                   impi_cas_retries_table));
       }
     }
   }
@@ -2189,7 +2666,9 @@ int main(int argc, char* argv[])
     // Use local store.
     TRC_STATUS("Using local store");
     local_impi_data_store = (Store*)new LocalStore();
-    local_impi_store = new ImpiStore(local_data_store);
+    local_impi_store = new ImpiStore(local_data_store,
+                                     impi_write_contention_table,
+                                     impi_cas_retries_table);
   }
 
   // Load the sproutlet plugins.
@@ -2244,8 +2723,15 @@ int main(int argc, char* argv[])
                              hc);
 
   init_thread_dispatcher(opt.worker_threads,
+                         opt.sharded_worker_queues,
+                         opt.max_worker_queue_depth,
+                         opt.worker_queue_priorities,
                          latency_table,
+                         priority_latency_tables,
                          queue_size_table,
+                         shard_latency_tables,
+                         shard_queue_size_tables,
+                         overload_counter,
                          load_monitor,
                          exception_handler);
 
@@ -2266,9 +2752,6 @@ int main(int argc, char* argv[])
     return 1;
   }
 
-  AoRTimeoutTask::Config aor_timeout_config(local_sdm,
-                                            remote_sdms,
-                                            hss_connection);
   AuthTimeoutTask::Config auth_timeout_config(local_impi_store,
                                               hss_connection);
 
@@ -2395,8 +2878,19 @@ int main(int argc, char* argv[])
   // rx_msg_q will stop getting serviced so could fill up blocking
   // the PJSIP thread, causing a deadlock.
   stop_pjsip_thread();
+
+  // Stop popping AoR expiry timers before the worker threads that process
+  // them.  The wheel itself is kept until the worker threads have stopped, as
+  // they still set timers as they update AoRs.
+  if (aor_timer_wheel != NULL)
+  {
+    aor_timer_wheel->stop();
+  }
+
   stop_worker_threads();
 
+  delete aor_timer_wheel; aor_timer_wheel = NULL;
+
   // We must call stop_stack here because this terminates the
   // transaction layer, which can otherwise generate work for other modules
   // after they have unregistered.
@@ -2429,6 +2923,7 @@ int main(int argc, char* argv[])
   delete http_stack_mgmt; http_stack_mgmt = NULL;
   delete chronos_connection;
   delete hss_connection;
+  delete reg_data_cache;
   delete fifc_service;
   delete mmf_service;
   delete sifc_service;
@@ -2486,9 +2981,28 @@ int main(int argc, char* argv[])
   delete alarm_manager;
 
   delete latency_table;
+  for (size_t ii = 0; ii < priority_latency_tables.size(); ++ii)
+  {
+    delete priority_latency_tables[ii];
+  }
   delete queue_size_table;
+  for (size_t ii = 0; ii < shard_latency_tables.size(); ++ii)
+  {
+    delete shard_latency_tables[ii];
+    delete shard_queue_size_tables[ii];
+  }
   delete requests_counter;
   delete overload_counter;
+  delete ralf_latency_table;
+  delete ralf_dropped_table;
+  for (size_t ii = 0; ii < remote_store_latency_tables.size(); ++ii)
+  {
+    delete remote_store_latency_tables[ii];
+  }
+  delete aor_write_contention_table;
+  delete aor_cas_retries_table;
+  delete impi_write_contention_table;
+  delete impi_cas_retries_table;
 
   delete homestead_cxn_count;
 
@@ -2498,6 +3012,12 @@ int main(int argc, char* argv[])
   delete homestead_uar_latency_table;
   delete homestead_lir_latency_table;
   delete no_shared_ifcs_set_table;
+  delete reg_data_cache_hits_table;
+  delete reg_data_cache_misses_table;
+  delete reg_data_cache_evictions_table;
+  delete enum_cache_hits_table;
+  delete enum_cache_misses_table;
+  delete local_aor_expiries_table;
 
   delete token_rate_table;
   delete smoothed_latency_scalar;
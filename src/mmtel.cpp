@@ -53,7 +53,7 @@ AppServerTsx* Mmtel::get_app_tsx(SproutletHelper* helper,
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&psu_hdr->name_addr);
     std::string served_user = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR, uri);
 
-    simservs* user_services = get_user_services(served_user, trail);
+    std::shared_ptr<const simservs> user_services = get_user_services(served_user, trail);
     mmtel_tsx = new MmtelTsx(req, user_services, trail);
   }
   else
@@ -69,7 +69,8 @@ AppServerTsx* Mmtel::get_app_tsx(SproutletHelper* helper,
 // @returns The simservs object if it is relevant and present.  If there is
 // no simservs configuration for the user, returns a default simservs object
 // with all services disabled.
-simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
+std::shared_ptr<const simservs> Mmtel::get_user_services(std::string public_id,
+                                                         SAS::TrailId trail)
 {
   // Fetch the user's simservs configuration from the XDMS
   TRC_DEBUG("Fetching simservs configuration for %s", public_id.c_str());
@@ -78,18 +79,33 @@ simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
     event.add_var_param(public_id);
     SAS::report_event(event);
   }
-  std::string simservs_xml;
-  if (!_xdmc->get_simservs(public_id, simservs_xml, "", trail))
+
+  std::shared_ptr<const simservs> user_services;
+
+  if (_simservs_cache != NULL)
+  {
+    // The cache parses the configuration, and only goes to the XDMS if it
+    // doesn't have a current copy.
+    user_services = _simservs_cache->get(public_id, trail);
+  }
+  else
+  {
+    std::string simservs_xml;
+    if (_xdmc->get_simservs(public_id, simservs_xml, "", trail))
+    {
+      // Parse the retrieved XDMS information
+      user_services.reset(new simservs(simservs_xml));
+    }
+  }
+
+  if (!user_services)
   {
     TRC_DEBUG("Failed to fetch simservs configuration for %s, no MMTel services enabled", public_id.c_str());
     SAS::Event event(trail, SASEvent::FAILED_RETRIEVE_SIMSERVS, 0);
     SAS::report_event(event);
-    return new simservs("");
+    user_services.reset(new simservs(""));
   }
 
-  // Parse the retrieved XDMS information
-  simservs *user_services = new simservs(simservs_xml);
-
   return user_services;
 }
 
@@ -228,7 +244,8 @@ AppServerTsx* CallDiversionAS::get_app_tsx(SproutletHelper* helper,
         }
       }
 
-      simservs* user_services = new simservs(target, conditions, no_reply_timer);
+      std::shared_ptr<const simservs> user_services(
+                             new simservs(target, conditions, no_reply_timer));
       mmtel_tsx = new MmtelTsx(req, user_services, trail, this);
 
       {
@@ -256,7 +273,7 @@ AppServerTsx* CallDiversionAS::get_app_tsx(SproutletHelper* helper,
 
 /// Constructor for the MmtelTsx.
 MmtelTsx::MmtelTsx(pjsip_msg* req,
-                   simservs* user_services,
+                   std::shared_ptr<const simservs> user_services,
                    SAS::TrailId trail,
                    CDivCallback* cdiv_callback) :
   AppServerTsx(),
@@ -348,11 +365,6 @@ MmtelTsx::~MmtelTsx()
     cancel_timer(_no_reply_timer);
     _no_reply_timer = 0;
   }
-
-  if (_user_services != NULL)
-  {
-    delete _user_services;
-  }
 }
 
 // Apply Mmtel processing on initial invite.
@@ -30,6 +30,10 @@ private:
   SNMP::IPCountTable* _xdm_cxn_count_tbl;
   SNMP::EventAccumulatorTable* _xdm_latency_tbl;
   XDMConnection* _xdm_connection;
+  SNMP::CounterTable* _simservs_cache_hits_tbl;
+  SNMP::CounterTable* _simservs_cache_misses_tbl;
+  SNMP::CounterTable* _simservs_cache_revalidations_tbl;
+  SimservsCache* _simservs_cache;
 };
 
 /// Export the plug-in using the magic symbol "sproutlet_plugin"
@@ -41,7 +45,11 @@ MMTELASPlugin sproutlet_plugin;
 MMTELASPlugin::MMTELASPlugin() :
   _mmtel_sproutlet(NULL),
   _mmtel(NULL),
-  _xdm_connection(NULL)
+  _xdm_connection(NULL),
+  _simservs_cache_hits_tbl(NULL),
+  _simservs_cache_misses_tbl(NULL),
+  _simservs_cache_revalidations_tbl(NULL),
+  _simservs_cache(NULL)
 {
 }
 
@@ -76,8 +84,27 @@ bool MMTELASPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                           _xdm_cxn_count_tbl,
                                           _xdm_latency_tbl);
 
+      if (opt.simservs_cache_size > 0)
+      {
+        TRC_STATUS("Caching simservs for up to %d subscribers for %ds",
+                   opt.simservs_cache_size,
+                   opt.simservs_cache_ttl);
+        _simservs_cache_hits_tbl = SNMP::CounterTable::create("homer-simservs-cache-hits",
+                                                              ".1.2.826.0.1.1578918.9.3.2.3");
+        _simservs_cache_misses_tbl = SNMP::CounterTable::create("homer-simservs-cache-misses",
+                                                                ".1.2.826.0.1.1578918.9.3.2.4");
+        _simservs_cache_revalidations_tbl = SNMP::CounterTable::create("homer-simservs-cache-revalidations",
+                                                                       ".1.2.826.0.1.1578918.9.3.2.5");
+        _simservs_cache = new SimservsCache(_xdm_connection,
+                                            opt.simservs_cache_size,
+                                            opt.simservs_cache_ttl,
+                                            _simservs_cache_hits_tbl,
+                                            _simservs_cache_misses_tbl,
+                                            _simservs_cache_revalidations_tbl);
+      }
+
       // Load the MMTEL AppServer
-      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection);
+      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection, _simservs_cache);
       _mmtel_sproutlet = new SproutletAppServerShim(_mmtel,
                                                     opt.port_mmtel,
                                                     opt.uri_mmtel,
@@ -95,7 +122,11 @@ void MMTELASPlugin::unload()
 {
   delete _mmtel_sproutlet;
   delete _mmtel;
+  delete _simservs_cache;
   delete _xdm_connection;
   delete _xdm_cxn_count_tbl;
   delete _xdm_latency_tbl;
+  delete _simservs_cache_hits_tbl;
+  delete _simservs_cache_misses_tbl;
+  delete _simservs_cache_revalidations_tbl;
 }
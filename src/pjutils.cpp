@@ -920,19 +920,16 @@ void PJUtils::resolve(const std::string& name,
 }
 
 
-/// Resolves the next hop target of the SIP message
-void PJUtils::resolve_next_hop(pjsip_tx_data* tdata,
-                               int retries,
-                               std::vector<AddrInfo>& servers,
-                               int allowed_host_state,
-                               SAS::TrailId trail)
+/// Gets the name, port and transport of the next hop target of a SIP message.
+static void get_next_hop_target(pjsip_tx_data* tdata,
+                                std::string& name,
+                                int& port,
+                                int& transport)
 {
-  // Get the next hop URI from the message and parse out the destination, port
-  // and transport.
   pjsip_sip_uri* next_hop = (pjsip_sip_uri*)PJUtils::next_hop(tdata->msg);
-  std::string name = std::string(next_hop->host.ptr, next_hop->host.slen);
-  int port = next_hop->port;
-  int transport = -1;
+  name = std::string(next_hop->host.ptr, next_hop->host.slen);
+  port = next_hop->port;
+  transport = -1;
   if (pj_stricmp2(&next_hop->transport_param, "TCP") == 0)
   {
     transport = IPPROTO_TCP;
@@ -941,6 +938,22 @@ void PJUtils::resolve_next_hop(pjsip_tx_data* tdata,
   {
     transport = IPPROTO_UDP;
   }
+}
+
+
+/// Resolves the next hop target of the SIP message
+void PJUtils::resolve_next_hop(pjsip_tx_data* tdata,
+                               int retries,
+                               std::vector<AddrInfo>& servers,
+                               int allowed_host_state,
+                               SAS::TrailId trail)
+{
+  // Get the next hop URI from the message and parse out the destination, port
+  // and transport.
+  std::string name;
+  int port;
+  int transport;
+  get_next_hop_target(tdata, name, port, transport);
 
   if (retries == 0)
   {
@@ -959,11 +972,42 @@ void PJUtils::resolve_next_hop(pjsip_tx_data* tdata,
 
   TRC_INFO("Resolved destination URI %s to %d servers",
            PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR,
-                                  (pjsip_uri*)next_hop).c_str(),
+                                  PJUtils::next_hop(tdata->msg)).c_str(),
            servers.size());
 }
 
 
+/// Resolves the next hop target of the SIP message without blocking on DNS.
+bool PJUtils::resolve_next_hop_async(pjsip_tx_data* tdata,
+                                     int retries,
+                                     std::vector<AddrInfo>& servers,
+                                     int allowed_host_state,
+                                     SAS::TrailId trail,
+                                     const SIPResolver::ResolveCallback& callback)
+{
+  std::string name;
+  int port;
+  int transport;
+  get_next_hop_target(tdata, name, port, transport);
+
+  if (retries == 0)
+  {
+    // Used default number of retries.
+    retries = DEFAULT_RETRIES;
+  }
+
+  return stack_data.sipresolver->resolve_async(name,
+                                               stack_data.addr_family,
+                                               port,
+                                               transport,
+                                               retries,
+                                               servers,
+                                               allowed_host_state,
+                                               trail,
+                                               callback);
+}
+
+
 /// Blacklists the specified server so it will not be preferred in subsequent
 /// resolve calls.
 void PJUtils::blacklist_server(AddrInfo& server)
@@ -8,59 +8,302 @@
  * Otherwise no rights are granted except for those provided to you by
  * Metaswitch Networks in a separate written agreement.
  */
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
 #include "ralf_processor.h"
 #include "exception_handler.h"
+#include "sproutsasevent.h"
+#include "log.h"
 
 /// Constructor.
 RalfProcessor::RalfProcessor(HttpConnection* ralf_connection,
                              ExceptionHandler* exception_handler,
-                             const int ralf_threads) :
-  _thread_pool(new Pool(ralf_connection,
+                             const int ralf_threads,
+                             const int max_queued_acrs,
+                             const int batch_size,
+                             const int batch_interval_ms,
+                             SNMP::EventAccumulatorTable* latency_tbl,
+                             SNMP::CounterTable* dropped_tbl) :
+  _thread_pool(new Pool(this,
+                        ralf_connection,
                         exception_handler,
                         &exception_callback,
-                        ralf_threads))
+                        ralf_threads,
+                        max_queued_acrs)),
+  _ralf_threads((ralf_threads > 0) ? ralf_threads : 1),
+  _max_queued_acrs(max_queued_acrs),
+  _batch_size(batch_size),
+  _batch_interval_ms(batch_interval_ms),
+  _queued_acrs(0),
+  _pending_batch(NULL),
+  _flush_thread_started(false),
+  _terminating(false),
+  _latency_tbl(latency_tbl),
+  _dropped_tbl(dropped_tbl)
 {
   _thread_pool->start();
+
+  if (_batch_size > 1)
+  {
+    _pending_batch = new RalfBatch();
+    _pending_batch->reserve(_batch_size);
+
+    pthread_mutex_init(&_batch_lock, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_batch_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    int rc = pthread_create(&_flush_thread, NULL, &flush_thread_fn, this);
+
+    if (rc == 0)
+    {
+      _flush_thread_started = true;
+    }
+    else
+    {
+      // LCOV_EXCL_START
+      // Without the flush thread part-filled batches would never be sent, so
+      // send each ACR as soon as it is queued instead.
+      TRC_ERROR("Failed to start Ralf batch flush thread, not batching ACRs: %s",
+                strerror(rc));
+      // LCOV_EXCL_STOP
+    }
+  }
 }
 
 /// Destructor.
 RalfProcessor::~RalfProcessor()
 {
+  if (_batch_size > 1)
+  {
+    // Stop the flush thread, then send anything left in the pending batch.
+    pthread_mutex_lock(&_batch_lock);
+    _terminating = true;
+    pthread_cond_signal(&_batch_cond);
+    pthread_mutex_unlock(&_batch_lock);
+
+    if (_flush_thread_started)
+    {
+      pthread_join(_flush_thread, NULL);
+    }
+
+    pthread_mutex_lock(&_batch_lock);
+    flush_batch();
+    pthread_mutex_unlock(&_batch_lock);
+  }
+
   if (_thread_pool != NULL)
   {
     _thread_pool->stop();
     _thread_pool->join();
     delete _thread_pool; _thread_pool = NULL;
   }
+
+  if (_batch_size > 1)
+  {
+    delete _pending_batch; _pending_batch = NULL;
+    pthread_cond_destroy(&_batch_cond);
+    pthread_mutex_destroy(&_batch_lock);
+  }
 }
 
 /// Adds a ralf request to the queue
 void RalfProcessor::send_request_to_ralf(RalfRequest* rr)
 {
-  _thread_pool->add_work(rr);
+  if (_queued_acrs.fetch_add(1) >= _max_queued_acrs)
+  {
+    // Ralf isn't keeping up with us.  Rather than block the calling thread (or
+    // use unbounded memory) we drop the ACR.
+    _queued_acrs--;
+    TRC_DEBUG("Dropping ACR for %s - %d ACRs already queued",
+              rr->path.c_str(), _max_queued_acrs);
+    SAS::Event event(rr->trail, SASEvent::ACR_DROPPED_OVERLOAD, 0);
+    event.add_static_param(_max_queued_acrs);
+    SAS::report_event(event);
+
+    if (_dropped_tbl != NULL)
+    {
+      _dropped_tbl->increment();
+    }
+
+    delete rr; rr = NULL;
+    return;
+  }
+
+  rr->stopwatch.start();
+
+  if ((_batch_size <= 1) || (!_flush_thread_started))
+  {
+    // Batching is disabled, so send the request straight away.
+    _thread_pool->add_work(new RalfBatch(1, rr));
+    return;
+  }
+
+  pthread_mutex_lock(&_batch_lock);
+
+  if (_pending_batch->empty())
+  {
+    // Wake the flush thread to time this batch.
+    clock_gettime(CLOCK_MONOTONIC, &_pending_since);
+    pthread_cond_signal(&_batch_cond);
+  }
+
+  _pending_batch->push_back(rr);
+
+  if ((int)_pending_batch->size() >= _batch_size)
+  {
+    flush_batch();
+  }
+
+  pthread_mutex_unlock(&_batch_lock);
+}
+
+void RalfProcessor::flush_batch()
+{
+  if (!_pending_batch->empty())
+  {
+    // Share the batch out between the sending threads, so that one thread
+    // isn't left sending the whole batch while the others are idle.
+    size_t num_parts = std::min((size_t)_ralf_threads, _pending_batch->size());
+    TRC_DEBUG("Flushing batch of %zu ACRs in %zu parts",
+              _pending_batch->size(), num_parts);
+
+    for (size_t ii = 0; ii < num_parts; ++ii)
+    {
+      RalfBatch* part = new RalfBatch();
+      part->reserve((_pending_batch->size() + num_parts - 1) / num_parts);
+
+      for (size_t jj = ii; jj < _pending_batch->size(); jj += num_parts)
+      {
+        part->push_back((*_pending_batch)[jj]);
+      }
+
+      _thread_pool->add_work(part);
+    }
+
+    _pending_batch->clear();
+  }
+}
+
+void* RalfProcessor::flush_thread_fn(void* p)
+{
+  ((RalfProcessor*)p)->flush_thread();
+  return NULL;
+}
+
+// Flushes batches that haven't filled up within the batch interval.
+void RalfProcessor::flush_thread()
+{
+  pthread_mutex_lock(&_batch_lock);
+
+  while (!_terminating)
+  {
+    if (_pending_batch->empty())
+    {
+      pthread_cond_wait(&_batch_cond, &_batch_lock);
+      continue;
+    }
+
+    struct timespec deadline = _pending_since;
+    deadline.tv_sec += _batch_interval_ms / 1000;
+    deadline.tv_nsec += (_batch_interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    int rc = pthread_cond_timedwait(&_batch_cond, &_batch_lock, &deadline);
+
+    if (rc == ETIMEDOUT)
+    {
+      // The batch we were timing may have filled up and been flushed while we
+      // were waiting, so only flush if the current batch is old enough.
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+
+      if ((now.tv_sec > deadline.tv_sec) ||
+          ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec)))
+      {
+        flush_batch();
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&_batch_lock);
 }
 
-// Send the ACR to Ralf
-void RalfProcessor::Pool::process_work(RalfProcessor::RalfRequest*& rr)
+// Send the ACRs to Ralf
+void RalfProcessor::Pool::process_work(RalfProcessor::RalfBatch*& batch)
 {
-  // Send the request using HTTPConnection, which adds penalties via
-  // the load monitor if the request fails
-  std::map<std::string, std::string> headers;
-  _ralf_connection->send_post(rr->path,
-                              headers,
-                              rr->message,
-                              rr->trail);
-  delete rr; rr = NULL;
+  // Frees the batch however we leave this function, including if a send
+  // throws.  Any requests that weren't sent are freed with it, and are no
+  // longer counted as queued.
+  struct BatchReleaser
+  {
+    RalfProcessor* processor;
+    RalfBatch* batch;
+
+    ~BatchReleaser()
+    {
+      for (RalfBatch::iterator it = batch->begin(); it != batch->end(); ++it)
+      {
+        if (*it != NULL)
+        {
+          processor->_queued_acrs--;
+          delete *it; *it = NULL;
+        }
+      }
+
+      delete batch;
+    }
+  } releaser = {_ralf_processor, batch};
+  batch = NULL;
+
+  // The requests are sent back-to-back, reusing this thread's connection to
+  // Ralf.
+  for (RalfBatch::iterator it = releaser.batch->begin();
+       it != releaser.batch->end();
+       ++it)
+  {
+    RalfRequest* rr = *it;
+
+    // Send the request using HTTPConnection, which adds penalties via
+    // the load monitor if the request fails
+    std::map<std::string, std::string> headers;
+    _ralf_connection->send_post(rr->path,
+                                headers,
+                                rr->message,
+                                rr->trail);
+
+    unsigned long latency_us = 0;
+    if ((_ralf_processor->_latency_tbl != NULL) &&
+        (rr->stopwatch.read(latency_us)))
+    {
+      _ralf_processor->_latency_tbl->accumulate(latency_us);
+    }
+
+    _ralf_processor->_queued_acrs--;
+    delete rr; *it = NULL;
+  }
 }
 
-RalfProcessor::Pool::Pool(HttpConnection* ralf_connection,
-                          ExceptionHandler* exception_handler, 
-                          void (*callback)(RalfProcessor::RalfRequest*),
-                          unsigned int num_threads) :
-  ThreadPool<RalfProcessor::RalfRequest*>(num_threads, 
-                                          exception_handler, 
-                                          callback, 
-                                          100),
+RalfProcessor::Pool::Pool(RalfProcessor* ralf_processor,
+                          HttpConnection* ralf_connection,
+                          ExceptionHandler* exception_handler,
+                          void (*callback)(RalfProcessor::RalfBatch*),
+                          unsigned int num_threads,
+                          unsigned int max_queue) :
+  ThreadPool<RalfProcessor::RalfBatch*>(num_threads,
+                                        exception_handler,
+                                        callback,
+                                        max_queue),
+  _ralf_processor(ralf_processor),
   _ralf_connection(ralf_connection)
 {}
 
@@ -0,0 +1,270 @@
+/**
+ * @file reg_data_cache.cpp Cache of registration data retrieved from the HSS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+#include <functional>
+
+#include "log.h"
+#include "reg_data_cache.h"
+
+RegDataCache::RegDataCache(int max_size,
+                           int ttl,
+                           SNMP::CounterTable* hits_tbl,
+                           SNMP::CounterTable* misses_tbl,
+                           SNMP::CounterTable* evictions_tbl) :
+  _max_shard_size((max_size + NUM_SHARDS - 1) / NUM_SHARDS),
+  _ttl_ms((unsigned long)ttl * 1000),
+  _hits_tbl(hits_tbl),
+  _misses_tbl(misses_tbl),
+  _evictions_tbl(evictions_tbl)
+{
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_mutex_init(&_shards[ii].lock, NULL);
+
+    for (int jj = 0; jj < GENERATIONS_PER_SHARD; ++jj)
+    {
+      _shards[ii].generations[jj] = 0;
+    }
+  }
+}
+
+RegDataCache::~RegDataCache()
+{
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_mutex_destroy(&_shards[ii].lock);
+  }
+}
+
+std::shared_ptr<const RegDataCache::RegData> RegDataCache::get(const std::string& impu)
+{
+  std::shared_ptr<const RegData> data;
+  Shard& shard = shard_for(impu);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(impu);
+
+  if (it != shard.entries.end())
+  {
+    if (it->second.expiry_ms > now_ms())
+    {
+      // Move the entry to the front of the LRU list.
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+      data = it->second.data;
+    }
+    else
+    {
+      TRC_DEBUG("Cached registration data for %s has expired", impu.c_str());
+      shard.lru.erase(it->second.lru_it);
+      shard.entries.erase(it);
+    }
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  if (data)
+  {
+    TRC_DEBUG("Found cached registration data for %s", impu.c_str());
+    if (_hits_tbl != NULL)
+    {
+      _hits_tbl->increment();
+    }
+  }
+  else if (_misses_tbl != NULL)
+  {
+    _misses_tbl->increment();
+  }
+
+  return data;
+}
+
+uint64_t RegDataCache::generation(const std::string& impu)
+{
+  Shard& shard = shard_for(impu);
+
+  pthread_mutex_lock(&shard.lock);
+  uint64_t generation = generation_for(shard, impu);
+  pthread_mutex_unlock(&shard.lock);
+
+  return generation;
+}
+
+void RegDataCache::put(const std::string& impu,
+                       const RegData& data,
+                       uint64_t generation,
+                       bool irs_changed)
+{
+  std::shared_ptr<const RegData> new_data(new RegData(data));
+  Shard& shard = shard_for(impu);
+
+  pthread_mutex_lock(&shard.lock);
+
+  if (generation_for(shard, impu) != generation)
+  {
+    // The data was invalidated while the request for it was outstanding, so
+    // may already be out of date.
+    TRC_DEBUG("Not caching registration data for %s as it has changed",
+              impu.c_str());
+  }
+  else
+  {
+    store(shard, impu, new_data);
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  // Do this after storing the new data, as the other IMPUs' generations may be
+  // shared with this one.
+  if (irs_changed)
+  {
+    remove_irs(data.associated_uris, impu);
+  }
+}
+
+void RegDataCache::store(Shard& shard,
+                         const std::string& impu,
+                         std::shared_ptr<const RegData> new_data)
+{
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(impu);
+
+  if (it != shard.entries.end())
+  {
+    shard.lru.erase(it->second.lru_it);
+    shard.entries.erase(it);
+  }
+
+  // Make space for the new entry.  Expired entries are evicted without being
+  // counted, as they would have been discarded anyway.
+  unsigned long now = now_ms();
+
+  while ((!shard.lru.empty()) && (shard.entries.size() >= _max_shard_size))
+  {
+    std::unordered_map<std::string, Entry>::iterator lru =
+                                          shard.entries.find(shard.lru.back());
+
+    if ((lru->second.expiry_ms > now) && (_evictions_tbl != NULL))
+    {
+      _evictions_tbl->increment();
+    }
+
+    shard.entries.erase(lru);
+    shard.lru.pop_back();
+  }
+
+  if (_max_shard_size > 0)
+  {
+    shard.lru.push_front(impu);
+    Entry& entry = shard.entries[impu];
+    entry.data = new_data;
+    entry.expiry_ms = now + _ttl_ms;
+    entry.lru_it = shard.lru.begin();
+  }
+}
+
+uint64_t RegDataCache::invalidate(const std::string& impu)
+{
+  uint64_t generation;
+  std::shared_ptr<const RegData> old_data = remove(impu, generation);
+
+  if (old_data)
+  {
+    TRC_DEBUG("Invalidated cached registration data for %s", impu.c_str());
+    remove_irs(old_data->associated_uris, impu);
+
+    // The other IMPUs' generations may be shared with this one.
+    generation = this->generation(impu);
+  }
+
+  return generation;
+}
+
+void RegDataCache::invalidate_irs(const AssociatedURIs& associated_uris)
+{
+  TRC_DEBUG("Invalidating cached registration data for implicit registration set");
+  remove_irs(associated_uris, "");
+}
+
+int RegDataCache::size()
+{
+  int size = 0;
+
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    pthread_mutex_lock(&_shards[ii].lock);
+    size += _shards[ii].entries.size();
+    pthread_mutex_unlock(&_shards[ii].lock);
+  }
+
+  return size;
+}
+
+RegDataCache::Shard& RegDataCache::shard_for(const std::string& impu)
+{
+  return _shards[std::hash<std::string>()(impu) % NUM_SHARDS];
+}
+
+uint64_t& RegDataCache::generation_for(Shard& shard, const std::string& impu)
+{
+  size_t hash = std::hash<std::string>()(impu) / NUM_SHARDS;
+  return shard.generations[hash % GENERATIONS_PER_SHARD];
+}
+
+std::shared_ptr<const RegDataCache::RegData> RegDataCache::remove(const std::string& impu,
+                                                                  uint64_t& generation)
+{
+  std::shared_ptr<const RegData> data;
+  Shard& shard = shard_for(impu);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(impu);
+
+  if (it != shard.entries.end())
+  {
+    data = it->second.data;
+    shard.lru.erase(it->second.lru_it);
+    shard.entries.erase(it);
+  }
+
+  generation = ++generation_for(shard, impu);
+
+  pthread_mutex_unlock(&shard.lock);
+
+  return data;
+}
+
+void RegDataCache::remove_irs(const AssociatedURIs& associated_uris,
+                              const std::string& except)
+{
+  // get_all_uris isn't const, so take a copy.
+  AssociatedURIs uris_copy = associated_uris;
+  std::vector<std::string> uris = uris_copy.get_all_uris();
+
+  for (std::vector<std::string>::const_iterator it = uris.begin();
+       it != uris.end();
+       ++it)
+  {
+    if (*it != except)
+    {
+      uint64_t unused_generation;
+      remove(*it, unused_generation);
+    }
+  }
+}
+
+unsigned long RegDataCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((unsigned long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
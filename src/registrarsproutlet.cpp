@@ -177,12 +177,9 @@ void RegistrarSproutletTsx::on_rx_initial_request(pjsip_msg *req)
 
 void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
 {
-  pjsip_status_code st_code = PJSIP_SC_OK;
-
   // Get the system time in seconds for calculating absolute expiry times.
   int now = time(NULL);
   int expiry = 0;
-  bool is_initial_registration;
 
   // Loop through headers as early as possible so that we know the expiry time
   // and which registration statistics to update.
@@ -282,8 +279,6 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
   SAS::report_marker(start_marker);
 
   // Query the HSS for the associated URIs.
-  AssociatedURIs associated_uris = {};
-  std::map<std::string, Ifcs> ifc_map;
   std::string private_id;
   std::string private_id_for_binding;
   bool success = get_private_id(req, private_id);
@@ -333,21 +328,114 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
                             scscf_uri);
   _scscf_uri = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR, (pjsip_uri*)scscf_uri);
 
-  std::string regstate;
-  std::deque<std::string> ccfs;
-  std::deque<std::string> ecfs;
-  HTTPCode http_code = _registrar->_hss->update_registration_state(public_id,
-                                                                   private_id,
-                                                                   HSSConnection::REG,
-                                                                   regstate,
-                                                                   _scscf_uri,
-                                                                   ifc_map,
-                                                                   associated_uris,
-                                                                   ccfs,
-                                                                   ecfs,
-                                                                   trail());
-
-  st_code = determine_hss_sip_response(http_code, regstate, "REGISTER");
+  // Updates the registration state in Homestead without suspending the
+  // transaction, and then completes the REGISTER.
+  auto register_with_hss = [=]()
+  {
+    HSSConnection::RegData reg_data;
+    HTTPCode http_code = _registrar->_hss->update_registration_state(public_id,
+                                                                     private_id,
+                                                                     HSSConnection::REG,
+                                                                     reg_data.regstate,
+                                                                     _scscf_uri,
+                                                                     reg_data.service_profiles,
+                                                                     reg_data.associated_uris,
+                                                                     reg_data.ccfs,
+                                                                     reg_data.ecfs,
+                                                                     trail());
+
+    complete_register_request(req,
+                              acr,
+                              now,
+                              expiry,
+                              num_contacts,
+                              num_emergency_bindings,
+                              num_emergency_deregisters,
+                              reject_with_400,
+                              public_id,
+                              private_id,
+                              private_id_for_binding,
+                              routing_uri,
+                              http_code,
+                              reg_data);
+  };
+
+  // If we can, suspend the transaction while Homestead is queried rather
+  // than blocking this worker thread, and complete the REGISTER once it has
+  // responded.
+  if (_registrar->_hss->async_enabled())
+  {
+    ResumeFn resume = suspend();
+
+    bool queued = _registrar->_hss->update_registration_state_async(
+      public_id,
+      private_id,
+      HSSConnection::REG,
+      _scscf_uri,
+      trail(),
+      [=](HTTPCode http_code, std::shared_ptr<HSSConnection::RegData> reg_data)
+      {
+        // This runs on the HSS query thread, so hand the response back to
+        // the transaction's thread.
+        resume([=]()
+        {
+          complete_register_request(req,
+                                    acr,
+                                    now,
+                                    expiry,
+                                    num_contacts,
+                                    num_emergency_bindings,
+                                    num_emergency_deregisters,
+                                    reject_with_400,
+                                    public_id,
+                                    private_id,
+                                    private_id_for_binding,
+                                    routing_uri,
+                                    http_code,
+                                    *reg_data);
+        });
+      });
+
+    if (!queued)
+    {
+      // The query couldn't be queued, so resume the transaction straight
+      // away and query Homestead synchronously.
+      resume(register_with_hss);
+    }
+
+    return;
+  }
+
+  register_with_hss();
+}
+
+/// Completes processing of a REGISTER once Homestead has responded to the
+/// registration state update.
+void RegistrarSproutletTsx::complete_register_request(pjsip_msg* req,
+                                                      ACR* acr,
+                                                      int now,
+                                                      int expiry,
+                                                      int num_contacts,
+                                                      int num_emergency_bindings,
+                                                      int num_emergency_deregisters,
+                                                      bool reject_with_400,
+                                                      const std::string& public_id,
+                                                      const std::string& private_id,
+                                                      const std::string& private_id_for_binding,
+                                                      pjsip_sip_uri* routing_uri,
+                                                      HTTPCode http_code,
+                                                      HSSConnection::RegData& reg_data)
+{
+  bool is_initial_registration;
+  std::string& regstate = reg_data.regstate;
+  std::map<std::string, Ifcs>& ifc_map = reg_data.service_profiles;
+  AssociatedURIs& associated_uris = reg_data.associated_uris;
+  std::deque<std::string>& ccfs = reg_data.ccfs;
+  std::deque<std::string>& ecfs = reg_data.ecfs;
+
+  pjsip_status_code st_code = determine_hss_sip_response(http_code,
+                                                         regstate,
+                                                         "REGISTER");
 
   if (st_code != PJSIP_SC_OK)
   {
@@ -383,8 +471,8 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
 
   // Get the default URI to use as a key in the binding store.
   std::string aor;
-  success = associated_uris.get_default_impu(aor,
-                                             num_emergency_bindings > 0);
+  bool success = associated_uris.get_default_impu(aor,
+                                                  num_emergency_bindings > 0);
   if (!success)
   {
     // Don't have a default IMPU so send an error response. We only hit this
@@ -460,11 +548,22 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
   if (all_bindings_expired)
   {
     TRC_DEBUG("All bindings have expired - triggering deregistration at the HSS");
-    _registrar->_hss->update_registration_state(aor,
-                                                "",
-                                                HSSConnection::DEREG_USER,
-                                                _scscf_uri,
-                                                trail());
+
+    // Nothing depends on the result, so don't wait for it if we don't have to.
+    if (!_registrar->_hss->update_registration_state_async(
+                             aor,
+                             "",
+                             HSSConnection::DEREG_USER,
+                             _scscf_uri,
+                             trail(),
+                             [](HTTPCode, std::shared_ptr<HSSConnection::RegData>) {}))
+    {
+      _registrar->_hss->update_registration_state(aor,
+                                                  "",
+                                                  HSSConnection::DEREG_USER,
+                                                  _scscf_uri,
+                                                  trail());
+    }
   }
 
   if ((aor_pair != NULL) && (aor_pair->get_current() != NULL))
@@ -907,6 +1006,10 @@ SubscriberDataManager::AoRPair* RegistrarSproutletTsx::write_to_store(
   bool all_bindings_expired = false;
   Store::Status set_rc;
 
+  // Serialize with other threads updating this AoR, so that the loop only
+  // retries when another node has updated it.
+  StripedLock::Guard write_guard(primary_sdm->write_lock(), aor);
+
   do
   {
     // delete NULL is safe, so we can do this on every iteration.
@@ -937,37 +1040,24 @@ SubscriberDataManager::AoRPair* RegistrarSproutletTsx::write_to_store(
       }
       else
       {
-        std::vector<SubscriberDataManager*>::iterator it = backup_sdms.begin();
-        SubscriberDataManager::AoRPair* local_backup_aor = NULL;
-
-        while ((it != backup_sdms.end()) && (!found_binding))
-        {
-          if ((*it)->has_servers())
-          {
-            local_backup_aor = (*it)->get_aor_data(aor, trail());
-
-            if ((local_backup_aor != NULL) &&
-                (local_backup_aor->current_contains_bindings()))
+        SubscriberDataManager::AoRPair* local_backup_aor =
+          SubscriberDataManager::get_aor_data_from_any(
+            backup_sdms,
+            aor,
+            [](SubscriberDataManager::AoRPair* aor_pair)
             {
-              found_binding = true;
-              backup_aor = local_backup_aor;
+              return aor_pair->current_contains_bindings();
+            },
+            trail());
 
-              // Flag that we have allocated the memory for the backup pair so
-              // that we can tidy it up later.
-              backup_aor_alloced = true;
-            }
-          }
-
-          if (!found_binding)
-          {
-            ++it;
+        if (local_backup_aor != NULL)
+        {
+          found_binding = true;
+          backup_aor = local_backup_aor;
 
-            if (local_backup_aor != NULL)
-            {
-              delete local_backup_aor;
-              local_backup_aor = NULL;
-            }
-          }
+          // Flag that we have allocated the memory for the backup pair so
+          // that we can tidy it up later.
+          backup_aor_alloced = true;
         }
       }
 
@@ -172,7 +172,7 @@ void RegistrationUtils::interpret_ifcs(Ifcs& ifcs,
 {
   found_match = false;
 
-  for (Ifc ifc : ifcs.ifcs_list())
+  for (const Ifc& ifc : ifcs.ifcs_list())
   {
     // As per TS 24.229, section 5.4.1.7, note 1, we don't fill in any
     // P-Associated-URI details.
@@ -211,7 +211,7 @@ void RegistrationUtils::interpret_ifcs(Ifcs& ifcs,
     SAS::Event event(trail, SASEvent::STARTING_FALLBACK_IFCS_LOOKUP, 1);
     SAS::report_event(event);
 
-    for (Ifc ifc : fallback_ifcs)
+    for (const Ifc& ifc : fallback_ifcs)
     {
       if (ifc.filter_matches(SessionCase::Originating,
                              true,
@@ -340,12 +340,10 @@ void RegistrationUtils::register_with_application_servers(Ifcs& ifcs,
   bool found_match;
 
   std::vector<Ifc> fallback_ifcs;
-  rapidxml::xml_document<>* root = NULL;
 
   if ((fifc_service) && (ifc_configuration._apply_fallback_ifcs))
   {
-    root = new rapidxml::xml_document<>;
-    fallback_ifcs = fifc_service->get_fallback_ifcs(root);
+    fallback_ifcs = fifc_service->get_fallback_ifcs();
   }
 
   std::vector<AsInvocation> as_list;
@@ -418,8 +416,6 @@ void RegistrationUtils::register_with_application_servers(Ifcs& ifcs,
                                          trail);
     }
   }
-
-  delete root; root = NULL;
 }
 
 static PJUtils::Callback* build_register_cb(void* token,
@@ -597,9 +593,12 @@ static bool expire_bindings(SubscriberDataManager *sdm,
                             std::string& scscf_uri,
                             SAS::TrailId trail)
 {
-  // We need the retry loop to handle the store's compare-and-swap.
+  // We need the retry loop to handle the store's compare-and-swap.  Other
+  // threads on this node updating the AoR are held off by the write lock, so
+  // it only retries when another node has updated it.
   bool all_bindings_expired = false;
   Store::Status set_rc;
+  StripedLock::Guard write_guard(sdm->write_lock(), aor);
 
   do
   {
@@ -284,19 +284,20 @@ void SCSCFSproutlet::get_bindings(const std::string& aor,
   if ((*aor_pair == NULL) ||
       (!(*aor_pair)->current_contains_bindings()))
   {
-    std::vector<SubscriberDataManager*>::iterator it = _remote_sdms.begin();
+    SubscriberDataManager::AoRPair* remote_aor_pair =
+      SubscriberDataManager::get_aor_data_from_any(
+        _remote_sdms,
+        aor,
+        [](SubscriberDataManager::AoRPair* aor_pair)
+        {
+          return aor_pair->current_contains_bindings();
+        },
+        trail);
 
-    while ((it != _remote_sdms.end()) &&
-           ((*aor_pair == NULL) || !(*aor_pair)->current_contains_bindings()))
+    if (remote_aor_pair != NULL)
     {
       delete *aor_pair;
-
-      if ((*it)->has_servers())
-      {
-        *aor_pair = (*it)->get_aor_data(aor, trail);
-      }
-
-      ++it;
+      *aor_pair = remote_aor_pair;
     }
   }
 
@@ -339,38 +340,88 @@ long SCSCFSproutlet::read_hss_data(const std::string& public_id,
                                    const std::string& wildcard,
                                    SAS::TrailId trail)
 {
-  AssociatedURIs associated_uris = {};
-  std::string regstate;
-  std::map<std::string, Ifcs> ifc_map;
+  HSSConnection::RegData data;
 
   long http_code = _hss->update_registration_state(public_id,
                                                    private_id,
                                                    req_type,
-                                                   regstate,
+                                                   data.regstate,
                                                    scscf_uri,
-                                                   ifc_map,
-                                                   associated_uris,
-                                                   aliases,
-                                                   ccfs,
-                                                   ecfs,
+                                                   data.service_profiles,
+                                                   data.associated_uris,
+                                                   data.aliases,
+                                                   data.ccfs,
+                                                   data.ecfs,
                                                    cache_allowed,
                                                    wildcard,
                                                    trail);
+  extract_hss_data(public_id,
+                   http_code,
+                   data,
+                   registered,
+                   barred,
+                   default_uri,
+                   uris,
+                   aliases,
+                   ifcs,
+                   ccfs,
+                   ecfs);
+
+  return (http_code);
+}
+
+
+/// Read data for a public user identity from the HSS without blocking.
+bool SCSCFSproutlet::read_hss_data_async(const std::string& public_id,
+                                         const std::string& private_id,
+                                         const std::string& req_type,
+                                         const std::string& scscf_uri,
+                                         bool cache_allowed,
+                                         const std::string& wildcard,
+                                         SAS::TrailId trail,
+                                         const HSSConnection::RegDataCallback& callback)
+{
+  return _hss->update_registration_state_async(public_id,
+                                               private_id,
+                                               req_type,
+                                               scscf_uri,
+                                               cache_allowed,
+                                               wildcard,
+                                               trail,
+                                               callback);
+}
+
+
+/// Pull the data for a public user identity out of the response from the HSS.
+void SCSCFSproutlet::extract_hss_data(const std::string& public_id,
+                                      long http_code,
+                                      HSSConnection::RegData& data,
+                                      bool& registered,
+                                      bool& barred,
+                                      std::string& default_uri,
+                                      std::vector<std::string>& uris,
+                                      std::vector<std::string>& aliases,
+                                      Ifcs& ifcs,
+                                      std::deque<std::string>& ccfs,
+                                      std::deque<std::string>& ecfs)
+{
+  aliases = data.aliases;
+  ccfs = data.ccfs;
+  ecfs = data.ecfs;
+
   if (http_code == HTTP_OK)
   {
-    ifcs = ifc_map[public_id];
+    ifcs = data.service_profiles[public_id];
 
     // Get the default URI. This should always succeed.
-    associated_uris.get_default_impu(default_uri, true);
+    data.associated_uris.get_default_impu(default_uri, true);
 
     // We may want to route to bindings that are barred (in case of an emergency),
     // so get all the URIs.
-    uris = associated_uris.get_all_uris();
-    registered = (regstate == RegDataXMLUtils::STATE_REGISTERED);
-    barred = associated_uris.is_impu_barred(public_id);
+    uris = data.associated_uris.get_all_uris();
+    registered = (data.regstate == RegDataXMLUtils::STATE_REGISTERED);
+    barred = data.associated_uris.is_impu_barred(public_id);
   }
-
-  return (http_code);
 }
 
 
@@ -451,6 +502,9 @@ SCSCFSproutletTsx::SCSCFSproutletTsx(SCSCFSproutlet* scscf,
   _session_case(NULL),
   _as_chain_link(),
   _hss_data_cached(false),
+  _hss_data_fetched(false),
+  _hss_data_public_id(),
+  _hss_data_http_code(HTTP_OK),
   _registered(false),
   _barred(false),
   _default_uri(""),
@@ -523,8 +577,6 @@ void SCSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
 {
   TRC_INFO("S-CSCF received initial request");
 
-  pjsip_status_code status_code = PJSIP_SC_OK;
-
   // Work out if we should be auto-registering the user based on this
   // request and if we are, also work out the IMPI to register them with.
   const pjsip_route_hdr* top_route = route_hdr();
@@ -578,9 +630,83 @@ pjsip_sip_uri* routing_uri = get_routing_uri(req);
                             scscf_uri);
   _scscf_uri = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR, (pjsip_uri*)scscf_uri);
 
-  // Determine the session case and the served user.  This will link to
-  // an AsChain object (creating it if necessary), if we need to provide
-  // services.
+  // Determine the session case, and the AsChain if this request is returning
+  // from an application server.
+  retrieve_odi_and_sesscase(req);
+
+  // A request that isn't returning from an application server needs the
+  // served user's data from the HSS.  If we can, fetch it without blocking
+  // this thread and carry on once homestead has responded.
+  if (!_as_chain_link.is_set())
+  {
+    std::string served_user = served_user_from_msg(req);
+
+    if ((!served_user.empty()) && (fetch_hss_data_async(served_user, req)))
+    {
+      return;
+    }
+  }
+
+  process_initial_request(req);
+}
+
+/// Fetches the data for the served user from the HSS without blocking, and
+/// then continues processing the initial request.  Returns false if the data
+/// must be fetched synchronously instead.
+bool SCSCFSproutletTsx::fetch_hss_data_async(const std::string& public_id,
+                                             pjsip_msg* req)
+{
+  if (!_scscf->_hss->async_enabled())
+  {
+    return false;
+  }
+
+  std::string req_type = _auto_reg ? HSSConnection::REG : HSSConnection::CALL;
+  bool cache_allowed = !_auto_reg;
+
+  ResumeFn resume = suspend();
+
+  bool queued = _scscf->read_hss_data_async(
+    public_id,
+    _impi,
+    req_type,
+    _scscf_uri,
+    cache_allowed,
+    _wildcard,
+    trail(),
+    [this, resume, public_id, req]
+      (HTTPCode http_code, std::shared_ptr<HSSConnection::RegData> data)
+    {
+      // This runs on the HSS query thread, so hand the data back to the
+      // transaction's thread.
+      resume([this, public_id, req, http_code, data]()
+      {
+        store_hss_data(public_id, http_code, *data);
+        process_initial_request(req);
+      });
+    });
+
+  if (!queued)
+  {
+    // The query couldn't be queued, so resume the transaction straight away
+    // and let it fetch the data synchronously.
+    resume([this, req]()
+    {
+      process_initial_request(req);
+    });
+  }
+
+  return true;
+}
+
+/// Continues processing an initial request once the session case is known
+/// (and, if possible, the served user's data has been fetched from the HSS).
+void SCSCFSproutletTsx::process_initial_request(pjsip_msg* req)
+{
+  pjsip_status_code status_code = PJSIP_SC_OK;
+
+  // Determine the served user.  This will link to an AsChain object
+  // (creating it if necessary), if we need to provide services.
   status_code = determine_served_user(req);
 
   // Pass the received request to the ACR.
@@ -1099,8 +1225,6 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
 {
   pjsip_status_code status_code = PJSIP_SC_OK;
 
-  retrieve_odi_and_sesscase(req);
-
   if (_as_chain_link.is_set())
   {
     bool retargeted = false;
@@ -1999,7 +2123,15 @@ void SCSCFSproutletTsx::route_to_ue_bindings(pjsip_msg* req)
 long SCSCFSproutletTsx::get_data_from_hss(std::string public_id)
 {
   long http_code = HTTP_OK;
-  if (!_hss_data_cached)
+  if ((!_hss_data_cached) &&
+      (_hss_data_fetched) &&
+      (public_id == _hss_data_public_id))
+  {
+    // We've already asked the HSS about this public ID and it failed, so
+    // don't ask again.
+    http_code = _hss_data_http_code;
+  }
+  else if (!_hss_data_cached)
   {
     std::string req_type = _auto_reg ? HSSConnection::REG : HSSConnection::CALL;
     bool cache_allowed = !_auto_reg;
@@ -2031,6 +2163,30 @@ long SCSCFSproutletTsx::get_data_from_hss(std::string public_id)
 }
 
 
+/// Stores the subscriber's data fetched asynchronously from the HSS in the
+/// per-transaction cache.
+void SCSCFSproutletTsx::store_hss_data(const std::string& public_id,
+                                       long http_code,
+                                       HSSConnection::RegData& data)
+{
+  SCSCFSproutlet::extract_hss_data(public_id,
+                                   http_code,
+                                   data,
+                                   _registered,
+                                   _barred,
+                                   _default_uri,
+                                   _uris,
+                                   _aliases,
+                                   _ifcs,
+                                   _ccfs,
+                                   _ecfs);
+  _hss_data_cached = (http_code == HTTP_OK);
+  _hss_data_fetched = true;
+  _hss_data_public_id = public_id;
+  _hss_data_http_code = http_code;
+}
+
+
 /// Look up the registration state for the given public ID, using the
 /// per-transaction cache if possible (and caching them and the iFC otherwise).
 bool SCSCFSproutletTsx::is_user_registered(std::string public_id)
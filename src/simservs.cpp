@@ -213,19 +213,19 @@ simservs::~simservs()
 }
 
 /// Is OIP (originating identity presentation) enabled?
-bool simservs::oip_enabled()
+bool simservs::oip_enabled() const
 {
   return _oip_enabled;
 }
 
 /// Is OIR (originating identity presentation restriction) enabled?
-bool simservs::oir_enabled()
+bool simservs::oir_enabled() const
 {
   return _oir_enabled;
 }
 
 /// Is originating identity presentation restricted?  Only valid if oir_enabled().
-bool simservs::oir_presentation_restricted()
+bool simservs::oir_presentation_restricted() const
 {
   return _oir_presentation_restricted;
 }
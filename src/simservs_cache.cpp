@@ -0,0 +1,261 @@
+/**
+ * @file simservs_cache.cpp Cache of the simservs documents retrieved from the
+ * XDMS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+#include <errno.h>
+
+#include "log.h"
+#include "simservs_cache.h"
+
+SimservsCache::SimservsCache(XDMConnection* xdm_connection,
+                             int max_size,
+                             int ttl,
+                             SNMP::CounterTable* hits_tbl,
+                             SNMP::CounterTable* misses_tbl,
+                             SNMP::CounterTable* revalidations_tbl) :
+  _xdmc(xdm_connection),
+  _max_size((max_size > 0) ? max_size : 1),
+  _ttl_ms((unsigned long)ttl * 1000),
+  _hits_tbl(hits_tbl),
+  _misses_tbl(misses_tbl),
+  _revalidations_tbl(revalidations_tbl)
+{
+  pthread_mutex_init(&_lock, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+}
+
+SimservsCache::~SimservsCache()
+{
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+}
+
+std::shared_ptr<const simservs> SimservsCache::get(const std::string& public_id,
+                                                   SAS::TrailId trail)
+{
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += MAX_WAIT_MS / 1000;
+  deadline.tv_nsec += (MAX_WAIT_MS % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&_lock);
+
+  // If another thread is already fetching this user's document, wait for it
+  // to finish and use its result.
+  bool waited = false;
+  std::unordered_map<std::string, Entry>::iterator it;
+  while (((it = _cache.find(public_id)) != _cache.end()) && (it->second.pending))
+  {
+    if (pthread_cond_timedwait(&_cond, &_lock, &deadline) == ETIMEDOUT)
+    {
+      // The other thread's request is taking too long, so make our own
+      // request, leaving the entry for the other thread to update.
+      TRC_DEBUG("Timed out waiting for simservs for %s", public_id.c_str());
+      std::shared_ptr<const simservs> cached = it->second.services;
+      std::string etag = it->second.etag;
+      pthread_mutex_unlock(&_lock);
+
+      std::shared_ptr<const simservs> services;
+      fetch(public_id, cached, services, etag, trail);
+      return services;
+    }
+
+    waited = true;
+  }
+
+  unsigned long now = now_ms();
+
+  if ((it != _cache.end()) && ((waited) || (it->second.expiry_ms > now)))
+  {
+    // If we waited for another thread's request and it failed, this lookup
+    // didn't get a current document either, so counts as a miss.
+    bool failed = (it->second.expiry_ms == 0);
+    TRC_DEBUG("Found cached simservs for %s%s",
+              public_id.c_str(),
+              (failed) ? " (XDMS request failed)" : "");
+    std::shared_ptr<const simservs> services = it->second.services;
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    pthread_mutex_unlock(&_lock);
+
+    SNMP::CounterTable* tbl = (failed) ? _misses_tbl : _hits_tbl;
+    if (tbl != NULL)
+    {
+      tbl->increment();
+    }
+
+    return services;
+  }
+
+  // We need to go to the XDMS.  Mark the entry as pending first, so that other
+  // threads wanting the same user wait for us.  If the entry has just
+  // expired, keep its document so that we can revalidate it.
+  std::shared_ptr<const simservs> cached;
+  std::string etag;
+
+  if (it != _cache.end())
+  {
+    cached = it->second.services;
+    etag = it->second.etag;
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+  }
+  else
+  {
+    if (_cache.size() >= _max_size)
+    {
+      evict_entries();
+    }
+
+    it = _cache.insert(std::make_pair(public_id, Entry())).first;
+    it->second.expiry_ms = 0;
+    _lru.push_front(public_id);
+    it->second.lru = _lru.begin();
+  }
+
+  it->second.pending = true;
+  pthread_mutex_unlock(&_lock);
+
+  std::shared_ptr<const simservs> services;
+  bool fetched = false;
+
+  try
+  {
+    fetched = fetch(public_id, cached, services, etag, trail);
+  }
+  catch (...)
+  {
+    // Don't leave other threads waiting for a request that won't complete.
+    complete_fetch(public_id, cached, etag, false);
+    throw;
+  }
+
+  complete_fetch(public_id, services, etag, fetched);
+
+  return services;
+}
+
+void SimservsCache::complete_fetch(const std::string& public_id,
+                                   const std::shared_ptr<const simservs>& services,
+                                   const std::string& etag,
+                                   bool fetched)
+{
+  pthread_mutex_lock(&_lock);
+
+  // Pending entries are never evicted, so the entry must still be there.  If
+  // the XDMS didn't answer, the entry is left expired so that the next lookup
+  // tries again.
+  Entry& entry = _cache.find(public_id)->second;
+  entry.pending = false;
+  entry.services = services;
+  entry.etag = etag;
+  entry.expiry_ms = (fetched) ? now_ms() + _ttl_ms : 0;
+
+  pthread_cond_broadcast(&_cond);
+  pthread_mutex_unlock(&_lock);
+}
+
+bool SimservsCache::fetch(const std::string& public_id,
+                          const std::shared_ptr<const simservs>& cached,
+                          std::shared_ptr<const simservs>& services,
+                          std::string& etag,
+                          SAS::TrailId trail)
+{
+  bool fetched = true;
+
+  if (!cached)
+  {
+    etag = "";
+  }
+
+  std::string xml_data;
+  HTTPCode http_code = _xdmc->get_simservs_if_modified(public_id,
+                                                       xml_data,
+                                                       etag,
+                                                       trail);
+
+  if ((http_code == HTTP_NOT_MODIFIED) && (cached))
+  {
+    TRC_DEBUG("Cached simservs for %s are still current", public_id.c_str());
+    services = cached;
+
+    if (_revalidations_tbl != NULL)
+    {
+      _revalidations_tbl->increment();
+    }
+  }
+  else
+  {
+    if (_misses_tbl != NULL)
+    {
+      _misses_tbl->increment();
+    }
+
+    if (http_code == HTTP_OK)
+    {
+      TRC_DEBUG("Fetched simservs for %s", public_id.c_str());
+      services.reset(new simservs(xml_data));
+    }
+    else if (http_code == HTTP_NOT_FOUND)
+    {
+      // The user has no simservs document, so has no services enabled.
+      TRC_DEBUG("No simservs for %s", public_id.c_str());
+      services.reset(new simservs(""));
+      etag = "";
+    }
+    else
+    {
+      // Fall back to the document we have (if any) until the XDMS recovers.
+      TRC_DEBUG("Failed to fetch simservs for %s (%ld)",
+                public_id.c_str(),
+                http_code);
+      services = cached;
+      fetched = false;
+    }
+  }
+
+  return fetched;
+}
+
+void SimservsCache::evict_entries()
+{
+  // Entries that are being fetched must stay, as other threads are waiting
+  // on them.
+  std::list<std::string>::iterator lru_it = _lru.end();
+
+  while ((_cache.size() >= _max_size) && (lru_it != _lru.begin()))
+  {
+    --lru_it;
+    std::unordered_map<std::string, Entry>::iterator it = _cache.find(*lru_it);
+
+    if (!it->second.pending)
+    {
+      TRC_DEBUG("Evicting simservs for %s", lru_it->c_str());
+      _cache.erase(it);
+      lru_it = _lru.erase(lru_it);
+    }
+  }
+}
+
+unsigned long SimservsCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((unsigned long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
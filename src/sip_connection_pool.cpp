@@ -31,7 +31,8 @@ SIPConnectionPool::SIPConnectionPool(pjsip_host_port* target,
                                pj_pool_t* pool,
                                pjsip_endpoint* endpt,
                                pjsip_tpfactory* tp_factory,
-                               SNMP::IPCountTable* sprout_count_tbl) :
+                               SNMP::IPCountTable* sprout_count_tbl,
+                               SNMP::IPCountTable* requests_tbl) :
   _target(*target),
   _num_connections(num_connections),
   _recycle_period(recycle_period),
@@ -42,13 +43,27 @@ SIPConnectionPool::SIPConnectionPool(pjsip_host_port* target,
   _recycler(NULL),
   _terminated(false),
   _active_connections(0),
-  _sprout_count_tbl(sprout_count_tbl)
+  _tp_hash(num_connections),
+  _next_slot(0),
+  _sprout_count_tbl(sprout_count_tbl),
+  _requests_tbl(requests_tbl)
 {
   TRC_STATUS("Creating connection pool to %.*s:%d", _target.host.slen, _target.host.ptr, _target.port);
   TRC_STATUS("  connections = %d, recycle time = %d +/- %d seconds", _num_connections, _recycle_period, _recycle_margin);
 
   pthread_mutex_init(&_tp_hash_lock, NULL);
-  _tp_hash.resize(_num_connections);
+  pthread_mutex_init(&_requests_tbl_lock, NULL);
+
+  for (int ii = 0; ii < _num_connections; ++ii)
+  {
+    pthread_mutex_init(&_tp_hash[ii].lock, NULL);
+    _tp_hash[ii].tp = NULL;
+    _tp_hash[ii].listener_key = NULL;
+    _tp_hash[ii].connected = false;
+    _tp_hash[ii].recycle_time = 0;
+    _tp_hash[ii].requests = 0;
+    _tp_hash[ii].bytes = 0;
+  }
 }
 
 
@@ -65,6 +80,14 @@ SIPConnectionPool::~SIPConnectionPool()
 
   // Quiesce all the connections.
   quiesce_connections();
+
+  for (int ii = 0; ii < _num_connections; ++ii)
+  {
+    pthread_mutex_destroy(&_tp_hash[ii].lock);
+  }
+
+  pthread_mutex_destroy(&_tp_hash_lock);
+  pthread_mutex_destroy(&_requests_tbl_lock);
 }
 
 
@@ -97,40 +120,166 @@ pjsip_transport* SIPConnectionPool::get_connection()
 {
   pjsip_transport* tp = NULL;
 
-  pthread_mutex_lock(&_tp_hash_lock);
+  // Start the search at a different slot each time, so that connections with
+  // the same load are used in turn.
+  int start_slot = (_num_connections > 0) ? (_next_slot++ % _num_connections) : 0;
 
-  if (_active_connections > 0)
+  // Find the least loaded connected slot.  This doesn't take any locks, so
+  // the slot may be disconnected before we add a reference to its transport,
+  // in which case we search again.
+  for (int attempt = 0; (tp == NULL) && (attempt < _num_connections); ++attempt)
   {
-    // Select a transport by starting at a random point in the hash and
-    // stepping through the hash until a connected entry is found.
-    int start_slot = rand() % _num_connections;
-    int ii = start_slot;
-    while (!_tp_hash[ii].connected)
+    int best_slot = -1;
+    int best_requests = 0;
+    long best_bytes = 0;
+
+    for (int jj = 0; jj < _num_connections; ++jj)
     {
-      ii = (ii + 1) % _num_connections;
-      if (ii == start_slot)
+      int ii = (start_slot + jj) % _num_connections;
+
+      if (_tp_hash[ii].connected)
       {
-        break;
+        int requests = _tp_hash[ii].requests;
+        long bytes = _tp_hash[ii].bytes;
+
+        if ((best_slot == -1) ||
+            (requests < best_requests) ||
+            ((requests == best_requests) && (bytes < best_bytes)))
+        {
+          best_slot = ii;
+          best_requests = requests;
+          best_bytes = bytes;
+        }
       }
     }
 
-    tp = _tp_hash[ii].tp;
+    if (best_slot == -1)
+    {
+      // No connected transports.
+      break;
+    }
 
-    if (tp != NULL)
+    pthread_mutex_lock(&_tp_hash[best_slot].lock);
+
+    if (_tp_hash[best_slot].connected)
     {
+      tp = _tp_hash[best_slot].tp;
+
       // Add a reference to the transport to make sure it is not destroyed.
       // The reference must be decremented once again when the transport is set
       // on the message.
       pjsip_transport_add_ref(tp);
+
+      TRC_DEBUG("Selected transport %s in slot %d (%d requests, %ld bytes)",
+                tp->obj_name, best_slot, best_requests, best_bytes);
     }
-  }
 
-  pthread_mutex_unlock(&_tp_hash_lock);
+    pthread_mutex_unlock(&_tp_hash[best_slot].lock);
+  }
 
   return tp;
 }
 
 
+void SIPConnectionPool::request_sent(pjsip_transport* tp, int bytes)
+{
+  int hash_slot = find_slot(tp);
+
+  if (hash_slot != -1)
+  {
+    ++_tp_hash[hash_slot].requests;
+    _tp_hash[hash_slot].bytes += bytes;
+  }
+
+  if (_requests_tbl != NULL)
+  {
+    // This is counted even if the transport has left the pool, so that it
+    // always balances the decrement in request_complete.
+    std::string host = PJUtils::pj_str_to_string(&tp->remote_name.host);
+    pthread_mutex_lock(&_requests_tbl_lock);
+    _requests_tbl->get(host)->increment();
+    pthread_mutex_unlock(&_requests_tbl_lock);
+  }
+}
+
+
+void SIPConnectionPool::request_complete(pjsip_transport* tp, int bytes)
+{
+  int hash_slot = find_slot(tp);
+
+  if (hash_slot != -1)
+  {
+    --_tp_hash[hash_slot].requests;
+    _tp_hash[hash_slot].bytes -= bytes;
+  }
+
+  if (_requests_tbl != NULL)
+  {
+    std::string host = PJUtils::pj_str_to_string(&tp->remote_name.host);
+    pthread_mutex_lock(&_requests_tbl_lock);
+    if (_requests_tbl->get(host)->decrement() == 0)
+    {
+      _requests_tbl->remove(host);
+    }
+    pthread_mutex_unlock(&_requests_tbl_lock);
+  }
+}
+
+
+/// Finds the slot holding the specified transport, without locking.  Returns
+/// -1 if the transport isn't in the pool.
+int SIPConnectionPool::find_slot(pjsip_transport* tp)
+{
+  for (int ii = 0; ii < _num_connections; ++ii)
+  {
+    if (_tp_hash[ii].tp == tp)
+    {
+      return ii;
+    }
+  }
+
+  return -1;
+}
+
+
+std::vector<SIPConnectionPool::ConnectionLoad> SIPConnectionPool::get_connection_load()
+{
+  std::vector<ConnectionLoad> load;
+
+  for (int ii = 0; ii < _num_connections; ++ii)
+  {
+    pthread_mutex_lock(&_tp_hash[ii].lock);
+
+    if (_tp_hash[ii].connected)
+    {
+      pjsip_transport* tp = _tp_hash[ii].tp;
+      ConnectionLoad conn;
+      conn.remote = PJUtils::pj_str_to_string(&tp->remote_name.host) + ":" +
+                    std::to_string(tp->remote_name.port);
+      conn.requests = _tp_hash[ii].requests;
+      conn.bytes = _tp_hash[ii].bytes;
+      load.push_back(conn);
+    }
+
+    pthread_mutex_unlock(&_tp_hash[ii].lock);
+  }
+
+  return load;
+}
+
+
+void SIPConnectionPool::log_connection_load()
+{
+  std::vector<ConnectionLoad> load = get_connection_load();
+
+  for (size_t ii = 0; ii < load.size(); ++ii)
+  {
+    TRC_DEBUG("Connection to %s has %d requests (%ld bytes) outstanding",
+              load[ii].remote.c_str(), load[ii].requests, load[ii].bytes);
+  }
+}
+
+
 pj_status_t SIPConnectionPool::resolve_host(const pj_str_t* host,
                                             int port,
                                             pj_sockaddr* addr)
@@ -229,9 +378,13 @@ pj_status_t SIPConnectionPool::create_connection(int hash_slot)
 
   // Store the new transport in the hash slot, but marked as disconnected.
   pthread_mutex_lock(&_tp_hash_lock);
+  pthread_mutex_lock(&_tp_hash[hash_slot].lock);
   _tp_hash[hash_slot].tp = tp;
   _tp_hash[hash_slot].listener_key = key;
-  _tp_hash[hash_slot].connected = PJ_FALSE;
+  _tp_hash[hash_slot].connected = false;
+  _tp_hash[hash_slot].requests = 0;
+  _tp_hash[hash_slot].bytes = 0;
+  pthread_mutex_unlock(&_tp_hash[hash_slot].lock);
   _tp_map[tp] = hash_slot;
 
   // Don't increment the connection count here, wait until we get confirmation
@@ -263,9 +416,11 @@ void SIPConnectionPool::quiesce_connection(int hash_slot)
                                           (void *)this);
 
     // Remove the transport from the hash and the map.
+    pthread_mutex_lock(&_tp_hash[hash_slot].lock);
     _tp_hash[hash_slot].tp = NULL;
     _tp_hash[hash_slot].listener_key = NULL;
-    _tp_hash[hash_slot].connected = PJ_FALSE;
+    _tp_hash[hash_slot].connected = false;
+    pthread_mutex_unlock(&_tp_hash[hash_slot].lock);
     _tp_map.erase(tp);
 
     // Release the lock now so we don't have a deadlock if pjsip_transport_shutdown
@@ -310,7 +465,9 @@ void SIPConnectionPool::transport_state_update(pjsip_transport* tp, pjsip_transp
     {
       // New connection has connected successfully, so update the statistics.
       TRC_DEBUG("Transport %s in slot %d has connected", tp->obj_name, hash_slot);
-      _tp_hash[hash_slot].connected = PJ_TRUE;
+      pthread_mutex_lock(&_tp_hash[hash_slot].lock);
+      _tp_hash[hash_slot].connected = true;
+      pthread_mutex_unlock(&_tp_hash[hash_slot].lock);
       ++_active_connections;
       increment_connection_count(tp);
 
@@ -375,9 +532,11 @@ void SIPConnectionPool::transport_state_update(pjsip_transport* tp, pjsip_transp
       }
 
       // Remove the transport from the hash and the map.
+      pthread_mutex_lock(&_tp_hash[hash_slot].lock);
       _tp_hash[hash_slot].tp = NULL;
       _tp_hash[hash_slot].listener_key = NULL;
-      _tp_hash[hash_slot].connected = PJ_FALSE;
+      _tp_hash[hash_slot].connected = false;
+      pthread_mutex_unlock(&_tp_hash[hash_slot].lock);
       _tp_map.erase(tp);
 
       // Remove our reference to the transport.
@@ -425,6 +584,8 @@ void SIPConnectionPool::recycle_connections()
         create_connection(ii);
       }
     }
+
+    log_connection_load();
   }
 }
 
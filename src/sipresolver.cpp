@@ -16,7 +16,8 @@
 
 SIPResolver::SIPResolver(DnsCachedResolver* dns_client,
                          int blacklist_duration) :
-  BaseResolver(dns_client)
+  BaseResolver(dns_client),
+  _async_pool(NULL)
 {
   TRC_DEBUG("Creating SIP resolver");
 
@@ -37,6 +38,8 @@ SIPResolver::SIPResolver(DnsCachedResolver* dns_client,
 
 SIPResolver::~SIPResolver()
 {
+  // Stop the asynchronous resolver threads first, as they use the caches.
+  delete _async_pool; _async_pool = NULL;
   destroy_blacklist();
   destroy_srv_cache();
   destroy_naptr_cache();
@@ -331,6 +334,78 @@ void SIPResolver::resolve(const std::string& name,
   }
 }
 
+bool SIPResolver::resolve_async(const std::string& name,
+                                int af,
+                                int port,
+                                int transport,
+                                int retries,
+                                std::vector<AddrInfo>& targets,
+                                int allowed_host_state,
+                                SAS::TrailId trail,
+                                const ResolveCallback& callback)
+{
+  IP46Address addr;
+
+  if ((_async_pool == NULL) || (parse_ip_target(name, addr)))
+  {
+    // Either asynchronous resolution is disabled or the target is an IP
+    // address (so there are no DNS lookups to wait for), so just resolve it
+    // now.
+    resolve(name, af, port, transport, retries, targets, allowed_host_state, trail);
+    return false;
+  }
+
+  // Requests that differ in any parameter can resolve to different targets,
+  // so all of them go in the key.  The trail isn't part of the key, so the
+  // shared lookup isn't reported to any one trail.
+  std::string key = name + "|" + std::to_string(af) +
+                           "|" + std::to_string(port) +
+                           "|" + std::to_string(transport) +
+                           "|" + std::to_string(retries) +
+                           "|" + std::to_string(allowed_host_state);
+
+  TRC_DEBUG("Resolving %s asynchronously", name.c_str());
+  _async_pool->lookup(key,
+                      [=]()
+                      {
+                        std::vector<AddrInfo> results;
+                        resolve(name, af, port, transport, retries, results, allowed_host_state, 0);
+                        return results;
+                      },
+                      [=](const std::vector<AddrInfo>& shared_results)
+                      {
+                        std::vector<AddrInfo> results;
+
+                        if (!shared_results.empty())
+                        {
+                          // The shared lookup has filled the DNS caches, so
+                          // resolving again for this request doesn't wait on
+                          // the network.  This reports the resolution on the
+                          // request's own trail, and makes its own random
+                          // choice between SRV targets, so that requests
+                          // sharing a lookup don't all pick the same target.
+                          resolve(name, af, port, transport, retries, results, allowed_host_state, trail);
+                        }
+                        else if (trail != 0)
+                        {
+                          // Don't repeat a failed lookup, which may have
+                          // timed out.
+                          SAS::Event event(trail, SASEvent::SIPRESOLVE_NO_RECORDS, 0);
+                          event.add_var_param(name);
+                          SAS::report_event(event);
+                        }
+
+                        callback(results);
+                      });
+  return true;
+}
+
+void SIPResolver::start_async_threads(int num_threads)
+{
+  TRC_STATUS("Starting %d asynchronous SIP resolver threads", num_threads);
+  _async_pool = new AsyncLookupPool<std::vector<AddrInfo> >(num_threads);
+}
+
 std::string SIPResolver::get_transport_str(int transport)
 {
   if (transport == IPPROTO_UDP)
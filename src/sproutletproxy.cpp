@@ -24,6 +24,7 @@ extern "C" {
 #include "sproutsasevent.h"
 #include "sproutletproxy.h"
 #include "snmp_sip_request_types.h"
+#include "thread_dispatcher.h"
 
 const pj_str_t SproutletProxy::STR_SERVICE = {"service", 7};
 
@@ -43,6 +44,7 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
              stateless_proxies),
   _root_uri(NULL),
   _host_aliases(host_aliases),
+  _local_hosts(true),
   _sproutlets(sproutlets)
 {
   /// Store the URI of this SproutletProxy - this is used for Record-Routing.
@@ -51,6 +53,16 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
                                                        stack_data.pool,
                                                        false);
 
+  std::map<std::string, bool> local_hosts;
+  local_hosts[PJUtils::pj_str_to_string(&_root_uri->host)] = true;
+  for (std::unordered_set<std::string>::const_iterator it = _host_aliases.begin();
+       it != _host_aliases.end();
+       ++it)
+  {
+    local_hosts[*it] = true;
+  }
+  _local_hosts.build(local_hosts);
+
   for (std::list<Sproutlet*>::iterator it = _sproutlets.begin();
        it != _sproutlets.end();
        ++it)
@@ -150,6 +162,10 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
     }
   }
 
+  // Sproutlets are only registered at start of day, so it's fine to rebuild
+  // the routing table each time.
+  _service_table.build(_services);
+
   return ok;
 }
 
@@ -286,8 +302,9 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
   // Now we know we have a SIP URI, cast to one.
   pjsip_sip_uri* sip_uri = (pjsip_sip_uri*)uri;
 
-  std::string service_name;
-  std::map<std::string, Sproutlet*>::const_iterator it;
+  // The candidate service names are looked up in place, so nothing is copied
+  // out of the URI unless a sproutlet matches.
+  Sproutlet* const* entry;
 
   // First check if there is a services parameter, and if it matches a
   // sproutlet.
@@ -302,12 +319,12 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
     if (is_host_local(&sip_uri->host))
     {
       // Check if this service matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&services_param->value);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      entry = _service_table.find(services_param->value.ptr,
+                                  services_param->value.slen);
+      if (entry != NULL)
       {
-        sproutlet = it->second;
-        alias = service_name;
+        sproutlet = *entry;
+        alias = PJUtils::pj_str_to_string(&services_param->value);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = SERVICE_NAME;
       }
@@ -328,14 +345,17 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
     if (sep != NULL)
     {
       // Extract the possible service name
-      service_name = std::string(hostname.ptr, sep - hostname.ptr);
+      pj_str_t service_name;
+      service_name.ptr = hostname.ptr;
+      service_name.slen = sep - hostname.ptr;
 
       // Remove the service name part and the period from the hostname.
       hostname.slen -= (sep - hostname.ptr + 1);
       hostname.ptr = sep + 1;
 
-      TRC_DEBUG("Possible service name %s will be used if %.*s is a local hostname",
-                service_name.c_str(),
+      TRC_DEBUG("Possible service name %.*s will be used if %.*s is a local hostname",
+                service_name.slen,
+                service_name.ptr,
                 hostname.slen,
                 hostname.ptr);
 
@@ -343,11 +363,11 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
       {
         // Check if the part of the hostname before the first '.' matches
         // a sproutlet.
-        it = _services.find(service_name);
-        if (it != _services.end())
+        entry = _service_table.find(service_name.ptr, service_name.slen);
+        if (entry != NULL)
         {
-          sproutlet = it->second;
-          alias = service_name;
+          sproutlet = *entry;
+          alias = PJUtils::pj_str_to_string(&service_name);
           local_hostname = PJUtils::pj_str_to_string(&hostname);
           selection_type = DOMAIN_PART;
         }
@@ -365,12 +385,11 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
     if (is_host_local(&sip_uri->host))
     {
       // Check if the user part matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&sip_uri->user);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      entry = _service_table.find(sip_uri->user.ptr, sip_uri->user.slen);
+      if (entry != NULL)
       {
-        sproutlet = it->second;
-        alias = service_name;
+        sproutlet = *entry;
+        alias = PJUtils::pj_str_to_string(&sip_uri->user);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = USER_PART;
       }
@@ -519,24 +538,7 @@ std::string SproutletProxy::get_local_hostname(const pjsip_sip_uri* uri) const
 
 bool SproutletProxy::is_host_local(const pj_str_t* host) const
 {
-  bool rc = false;
-
-  if (!pj_stricmp(host, &_root_uri->host))
-  {
-    rc = true;
-  }
-
-  for (std::unordered_set<std::string>::const_iterator it = _host_aliases.begin();
-       (rc != true) && (it != _host_aliases.end());
-       ++it)
-  {
-    if (!pj_stricmp2(host, it->c_str()))
-    {
-      rc = true;
-    }
-  }
-
-  return rc;
+  return (_local_hosts.find(host->ptr, host->slen) != NULL);
 }
 
 bool SproutletProxy::is_uri_reflexive(const pjsip_uri* uri,
@@ -600,7 +602,8 @@ SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
   _pending_req_q(),
   _sproutlet_proxy(proxy),
   _timers(),
-  _pending_timers()
+  _pending_timers(),
+  _suspended_tsxs(0)
 {
   TRC_VERBOSE("Sproutlet Proxy transaction (%p) created", this);
 }
@@ -1040,6 +1043,36 @@ void SproutletProxy::UASTsx::process_timer_pop(pj_timer_entry* tentry)
 }
 
 
+ResumeFn SproutletProxy::UASTsx::suspend(SproutletWrapper* tsx)
+{
+  _suspended_tsxs++;
+
+  UASTsx* uas_tsx = this;
+  return [uas_tsx, tsx](const std::function<void()>& fn)
+  {
+    // This may be called on any thread, so queue the processing to run on a
+    // worker thread.
+    add_callback_to_queue(new ResumeCallback(uas_tsx, tsx, fn));
+  };
+}
+
+
+void SproutletProxy::UASTsx::process_resume(SproutletWrapper* tsx,
+                                            const std::function<void()>& fn)
+{
+  enter_context();
+
+  _suspended_tsxs--;
+  tsx->on_resume(fn);
+  schedule_requests();
+
+  // Check to see if the UASTsx can be destroyed.
+  check_destroy();
+
+  exit_context();
+}
+
+
 void SproutletProxy::UASTsx::tx_response(SproutletWrapper* downstream,
                                          pjsip_tx_data* rsp)
 {
@@ -1149,6 +1182,7 @@ void SproutletProxy::UASTsx::check_destroy()
       (_umap.empty()) &&
       (_pending_req_q.empty()) &&
       (_pending_timers.empty()) &&
+      (_suspended_tsxs == 0) &&
       (_tsx == NULL))
   {
     // UAS transaction has been destroyed and all Sproutlets are complete.
@@ -1249,6 +1283,7 @@ SproutletWrapper::SproutletWrapper(SproutletProxy* proxy,
   _process_actions_entered(0),
   _forks(),
   _pending_timers(),
+  _suspends(0),
   _trail_id(trail_id)
 {
   if (_original_transport != NULL)
@@ -1720,6 +1755,13 @@ bool SproutletWrapper::timer_running(TimerID id)
   return _proxy_tsx->timer_running(id);
 }
 
+ResumeFn SproutletWrapper::suspend()
+{
+  TRC_DEBUG("%s suspending", _id.c_str());
+  _suspends++;
+  return _proxy_tsx->suspend(this);
+}
+
 SAS::TrailId SproutletWrapper::trail() const
 {
   return _trail_id;
@@ -1955,6 +1997,14 @@ void SproutletWrapper::on_timer_pop(TimerID id, void* context)
   process_actions(false);
 }
 
+void SproutletWrapper::on_resume(const std::function<void()>& fn)
+{
+  TRC_DEBUG("%s resuming", _id.c_str());
+  _suspends--;
+  fn();
+  process_actions(false);
+}
+
 void SproutletWrapper::register_tdata(pjsip_tx_data* tdata)
 {
   TRC_DEBUG("Adding message %p => txdata %p mapping",
@@ -2047,10 +2097,12 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   if ((_complete) &&
       (_pending_responses == 0) &&
       (_pending_timers.empty()) &&
+      (_suspends == 0) &&
       (_process_actions_entered == 0))
   {
     // Sproutlet has sent a final response, has no downstream forks waiting
-    // a response, and has no pending timers, so should destroy itself.
+    // a response, has no pending timers and isn't suspended, so should
+    // destroy itself.
     TRC_VERBOSE("%s suiciding", _id.c_str());
     delete this;
   }
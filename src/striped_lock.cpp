@@ -0,0 +1,114 @@
+/**
+ * @file striped_lock.cpp Set of locks indexed by string keys.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <functional>
+#include <iterator>
+#include <errno.h>
+
+#include "striped_lock.h"
+#include "log.h"
+
+// The stripes held by this thread, in the order they were taken.  A stripe
+// appears once for each time it is held.
+static thread_local std::vector<pthread_mutex_t*> held_stripes;
+
+StripedLock::StripedLock(size_t num_stripes,
+                         SNMP::CounterTable* contention_tbl) :
+  _stripes((num_stripes > 0) ? num_stripes : 1),
+  _contention_tbl(contention_tbl)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+
+  for (size_t ii = 0; ii < _stripes.size(); ++ii)
+  {
+    pthread_mutex_init(&_stripes[ii], &attr);
+  }
+
+  pthread_mutexattr_destroy(&attr);
+}
+
+StripedLock::~StripedLock()
+{
+  for (size_t ii = 0; ii < _stripes.size(); ++ii)
+  {
+    pthread_mutex_destroy(&_stripes[ii]);
+  }
+}
+
+void StripedLock::lock(const std::string& key)
+{
+  pthread_mutex_t* mutex = stripe(key);
+
+  if (pthread_mutex_trylock(mutex) == EBUSY)
+  {
+    // Another thread is working on this key (or one that shares its stripe),
+    // so wait for it to finish.
+    TRC_DEBUG("Waiting for lock on %s", key.c_str());
+
+    if (_contention_tbl != NULL)
+    {
+      _contention_tbl->increment();
+    }
+
+    pthread_mutex_lock(mutex);
+  }
+
+  held_stripes.push_back(mutex);
+}
+
+void StripedLock::unlock(const std::string& key)
+{
+  pthread_mutex_t* mutex = stripe(key);
+
+  for (std::vector<pthread_mutex_t*>::reverse_iterator it = held_stripes.rbegin();
+       it != held_stripes.rend();
+       ++it)
+  {
+    if (*it == mutex)
+    {
+      held_stripes.erase(std::next(it).base());
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(mutex);
+}
+
+StripedLock::Release::Release()
+{
+  _released.swap(held_stripes);
+
+  for (std::vector<pthread_mutex_t*>::reverse_iterator it = _released.rbegin();
+       it != _released.rend();
+       ++it)
+  {
+    pthread_mutex_unlock(*it);
+  }
+}
+
+StripedLock::Release::~Release()
+{
+  for (std::vector<pthread_mutex_t*>::iterator it = _released.begin();
+       it != _released.end();
+       ++it)
+  {
+    pthread_mutex_lock(*it);
+  }
+
+  held_stripes.insert(held_stripes.begin(), _released.begin(), _released.end());
+}
+
+pthread_mutex_t* StripedLock::stripe(const std::string& key)
+{
+  return &_stripes[std::hash<std::string>()(key) % _stripes.size()];
+}
@@ -28,7 +28,9 @@ extern "C" {
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
 #include <time.h>
+#include <errno.h>
 
 #include "log.h"
 #include "utils.h"
@@ -80,11 +82,35 @@ void delete_bindings(ClassifiedBindings& cbs)
 SubscriberDataManager::SubscriberDataManager(Store* data_store,
                                              ChronosConnection* chronos_connection,
                                              AnalyticsLogger* analytics_logger,
-                                             bool is_primary) :
-  _primary_sdm(is_primary)
+                                             bool is_primary,
+                                             SerializationFormat serialization_format,
+                                             SNMP::CounterTable* lock_contention_tbl,
+                                             SNMP::CounterTable* cas_retries_tbl) :
+  _primary_sdm(is_primary),
+  _read_pool(NULL),
+  _read_deadline_ms(0),
+  _read_latency_tbl(NULL),
+  _write_lock(StripedLock::DEFAULT_STRIPES, lock_contention_tbl),
+  _cas_retries_tbl(cas_retries_tbl)
 {
-  JsonSerializerDeserializer* serializer = new JsonSerializerDeserializer();
-  std::vector<JsonSerializerDeserializer*> deserializers = { new JsonSerializerDeserializer() };
+  SerializerDeserializer* serializer;
+
+  if (serialization_format == BINARY)
+  {
+    serializer = new BinarySerializerDeserializer();
+  }
+  else
+  {
+    serializer = new JsonSerializerDeserializer();
+  }
+
+  // We can read both formats whichever we write, so that nodes writing
+  // different formats can share a store.  Try the binary format first, as it
+  // rejects JSON data immediately.
+  std::vector<SerializerDeserializer*> deserializers = {
+    new BinarySerializerDeserializer(),
+    new JsonSerializerDeserializer()
+  };
 
   _connector = new Connector(data_store, serializer, deserializers);
   _chronos_timer_request_sender = new ChronosTimerRequestSender(chronos_connection);
@@ -95,11 +121,224 @@ SubscriberDataManager::SubscriberDataManager(Store* data_store,
 
 SubscriberDataManager::~SubscriberDataManager()
 {
+  // Finish any outstanding parallel reads before tearing down the store.
+  delete _read_pool; _read_pool = NULL;
+
   delete _notify_sender;
   delete _chronos_timer_request_sender;
   delete _connector;
 }
 
+struct SubscriberDataManager::ParallelRead
+{
+  ParallelRead() : outstanding(0), result(NULL), abandoned(false)
+  {
+    pthread_mutex_init(&lock, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+  }
+
+  ~ParallelRead()
+  {
+    delete result; result = NULL;
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+  }
+
+  // Offers an AoR read from one of the stores.  The first usable AoR is kept,
+  // unless the caller has stopped waiting, and the rest are deleted.  Must
+  // be called with the lock held.
+  void offer(AoRPair* aor_pair, const AoRFilter& usable)
+  {
+    if ((!abandoned) &&
+        (result == NULL) &&
+        (aor_pair != NULL) &&
+        (usable(aor_pair)))
+    {
+      result = aor_pair;
+    }
+    else
+    {
+      delete aor_pair;
+    }
+  }
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int outstanding;
+  AoRPair* result;
+  bool abandoned;
+};
+
+void SubscriberDataManager::start_parallel_reads(int num_threads,
+                                                 int deadline_ms,
+                                                 SNMP::EventAccumulatorTable* latency_tbl,
+                                                 int max_queued_reads)
+{
+  _read_deadline_ms = deadline_ms;
+  _read_latency_tbl = latency_tbl;
+  _read_pool = new AsyncLookupPool<AoRPair*>(num_threads, max_queued_reads);
+}
+
+void SubscriberDataManager::enable_local_expiry(TimerWheel* timer_wheel,
+                                                int backstop_delay)
+{
+  _chronos_timer_request_sender->_timer_wheel = timer_wheel;
+  _chronos_timer_request_sender->_backstop_delay = backstop_delay;
+}
+
+SubscriberDataManager::AoRPair* SubscriberDataManager::get_aor_data_from_any(
+                                  const std::vector<SubscriberDataManager*>& sdms,
+                                  const std::string& aor_id,
+                                  const AoRFilter& usable,
+                                  SAS::TrailId trail)
+{
+  // Don't hold up other threads updating this AoR while we read the remote
+  // stores.
+  StripedLock::Release release;
+
+  // The state is shared with the reading threads, and freed by whichever of
+  // us finishes with it last.
+  std::shared_ptr<ParallelRead> read = std::make_shared<ParallelRead>();
+  std::vector<SubscriberDataManager*> serial_sdms;
+  int deadline_ms = 0;
+
+  pthread_mutex_lock(&read->lock);
+
+  for (std::vector<SubscriberDataManager*>::const_iterator it = sdms.begin();
+       it != sdms.end();
+       ++it)
+  {
+    SubscriberDataManager* sdm = *it;
+
+    if (!sdm->has_servers())
+    {
+      continue;
+    }
+
+    if (sdm->_read_pool == NULL)
+    {
+      serial_sdms.push_back(sdm);
+      continue;
+    }
+
+    // The read callback takes the lock, so it can't run until we have
+    // finished queuing the reads and counted this one as outstanding.
+    bool queued = sdm->_read_pool->submit(
+      [sdm, aor_id, trail, read]() -> AoRPair*
+      {
+        // Don't bother reading the store if the caller has already given up
+        // waiting (because the read was queued for too long).
+        pthread_mutex_lock(&read->lock);
+        bool abandoned = read->abandoned;
+        pthread_mutex_unlock(&read->lock);
+
+        if (abandoned)
+        {
+          TRC_DEBUG("Skipping abandoned read of %s", aor_id.c_str());
+          return NULL;
+        }
+
+        Utils::StopWatch stopwatch;
+        stopwatch.start();
+
+        AoRPair* aor_pair = sdm->get_aor_data(aor_id, trail);
+
+        unsigned long latency_us = 0;
+        if ((sdm->_read_latency_tbl != NULL) &&
+            (stopwatch.read(latency_us)))
+        {
+          sdm->_read_latency_tbl->accumulate(latency_us);
+        }
+
+        return aor_pair;
+      },
+      [read, usable](AoRPair* const& aor_pair)
+      {
+        pthread_mutex_lock(&read->lock);
+        read->offer(aor_pair, usable);
+        read->outstanding--;
+        pthread_cond_signal(&read->cond);
+        pthread_mutex_unlock(&read->lock);
+      });
+
+    if (queued)
+    {
+      deadline_ms = std::max(deadline_ms, sdm->_read_deadline_ms);
+      read->outstanding++;
+    }
+    else
+    {
+      // This store already has a backlog of reads, so it is unlikely to
+      // return in time.  Don't add to the backlog.
+      TRC_DEBUG("Not reading %s from a store with too many reads queued",
+                aor_id.c_str());
+    }
+  }
+
+  pthread_mutex_unlock(&read->lock);
+
+  // The deadline runs from when the parallel reads were requested.
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += deadline_ms / 1000;
+  deadline.tv_nsec += (deadline_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  // Read any stores without reading threads while the others are being read,
+  // stopping as soon as we have a usable AoR.
+  bool found = false;
+
+  for (std::vector<SubscriberDataManager*>::iterator it = serial_sdms.begin();
+       (it != serial_sdms.end()) && (!found);
+       ++it)
+  {
+    pthread_mutex_lock(&read->lock);
+    found = (read->result != NULL);
+    pthread_mutex_unlock(&read->lock);
+
+    if (!found)
+    {
+      AoRPair* aor_pair = (*it)->get_aor_data(aor_id, trail);
+
+      pthread_mutex_lock(&read->lock);
+      read->offer(aor_pair, usable);
+      found = (read->result != NULL);
+      pthread_mutex_unlock(&read->lock);
+    }
+  }
+
+  // Now wait for the parallel reads, until one of them returns a usable AoR,
+  // they have all completed, or the deadline passes.
+  pthread_mutex_lock(&read->lock);
+
+  while ((read->result == NULL) && (read->outstanding > 0))
+  {
+    if (pthread_cond_timedwait(&read->cond, &read->lock, &deadline) == ETIMEDOUT)
+    {
+      TRC_DEBUG("Timed out waiting for %d remote reads of %s",
+                read->outstanding, aor_id.c_str());
+      break;
+    }
+  }
+
+  // Any reads that complete from now on are discarded.
+  AoRPair* aor_pair = read->result;
+  read->result = NULL;
+  read->abandoned = true;
+
+  pthread_mutex_unlock(&read->lock);
+
+  return aor_pair;
+}
+
 /// Retrieve the registration data for a given SIP Address of Record.
 ///
 /// @param aor_id       The SIP Address of Record for the registration
@@ -207,7 +446,9 @@ Store::Status SubscriberDataManager::set_aor_data(
       log_removed_or_shortened_bindings(classified_bindings, now);
     }
 
-    // 3. Send any Chronos timer requests
+    // 3. Send any Chronos timer requests.  Other threads updating this AoR
+    // aren't held up while we wait for Chronos.
+    StripedLock::Release release;
     _chronos_timer_request_sender->send_timers(aor_id, aor_pair, now, trail);
   }
 
@@ -227,6 +468,11 @@ Store::Status SubscriberDataManager::set_aor_data(
   {
     // We were unable to write to the store - return to the caller and
     // send no further messages
+    if ((rc == Store::Status::DATA_CONTENTION) && (_cas_retries_tbl != NULL))
+    {
+      _cas_retries_tbl->increment();
+    }
+
     delete_bindings(classified_bindings);
     return rc;
   }
@@ -239,7 +485,9 @@ Store::Status SubscriberDataManager::set_aor_data(
       log_new_or_extended_bindings(classified_bindings, now);
     }
 
-    // 6. Send any NOTIFYs
+    // 6. Send any NOTIFYs.  The AoR has been written, so other threads can
+    // update it while we do this.
+    StripedLock::Release release;
     _notify_sender->send_notifys(aor_id, associated_uris, aor_pair, now, trail);
   }
 
@@ -286,6 +534,11 @@ void SubscriberDataManager::classify_bindings(const std::string& aor_id,
       // Binding is new
       event = NotifyUtils::ContactEvent::CREATED;
     }
+    else if (aor_orig_b_match->second == aor_current_b.second)
+    {
+      // Both AoRs share the binding, so it can't have changed.
+      event = NotifyUtils::ContactEvent::REGISTERED;
+    }
     else
     {
       // The binding is in both AoRs. Check if the expiry time has changed at all
@@ -397,18 +650,20 @@ void SubscriberDataManager::expire_subscriptions(AoRPair* aor_pair,
       }
       // The subscription has expired, so remove it. This could be
       // a single one shot subscription though - if so pretend it was
-      // part of the original AoR
+      // part of the original AoR by moving it there.
       SubscriberDataManager::AoR::Subscriptions::const_iterator aor_orig_s =
         aor_pair->get_orig()->subscriptions().find(i->first);
 
       if (aor_orig_s == aor_pair->get_orig()->subscriptions().end())
       {
-        SubscriberDataManager::AoR::Subscription* s_copy =
-          aor_pair->get_orig()->get_subscription(i->first);
-        *s_copy = *i->second;
+        aor_pair->get_orig()->_subscriptions.insert(std::make_pair(i->first,
+                                                                   i->second));
+      }
+      else
+      {
+        AoR::release(i->second);
       }
 
-      delete i->second;
       aor_pair->get_current()->_subscriptions.erase(i++);
     }
     else
@@ -450,7 +705,7 @@ int SubscriberDataManager::expire_bindings(AoR* aor_data,
         SAS::report_event(event);
       }
 
-      delete i->second;
+      AoR::release(i->second);
       aor_data->_bindings.erase(i++);
     }
     else
@@ -470,8 +725,8 @@ int SubscriberDataManager::expire_bindings(AoR* aor_data,
 /// SubscriberDataManager::Connector Methods
 
 SubscriberDataManager::Connector::Connector(Store* data_store,
-                               JsonSerializerDeserializer*& serializer,
-                               std::vector<JsonSerializerDeserializer*>& deserializers) :
+                               SerializerDeserializer*& serializer,
+                               std::vector<SerializerDeserializer*>& deserializers) :
   _data_store(data_store),
   _serializer(serializer),
   _deserializers(deserializers)
@@ -485,7 +740,7 @@ SubscriberDataManager::Connector::~Connector()
 {
   delete _serializer; _serializer = NULL;
 
-  for (JsonSerializerDeserializer* ds : _deserializers)
+  for (SerializerDeserializer* ds : _deserializers)
   {
     delete ds; ds = NULL;
   }
@@ -515,6 +770,7 @@ SubscriberDataManager::AoR* SubscriberDataManager::Connector::get_aor_data(
     if (aor_data != NULL)
     {
       aor_data->_cas = cas;
+      aor_data->mark_unchanged();
 
       SAS::Event event(trail, SASEvent::REGSTORE_GET_FOUND, 0);
       event.add_var_param(aor_id);
@@ -602,10 +858,11 @@ SubscriberDataManager::AoR* SubscriberDataManager::Connector::deserialize_aor(
 {
   AoR* aor = NULL;
 
-  for (JsonSerializerDeserializer* deserializer : _deserializers)
+  for (SerializerDeserializer* deserializer : _deserializers)
   {
-    TRC_DEBUG("Try to deserialize record for %s with JSON deserializer",
-              aor_id.c_str());
+    TRC_DEBUG("Try to deserialize record for %s with %s deserializer",
+              aor_id.c_str(),
+              deserializer->name().c_str());
     aor = deserializer->deserialize_aor(aor_id, s);
 
     if (aor != NULL)
@@ -665,20 +922,20 @@ SubscriberDataManager::AoR& SubscriberDataManager::AoR::operator= (AoR const& ot
 
 void SubscriberDataManager::AoR::common_constructor(const AoR& other)
 {
+  // The bindings and subscriptions are shared with the other AoR until one of
+  // the AoRs changes them.
   for (Bindings::const_iterator i = other._bindings.begin();
        i != other._bindings.end();
        ++i)
   {
-    Binding* bb = new Binding(*i->second);
-    _bindings.insert(std::make_pair(i->first, bb));
+    _bindings.insert(std::make_pair(i->first, share(i->second)));
   }
 
   for (Subscriptions::const_iterator i = other._subscriptions.begin();
        i != other._subscriptions.end();
        ++i)
   {
-    Subscription* ss = new Subscription(*i->second);
-    _subscriptions.insert(std::make_pair(i->first, ss));
+    _subscriptions.insert(std::make_pair(i->first, share(i->second)));
   }
 
   _notify_cseq = other._notify_cseq;
@@ -697,7 +954,7 @@ void SubscriberDataManager::AoR::clear(bool clear_emergency_bindings)
   {
     if ((clear_emergency_bindings) || (!i->second->_emergency_registration))
     {
-      delete i->second;
+      release(i->second);
       _bindings.erase(i++);
     }
     else
@@ -715,7 +972,7 @@ void SubscriberDataManager::AoR::clear(bool clear_emergency_bindings)
        i != _subscriptions.end();
        ++i)
   {
-    delete i->second;
+    release(i->second);
   }
 
   _subscriptions.clear();
@@ -729,10 +986,10 @@ SubscriberDataManager::AoR::Binding*
          SubscriberDataManager::AoR::get_binding(const std::string& binding_id)
 {
   AoR::Binding* b;
-  AoR::Bindings::const_iterator i = _bindings.find(binding_id);
+  AoR::Bindings::iterator i = _bindings.find(binding_id);
   if (i != _bindings.end())
   {
-    b = i->second;
+    b = change(i->second);
   }
   else
   {
@@ -752,7 +1009,7 @@ void SubscriberDataManager::AoR::remove_binding(const std::string& binding_id)
   AoR::Bindings::iterator i = _bindings.find(binding_id);
   if (i != _bindings.end())
   {
-    delete i->second;
+    release(i->second);
     _bindings.erase(i);
   }
 }
@@ -763,10 +1020,10 @@ SubscriberDataManager::AoR::Subscription*
        SubscriberDataManager::AoR::get_subscription(const std::string& to_tag)
 {
   AoR::Subscription* s;
-  AoR::Subscriptions::const_iterator i = _subscriptions.find(to_tag);
+  AoR::Subscriptions::iterator i = _subscriptions.find(to_tag);
   if (i != _subscriptions.end())
   {
-    s = i->second;
+    s = change(i->second);
   }
   else
   {
@@ -785,7 +1042,7 @@ void SubscriberDataManager::AoR::remove_subscription(const std::string& to_tag)
   AoR::Subscriptions::iterator i = _subscriptions.find(to_tag);
   if (i != _subscriptions.end())
   {
-    delete i->second;
+    release(i->second);
     _subscriptions.erase(i);
   }
 }
@@ -797,7 +1054,7 @@ void SubscriberDataManager::AoR::clear_bindings()
        i != _bindings.end();
        ++i)
   {
-    delete i->second;
+    release(i->second);
   }
 
   // Clear the bindings map.
@@ -1038,6 +1295,58 @@ void SubscriberDataManager::AoR::Subscription::from_json(const rapidjson::Value&
   JSON_GET_INT_MEMBER(s_obj, JSON_EXPIRES, _expires);
 }
 
+/// Appends a binding or subscription serialized as JSON to a string.  The
+/// result is kept in the member's cache if it is unchanged from the store.
+template <class T>
+static void append_member_json(const T* member,
+                               bool changed,
+                               std::string& cache,
+                               std::string& out)
+{
+  if (!cache.empty())
+  {
+    out.append(cache);
+    return;
+  }
+
+  // rapidjson needs an object or array at the top level, so write the member
+  // as the only element of an array and strip the brackets.
+  rapidjson::StringBuffer sb;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+  writer.StartArray();
+  member->to_json(writer);
+  writer.EndArray();
+
+  std::string json(sb.GetString() + 1, sb.GetSize() - 2);
+  out.append(json);
+
+  if (!changed)
+  {
+    cache.swap(json);
+  }
+}
+
+/// Appends a string to hand-built JSON, escaped in the same way as rapidjson.
+static void append_json_string(std::string& out, const std::string& value)
+{
+  rapidjson::StringBuffer sb;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+  writer.StartArray();
+  writer.String(value.c_str());
+  writer.EndArray();
+  out.append(sb.GetString() + 1, sb.GetSize() - 2);
+}
+
+void SubscriberDataManager::AoR::Binding::append_json(std::string& out) const
+{
+  append_member_json(this, _state._changed, _state._json, out);
+}
+
+void SubscriberDataManager::AoR::Subscription::append_json(std::string& out) const
+{
+  append_member_json(this, _state._changed, _state._json, out);
+}
+
 // Utility function to return the expiry time of the binding or subscription due
 // to expire next. If the function finds no expiry times in the bindings or
 // subscriptions it returns 0. This function should never be called on an empty AoR,
@@ -1083,18 +1392,47 @@ void SubscriberDataManager::AoR::copy_subscriptions_and_bindings(SubscriberDataM
        i != source_aor->bindings().end();
        ++i)
   {
-    Binding* src = i->second;
-    Binding* dst = get_binding(i->first);
-    *dst = *src;
+    Binding*& dst = _bindings[i->first];
+    if (dst != i->second)
+    {
+      if (dst != NULL)
+      {
+        release(dst);
+      }
+      dst = share(i->second);
+    }
   }
 
   for (Subscriptions::const_iterator i = source_aor->subscriptions().begin();
        i != source_aor->subscriptions().end();
        ++i)
   {
-    Subscription* src = i->second;
-    Subscription* dst = get_subscription(i->first);
-    *dst = *src;
+    Subscription*& dst = _subscriptions[i->first];
+    if (dst != i->second)
+    {
+      if (dst != NULL)
+      {
+        release(dst);
+      }
+      dst = share(i->second);
+    }
+  }
+}
+
+void SubscriberDataManager::AoR::mark_unchanged()
+{
+  for (Bindings::const_iterator i = _bindings.begin();
+       i != _bindings.end();
+       ++i)
+  {
+    i->second->_state._changed = false;
+  }
+
+  for (Subscriptions::const_iterator i = _subscriptions.begin();
+       i != _subscriptions.end();
+       ++i)
+  {
+    i->second->_state._changed = false;
   }
 }
 
@@ -1179,58 +1517,433 @@ SubscriberDataManager::AoR* SubscriberDataManager::JsonSerializerDeserializer::
 
 std::string SubscriberDataManager::JsonSerializerDeserializer::serialize_aor(AoR* aor_data)
 {
-  rapidjson::StringBuffer sb;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+  // The document is built by hand (producing the same output as rapidjson
+  // would) so that bindings and subscriptions that haven't changed since they
+  // were read from the store don't have to be serialized again.
+  std::string data;
 
-  writer.StartObject();
+  data.push_back('{');
   {
     //
     // Bindings
     //
-    writer.String(JSON_BINDINGS);
-    writer.StartObject();
+    append_json_string(data, JSON_BINDINGS);
+    data.append(":{");
+    for (AoR::Bindings::const_iterator it = aor_data->bindings().begin();
+         it != aor_data->bindings().end();
+         ++it)
     {
-      for (AoR::Bindings::const_iterator it = aor_data->bindings().begin();
-           it != aor_data->bindings().end();
-           ++it)
+      if (it != aor_data->bindings().begin())
       {
-        writer.String(it->first.c_str());
-        it->second->to_json(writer);
+        data.push_back(',');
       }
+      append_json_string(data, it->first);
+      data.push_back(':');
+      it->second->append_json(data);
     }
-    writer.EndObject();
+    data.append("},");
 
     //
     // Subscriptions.
     //
-    writer.String(JSON_SUBSCRIPTIONS);
-    writer.StartObject();
+    append_json_string(data, JSON_SUBSCRIPTIONS);
+    data.append(":{");
+    for (AoR::Subscriptions::const_iterator it = aor_data->subscriptions().begin();
+         it != aor_data->subscriptions().end();
+         ++it)
     {
-      for (AoR::Subscriptions::const_iterator it = aor_data->subscriptions().begin();
-           it != aor_data->subscriptions().end();
-           ++it)
+      if (it != aor_data->subscriptions().begin())
       {
-        writer.String(it->first.c_str());
-        it->second->to_json(writer);
+        data.push_back(',');
       }
+      append_json_string(data, it->first);
+      data.push_back(':');
+      it->second->append_json(data);
     }
-    writer.EndObject();
+    data.append("},");
 
     // Notify Cseq flag
-    writer.String(JSON_NOTIFY_CSEQ); writer.Int(aor_data->_notify_cseq);
-    writer.String(JSON_TIMER_ID); writer.String(aor_data->_timer_id.c_str());
-    writer.String(JSON_SCSCF_URI); writer.String(aor_data->_scscf_uri.c_str());
+    append_json_string(data, JSON_NOTIFY_CSEQ);
+    data.push_back(':');
+    data.append(std::to_string(aor_data->_notify_cseq));
+    data.push_back(',');
+    append_json_string(data, JSON_TIMER_ID);
+    data.push_back(':');
+    append_json_string(data, aor_data->_timer_id);
+    data.push_back(',');
+    append_json_string(data, JSON_SCSCF_URI);
+    data.push_back(':');
+    append_json_string(data, aor_data->_scscf_uri);
+  }
+  data.push_back('}');
+
+  return data;
+}
+
+//
+// (De)serializer for the binary SubscriberDataManager format.
+//
+// The data starts with a marker byte and the format version.  Integers are
+// written as variable length (7 bits per byte) unsigned values, with signed
+// values zig-zag encoded first so that small negative numbers stay small.
+// Each string is written as either a reference to a string already written
+// (its index plus one) or a zero followed by the length and the bytes of a new
+// string, which is then given the next index.
+//
+
+static const char BINARY_MARKER = '\0';
+static const uint32_t BINARY_VERSION = 1;
+
+/// Helper for writing the binary format.
+class BinaryAoRWriter
+{
+public:
+  BinaryAoRWriter(std::string& data) : _data(data) {}
+
+  void write_uint(uint32_t value)
+  {
+    while (value >= 0x80)
+    {
+      _data.push_back((char)((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    _data.push_back((char)value);
+  }
+
+  void write_int(int32_t value)
+  {
+    write_uint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
   }
-  writer.EndObject();
 
-  return sb.GetString();
+  void write_bool(bool value)
+  {
+    _data.push_back(value ? 1 : 0);
+  }
+
+  void write_string(const std::string& value)
+  {
+    std::map<std::string, uint32_t>::const_iterator it = _strings.find(value);
+
+    if (it != _strings.end())
+    {
+      write_uint(it->second + 1);
+    }
+    else
+    {
+      write_uint(0);
+      write_uint(value.size());
+      _data.append(value);
+      _strings.insert(std::make_pair(value, (uint32_t)_strings.size()));
+    }
+  }
+
+  void write_string_list(const std::list<std::string>& values)
+  {
+    write_uint(values.size());
+    for (std::list<std::string>::const_iterator it = values.begin();
+         it != values.end();
+         ++it)
+    {
+      write_string(*it);
+    }
+  }
+
+private:
+  std::string& _data;
+  std::map<std::string, uint32_t> _strings;
+};
+
+/// Helper for reading the binary format.  Each method returns false if the
+/// data is truncated or otherwise invalid.
+class BinaryAoRReader
+{
+public:
+  BinaryAoRReader(const std::string& data) : _data(data), _pos(0) {}
+
+  bool read_uint(uint32_t& value)
+  {
+    value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+      if (_pos >= _data.size())
+      {
+        return false;
+      }
+
+      uint8_t byte = (uint8_t)_data[_pos++];
+      value |= (uint32_t)(byte & 0x7F) << shift;
+
+      if ((byte & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+
+    // Too many bytes for a 32-bit value.
+    return false;
+  }
+
+  bool read_int(int& value)
+  {
+    uint32_t encoded;
+    if (!read_uint(encoded))
+    {
+      return false;
+    }
+
+    value = (int)((encoded >> 1) ^ (~(encoded & 1) + 1));
+    return true;
+  }
+
+  bool read_byte(char& value)
+  {
+    if (_pos >= _data.size())
+    {
+      return false;
+    }
+
+    value = _data[_pos++];
+    return true;
+  }
+
+  bool read_bool(bool& value)
+  {
+    char byte;
+    if (!read_byte(byte))
+    {
+      return false;
+    }
+
+    value = (byte != 0);
+    return true;
+  }
+
+  bool read_string(std::string& value)
+  {
+    uint32_t ref;
+    if (!read_uint(ref))
+    {
+      return false;
+    }
+
+    if (ref > 0)
+    {
+      if (ref > _strings.size())
+      {
+        return false;
+      }
+
+      value = _strings[ref - 1];
+      return true;
+    }
+
+    uint32_t len;
+    if ((!read_uint(len)) || (len > _data.size() - _pos))
+    {
+      return false;
+    }
+
+    value.assign(_data, _pos, len);
+    _pos += len;
+    _strings.push_back(value);
+    return true;
+  }
+
+  bool read_string_list(std::list<std::string>& values)
+  {
+    uint32_t count;
+    if (!read_uint(count))
+    {
+      return false;
+    }
+
+    for (uint32_t ii = 0; ii < count; ++ii)
+    {
+      std::string value;
+      if (!read_string(value))
+      {
+        return false;
+      }
+      values.push_back(value);
+    }
+
+    return true;
+  }
+
+  bool at_end() const { return (_pos == _data.size()); }
+
+  size_t offset() const { return _pos; }
+
+private:
+  const std::string& _data;
+  size_t _pos;
+  std::vector<std::string> _strings;
+};
+
+std::string SubscriberDataManager::BinarySerializerDeserializer::serialize_aor(AoR* aor_data)
+{
+  std::string data;
+  BinaryAoRWriter writer(data);
+
+  data.push_back(BINARY_MARKER);
+  writer.write_uint(BINARY_VERSION);
+
+  writer.write_uint(aor_data->bindings().size());
+  for (AoR::Bindings::const_iterator it = aor_data->bindings().begin();
+       it != aor_data->bindings().end();
+       ++it)
+  {
+    const AoR::Binding* b = it->second;
+    writer.write_string(it->first);
+    writer.write_string(b->_uri);
+    writer.write_string(b->_cid);
+    writer.write_int(b->_cseq);
+    writer.write_int(b->_expires);
+    writer.write_int(b->_priority);
+
+    writer.write_uint(b->_params.size());
+    for (std::map<std::string, std::string>::const_iterator p = b->_params.begin();
+         p != b->_params.end();
+         ++p)
+    {
+      writer.write_string(p->first);
+      writer.write_string(p->second);
+    }
+
+    writer.write_string_list(b->_path_headers);
+    writer.write_string_list(b->_path_uris);
+    writer.write_string(b->_private_id);
+    writer.write_bool(b->_emergency_registration);
+  }
+
+  writer.write_uint(aor_data->subscriptions().size());
+  for (AoR::Subscriptions::const_iterator it = aor_data->subscriptions().begin();
+       it != aor_data->subscriptions().end();
+       ++it)
+  {
+    const AoR::Subscription* s = it->second;
+    writer.write_string(it->first);
+    writer.write_string(s->_req_uri);
+    writer.write_string(s->_from_uri);
+    writer.write_string(s->_from_tag);
+    writer.write_string(s->_to_uri);
+    writer.write_string(s->_to_tag);
+    writer.write_string(s->_cid);
+    writer.write_string_list(s->_route_uris);
+    writer.write_int(s->_expires);
+  }
+
+  writer.write_int(aor_data->_notify_cseq);
+  writer.write_string(aor_data->_timer_id);
+  writer.write_string(aor_data->_scscf_uri);
+
+  return data;
+}
+
+SubscriberDataManager::AoR* SubscriberDataManager::BinarySerializerDeserializer::
+  deserialize_aor(const std::string& aor_id, const std::string& s)
+{
+  BinaryAoRReader reader(s);
+  char marker;
+
+  if ((!reader.read_byte(marker)) || (marker != BINARY_MARKER))
+  {
+    TRC_DEBUG("Data is not in the binary format");
+    return NULL;
+  }
+
+  uint32_t version;
+  if ((!reader.read_uint(version)) || (version != BINARY_VERSION))
+  {
+    TRC_INFO("Unsupported binary AoR format version");
+    return NULL;
+  }
+
+  AoR* aor = new AoR(aor_id);
+  bool ok = true;
+
+  uint32_t num_bindings = 0;
+  ok = reader.read_uint(num_bindings);
+
+  for (uint32_t ii = 0; (ok) && (ii < num_bindings); ++ii)
+  {
+    std::string binding_id;
+    ok = reader.read_string(binding_id);
+
+    if (ok)
+    {
+      AoR::Binding* b = aor->get_binding(binding_id);
+      uint32_t num_params = 0;
+
+      ok = ((reader.read_string(b->_uri)) &&
+            (reader.read_string(b->_cid)) &&
+            (reader.read_int(b->_cseq)) &&
+            (reader.read_int(b->_expires)) &&
+            (reader.read_int(b->_priority)) &&
+            (reader.read_uint(num_params)));
+
+      for (uint32_t jj = 0; (ok) && (jj < num_params); ++jj)
+      {
+        std::string name;
+        std::string value;
+        ok = ((reader.read_string(name)) && (reader.read_string(value)));
+        b->_params[name] = value;
+      }
+
+      ok = ((ok) &&
+            (reader.read_string_list(b->_path_headers)) &&
+            (reader.read_string_list(b->_path_uris)) &&
+            (reader.read_string(b->_private_id)) &&
+            (reader.read_bool(b->_emergency_registration)));
+    }
+  }
+
+  uint32_t num_subscriptions = 0;
+  ok = ((ok) && (reader.read_uint(num_subscriptions)));
+
+  for (uint32_t ii = 0; (ok) && (ii < num_subscriptions); ++ii)
+  {
+    std::string to_tag;
+    ok = reader.read_string(to_tag);
+
+    if (ok)
+    {
+      AoR::Subscription* s = aor->get_subscription(to_tag);
+      ok = ((reader.read_string(s->_req_uri)) &&
+            (reader.read_string(s->_from_uri)) &&
+            (reader.read_string(s->_from_tag)) &&
+            (reader.read_string(s->_to_uri)) &&
+            (reader.read_string(s->_to_tag)) &&
+            (reader.read_string(s->_cid)) &&
+            (reader.read_string_list(s->_route_uris)) &&
+            (reader.read_int(s->_expires)));
+    }
+  }
+
+  ok = ((ok) &&
+        (reader.read_int(aor->_notify_cseq)) &&
+        (reader.read_string(aor->_timer_id)) &&
+        (reader.read_string(aor->_scscf_uri)) &&
+        (reader.at_end()));
+
+  if (!ok)
+  {
+    TRC_INFO("Failed to deserialize binary AoR (error at offset %zu)",
+             reader.offset());
+    delete aor; aor = NULL;
+  }
+
+  return aor;
 }
 
 /// ChronosTimerRequestSender Methods
 
 SubscriberDataManager::ChronosTimerRequestSender::
      ChronosTimerRequestSender(ChronosConnection* chronos_conn) :
-  _chronos_conn(chronos_conn)
+  _chronos_conn(chronos_conn),
+  _timer_wheel(NULL),
+  _backstop_delay(0)
 {
 }
 
@@ -1265,6 +1978,11 @@ void SubscriberDataManager::ChronosTimerRequestSender::send_timers(
   // We do this before getting next_expires to save on processing.
   if (current_aor->get_bindings_count() == 0)
   {
+    if (_timer_wheel != NULL)
+    {
+      _timer_wheel->cancel(aor_id);
+    }
+
     if (timer_id != "")
     {
       _chronos_conn->send_delete(timer_id, trail);
@@ -1283,9 +2001,29 @@ void SubscriberDataManager::ChronosTimerRequestSender::send_timers(
     TRC_DEBUG("get_next_expires returned 0. The expiry of AoR members is corrupt, or an empty (invalid) AoR was passed in.");
   }
 
-  if ((new_tags != old_tags)                 ||
-      (new_next_expires != old_next_expires) ||
-      (timer_id == ""))
+  if (_timer_wheel != NULL)
+  {
+    // The AoR is expired by the local timer.  The Chronos timer is only a
+    // backstop, so changes that don't move the next expiry (such as to the
+    // number of bindings and subscriptions in the tags) don't update it.
+    _timer_wheel->set(aor_id, new_next_expires);
+
+    if ((new_next_expires != old_next_expires) ||
+        (timer_id == ""))
+    {
+      int expiry = ((new_next_expires > now) ? (new_next_expires - now) : 0) +
+                   _backstop_delay;
+
+      set_timer(aor_id,
+                timer_id,
+                expiry,
+                new_tags,
+                trail);
+    }
+  }
+  else if ((new_tags != old_tags)                 ||
+           (new_next_expires != old_next_expires) ||
+           (timer_id == ""))
   {
     // Set the expiry time to be relative to now.
     int expiry = (new_next_expires > now) ? (new_next_expires - now) : (now);
@@ -1411,10 +2149,16 @@ void SubscriberDataManager::NotifySender::send_notifys(
       }
       else
       {
-        // The binding is in both AoRs. Check if the expiry time has changed at all
+        // The binding is in both AoRs. Check if the expiry time has changed at
+        // all (which it can't have done if the AoRs share the binding).
         NotifyUtils::ContactEvent event;
 
-        if (aor_orig_b_match->second->_expires < binding->_expires)
+        if (aor_orig_b_match->second == binding)
+        {
+          TRC_DEBUG("Binding %s is unchanged", b_id.c_str());
+          event = NotifyUtils::ContactEvent::REGISTERED;
+        }
+        else if (aor_orig_b_match->second->_expires < binding->_expires)
         {
           TRC_DEBUG("Binding %s has been refreshed", b_id.c_str());
           event = NotifyUtils::ContactEvent::REFRESHED;
@@ -1514,7 +2258,7 @@ void SubscriberDataManager::NotifySender::send_notifys(
 
         if (status == PJ_SUCCESS)
         {
-          subscription->_refreshed = false;
+          aor_pair->get_current()->get_subscription(s_id)->_refreshed = false;
         }
         else
         {
@@ -1585,6 +2329,7 @@ void SubscriberDataManager::NotifySender::send_notifys_for_expired_subscriptions
       pjsip_tx_data* tdata_notify = NULL;
 
       // This is a terminated subscription - set the expiry time to now
+      s = aor_pair->get_orig()->get_subscription(s_id);
       s->_expires = now;
       pj_status_t status = NotifyUtils::create_subscription_notify(
                                           &tdata_notify,
@@ -478,6 +478,10 @@ SubscriberDataManager::AoRPair* SubscriptionSproutletTsx::write_subscriptions_to
   std::string subscription_contact;
   std::string subscription_id;
 
+  // Serialize with other threads updating this AoR, so that the loop only
+  // retries when another node has updated it.
+  StripedLock::Guard write_guard(primary_sdm->write_lock(), aor);
+
   do
   {
     // delete NULL is safe, so we can do this on every iteration.
@@ -510,39 +514,26 @@ SubscriberDataManager::AoRPair* SubscriptionSproutletTsx::write_subscriptions_to
       }
       else
       {
-        std::vector<SubscriberDataManager*>::iterator it = backup_sdms.begin();
-        SubscriberDataManager::AoRPair* local_backup_aor = NULL;
+        SubscriberDataManager::AoRPair* local_backup_aor =
+          SubscriberDataManager::get_aor_data_from_any(
+            backup_sdms,
+            aor,
+            [](SubscriberDataManager::AoRPair* aor_pair)
+            {
+              return aor_pair->current_contains_subscriptions();
+            },
+            trail());
 
-        while ((it != backup_sdms.end()) && (!found_subscription))
+        if (local_backup_aor != NULL)
         {
-          if ((*it)->has_servers())
-          {
-            local_backup_aor = (*it)->get_aor_data(aor, trail());
-
-            if ((local_backup_aor != NULL) &&
-                (local_backup_aor->current_contains_subscriptions()))
-            {
-              // LCOV_EXCL_START - this code is very similar to code in handlers.cpp and is unit tested there.
-              found_subscription = true;
-              backup_aor = local_backup_aor;
-
-              // Flag that we have allocated the memory for the backup pair so
-              // that we can tidy it up later.
-              backup_aor_alloced = true;
-              // LCOV_EXCL_STOP
-            }
-          }
-
-          if (!found_subscription)
-          {
-            ++it;
-
-            if (local_backup_aor != NULL)
-            {
-              delete local_backup_aor;
-              local_backup_aor = NULL;
-            }
-          }
+          // LCOV_EXCL_START - this code is very similar to code in handlers.cpp and is unit tested there.
+          found_subscription = true;
+          backup_aor = local_backup_aor;
+
+          // Flag that we have allocated the memory for the backup pair so
+          // that we can tidy it up later.
+          backup_aor_alloced = true;
+          // LCOV_EXCL_STOP
         }
       }
 
@@ -656,6 +647,9 @@ SubscriberDataManager::AoRPair* SubscriptionSproutletTsx::write_subscriptions_to
         // Pass the response to the ACR.
         acr->tx_response(rsp);
 
+        // The AoR has been written, so other threads can update it while we
+        // send the response.
+        StripedLock::Release release;
         send_response(rsp);
       }
     }
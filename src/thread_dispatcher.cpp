@@ -25,9 +25,13 @@ extern "C" {
 #include <list>
 #include <queue>
 #include <string>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
 
 #include "constants.h"
-#include "eventq.h"
+#include "thread_dispatcher.h"
+#include "priority_event_queue.h"
 #include "pjutils.h"
 #include "log.h"
 #include "sas.h"
@@ -46,6 +50,7 @@ extern "C" {
 #include "exception_handler.h"
 #include "snmp_event_accumulator_table.h"
 #include "snmp_event_accumulator_by_scope_table.h"
+#include "snmp_counter_by_scope_table.h"
 
 static std::vector<pj_thread_t*> worker_threads;
 
@@ -56,6 +61,15 @@ struct MessageEvent
 
   // A stop watch for tracking SIP message latency
   Utils::StopWatch stop_watch;
+
+  // The priority the message was queued at
+  int priority;
+
+  // The queue the message was put on
+  size_t queue;
+
+  // The connection the message arrived on, if it is connection-oriented
+  pjsip_transport* connection;
 };
 
 // An Event on the queue is either a SIP message or a callback
@@ -76,8 +90,54 @@ struct worker_thread_qe
   Event event;
 };
 
-// Queue for incoming events.
-eventq<struct worker_thread_qe> worker_thread_q;
+// Queues for incoming events.  By default there is a single queue shared by
+// all the worker threads.  If the queues are sharded, each worker thread has
+// its own queue.  SIP messages are assigned to a queue by hashing their
+// Call-ID, so all the messages for a dialog are normally processed by the
+// same thread, and idle worker threads steal events from the other queues.
+//
+// Each queue has a number of priority levels, so that events that complete
+// work already in progress (such as responses and callbacks) are not held up
+// behind new requests.
+static std::vector<PriorityEventQueue<struct worker_thread_qe>*> worker_thread_qs;
+static bool sharded_queues = false;
+
+// Total number of events across all the queues.  This is tracked separately
+// so that we don't have to lock every queue to report the queue size.
+static std::atomic<int> queued_events(0);
+
+// Used to spread callbacks (which have no Call-ID) across sharded queues.
+static std::atomic<unsigned int> next_callback_queue(0);
+
+// The priority of each class of event.
+static std::vector<int> event_priorities;
+
+// The longest time an event waits on a queue before it is processed ahead of
+// higher priority events (in milliseconds).
+static const int MAX_PRIORITY_WAIT = 1000;
+
+// Set when the worker threads are being stopped.
+static std::atomic<bool> terminating(false);
+
+// Held for reading while a callback is queued, and for writing while the
+// worker threads are told to stop, so that no callback can be queued once
+// the queues have been terminated (callbacks can be queued from any thread).
+static pthread_rwlock_t worker_qs_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+#ifdef UNIT_TEST
+// The UTs don't start the worker threads, so callbacks are held here until
+// the test runs them.
+static pthread_mutex_t ut_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::queue<PJUtils::Callback*> ut_callbacks;
+#endif
+
+// Worker threads that have found no work on any of the sharded queues wait
+// on this condition, which is signalled as events are queued.  The count of
+// idle workers means that queuing an event only needs to take the lock if
+// there is a worker to wake.
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static std::atomic<int> idle_workers(0);
 
 // Deadlock detection threshold for the message queue (in milliseconds).  This
 // is set to roughly twice the expected maximum service time for each message
@@ -85,14 +145,275 @@ eventq<struct worker_thread_qe> worker_thread_q;
 // from a single request, each with a possible 500ms timeout).
 static const int MSG_Q_DEADLOCK_TIME = 4000;
 
+// High-water mark for the queues, or zero if they are unbounded.
+static int max_queue_depth = 0;
+
+// The number of messages on the queues from each connection-oriented
+// transport.  When the queues are overloaded, connections holding more than
+// their share of the high-water mark have their requests rejected, so that
+// back-pressure falls on the connections causing the overload.
+static pthread_mutex_t connection_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_map<pjsip_transport*, int> connection_events;
+
 static int num_worker_threads = 1;
 static SNMP::EventAccumulatorByScopeTable* latency_table = NULL;
+static std::vector<SNMP::EventAccumulatorByScopeTable*> priority_latency_tables;
 static LoadMonitor* load_monitor = NULL;
 static SNMP::EventAccumulatorByScopeTable* queue_size_table = NULL;
+static std::vector<SNMP::EventAccumulatorByScopeTable*> shard_latency_tables;
+static std::vector<SNMP::EventAccumulatorByScopeTable*> shard_queue_size_tables;
+static SNMP::CounterByScopeTable* overload_counter = NULL;
 static ExceptionHandler* exception_handler = NULL;
 
 static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata);
 
+/// Selects the queue for a received message.
+static size_t queue_for_message(pjsip_rx_data* rdata)
+{
+  if (!sharded_queues)
+  {
+    return 0;
+  }
+
+  pjsip_cid_hdr* cid = (pjsip_cid_hdr*)rdata->msg_info.cid;
+  if (cid == NULL)
+  {
+    // No Call-ID to give the message an affinity, so treat it like a
+    // callback.
+    return next_callback_queue++ % worker_thread_qs.size();
+  }
+
+  pj_uint32_t hash = pj_hash_calc(0, cid->id.ptr, cid->id.slen);
+  return hash % worker_thread_qs.size();
+}
+
+/// Determines the class of a received message.
+static WorkerEventClass message_class(pjsip_rx_data* rdata)
+{
+  pjsip_msg* msg = rdata->msg_info.msg;
+
+  if (msg->type != PJSIP_REQUEST_MSG)
+  {
+    return RESPONSE_EVENT;
+  }
+
+  // ACK, BYE and CANCEL end work already in progress, as do any other
+  // requests within a dialog.
+  pjsip_method_e method = msg->line.req.method.id;
+  if ((method == PJSIP_ACK_METHOD) ||
+      (method == PJSIP_BYE_METHOD) ||
+      (method == PJSIP_CANCEL_METHOD) ||
+      ((rdata->msg_info.to != NULL) && (rdata->msg_info.to->tag.slen != 0)))
+  {
+    return IN_DIALOG_EVENT;
+  }
+
+  return NEW_REQUEST_EVENT;
+}
+
+/// Adds an event to the specified queue, tracking the total queue size.
+static void enqueue_event(size_t queue,
+                          const struct worker_thread_qe& qe,
+                          int priority)
+{
+  // Track the current queue size, both in total and for this queue.
+  queue_size_table->accumulate(queued_events.load());
+
+  int depth = worker_thread_qs[queue]->size();
+  if (shard_queue_size_tables[queue] != NULL)
+  {
+    shard_queue_size_tables[queue]->accumulate(depth);
+  }
+
+  TRC_DEBUG("Queuing event on queue %zu at priority %d (depth %d)",
+            queue, priority, depth);
+  queued_events++;
+  worker_thread_qs[queue]->push(qe, priority);
+
+  // If any worker threads are idle, wake one to take the event (which it
+  // will steal if it isn't on the worker's own queue).
+  if (idle_workers > 0)
+  {
+    pthread_mutex_lock(&idle_lock);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+  }
+}
+
+/// Gets the next event for a worker thread, blocking until one is available.
+/// Returns false if the worker thread should exit.
+static bool get_event(size_t queue, struct worker_thread_qe& qe)
+{
+  bool found = false;
+
+  if (!sharded_queues)
+  {
+    found = worker_thread_qs[0]->pop(qe);
+  }
+  else
+  {
+    size_t num_queues = worker_thread_qs.size();
+
+    while ((!found) && (!terminating))
+    {
+      // Take work from our own queue if there is any.  Otherwise try to take
+      // it from the others, starting with our neighbour so that the threads
+      // don't all steal from the same queue.
+      for (size_t ii = 0; (!found) && (ii < num_queues); ++ii)
+      {
+        found = worker_thread_qs[(queue + ii) % num_queues]->pop(qe, 0);
+      }
+
+      if (!found)
+      {
+        // There's no work on any queue, so wait until some is queued.  The
+        // check of the total queued events is made after registering as idle,
+        // so an event queued after the queues were checked either is seen
+        // here or wakes us.
+        pthread_mutex_lock(&idle_lock);
+        idle_workers++;
+
+        if ((queued_events == 0) && (!terminating))
+        {
+          pthread_cond_wait(&idle_cond, &idle_lock);
+        }
+
+        idle_workers--;
+        pthread_mutex_unlock(&idle_lock);
+      }
+    }
+  }
+
+  if (found)
+  {
+    queued_events--;
+  }
+
+  return found;
+}
+
+/// Returns whether the queues are at or above their high-water mark.
+static bool queues_overloaded()
+{
+  return ((max_queue_depth > 0) && (queued_events >= max_queue_depth));
+}
+
+/// Determines whether a message can be rejected when the queues are
+/// overloaded.  Only requests that start new work (out-of-dialog INVITEs and
+/// REGISTERs) are rejected, so that work already in progress can complete.
+static bool is_rejectable(pjsip_rx_data* rdata)
+{
+  pjsip_msg* msg = rdata->msg_info.msg;
+
+  if (msg->type != PJSIP_REQUEST_MSG)
+  {
+    return false;
+  }
+
+  if (msg->line.req.method.id == PJSIP_REGISTER_METHOD)
+  {
+    return true;
+  }
+
+  return ((msg->line.req.method.id == PJSIP_INVITE_METHOD) &&
+          (rdata->msg_info.to != NULL) &&
+          (rdata->msg_info.to->tag.slen == 0));
+}
+
+/// Rejects a request statelessly because the queues are overloaded.
+static void reject_overloaded(pjsip_rx_data* rdata)
+{
+  SAS::TrailId trail = get_trail(rdata);
+  int queue_depth = queued_events;
+  TRC_DEBUG("Rejected request as worker queues are overloaded (%d events)",
+            queue_depth);
+
+  SAS::Event event(trail, SASEvent::WORKER_QUEUE_OVERLOAD, 0);
+  event.add_static_param(queue_depth);
+  event.add_static_param(max_queue_depth);
+  SAS::report_event(event);
+
+  // Respond in the same way as when the load monitor rejects a request, with
+  // a Retry-After header with a zero length timeout.
+  pjsip_retry_after_hdr* retry_after =
+                             pjsip_retry_after_hdr_create(rdata->tp_info.pool, 0);
+  PJUtils::respond_stateless(stack_data.endpt,
+                             rdata,
+                             PJSIP_SC_SERVICE_UNAVAILABLE,
+                             NULL,
+                             (pjsip_hdr*)retry_after,
+                             NULL);
+
+  overload_counter->increment();
+
+  // A queue this deep means the load monitor is admitting more requests than
+  // we can process, so tell it to reduce its rate.
+  load_monitor->incr_penalties();
+}
+
+/// Records that a message from a connection has been queued.
+static void connection_event_queued(pjsip_transport* connection)
+{
+  pthread_mutex_lock(&connection_events_lock);
+  connection_events[connection]++;
+  pthread_mutex_unlock(&connection_events_lock);
+}
+
+/// Records that a message from a connection has been processed.  This must be
+/// called while the message still holds its reference to the transport.
+static void connection_event_done(pjsip_transport* connection)
+{
+  pthread_mutex_lock(&connection_events_lock);
+  std::unordered_map<pjsip_transport*, int>::iterator it =
+                                          connection_events.find(connection);
+  if ((it != connection_events.end()) && (--it->second <= 0))
+  {
+    connection_events.erase(it);
+  }
+  pthread_mutex_unlock(&connection_events_lock);
+}
+
+/// Determines whether a request should be rejected because the queues are
+/// overloaded and the connection it arrived on holds more than its share of
+/// the queued messages (the high-water mark divided equally between the
+/// connections with messages queued, but at least one message).  Only requests
+/// that start new work (REGISTERs and requests outside a dialog) are pushed
+/// back, so that dialogs already in progress on the connection can complete.
+static bool connection_over_share(pjsip_rx_data* rdata)
+{
+  pjsip_transport* connection = rdata->tp_info.transport;
+  pjsip_msg* msg = rdata->msg_info.msg;
+
+  if ((!(connection->flag & PJSIP_TRANSPORT_RELIABLE)) ||
+      (msg->type != PJSIP_REQUEST_MSG) ||
+      (msg->line.req.method.id == PJSIP_ACK_METHOD) ||
+      (msg->line.req.method.id == PJSIP_CANCEL_METHOD))
+  {
+    return false;
+  }
+
+  if ((msg->line.req.method.id != PJSIP_REGISTER_METHOD) &&
+      ((rdata->msg_info.to == NULL) || (rdata->msg_info.to->tag.slen != 0)))
+  {
+    // In-dialog request.
+    return false;
+  }
+
+  bool over_share = false;
+
+  pthread_mutex_lock(&connection_events_lock);
+  std::unordered_map<pjsip_transport*, int>::iterator it =
+                                          connection_events.find(connection);
+  if (it != connection_events.end())
+  {
+    int share = std::max(1, max_queue_depth / (int)connection_events.size());
+    over_share = (it->second > share);
+  }
+  pthread_mutex_unlock(&connection_events_lock);
+
+  return over_share;
+}
+
 // Module to clone SIP requests and dispatch them to worker threads.
 
 // Priority of PJSIP_MOD_PRIORITY_TRANSPORT_LAYER-1 causes this to run
@@ -129,11 +450,12 @@ static int worker_thread(void* p)
   rp.start_mod = &mod_thread_dispatcher;
   rp.idx_after_start = 1;
 
-  TRC_DEBUG("Worker thread started");
+  size_t queue = (size_t)p;
+  TRC_DEBUG("Worker thread started (queue %zu)", queue);
 
   struct worker_thread_qe qe = { MESSAGE };
 
-  while (worker_thread_q.pop(qe))
+  while (get_event(queue, qe))
   {
     if (qe.type == MESSAGE)
     {
@@ -193,6 +515,12 @@ static int worker_thread(void* p)
         CW_END
 
         TRC_DEBUG("Worker thread completed processing message %p", rdata);
+
+        if (me->connection != NULL)
+        {
+          connection_event_done(me->connection);
+        }
+
         pjsip_rx_data_free_cloned(rdata);
 
         unsigned long latency_us = 0;
@@ -200,6 +528,14 @@ static int worker_thread(void* p)
         {
           TRC_DEBUG("Request latency = %ldus", latency_us);
           latency_table->accumulate(latency_us);
+          if (shard_latency_tables[me->queue] != NULL)
+          {
+            shard_latency_tables[me->queue]->accumulate(latency_us);
+          }
+          if (priority_latency_tables[me->priority] != NULL)
+          {
+            priority_latency_tables[me->priority]->accumulate(latency_us);
+          }
           load_monitor->request_complete(latency_us);
         }
         else
@@ -230,20 +566,37 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   SAS::report_event(event);
 
   // Check that the worker threads are not all deadlocked.
-  if (worker_thread_q.is_deadlocked())
+  for (size_t ii = 0; ii < worker_thread_qs.size(); ++ii)
   {
-    // The queue has not been serviced for sufficiently long to imply that
-    // all the worker threads are deadlock, so exit the process so it will be
-    // restarted.
-    CL_SPROUT_SIP_DEADLOCK.log();
-    TRC_ERROR("Detected worker thread deadlock - exiting");
-    abort();
+    if (worker_thread_qs[ii]->is_deadlocked())
+    {
+      // The queue has not been serviced for sufficiently long to imply that
+      // all the worker threads are deadlock, so exit the process so it will
+      // be restarted.  (Sharded queues are serviced by any idle worker thread,
+      // so this is true of each queue individually.)
+      CL_SPROUT_SIP_DEADLOCK.log();
+      TRC_ERROR("Detected worker thread deadlock on queue %zu - exiting", ii);
+      abort();
+    }
+  }
+
+  // If the queues are overloaded, reject INVITEs and REGISTERs that would
+  // start new work before doing the work of cloning them, along with any other
+  // new work from connections that are sending more than their share.
+  // Everything else is still queued.  The transport thread never waits for
+  // the queues to drain, as that would hold up every other connection.
+  if ((queues_overloaded()) &&
+      ((is_rejectable(rdata)) || (connection_over_share(rdata))))
+  {
+    reject_overloaded(rdata);
+    return PJ_TRUE;
   }
 
   // Before we start, get a timestamp.  This will track the time from
   // receiving a message to forwarding it on (or rejecting it).
   MessageEvent* me = new MessageEvent();
   me->stop_watch.start();
+  me->priority = event_priorities[message_class(rdata)];
 
   // Clone the message and queue it to a scheduler thread.
   pjsip_rx_data* clone_rdata;
@@ -259,29 +612,39 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   // Make sure the trail identifier is passed across.
   set_trail(clone_rdata, get_trail(rdata));
 
-  // @TODO - need to think about back-pressure mechanisms.  For example,
-  // should we have a maximum depth of queue and drop messages after that?
-  // May be better to hold on to the message until the queue has space - this
-  // will force back pressure on the particular TCP connection.  Or should we
-  // have a queue per transport and round-robin them?
-
   TRC_DEBUG("Queuing cloned received message %p for worker threads", clone_rdata);
   me->rdata = clone_rdata;
   Event queue_event;
   queue_event.message = me;
   struct worker_thread_qe qe = { MESSAGE, queue_event };
+  me->queue = queue_for_message(clone_rdata);
+
+  // Track how much of the queued work came from each connection.  The cloned
+  // message holds a reference to the transport until it has been processed.
+  me->connection = NULL;
+  if ((max_queue_depth > 0) &&
+      (clone_rdata->tp_info.transport->flag & PJSIP_TRANSPORT_RELIABLE))
+  {
+    me->connection = clone_rdata->tp_info.transport;
+    connection_event_queued(me->connection);
+  }
 
-  // Track the current queue size
-  queue_size_table->accumulate(worker_thread_q.size());
-  worker_thread_q.push(qe);
+  enqueue_event(me->queue, qe, me->priority);
 
   // return TRUE to flag that we have absorbed the incoming message.
   return PJ_TRUE;
 }
 
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
+                                   bool sharded_queues_arg,
+                                   int max_queue_depth_arg,
+                                   const std::vector<int>& event_priorities_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_table_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& priority_latency_tables_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_table_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& shard_latency_tables_arg,
+                                   const std::vector<SNMP::EventAccumulatorByScopeTable*>& shard_queue_size_tables_arg,
+                                   SNMP::CounterByScopeTable* overload_counter_arg,
                                    LoadMonitor* load_monitor_arg,
                                    ExceptionHandler* exception_handler_arg)
 {
@@ -289,12 +652,34 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
   // start_worker_threads is called.
   worker_threads.resize(num_worker_threads_arg);
 
-  // Enable deadlock detection on the message queue.
-  worker_thread_q.set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
+  // The dispatcher may have been stopped before (in the UTs).
+  terminating = false;
+
+  // Create the queues, with deadlock detection enabled on each.
+  sharded_queues = sharded_queues_arg;
+  size_t num_queues = sharded_queues ? num_worker_threads_arg : 1;
+
+  for (size_t ii = 0; ii < num_queues; ++ii)
+  {
+    PriorityEventQueue<struct worker_thread_qe>* q =
+      new PriorityEventQueue<struct worker_thread_qe>(NUM_WORKER_PRIORITIES,
+                                                      MAX_PRIORITY_WAIT);
+    q->set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
+    worker_thread_qs.push_back(q);
+  }
 
   num_worker_threads = num_worker_threads_arg;
   latency_table = latency_table_arg;
+  priority_latency_tables = priority_latency_tables_arg;
+  priority_latency_tables.resize(NUM_WORKER_PRIORITIES, NULL);
+  event_priorities = event_priorities_arg;
   queue_size_table = queue_size_table_arg;
+  shard_latency_tables = shard_latency_tables_arg;
+  shard_latency_tables.resize(num_queues, NULL);
+  shard_queue_size_tables = shard_queue_size_tables_arg;
+  shard_queue_size_tables.resize(num_queues, NULL);
+  overload_counter = overload_counter_arg;
+  max_queue_depth = max_queue_depth_arg;
   load_monitor = load_monitor_arg;
   exception_handler = exception_handler_arg;
 
@@ -312,8 +697,10 @@ pj_status_t start_worker_threads()
   for (size_t ii = 0; ii < worker_threads.size(); ++ii)
   {
     pj_thread_t* thread;
+    // Each worker thread is passed the index of its own queue (which is
+    // ignored if the queues aren't sharded).
     status = pj_thread_create(stack_data.pool, "worker", &worker_thread,
-                              NULL, 0, 0, &thread);
+                              (void*)(sharded_queues ? ii : 0), 0, 0, &thread);
     if (status != PJ_SUCCESS)
     {
       TRC_ERROR("Error creating worker thread, %s",
@@ -329,8 +716,20 @@ pj_status_t start_worker_threads()
 void stop_worker_threads()
 {
   // Now it is safe to signal the worker threads to exit via the queue and to
-  // wait for them to terminate.
-  worker_thread_q.terminate();
+  // wait for them to terminate.  Taking the lock for writing waits for any
+  // callback that is being queued, and callbacks are discarded from now on.
+  pthread_rwlock_wrlock(&worker_qs_lock);
+  terminating = true;
+  pthread_rwlock_unlock(&worker_qs_lock);
+  pthread_mutex_lock(&idle_lock);
+  pthread_cond_broadcast(&idle_cond);
+  pthread_mutex_unlock(&idle_lock);
+
+  for (size_t ii = 0; ii < worker_thread_qs.size(); ++ii)
+  {
+    worker_thread_qs[ii]->terminate();
+  }
+
   for (std::vector<pj_thread_t*>::iterator i = worker_threads.begin();
        i != worker_threads.end();
        ++i)
@@ -338,6 +737,12 @@ void stop_worker_threads()
     pj_thread_join(*i);
   }
   worker_threads.clear();
+
+  for (size_t ii = 0; ii < worker_thread_qs.size(); ++ii)
+  {
+    delete worker_thread_qs[ii];
+  }
+  worker_thread_qs.clear();
 }
 
 void unregister_thread_dispatcher(void)
@@ -348,14 +753,69 @@ void unregister_thread_dispatcher(void)
 
 void add_callback_to_queue(PJUtils::Callback* cb)
 {
+#ifdef UNIT_TEST
+  if (worker_thread_qs.empty())
+  {
+    pthread_mutex_lock(&ut_callbacks_lock);
+    ut_callbacks.push(cb);
+    pthread_mutex_unlock(&ut_callbacks_lock);
+    return;
+  }
+#endif
+
+  pthread_rwlock_rdlock(&worker_qs_lock);
+
+  if ((terminating) || (worker_thread_qs.empty()))
+  {
+    // The worker threads are stopping (asynchronous lookups can complete
+    // during shutdown), so the callback can never be run.
+    pthread_rwlock_unlock(&worker_qs_lock);
+    TRC_DEBUG("Discarding callback as the worker threads have stopped");
+    delete cb;
+    return;
+  }
+
   // Create an Event to hold the Callback
   Event queue_event;
   queue_event.callback = cb;
   worker_thread_qe qe = { CALLBACK, queue_event };
 
-  // Track the current queue size
-  queue_size_table->accumulate(worker_thread_q.size());
+  // Add the Event.  Callbacks have no affinity to a particular worker thread,
+  // so spread them across the queues.
+  size_t queue = sharded_queues ?
+                   (next_callback_queue++ % worker_thread_qs.size()) : 0;
+  enqueue_event(queue, qe, event_priorities[CALLBACK_EVENT]);
+
+  pthread_rwlock_unlock(&worker_qs_lock);
+}
+
+#ifdef UNIT_TEST
+int run_queued_callbacks()
+{
+  int count = 0;
+
+  while (true)
+  {
+    PJUtils::Callback* cb = NULL;
+
+    pthread_mutex_lock(&ut_callbacks_lock);
+    if (!ut_callbacks.empty())
+    {
+      cb = ut_callbacks.front();
+      ut_callbacks.pop();
+    }
+    pthread_mutex_unlock(&ut_callbacks_lock);
+
+    if (cb == NULL)
+    {
+      break;
+    }
+
+    cb->run();
+    delete cb;
+    ++count;
+  }
 
-  // Add the Event
-  worker_thread_q.push(qe);
+  return count;
 }
+#endif
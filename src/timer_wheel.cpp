@@ -0,0 +1,275 @@
+/**
+ * @file timer_wheel.cpp Hierarchical timer wheel for expiring keyed state.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+#include <string.h>
+
+#include "log.h"
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(const PopCallback& callback,
+                       int max_batch_size,
+                       SNMP::CounterTable* pops_tbl) :
+  _callback(callback),
+  _max_batch_size((max_batch_size > 0) ? max_batch_size : 1),
+  _pops_tbl(pops_tbl),
+  _terminating(false),
+  _started(false),
+  _current(time(NULL)),
+  _levels(NUM_LEVELS)
+{
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_cond, NULL);
+
+  _levels[0].resize(1 << INNER_BITS);
+  for (int level = 1; level < NUM_LEVELS; ++level)
+  {
+    _levels[level].resize(1 << OUTER_BITS);
+  }
+}
+
+TimerWheel::~TimerWheel()
+{
+  stop();
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+}
+
+void TimerWheel::start()
+{
+  int rc = pthread_create(&_thread, NULL, &tick_thread_fn, this);
+
+  if (rc == 0)
+  {
+    _started = true;
+  }
+  else
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to start timer wheel thread: %s", strerror(rc));
+    // LCOV_EXCL_STOP
+  }
+}
+
+void TimerWheel::stop()
+{
+  if (_started)
+  {
+    pthread_mutex_lock(&_lock);
+    _terminating = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    pthread_join(_thread, NULL);
+    _started = false;
+  }
+}
+
+void TimerWheel::set(const std::string& key, int expiry)
+{
+  pthread_mutex_lock(&_lock);
+
+  std::unordered_map<std::string, Timer>::iterator it = _timers.find(key);
+
+  if (it != _timers.end())
+  {
+    if (it->second.expiry == expiry)
+    {
+      // The timer is already set for this time.
+      pthread_mutex_unlock(&_lock);
+      return;
+    }
+
+    it->second.slot->erase(it->second.slot_it);
+  }
+  else
+  {
+    it = _timers.insert(std::make_pair(key, Timer())).first;
+  }
+
+  it->second.expiry = expiry;
+  insert(key, it->second);
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void TimerWheel::cancel(const std::string& key)
+{
+  pthread_mutex_lock(&_lock);
+
+  std::unordered_map<std::string, Timer>::iterator it = _timers.find(key);
+
+  if (it != _timers.end())
+  {
+    it->second.slot->erase(it->second.slot_it);
+    _timers.erase(it);
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+size_t TimerWheel::size()
+{
+  pthread_mutex_lock(&_lock);
+  size_t size = _timers.size();
+  pthread_mutex_unlock(&_lock);
+  return size;
+}
+
+void TimerWheel::pop(int now)
+{
+  std::vector<std::string> popped;
+
+  pthread_mutex_lock(&_lock);
+
+  if (_timers.empty())
+  {
+    // Nothing can pop, so skip straight to the present rather than ticking
+    // through every second since the wheel was last used.
+    if (_current <= now)
+    {
+      _current = now + 1;
+    }
+  }
+
+  while (_current <= now)
+  {
+    int index = _current & ((1 << INNER_BITS) - 1);
+
+    // At the start of each revolution of a level, move the timers in the
+    // next slot of the level outside it inwards.
+    for (int level = 1; (index == 0) && (level < NUM_LEVELS); ++level)
+    {
+      index = cascade(level);
+    }
+
+    std::list<std::string>& slot = _levels[0][_current & ((1 << INNER_BITS) - 1)];
+
+    while (!slot.empty())
+    {
+      std::string& key = slot.front();
+      std::unordered_map<std::string, Timer>::iterator it = _timers.find(key);
+      popped.push_back(key);
+      slot.pop_front();
+      _timers.erase(it);
+    }
+
+    _current++;
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  if (!popped.empty())
+  {
+    TRC_DEBUG("Popped %zu timers", popped.size());
+
+    if (_pops_tbl != NULL)
+    {
+      for (size_t ii = 0; ii < popped.size(); ++ii)
+      {
+        _pops_tbl->increment();
+      }
+    }
+
+    for (size_t start = 0; start < popped.size(); start += _max_batch_size)
+    {
+      size_t end = start + _max_batch_size;
+      if (end > popped.size())
+      {
+        end = popped.size();
+      }
+
+      std::vector<std::string> batch(popped.begin() + start,
+                                     popped.begin() + end);
+      _callback(batch);
+    }
+  }
+}
+
+void TimerWheel::insert(const std::string& key, Timer& timer)
+{
+  // Timers that are already due pop on the next tick.
+  int expiry = (timer.expiry > _current) ? timer.expiry : _current;
+  unsigned int delta = expiry - _current;
+
+  int level = 0;
+  while ((level < NUM_LEVELS - 1) &&
+         (delta >= (1u << level_shift(level + 1))))
+  {
+    level++;
+  }
+
+  if ((level == NUM_LEVELS - 1) &&
+      (delta >= (1u << (level_shift(level) + OUTER_BITS))))
+  {
+    // The timer is beyond the reach of the wheel, so put it in the last slot
+    // it does reach.  It is moved inwards (and back out here if need be) when
+    // that slot is cascaded.
+    expiry = _current + (1 << (level_shift(level) + OUTER_BITS)) - 1;
+  }
+
+  int bits = (level == 0) ? INNER_BITS : OUTER_BITS;
+  int index = (expiry >> level_shift(level)) & ((1 << bits) - 1);
+
+  timer.slot = &_levels[level][index];
+  timer.slot_it = timer.slot->insert(timer.slot->end(), key);
+}
+
+int TimerWheel::cascade(int level)
+{
+  int index = (_current >> level_shift(level)) & ((1 << OUTER_BITS) - 1);
+
+  std::list<std::string> slot;
+  slot.swap(_levels[level][index]);
+
+  for (std::list<std::string>::iterator it = slot.begin();
+       it != slot.end();
+       ++it)
+  {
+    insert(*it, _timers[*it]);
+  }
+
+  return index;
+}
+
+int TimerWheel::level_shift(int level)
+{
+  return (level == 0) ? 0 : INNER_BITS + (level - 1) * OUTER_BITS;
+}
+
+void* TimerWheel::tick_thread_fn(void* p)
+{
+  ((TimerWheel*)p)->tick_thread();
+  return NULL;
+}
+
+void TimerWheel::tick_thread()
+{
+  pthread_mutex_lock(&_lock);
+
+  while (!_terminating)
+  {
+    struct timespec wake;
+    clock_gettime(CLOCK_REALTIME, &wake);
+    wake.tv_sec += 1;
+    pthread_cond_timedwait(&_cond, &_lock, &wake);
+
+    if (!_terminating)
+    {
+      pthread_mutex_unlock(&_lock);
+      pop(time(NULL));
+      pthread_mutex_lock(&_lock);
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
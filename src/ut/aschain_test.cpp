@@ -10,6 +10,8 @@
  */
 
 #include <string>
+#include <thread>
+#include <vector>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -162,6 +164,40 @@ TEST_F(AsChainTest, Basics)
   EXPECT_TRUE(res.complete());
 }
 
+// ODI tokens are fixed-length hex strings, and strings that aren't valid
+// tokens are never found.
+TEST_F(AsChainTest, OdiTokens)
+{
+  IFCConfiguration ifc_configuration(false, false, "", &SNMP::FAKE_COUNTER_TABLE, &SNMP::FAKE_COUNTER_TABLE);
+  Ifcs ifcs = matching_ifcs(2, "sip:as1", "sip:as2");
+  AsChain* as_chain = new AsChain(_as_chain_table, SessionCase::Originating, "sip:5755550011@homedomain", true, 0, ifcs, NULL, NULL, ifc_configuration);
+  AsChainLink as_chain_link(as_chain, 0u);
+
+  std::string token = as_chain_link.next_odi_token();
+  EXPECT_THAT(token, MatchesRegex("[0-9a-f]{16}"));
+  EXPECT_NE(token, as_chain_link.next().next_odi_token());
+
+  // Tokens are accepted in either case.
+  std::string upper_token = token;
+  for (size_t ii = 0; ii < upper_token.length(); ++ii)
+  {
+    upper_token[ii] = toupper(upper_token[ii]);
+  }
+  AsChainLink res = _as_chain_table->lookup(upper_token);
+  EXPECT_EQ(as_chain, res._as_chain);
+  EXPECT_EQ(1u, res._index);
+  res.release();
+
+  EXPECT_FALSE(_as_chain_table->lookup("").is_set());
+  EXPECT_FALSE(_as_chain_table->lookup(token.substr(1)).is_set());
+  EXPECT_FALSE(_as_chain_table->lookup(token + "0").is_set());
+  EXPECT_FALSE(_as_chain_table->lookup("0123456789abcdeg").is_set());
+
+  // Once the chain is destroyed its tokens are no longer found.
+  as_chain_link.release();
+  EXPECT_FALSE(_as_chain_table->lookup(token).is_set());
+}
+
 // We have matching standard iFCs - we should select the ASs from
 // those iFCs and no more.
 TEST_F(AsChainTest, MatchingStandardiFCs)
@@ -499,3 +535,63 @@ TEST_F(AsChainTest, MatchingStandardiFCOnlyDummyAppServerWithFallbackiFCs)
   EXPECT_EQ(server_name, "");
   EXPECT_EQ(rc, PJSIP_SC_OK);
 }
+
+// Registers, looks up and unregisters AS chains' tokens from many threads at
+// once, to check that the table holds up when chains are created and
+// destroyed at a high rate.
+TEST_F(AsChainTest, ManyChainsConcurrently)
+{
+  const int NUM_THREADS = 16;
+  const int CHAINS_PER_THREAD = 5000;
+
+  IFCConfiguration ifc_configuration(false, false, "", &SNMP::FAKE_COUNTER_TABLE, &SNMP::FAKE_COUNTER_TABLE);
+  std::vector<AsChain*> as_chains;
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    Ifcs ifcs = matching_ifcs(3, "sip:as1", "sip:as2", "sip:as3");
+    as_chains.push_back(new AsChain(_as_chain_table, SessionCase::Originating, "sip:5755550011@homedomain", true, 0, ifcs, NULL, NULL, ifc_configuration));
+  }
+
+  std::vector<std::thread> threads;
+  std::vector<int> failures(NUM_THREADS, 0);
+
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    threads.push_back(std::thread([&, tt]()
+    {
+      AsChain* as_chain = as_chains[tt];
+
+      for (int ii = 0; ii < CHAINS_PER_THREAD; ++ii)
+      {
+        // Register a set of tokens for the chain, then look up each of the
+        // tokens that is passed to an AS, as the S-CSCF would.
+        std::vector<OdiToken> tokens;
+        _as_chain_table->register_(as_chain, tokens);
+
+        for (size_t jj = 1; jj < tokens.size(); ++jj)
+        {
+          AsChainLink link =
+            _as_chain_table->lookup(AsChainTable::token_to_string(tokens[jj]));
+          if ((link._as_chain != as_chain) || (link._index != jj))
+          {
+            failures[tt]++;
+          }
+          link.release();
+        }
+
+        _as_chain_table->unregister(tokens);
+      }
+    }));
+  }
+
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    threads[tt].join();
+    EXPECT_EQ(0, failures[tt]);
+  }
+
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    AsChainLink(as_chains[tt], 0u).release();
+  }
+}
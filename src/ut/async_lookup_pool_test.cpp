@@ -0,0 +1,136 @@
+/**
+ * @file async_lookup_pool_test.cpp UT for the asynchronous lookup pool.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <atomic>
+#include <string>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "async_lookup_pool.h"
+
+using namespace std;
+
+/// Fixture for AsyncLookupPoolTest.
+class AsyncLookupPoolTest : public ::testing::Test
+{
+public:
+  AsyncLookupPoolTest() : _lookups(0), _callbacks(0)
+  {
+  }
+
+  virtual ~AsyncLookupPoolTest()
+  {
+  }
+
+  // Returns a lookup that takes the specified time and returns the result.
+  AsyncLookupPool<string>::Lookup slow_lookup(int delay_ms,
+                                              const string& result)
+  {
+    return [=]()
+    {
+      _lookups++;
+      usleep(delay_ms * 1000);
+      return result;
+    };
+  }
+
+  // Returns a callback that checks the result.
+  AsyncLookupPool<string>::Callback check_result(const string& expected)
+  {
+    return [=](const string& result)
+    {
+      EXPECT_EQ(expected, result);
+      _callbacks++;
+    };
+  }
+
+  std::atomic<int> _lookups;
+  std::atomic<int> _callbacks;
+};
+
+TEST_F(AsyncLookupPoolTest, LookupsAreMerged)
+{
+  {
+    AsyncLookupPool<string> pool(2);
+
+    // The first request starts a lookup, and the rest are merged with it.
+    EXPECT_TRUE(pool.lookup("a", slow_lookup(100, "A"), check_result("A")));
+    for (int ii = 0; ii < 9; ++ii)
+    {
+      EXPECT_FALSE(pool.lookup("a", slow_lookup(100, "A"), check_result("A")));
+    }
+
+    // A request with a different key gets its own lookup.
+    EXPECT_TRUE(pool.lookup("b", slow_lookup(0, "B"), check_result("B")));
+
+    // Destroying the pool completes the outstanding lookups.
+  }
+
+  EXPECT_EQ(2, _lookups.load());
+  EXPECT_EQ(11, _callbacks.load());
+}
+
+TEST_F(AsyncLookupPoolTest, SlowLookupsDontBlock)
+{
+  AsyncLookupPool<string> pool(1);
+
+  // Requesting lookups returns immediately, however slow the lookups are.
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    pool.lookup(to_string(ii), slow_lookup(200, "X"), check_result("X"));
+  }
+  EXPECT_EQ(5u, pool.in_flight());
+  EXPECT_EQ(0, _callbacks.load());
+}
+
+TEST_F(AsyncLookupPoolTest, LaterLookupsAreNotMerged)
+{
+  AsyncLookupPool<string> pool(1);
+
+  // Once a lookup has completed, a new request for the same key starts a new
+  // lookup.
+  EXPECT_TRUE(pool.lookup("a", slow_lookup(0, "A"), check_result("A")));
+
+  for (int ii = 0; (_callbacks.load() == 0) && (ii < 100); ++ii)
+  {
+    usleep(10000);
+  }
+  ASSERT_EQ(1, _callbacks.load());
+
+  // The lookup is removed from the in-flight map just before its callbacks
+  // are run, so it has gone by now.
+  EXPECT_EQ(0u, pool.in_flight());
+  EXPECT_TRUE(pool.lookup("a", slow_lookup(0, "A"), check_result("A")));
+}
+
+TEST_F(AsyncLookupPoolTest, SubmittedLookupsAreNotMerged)
+{
+  {
+    AsyncLookupPool<string> pool(2);
+
+    // Submitted lookups always run, even if they are identical, and aren't
+    // counted as in flight.
+    for (int ii = 0; ii < 3; ++ii)
+    {
+      pool.submit(slow_lookup(50, "A"), check_result("A"));
+    }
+    EXPECT_EQ(0u, pool.in_flight());
+
+    // They don't stop a keyed lookup from starting either.
+    EXPECT_TRUE(pool.lookup("a", slow_lookup(0, "A"), check_result("A")));
+  }
+
+  EXPECT_EQ(4, _lookups.load());
+  EXPECT_EQ(4, _callbacks.load());
+}
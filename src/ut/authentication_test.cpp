@@ -15,6 +15,7 @@ extern "C" {
 
 #include <string>
 #include <sstream>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -27,6 +28,7 @@ extern "C" {
 #include "sproutletproxy.h"
 #include "hssconnection.h"
 #include "authenticationsproutlet.h"
+#include "thread_dispatcher.h"
 #include "fakehssconnection.hpp"
 #include "fakechronosconnection.hpp"
 #include "test_interposer.hpp"
@@ -756,6 +758,103 @@ TEST_F(AuthenticationTest, DigestAuthSuccess)
   _hss_connection->delete_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP");
 }
 
+/// Fixture for tests where authentication vectors are fetched from the HSS
+/// without blocking the worker thread.
+class AuthenticationAsyncHssTest : public AuthenticationTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    BaseAuthenticationTest::SetUpTestCase();
+    _hss_connection->start_async_threads(1);
+  }
+
+  static void TearDownTestCase()
+  {
+    BaseAuthenticationTest::TearDownTestCase();
+  }
+
+  /// Waits for the HSS query to complete, and then resumes the suspended
+  /// transaction on this thread.
+  void wait_for_hss()
+  {
+    for (int ii = 0; ii < 1000; ++ii)
+    {
+      if (run_queued_callbacks() > 0)
+      {
+        return;
+      }
+      usleep(1000);
+    }
+
+    FAIL() << "Timed out waiting for the HSS query";
+  }
+};
+
+TEST_F(AuthenticationAsyncHssTest, DigestAuthSuccess)
+{
+  // Test a successful SIP Digest authentication flow where the challenge is
+  // created once the HSS has responded.
+  pjsip_tx_data* tdata;
+
+  _hss_connection->set_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP",
+                              "{\"digest\":{\"realm\":\"homedomain\",\"qop\":\"auth\",\"ha1\":\"12345678123456781234567812345678\"}}");
+
+  // Send in a REGISTER request with no authentication header.
+  AuthenticationMessage msg1("REGISTER");
+  msg1._auth_hdr = false;
+  inject_msg(msg1.get());
+
+  // The transaction is suspended while the HSS is queried, so there's no
+  // response yet.
+  ASSERT_EQ(0, txdata_count());
+
+  // Once the HSS responds, expect a 401 Not Authorized response.
+  wait_for_hss();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(401).matches(tdata->msg);
+
+  std::string auth = get_headers(tdata->msg, "WWW-Authenticate");
+  std::map<std::string, std::string> auth_params;
+  parse_www_authenticate(auth, auth_params);
+  EXPECT_NE("", auth_params["nonce"]);
+  EXPECT_EQ("auth", auth_params["qop"]);
+  EXPECT_EQ("MD5", auth_params["algorithm"]);
+  free_txdata();
+
+  // The challenge was stored, so a REGISTER with the right response is let
+  // through.
+  AuthenticationMessage msg2("REGISTER");
+  msg2._algorithm = "MD5";
+  msg2._key = "12345678123456781234567812345678";
+  msg2._nonce = auth_params["nonce"];
+  msg2._opaque = auth_params["opaque"];
+  msg2._nc = "00000001";
+  msg2._cnonce = "8765432187654321";
+  msg2._qop = "auth";
+  msg2._integ_prot = "ip-assoc-pending";
+  inject_msg(msg2.get());
+  auth_sproutlet_allows_request();
+
+  _hss_connection->delete_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP");
+}
+
+TEST_F(AuthenticationAsyncHssTest, NoAuthVector)
+{
+  // Test that a REGISTER is rejected once the HSS responds if it has no
+  // authentication vector for the subscriber.
+  AuthenticationMessage msg("REGISTER");
+  msg._auth_hdr = false;
+  inject_msg(msg.get());
+  ASSERT_EQ(0, txdata_count());
+
+  wait_for_hss();
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(403).matches(current_txdata()->msg);
+  free_txdata();
+}
+
 TEST_F(AuthenticationTest, DigestAuthSuccessRemoteSite)
 {
   add_host_mapping("sprout-site2.homedomain", "5.6.7.8");
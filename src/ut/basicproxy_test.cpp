@@ -10,6 +10,7 @@
  */
 
 #include <string>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <boost/lexical_cast.hpp>
@@ -19,6 +20,7 @@
 #include "siptest.hpp"
 #include "utils.h"
 #include "basicproxy.h"
+#include "thread_dispatcher.h"
 #include "test_utils.hpp"
 #include "fakehssconnection.hpp"
 #include "faketransport_tcp.hpp"
@@ -3942,3 +3944,111 @@ TEST_F(BasicProxyTest, TransportFailureWithCancelPending)
 
   delete tp;
 }
+
+
+/// Fixture for tests where the next hop is resolved asynchronously.
+class BasicProxyAsyncResolveTest : public BasicProxyTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    BasicProxyTest::SetUpTestCase();
+    stack_data.sipresolver->start_async_threads(1);
+  }
+
+  static void TearDownTestCase()
+  {
+    BasicProxyTest::TearDownTestCase();
+  }
+
+  /// Waits for the asynchronous resolution to complete, then runs its
+  /// callback.
+  void run_resolved_callbacks()
+  {
+    int count = 0;
+    for (int ii = 0; (count == 0) && (ii < 100); ++ii)
+    {
+      usleep(10000);
+      count = run_queued_callbacks();
+    }
+    ASSERT_EQ(1, count);
+  }
+};
+
+
+TEST_F(BasicProxyAsyncResolveTest, CancelWhileResolving)
+{
+  // Tests CANCELing a request while the next hop is still being resolved.
+  // The request must not be sent once the resolution completes.
+
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        stack_data.scscf_port,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Add a test target for bob@homedomain, with a URI plus a path with a
+  // single proxy.
+  _basic_proxy->add_test_target("sip:bob@homedomain",
+                                "sip:bob@node1.homedomain;transport=TCP",
+                                std::list<std::string>(1, "sip:proxy1.homedomain;transport=TCP;lr"));
+
+  // Inject a request with a Route header referring to this node and a
+  // RequestURI with a URI in the home domain.
+  Message msg1;
+  msg1._method = "INVITE";
+  msg1._requri = "sip:bob@homedomain;transport=TCP";
+  msg1._from = "alice";
+  msg1._to = "bob";
+  msg1._todomain = "awaydomain";
+  msg1._via = tp->to_string(false);
+  msg1._route = "Route: <sip:127.0.0.1;transport=TCP;lr>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting only a 100 Trying, as the INVITE waits for proxy1.homedomain to
+  // be resolved.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Send a CANCEL from the originator.
+  Message msg2;
+  msg2._method = "CANCEL";
+  msg2._requri = "sip:bob@homedomain;transport=TCP";
+  msg2._from = "alice";
+  msg2._to = "bob";
+  msg2._todomain = "awaydomain";
+  msg2._via = tp->to_string(false);
+  msg2._unique = msg1._unique;    // Make sure branch and call-id are same as the INVITE
+  inject_msg(msg2.get_request(), tp);
+
+  // Expect a 200 OK response to the CANCEL, but no CANCEL downstream as the
+  // INVITE hasn't been sent.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  // Complete the resolution.  The INVITE isn't sent, and a 487 response is
+  // sent back to the source.
+  run_resolved_callbacks();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(487).matches(tdata->msg);
+  free_txdata();
+
+  // Send an ACK to complete the UAS transaction.
+  msg1._method = "ACK";
+  inject_msg(msg1.get_request(), tp);
+  ASSERT_EQ(0, txdata_count());
+
+  _basic_proxy->remove_test_targets("sip:bob@homedomain");
+
+  delete tp;
+}
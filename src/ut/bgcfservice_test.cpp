@@ -11,12 +11,17 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <fstream>
+#include <stdio.h>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 #include "utils.h"
 #include "sas.h"
 #include "bgcfservice.h"
+#include "pjutils.h"
 #include "fakelogger.h"
 #include "test_utils.hpp"
 
@@ -53,11 +58,11 @@ public:
 
     if (rt == RoutingType::DOMAIN_ROUTE)
     {
-      ret = bgcf_.get_route_from_domain(_in, 0);
+      ret = *bgcf_.get_route_from_domain(_in, 0);
     }
     else
     {
-      ret = bgcf_.get_route_from_number(_in, 0);
+      ret = *bgcf_.get_route_from_number(_in, 0);
     }
 
     std::stringstream store_strings;
@@ -161,3 +166,69 @@ TEST_F(BgcfServiceTest, NumberRouteTests)
   ET("+654-(3.21)", "sip3.example.com").test(bgcf_, RoutingType::NUMBER_ROUTE);
   ET("+654!-(321)", "").test(bgcf_, RoutingType::NUMBER_ROUTE);
 }
+
+// Checks number route lookups against 100k routes give the same results as
+// the linear map scan that the BGCF service used to do.
+TEST_F(BgcfServiceTest, LargeNumberRouteTable)
+{
+  const int NUM_ROUTES = 100000;
+  const int NUM_LOOKUPS = 200;
+
+  // Write out a BGCF configuration file with routes for +44<5 digit block>.
+  char path[] = "/tmp/bgcf_routes_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  std::map<std::string, std::vector<std::string>> linear_routes;
+  char number[32];
+  char route[64];
+  {
+    std::ofstream fs(path);
+    fs << "{\"routes\": [";
+    for (int ii = 0; ii < NUM_ROUTES; ++ii)
+    {
+      snprintf(number, sizeof(number), "+44-%05d", ii);
+      snprintf(route, sizeof(route), "sip:%05d.example.com", ii % 100);
+      fs << ((ii == 0) ? "" : ",")
+         << "{\"number\": \"" << number << "\", "
+         << "\"route\": [\"" << route << "\"]}";
+      linear_routes.insert(std::make_pair(PJUtils::remove_visual_separators(number),
+                                          std::vector<std::string>(1, route)));
+    }
+    fs << "]}";
+  }
+
+  BgcfService bgcf_(path);
+  unlink(path);
+
+  int mismatches = 0;
+
+  for (int ii = 0; ii < NUM_LOOKUPS; ++ii)
+  {
+    snprintf(number, sizeof(number), "+44%05d123456", (ii * 7919) % NUM_ROUTES);
+    std::string num = PJUtils::remove_visual_separators(number);
+    std::vector<std::string> expected;
+
+    for (std::map<std::string, std::vector<std::string>>::const_reverse_iterator it =
+           linear_routes.rbegin();
+         it != linear_routes.rend();
+         it++)
+    {
+      int len = std::min(num.size(), it->first.size());
+      if (num.compare(0, len, it->first, 0, len) == 0)
+      {
+        expected = it->second;
+        break;
+      }
+    }
+
+    if ((expected.empty()) ||
+        (*bgcf_.get_route_from_number(number, 0) != expected))
+    {
+      mismatches++;
+    }
+  }
+
+  EXPECT_EQ(0, mismatches);
+}
@@ -338,6 +338,40 @@ TEST_F(ChronosAoRTimeoutTasksTest, NullAoRTest)
   EXPECT_TRUE(log.contains("Failed to get AoR binding for"));
 }
 
+// Test that each AoR in a batch popped by the local timer wheel is processed
+// as if its Chronos timer had popped.
+TEST_F(ChronosAoRTimeoutTasksTest, LocalExpiryCallbackTest)
+{
+  req = NULL;
+  config = new AoRTimeoutTask::Config(store, {remote_store1, remote_store2}, mock_hss);
+
+  std::vector<std::string> aor_ids = {"sip:6505550231@homedomain",
+                                      "sip:6505550232@homedomain"};
+
+  {
+    InSequence s;
+    for (size_t ii = 0; ii < aor_ids.size(); ++ii)
+    {
+      SubscriberDataManager::AoRPair* aor = build_aor(aor_ids[ii]);
+      AssociatedURIs associated_uris = {};
+      associated_uris.add_uri(aor_ids[ii], false);
+
+      EXPECT_CALL(*mock_hss, get_registration_data(aor_ids[ii], _, _, _, _))
+           .WillOnce(DoAll(SetArgReferee<3>(AssociatedURIs(associated_uris)),
+                           Return(HTTP_OK)));
+      EXPECT_CALL(*store, get_aor_data(aor_ids[ii], _)).WillOnce(Return(aor));
+      EXPECT_CALL(*store, set_aor_data(aor_ids[ii], _, aor, _, _))
+           .WillOnce(DoAll(SetArgPointee<1>(AssociatedURIs(associated_uris)),
+                           Return(Store::OK)));
+      EXPECT_CALL(*remote_store1, has_servers()).WillOnce(Return(false));
+      EXPECT_CALL(*remote_store2, has_servers()).WillOnce(Return(false));
+    }
+  }
+
+  AoRExpiryCallback callback(config, aor_ids);
+  callback.run();
+}
+
 class ChronosAoRTimeoutTasksMockStoreTest : public SipTest
 {
   MockSubscriberDataManager* store;
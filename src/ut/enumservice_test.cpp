@@ -10,6 +10,9 @@
  */
 
 #include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -21,6 +24,7 @@
 #include "fakelogger.h"
 #include "test_utils.hpp"
 #include "mockcommunicationmonitor.h"
+#include "fakesnmp.hpp"
 #include "sprout_alarmdefinition.h"
 
 using namespace std;
@@ -440,3 +444,220 @@ TEST_F(DNSEnumServiceTest, PosixRegexTest)
   ET("1234", "").test(enum_);
 }
 
+
+TEST_F(DNSEnumServiceTest, CacheHitTest)
+{
+  // Repeated lookups for the same number only query the DNS server once.
+  SNMP::FakeCounterTable hits_tbl;
+  SNMP::FakeCounterTable misses_tbl;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  enum_.enable_cache(100, &hits_tbl, &misses_tbl);
+
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("+1234", "sip:+1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+  EXPECT_EQ(2, hits_tbl._count);
+  EXPECT_EQ(1, misses_tbl._count);
+}
+
+TEST_F(DNSEnumServiceTest, CacheNonTerminalRuleTest)
+{
+  // Each domain queried while following non-terminal rules is cached.
+  struct ares_naptr_reply naptr_reply[] = {{NULL, (unsigned char*)"", (unsigned char*)"e2u+sip", (unsigned char*)"!1234!5678!", ".", 1, 1}};
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  enum_.enable_cache(100, NULL, NULL);
+
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, CacheExpiryTest)
+{
+  // Cached rules are used for the TTL of the NAPTR records.
+  FakeDNSResolver::_ttl = 60;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  enum_.enable_cache(100, NULL, NULL);
+
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  cwtest_advance_time_ms(59000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  cwtest_advance_time_ms(2000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  cwtest_reset_time();
+}
+
+TEST_F(DNSEnumServiceTest, CacheZeroTTLTest)
+{
+  // Records with a TTL of 0 aren't cached.
+  FakeDNSResolver::_ttl = 0;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  enum_.enable_cache(100, NULL, NULL);
+
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  EXPECT_EQ(0u, enum_._cache.size());
+}
+
+TEST_F(DNSEnumServiceTest, NegativeCacheTest)
+{
+  // Domains that don't exist are cached, and lookups that only hit the cache
+  // don't report the state of the ENUM server.
+  AlarmManager am;
+  MockCommunicationMonitor cm_(&am);
+  EXPECT_CALL(cm_, inform_success(_)).Times(1);
+  FakeDNSResolver::_ttl = 30;
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), &cm_);
+  enum_.enable_cache(100, NULL, NULL);
+
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  // The number is now provisioned, but we don't see it until the negative
+  // cache entry expires.
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  ET("1234", "").test(enum_);
+
+  EXPECT_CALL(cm_, inform_success(_)).Times(1);
+  cwtest_advance_time_ms(31000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  cwtest_reset_time();
+}
+
+TEST_F(DNSEnumServiceTest, CacheServerErrorTest)
+{
+  // Server failures aren't cached.
+  AlarmManager am;
+  MockCommunicationMonitor cm_(&am);
+  EXPECT_CALL(cm_, inform_failure(_)).Times(2);
+  DNSEnumService enum_(_servers, ".e164.arpa", new BrokenDNSResolverFactory(), &cm_);
+  enum_.enable_cache(100, NULL, NULL);
+
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(0u, enum_._cache.size());
+}
+
+TEST_F(DNSEnumServiceTest, CacheFullTest)
+{
+  // When the cache is full, the least recently used domain is evicted to
+  // make space.
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("1.1.1.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  enum_.enable_cache(2, NULL, NULL);
+
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1111", "sip:1111@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 3);
+  EXPECT_EQ(2u, enum_._cache.size());
+
+  // 1234 was used more recently than 5678, so is still cached.
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 3);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 4);
+}
+
+TEST_F(DNSEnumServiceTest, CacheConcurrentMissTest)
+{
+  // Concurrent lookups for the same number that miss the cache share a
+  // single DNS query.
+  const int NUM_THREADS = 10;
+  SNMP::FakeCounterTable hits_tbl;
+  SNMP::FakeCounterTable misses_tbl;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new SlowDNSResolverFactory());
+  enum_.enable_cache(100, &hits_tbl, &misses_tbl);
+
+  std::vector<std::string> uris(NUM_THREADS);
+  std::vector<std::thread> threads;
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads.push_back(std::thread([&, ii]()
+    {
+      uris[ii] = enum_.lookup_uri_from_user("1234", 0);
+    }));
+  }
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads[ii].join();
+    EXPECT_EQ("sip:1234@ut.cw-ngv.com", uris[ii]);
+  }
+
+  EXPECT_EQ(1, FakeDNSResolver::_num_calls);
+  EXPECT_EQ(NUM_THREADS - 1, hits_tbl._count);
+  EXPECT_EQ(1, misses_tbl._count);
+}
+
+TEST_F(DNSEnumServiceTest, CacheConcurrentFailureTest)
+{
+  // Lookups that wait for a shared query that fails count as misses, and the
+  // failure isn't cached.
+  const int NUM_THREADS = 10;
+  SNMP::FakeCounterTable hits_tbl;
+  SNMP::FakeCounterTable misses_tbl;
+  BrokenDNSResolver::_delay_ms = 200;
+  DNSEnumService enum_(_servers, ".e164.arpa", new BrokenDNSResolverFactory());
+  enum_.enable_cache(100, &hits_tbl, &misses_tbl);
+
+  std::vector<std::thread> threads;
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads.push_back(std::thread([&]()
+    {
+      EXPECT_EQ("", enum_.lookup_uri_from_user("1234", 0));
+    }));
+  }
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads[ii].join();
+  }
+
+  EXPECT_EQ(0, hits_tbl._count);
+  EXPECT_EQ(NUM_THREADS, misses_tbl._count);
+  EXPECT_EQ(0u, enum_._cache.size());
+  BrokenDNSResolver::_delay_ms = 0;
+}
+
+TEST_F(DNSEnumServiceTest, CacheSlowQueryTest)
+{
+  // A lookup only waits a limited time for another thread's query for the
+  // same domain, and then makes its own.
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  SlowDNSResolver::_delay_ms = DNSEnumService::MAX_WAIT_MS + 500;
+  DNSEnumService enum_(_servers, ".e164.arpa", new SlowDNSResolverFactory());
+  enum_.enable_cache(100, NULL, NULL);
+
+  std::thread first([&]()
+  {
+    EXPECT_EQ("sip:1234@ut.cw-ngv.com", enum_.lookup_uri_from_user("1234", 0));
+  });
+
+  // Give the first thread time to start its query.
+  usleep(100000);
+  EXPECT_EQ("sip:1234@ut.cw-ngv.com", enum_.lookup_uri_from_user("1234", 0));
+  first.join();
+
+  EXPECT_EQ(2, FakeDNSResolver::_num_calls);
+  SlowDNSResolver::_delay_ms = 200;
+}
@@ -15,20 +15,25 @@
 #include <iostream>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "fakednsresolver.hpp"
 
 
 int FakeDNSResolver::_num_calls = 0;
+int FakeDNSResolver::_ttl = 300;
 std::map<std::string,struct ares_naptr_reply*> FakeDNSResolver::_database = std::map<std::string,struct ares_naptr_reply*>();
 // By default, expect requests for 127.0.0.1.
 struct IP46Address FakeDNSResolverFactory::_expected_server = {AF_INET, {{htonl(0x7f000001)}}};
+int SlowDNSResolver::_delay_ms = 200;
+int BrokenDNSResolver::_delay_ms = 0;
 
 
-int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
   ++_num_calls;
+  ttl = _ttl;
   // Look up the query domain and return the reply if found.
   std::map<std::string,struct ares_naptr_reply*>::iterator i = _database.find(domain);
   if (i != _database.end())
@@ -56,8 +61,22 @@ DNSResolver* FakeDNSResolverFactory::new_resolver(const std::vector<struct IP46A
   return new FakeDNSResolver(servers);
 }
 
-int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int SlowDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
+  usleep(_delay_ms * 1000);
+  return FakeDNSResolver::perform_naptr_query(domain, naptr_reply, ttl, trail);
+}
+
+
+DNSResolver* SlowDNSResolverFactory::new_resolver(const std::vector<struct IP46Address>& servers) const
+{
+  return new SlowDNSResolver(servers);
+}
+
+int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
+{
+  usleep(_delay_ms * 1000);
+  ttl = -1;
   return ARES_ESERVFAIL;
 }
 
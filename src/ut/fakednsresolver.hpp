@@ -21,13 +21,15 @@ class FakeDNSResolver : public DNSResolver
 {
 public:
   inline FakeDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
   // Reset the static data.
-  static inline void reset() { _num_calls = 0; _database.clear(); };
+  static inline void reset() { _num_calls = 0; _database.clear(); _ttl = 300; };
 
   // Number of calls that have been made so far.
   static int _num_calls;
+  // TTL returned with every response.
+  static int _ttl;
   // Database mapping domain names to NAPTR responses.
   static std::map<std::string,struct ares_naptr_reply*> _database;
 
@@ -45,13 +47,35 @@ public:
 
 };
 
+/// Fake DNSResolver which behaves like FakeDNSResolver, but takes a long time
+/// to respond, like a DNS server that is timing out.
+class SlowDNSResolver : public FakeDNSResolver
+{
+public:
+  inline SlowDNSResolver(const std::vector<struct IP46Address>& servers) : FakeDNSResolver(servers) {};
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
+
+  // How long each query takes, in milliseconds.
+  static int _delay_ms;
+};
+
+/// Fake DNSResolverFactory that creates SlowDNSResolvers.
+class SlowDNSResolverFactory : public DNSResolverFactory
+{
+public:
+  virtual DNSResolver* new_resolver(const std::vector<struct IP46Address>& server) const;
+};
+
 /// Fake DNSResolver which returns error responses.
 class BrokenDNSResolver : public DNSResolver
 {
 public:
   inline BrokenDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
+
+  // How long each query takes to fail, in milliseconds.
+  static int _delay_ms;
 };
 
 /// Fake DNSResolverFactory that checks parameters and then creates a
@@ -14,6 +14,7 @@
 
 #include "snmp_row.h"
 #include "snmp_event_accumulator_table.h"
+#include "snmp_event_accumulator_by_scope_table.h"
 #include "snmp_continuous_accumulator_table.h"
 #include "snmp_scalar.h"
 #include "snmp_counter_table.h"
@@ -32,6 +33,14 @@ public:
   void accumulate(uint32_t sample) { _count++; };
 };
 
+class FakeEventAccumulatorByScopeTable: public EventAccumulatorByScopeTable
+{
+public:
+  int _count;
+  FakeEventAccumulatorByScopeTable() { _count = 0; };
+  void accumulate(uint32_t sample) { _count++; };
+};
+
 class FakeContinuousAccumulatorTable: public ContinuousAccumulatorTable
 {
 public:
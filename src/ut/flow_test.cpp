@@ -11,6 +11,8 @@
 ///----------------------------------------------------------------------------
 
 #include <string>
+#include <thread>
+#include <vector>
 #include "gtest/gtest.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/lexical_cast.hpp>
@@ -131,3 +133,108 @@ TEST_F(FlowTest, FlowUnQuiesceMidDialog)
   EXPECT_FALSE(flow->should_quiesce());
 }
 
+
+
+TEST_F(FlowTest, FindFlowByAddressAndToken)
+{
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+
+  // Finding the same address gets the same flow.
+  Flow* found = ft->find_create_flow(tp, &addr);
+  EXPECT_EQ(flow, found);
+  found->dec_ref();
+
+  found = ft->find_flow(tp, &addr);
+  EXPECT_EQ(flow, found);
+  found->dec_ref();
+
+  found = ft->find_flow(flow->token());
+  EXPECT_EQ(flow, found);
+  found->dec_ref();
+
+  // A different port is a different flow.
+  pj_sockaddr other_addr = addr;
+  pj_sockaddr_set_port(&other_addr, 5061);
+  EXPECT_EQ(NULL, ft->find_flow(tp, &other_addr));
+
+  Flow* other = ft->find_create_flow(tp, &other_addr);
+  EXPECT_NE(flow, other);
+  EXPECT_NE(flow->token(), other->token());
+
+  // Releasing the last references to the other flow removes it.
+  std::string token = other->token();
+  other->dec_ref();
+  other->dec_ref();
+  EXPECT_EQ(NULL, ft->find_flow(tp, &other_addr));
+  EXPECT_EQ(NULL, ft->find_flow(token));
+}
+
+// Creates, looks up and removes flows from many threads at once, to check
+// that the flow table holds up with a large number of clients.
+TEST_F(FlowTest, ManyFlowsConcurrently)
+{
+  const int NUM_THREADS = 16;
+  const int FLOWS_PER_THREAD = 4000;
+  const int LOOKUPS_PER_FLOW = 4;
+
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+  std::vector<std::thread> threads;
+  std::vector<int> failures(NUM_THREADS, 0);
+
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    threads.push_back(std::thread([&, tt]()
+    {
+      pj_thread_desc desc;
+      pj_thread_t* thread = NULL;
+      pj_bzero(desc, sizeof(desc));
+      pj_thread_register("FlowTest", desc, &thread);
+
+      // Give each flow its own IP address and port.
+      std::vector<Flow*> flows(FLOWS_PER_THREAD);
+      std::vector<pj_sockaddr> addrs(FLOWS_PER_THREAD);
+
+      for (int ii = 0; ii < FLOWS_PER_THREAD; ++ii)
+      {
+        char ip[32];
+        snprintf(ip, sizeof(ip), "10.%d.%d.%d", tt, ii >> 8, ii & 0xFF);
+        pj_str_t ip_str = pj_str(ip);
+        pj_sockaddr_init(pj_AF_INET(), &addrs[ii], &ip_str, 5060 + (ii % 1000));
+        flows[ii] = ft->find_create_flow(tp, &addrs[ii]);
+      }
+
+      for (int jj = 0; jj < LOOKUPS_PER_FLOW; ++jj)
+      {
+        for (int ii = 0; ii < FLOWS_PER_THREAD; ++ii)
+        {
+          Flow* found = (jj % 2 == 0) ?
+                          ft->find_flow(tp, &addrs[ii]) :
+                          ft->find_flow(flows[ii]->token());
+          if (found != flows[ii])
+          {
+            failures[tt]++;
+          }
+
+          if (found != NULL)
+          {
+            found->dec_ref();
+          }
+        }
+      }
+
+      for (int ii = 0; ii < FLOWS_PER_THREAD; ++ii)
+      {
+        ft->remove_flow(flows[ii]);
+      }
+    }));
+  }
+
+  for (int tt = 0; tt < NUM_THREADS; ++tt)
+  {
+    threads[tt].join();
+    EXPECT_EQ(0, failures[tt]);
+  }
+
+  // Only the fixture's flow is left.
+  EXPECT_EQ(1u, fake_connection_count.value);
+}
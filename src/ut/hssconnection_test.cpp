@@ -13,7 +13,9 @@
 ///----------------------------------------------------------------------------
 
 #include <string>
+#include <atomic>
 #include <algorithm>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "utils.h"
@@ -23,6 +25,7 @@
 #include "basetest.hpp"
 #include "fakecurl.hpp"
 #include "fakesnmp.hpp"
+#include "test_interposer.hpp"
 #include "sprout_alarmdefinition.h"
 #include "mock_sifc_parser.h"
 
@@ -687,6 +690,455 @@ TEST_F(HssConnectionTest, CacheNotAllowed)
   EXPECT_EQ(rc, 200);
 }
 
+/// Fixture for tests of an HSSConnection with a registration data cache.
+class HssConnectionCacheTest : public HssConnectionTest
+{
+  SNMP::FakeCounterTable _hits_tbl;
+  SNMP::FakeCounterTable _misses_tbl;
+  SNMP::FakeCounterTable _evictions_tbl;
+  RegDataCache _cache;
+  HSSConnection _cached_hss;
+
+  HssConnectionCacheTest() :
+    HssConnectionTest(),
+    _cache(100, 30, &_hits_tbl, &_misses_tbl, &_evictions_tbl),
+    _cached_hss("narcissus",
+                &_resolver,
+                NULL,
+                &SNMP::FAKE_IP_COUNT_TABLE,
+                &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                &_cm,
+                NULL,
+                &_cache)
+  {
+    fakecurl_requests.clear();
+  }
+
+  virtual ~HssConnectionCacheTest()
+  {
+  }
+
+  // Gets the registration data for pubid42, returning whether a request was
+  // sent to Homestead.
+  bool get_pubid42()
+  {
+    AssociatedURIs uris;
+    std::map<std::string, Ifcs> ifcs_map;
+    std::deque<std::string> ccfs;
+    std::deque<std::string> ecfs;
+    std::string regstate;
+
+    fakecurl_requests.clear();
+    HTTPCode rc = _cached_hss.get_registration_data("pubid42",
+                                                    regstate,
+                                                    ifcs_map,
+                                                    uris,
+                                                    ccfs,
+                                                    ecfs,
+                                                    0);
+
+    // The data is the same whether or not it came from the cache.
+    EXPECT_EQ(200, rc);
+    EXPECT_EQ("REGISTERED", regstate);
+    EXPECT_EQ(2u, uris.get_unbarred_uris().size());
+    EXPECT_EQ(1u, ifcs_map.size());
+    EXPECT_EQ(2u, ccfs.size());
+    EXPECT_EQ(2u, ecfs.size());
+
+    return (fakecurl_requests.find("http://narcissus:80/impu/pubid42/reg-data") !=
+            fakecurl_requests.end());
+  }
+};
+
+TEST_F(HssConnectionCacheTest, SecondGetIsCached)
+{
+  EXPECT_TRUE(get_pubid42());
+  EXPECT_EQ(0, _hits_tbl._count);
+  EXPECT_EQ(1, _misses_tbl._count);
+  EXPECT_EQ(1, _cache.size());
+
+  EXPECT_FALSE(get_pubid42());
+  EXPECT_EQ(1, _hits_tbl._count);
+  EXPECT_EQ(1, _misses_tbl._count);
+}
+
+TEST_F(HssConnectionCacheTest, EntriesExpire)
+{
+  EXPECT_TRUE(get_pubid42());
+
+  cwtest_advance_time_ms(29000);
+  EXPECT_FALSE(get_pubid42());
+
+  cwtest_advance_time_ms(2000);
+  EXPECT_TRUE(get_pubid42());
+  EXPECT_EQ(2, _misses_tbl._count);
+
+  // Expired entries aren't counted as evictions.
+  EXPECT_EQ(0, _evictions_tbl._count);
+}
+
+TEST_F(HssConnectionCacheTest, RegistrationRefreshesCache)
+{
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  HTTPCode rc = _cached_hss.update_registration_state("pubid42",
+                                                      "",
+                                                      HSSConnection::REG,
+                                                      regstate,
+                                                      "server_name",
+                                                      ifcs_map,
+                                                      uris,
+                                                      0);
+  EXPECT_EQ(200, rc);
+
+  // The registration always goes to Homestead, but the following lookup is
+  // served from the cache.
+  EXPECT_FALSE(get_pubid42());
+  EXPECT_EQ(1, _hits_tbl._count);
+}
+
+TEST_F(HssConnectionCacheTest, DeregistrationInvalidatesCache)
+{
+  EXPECT_TRUE(get_pubid42());
+
+  // The deregistration fails (there's no response configured for it), but
+  // the cached data is still discarded.
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  _cached_hss.update_registration_state("pubid42",
+                                        "",
+                                        HSSConnection::DEREG_ADMIN,
+                                        regstate,
+                                        "server_name",
+                                        ifcs_map,
+                                        uris,
+                                        0);
+  EXPECT_EQ(0, _cache.size());
+  EXPECT_TRUE(get_pubid42());
+}
+
+TEST_F(HssConnectionCacheTest, CacheNotAllowedInvalidatesCache)
+{
+  EXPECT_TRUE(get_pubid42());
+
+  std::vector<std::string> aliases;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  AssociatedURIs uris;
+  std::deque<std::string> unused_deque;
+  _cached_hss.update_registration_state("pubid42",
+                                        "",
+                                        HSSConnection::REG,
+                                        regstate,
+                                        "server_name",
+                                        ifcs_map,
+                                        uris,
+                                        aliases,
+                                        unused_deque,
+                                        unused_deque,
+                                        false,
+                                        "",
+                                        0);
+  EXPECT_EQ(0, _cache.size());
+}
+
+TEST_F(HssConnectionCacheTest, LeastRecentlyUsedEvicted)
+{
+  // A cache with room for one entry in each of its shards.  Adding one more
+  // IMPU than that must evict at least one unexpired entry.
+  RegDataCache cache(16, 30, &_hits_tbl, &_misses_tbl, &_evictions_tbl);
+  RegDataCache::RegData data;
+  data.regstate = "REGISTERED";
+
+  for (int ii = 0; ii < 17; ++ii)
+  {
+    std::string impu = "sip:" + std::to_string(ii) + "@example.com";
+    cache.put(impu, data, cache.generation(impu));
+  }
+
+  EXPECT_GE(_evictions_tbl._count, 1);
+  EXPECT_EQ(17 - _evictions_tbl._count, cache.size());
+
+  // The most recently added entry is always still there.
+  EXPECT_TRUE(cache.get("sip:16@example.com") != NULL);
+}
+
+TEST_F(HssConnectionCacheTest, RegistrationInvalidatesImplicitRegistrationSet)
+{
+  RegDataCache::RegData data;
+  data.regstate = "REGISTERED";
+  _cache.put("sip:123@example.com", data, _cache.generation("sip:123@example.com"));
+  _cache.put("sip:456@example.com", data, _cache.generation("sip:456@example.com"));
+  EXPECT_EQ(2, _cache.size());
+
+  // pubid42's implicit registration set includes both of the IMPUs above, so
+  // registering it discards their data.
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  _cached_hss.update_registration_state("pubid42",
+                                        "",
+                                        HSSConnection::REG,
+                                        regstate,
+                                        "server_name",
+                                        ifcs_map,
+                                        uris,
+                                        0);
+  EXPECT_EQ(1, _cache.size());
+  EXPECT_TRUE(_cache.get("sip:123@example.com") == NULL);
+  EXPECT_TRUE(_cache.get("sip:456@example.com") == NULL);
+}
+
+TEST_F(HssConnectionCacheTest, StaleResponseNotCached)
+{
+  // A lookup that missed the cache before a registration invalidated the
+  // IMPU must not overwrite the cache with its (possibly older) response.
+  RegDataCache::RegData data;
+  data.regstate = "REGISTERED";
+  uint64_t generation = _cache.generation("sip:123@example.com");
+  _cache.invalidate("sip:123@example.com");
+  _cache.put("sip:123@example.com", data, generation);
+  EXPECT_EQ(0, _cache.size());
+
+  // A lookup that started after the invalidation is cached as normal.
+  _cache.put("sip:123@example.com",
+             data,
+             _cache.generation("sip:123@example.com"));
+  EXPECT_EQ(1, _cache.size());
+}
+
+TEST_F(HssConnectionCacheTest, CallToRegisteredSubscriberServedFromCache)
+{
+  EXPECT_TRUE(get_pubid42());
+
+  // There's no response configured for the call, so this only succeeds if it
+  // is served from the cache.
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  fakecurl_requests.clear();
+  HTTPCode rc = _cached_hss.update_registration_state("pubid42",
+                                                      "",
+                                                      HSSConnection::CALL,
+                                                      regstate,
+                                                      "server_name",
+                                                      ifcs_map,
+                                                      uris,
+                                                      0);
+  EXPECT_EQ(200, rc);
+  EXPECT_EQ("REGISTERED", regstate);
+  EXPECT_EQ(2u, uris.get_unbarred_uris().size());
+  EXPECT_EQ(1u, ifcs_map.size());
+  EXPECT_TRUE(fakecurl_requests.empty());
+  EXPECT_EQ(1, _cache.size());
+  EXPECT_EQ(1, _hits_tbl._count);
+}
+
+TEST_F(HssConnectionCacheTest, CallToUnregisteredSubscriberNotServedFromCache)
+{
+  RegDataCache::RegData data;
+  data.regstate = "NOT_REGISTERED";
+  _cache.put("pubid42", data, _cache.generation("pubid42"));
+
+  // The call may register the subscriber, so it goes to Homestead (and fails,
+  // as there's no response configured for it) and the cached data is
+  // discarded.
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  fakecurl_requests.clear();
+  HTTPCode rc = _cached_hss.update_registration_state("pubid42",
+                                                      "",
+                                                      HSSConnection::CALL,
+                                                      regstate,
+                                                      "server_name",
+                                                      ifcs_map,
+                                                      uris,
+                                                      0);
+  EXPECT_NE(200, rc);
+  EXPECT_TRUE(fakecurl_requests.find("http://narcissus:80/impu/pubid42/reg-data") !=
+              fakecurl_requests.end());
+  EXPECT_EQ(0, _cache.size());
+}
+
+TEST_F(HssConnectionCacheTest, DeregistrationInvalidatesImplicitRegistrationSet)
+{
+  fakecurl_responses_with_body[std::make_pair("http://10.42.42.42:80/impu/pubid42/reg-data", "{\"reqtype\": \"dereg-admin\", \"server_name\": \"server_name\"}")] =
+    fakecurl_responses_with_body[std::make_pair("http://10.42.42.42:80/impu/pubid42/reg-data", "{\"reqtype\": \"reg\", \"server_name\": \"server_name\"}")];
+
+  RegDataCache::RegData data;
+  data.regstate = "REGISTERED";
+  _cache.put("sip:123@example.com", data, _cache.generation("sip:123@example.com"));
+  _cache.put("sip:456@example.com", data, _cache.generation("sip:456@example.com"));
+  EXPECT_EQ(2, _cache.size());
+
+  // pubid42 isn't cached itself, but its implicit registration set includes
+  // both of the IMPUs above, so deregistering it discards their data.
+  AssociatedURIs uris;
+  std::map<std::string, Ifcs> ifcs_map;
+  std::string regstate;
+  HTTPCode rc = _cached_hss.update_registration_state("pubid42",
+                                                      "",
+                                                      HSSConnection::DEREG_ADMIN,
+                                                      regstate,
+                                                      "server_name",
+                                                      ifcs_map,
+                                                      uris,
+                                                      0);
+  EXPECT_EQ(200, rc);
+  EXPECT_EQ(0, _cache.size());
+
+  fakecurl_responses_with_body.erase(std::make_pair("http://10.42.42.42:80/impu/pubid42/reg-data", "{\"reqtype\": \"dereg-admin\", \"server_name\": \"server_name\"}"));
+}
+
+/// Fixture for tests of the asynchronous HSSConnection queries.
+class HssConnectionAsyncTest : public HssConnectionTest
+{
+  HssConnectionAsyncTest() :
+    HssConnectionTest(),
+    _callbacks(0)
+  {
+    _hss.start_async_threads(1);
+  }
+
+  virtual ~HssConnectionAsyncTest()
+  {
+  }
+
+  // Waits (for up to a second) for the specified number of callbacks to have
+  // run.
+  void wait_for_callbacks(int count)
+  {
+    for (int ii = 0; (_callbacks.load() < count) && (ii < 100); ++ii)
+    {
+      usleep(10000);
+    }
+  }
+
+  std::atomic<int> _callbacks;
+};
+
+TEST_F(HssConnectionTest, AsyncDisabled)
+{
+  // The asynchronous queries are disabled until the threads are started, and
+  // the callbacks are never run.
+  EXPECT_FALSE(_hss.async_enabled());
+  EXPECT_FALSE(_hss.get_registration_data_async(
+                 "pubid42",
+                 0,
+                 [](HTTPCode rc, std::shared_ptr<HSSConnection::RegData> data)
+                 {
+                   ADD_FAILURE();
+                 }));
+  EXPECT_FALSE(_hss.update_registration_state_async(
+                 "pubid42",
+                 "",
+                 HSSConnection::REG,
+                 "server_name",
+                 0,
+                 [](HTTPCode rc, std::shared_ptr<HSSConnection::RegData> data)
+                 {
+                   ADD_FAILURE();
+                 }));
+  EXPECT_FALSE(_hss.get_auth_vector_async(
+                 "privid69",
+                 "",
+                 "",
+                 "",
+                 "",
+                 0,
+                 [](HTTPCode rc, rapidjson::Document* doc)
+                 {
+                   ADD_FAILURE();
+                 }));
+}
+
+TEST_F(HssConnectionAsyncTest, GetRegistrationData)
+{
+  EXPECT_TRUE(_hss.async_enabled());
+  EXPECT_TRUE(_hss.get_registration_data_async(
+                "pubid42",
+                0,
+                [this](HTTPCode rc, std::shared_ptr<HSSConnection::RegData> data)
+                {
+                  EXPECT_EQ(200, rc);
+                  EXPECT_EQ("REGISTERED", data->regstate);
+                  EXPECT_EQ(2u, data->associated_uris.get_unbarred_uris().size());
+                  EXPECT_EQ(1u, data->service_profiles.size());
+                  EXPECT_EQ(2u, data->ccfs.size());
+                  EXPECT_EQ(2u, data->ecfs.size());
+                  _callbacks++;
+                }));
+
+  wait_for_callbacks(1);
+  EXPECT_EQ(1, _callbacks.load());
+}
+
+TEST_F(HssConnectionAsyncTest, UpdateRegistrationState)
+{
+  EXPECT_TRUE(_hss.update_registration_state_async(
+                "pubid42",
+                "",
+                HSSConnection::REG,
+                "server_name",
+                0,
+                [this](HTTPCode rc, std::shared_ptr<HSSConnection::RegData> data)
+                {
+                  EXPECT_EQ(200, rc);
+                  EXPECT_EQ("REGISTERED", data->regstate);
+                  _callbacks++;
+                }));
+
+  // An update for a different public ID runs alongside the first, and each
+  // gets its own response.
+  EXPECT_TRUE(_hss.update_registration_state_async(
+                "pubid43",
+                "",
+                HSSConnection::REG,
+                "server_name",
+                0,
+                [this](HTTPCode rc, std::shared_ptr<HSSConnection::RegData> data)
+                {
+                  EXPECT_EQ(200, rc);
+                  EXPECT_EQ("NOT_REGISTERED", data->regstate);
+                  _callbacks++;
+                }));
+
+  wait_for_callbacks(2);
+  EXPECT_EQ(2, _callbacks.load());
+}
+
+TEST_F(HssConnectionAsyncTest, GetAuthVector)
+{
+  fakecurl_responses["http://10.42.42.42:80/impi/privid69/av"] =
+    "{\"digest\": {\"ha1\": \"12345678\", \"realm\": \"example.com\", \"qop\": \"auth\"}}";
+
+  EXPECT_TRUE(_hss.get_auth_vector_async(
+                "privid69",
+                "",
+                "",
+                "",
+                "",
+                0,
+                [this](HTTPCode rc, rapidjson::Document* doc)
+                {
+                  EXPECT_EQ(200, rc);
+                  ASSERT_TRUE(doc != NULL);
+                  EXPECT_TRUE(doc->HasMember("digest"));
+                  delete doc;
+                  _callbacks++;
+                }));
+
+  wait_for_callbacks(1);
+  EXPECT_EQ(1, _callbacks.load());
+}
+
 /// Fake iFCs to use to test Shared iFCs.
 std::string ifc_priority_one = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
                                "<InitialFilterCriteria>\n"
@@ -1031,7 +1483,7 @@ TEST_F(HssWithSifcTest, SimpleSiFC)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set, with set id 10.
   const std::set<int32_t> ids = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now present in the map.
@@ -1051,7 +1503,7 @@ TEST_F(HssWithSifcTest, SifcWithIfc)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set with set id of 0.
   const std::set<int32_t> ids = {0};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that three iFCs are now present in the map,
@@ -1084,7 +1536,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   // anything at this point.
   std::multimap<int32_t, Ifc> ifc_list_one;
   const std::set<int32_t> set_list_one = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_one)));
 
   // Any iFCs from the first Shared iFC sets will be passed into this function.
@@ -1095,7 +1547,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   const std::set<int32_t> set_list_two = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_two)));
 
   // Send in a message, and check that three iFCs are now in the iFC map.
@@ -1115,7 +1567,7 @@ TEST_F(HssWithSifcTest, MultipleSifcs)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with set ids 1 and 2.
   const std::set<int32_t> ids = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now in the iFC map.
@@ -1139,9 +1591,9 @@ TEST_F(HssWithSifcTest, MultiplePubIdsWithSifcs)
   // profile, and 2 for the other.
   const std::set<int32_t> id_set_one = {1};
   const std::set<int32_t> id_set_two = {2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // The iFC map composes of keys, which are public ids, and their values, which
@@ -1169,7 +1621,7 @@ TEST_F(HssWithSifcTest, ComplexSifcIfcMix)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with ids 3 and 4.
   const std::set<int32_t> id_set_one = {3, 4};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check the expected number of iFCs are present, as
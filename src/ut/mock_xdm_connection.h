@@ -0,0 +1,34 @@
+/**
+ * @file mock_xdm_connection.h Mock XDM connection class
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef MOCK_XDM_CONNECTION_H_
+#define MOCK_XDM_CONNECTION_H_
+
+#include "gmock/gmock.h"
+
+#include "xdmconnection.h"
+#include "fakesnmp.hpp"
+
+class MockXDMConnection : public XDMConnection
+{
+public:
+  MockXDMConnection() : XDMConnection(NULL,
+                                      &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE) {};
+  virtual ~MockXDMConnection() {};
+
+  MOCK_METHOD4(get_simservs_if_modified,
+               HTTPCode(const std::string& user,
+                        std::string& xml_data,
+                        std::string& etag,
+                        SAS::TrailId trail));
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file perfect_hash_map_test.cpp UT for the perfect-hashed lookup table.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <map>
+#include <string>
+#include <stdio.h>
+#include "gtest/gtest.h"
+
+#include "perfect_hash_map.h"
+
+using namespace std;
+
+/// Fixture for PerfectHashMapTest.
+class PerfectHashMapTest : public ::testing::Test
+{
+public:
+  PerfectHashMapTest()
+  {
+  }
+
+  virtual ~PerfectHashMapTest()
+  {
+  }
+
+  // Looks up a key, returning the value or -1 if the key isn't found.
+  static int lookup(const PerfectHashMap<int>& table, const string& key)
+  {
+    const int* value = table.find(key);
+    return (value != NULL) ? *value : -1;
+  }
+};
+
+TEST_F(PerfectHashMapTest, Empty)
+{
+  PerfectHashMap<int> table;
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ(-1, lookup(table, "scscf"));
+
+  table.build(map<string, int>());
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ(-1, lookup(table, ""));
+}
+
+TEST_F(PerfectHashMapTest, FindsEveryKey)
+{
+  map<string, int> entries;
+  entries["scscf"] = 1;
+  entries["icscf"] = 2;
+  entries["bgcf"] = 3;
+  entries["mmtel"] = 4;
+  entries["cdiv"] = 5;
+  entries["memento"] = 6;
+  entries["gemini"] = 7;
+  entries[""] = 8;
+
+  PerfectHashMap<int> table;
+  table.build(entries);
+  EXPECT_EQ(entries.size(), table.size());
+
+  for (map<string, int>::const_iterator it = entries.begin();
+       it != entries.end();
+       ++it)
+  {
+    EXPECT_EQ(it->second, lookup(table, it->first));
+  }
+
+  EXPECT_EQ(-1, lookup(table, "SCSCF"));
+  EXPECT_EQ(-1, lookup(table, "scscf2"));
+  EXPECT_EQ(-1, lookup(table, "scsc"));
+  EXPECT_EQ(-1, lookup(table, "alias"));
+}
+
+TEST_F(PerfectHashMapTest, KeyNotNullTerminated)
+{
+  map<string, int> entries;
+  entries["scscf"] = 1;
+
+  PerfectHashMap<int> table;
+  table.build(entries);
+
+  // Look up the first label of a host name, as is done when routing on the
+  // domain part of a URI.
+  const char* host = "scscf.sprout.example.com";
+  const int* value = table.find(host, 5);
+  ASSERT_TRUE(value != NULL);
+  EXPECT_EQ(1, *value);
+  EXPECT_TRUE(table.find(host, 6) == NULL);
+}
+
+TEST_F(PerfectHashMapTest, CaseInsensitive)
+{
+  map<string, int> entries;
+  entries["Sprout.Example.com"] = 1;
+  entries["sprout.example.com"] = 2;
+  entries["sprout-alias"] = 3;
+
+  PerfectHashMap<int> table(true);
+  table.build(entries);
+
+  // The keys differing only in case are merged, keeping the first.
+  EXPECT_EQ(2u, table.size());
+  EXPECT_EQ(1, lookup(table, "sprout.example.com"));
+  EXPECT_EQ(1, lookup(table, "SPROUT.EXAMPLE.COM"));
+  EXPECT_EQ(3, lookup(table, "Sprout-Alias"));
+  EXPECT_EQ(-1, lookup(table, "sprout.example.co"));
+}
+
+TEST_F(PerfectHashMapTest, Rebuild)
+{
+  map<string, int> entries;
+  entries["fwd"] = 1;
+
+  PerfectHashMap<int> table;
+  table.build(entries);
+  EXPECT_EQ(1, lookup(table, "fwd"));
+
+  entries.clear();
+  entries["b2bua"] = 2;
+  table.build(entries);
+  EXPECT_EQ(-1, lookup(table, "fwd"));
+  EXPECT_EQ(2, lookup(table, "b2bua"));
+}
+
+TEST_F(PerfectHashMapTest, LargeTable)
+{
+  map<string, int> entries;
+  char buf[32];
+
+  for (int ii = 0; ii < 10000; ++ii)
+  {
+    snprintf(buf, sizeof(buf), "service%d", ii);
+    entries[buf] = ii;
+  }
+
+  PerfectHashMap<int> table;
+  table.build(entries);
+  EXPECT_EQ(entries.size(), table.size());
+
+  for (int ii = 0; ii < 10000; ++ii)
+  {
+    snprintf(buf, sizeof(buf), "service%d", ii);
+    EXPECT_EQ(ii, lookup(table, buf));
+    snprintf(buf, sizeof(buf), "other%d", ii);
+    EXPECT_EQ(-1, lookup(table, buf));
+  }
+}
@@ -0,0 +1,156 @@
+/**
+ * @file prefix_trie_test.cpp UT for the longest-prefix-match trie.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <string>
+#include <stdio.h>
+#include "gtest/gtest.h"
+
+#include "prefix_trie.h"
+
+using namespace std;
+
+/// Fixture for PrefixTrieTest.
+class PrefixTrieTest : public ::testing::Test
+{
+public:
+  PrefixTrieTest()
+  {
+  }
+
+  virtual ~PrefixTrieTest()
+  {
+  }
+
+  // Looks up a key, returning the matched value or -1 if nothing matched.
+  int lookup(const string& key)
+  {
+    const int* value = _trie.match(key);
+    return (value != NULL) ? *value : -1;
+  }
+
+  PrefixTrie<int> _trie;
+};
+
+TEST_F(PrefixTrieTest, Empty)
+{
+  EXPECT_EQ(0u, _trie.size());
+  EXPECT_EQ(-1, lookup("+15108580271"));
+  EXPECT_EQ(-1, lookup(""));
+}
+
+TEST_F(PrefixTrieTest, LongestPrefixWins)
+{
+  // Insert out of order to check that the order of insertion doesn't matter.
+  EXPECT_TRUE(_trie.insert("+22", 2));
+  EXPECT_TRUE(_trie.insert("+2222", 4));
+  EXPECT_TRUE(_trie.insert("+222", 3));
+  EXPECT_EQ(3u, _trie.size());
+
+  EXPECT_EQ(3, lookup("+22238899"));
+  EXPECT_EQ(2, lookup("+22338899"));
+  EXPECT_EQ(4, lookup("+22228899"));
+  EXPECT_EQ(-1, lookup("+23"));
+  EXPECT_EQ(-1, lookup("2222"));
+}
+
+TEST_F(PrefixTrieTest, EmptyPrefixMatchesEverything)
+{
+  EXPECT_TRUE(_trie.insert("", 0));
+  EXPECT_TRUE(_trie.insert("+1650555", 1));
+
+  EXPECT_EQ(1, lookup("+16505551234"));
+  EXPECT_EQ(0, lookup("+16505561234"));
+  EXPECT_EQ(0, lookup("2144324"));
+}
+
+TEST_F(PrefixTrieTest, DuplicatePrefixKeepsFirst)
+{
+  EXPECT_TRUE(_trie.insert("+44", 1));
+  EXPECT_FALSE(_trie.insert("+44", 2));
+  EXPECT_EQ(1u, _trie.size());
+  EXPECT_EQ(1, lookup("+447700900123"));
+}
+
+TEST_F(PrefixTrieTest, KeyShorterThanPrefix)
+{
+  // A key that is a prefix of configured prefixes matches the lexicographically
+  // greatest of them, in preference to any shorter prefix of the key.
+  EXPECT_TRUE(_trie.insert("1", 1));
+  EXPECT_TRUE(_trie.insert("123", 123));
+  EXPECT_TRUE(_trie.insert("125", 125));
+
+  EXPECT_EQ(125, lookup("12"));
+  EXPECT_EQ(125, lookup("1"));
+  EXPECT_EQ(123, lookup("123"));
+  EXPECT_EQ(1, lookup("13"));
+  EXPECT_EQ(125, lookup(""));
+}
+
+TEST_F(PrefixTrieTest, MatchedPrefix)
+{
+  EXPECT_TRUE(_trie.insert("+1510", 1));
+
+  const string* prefix = NULL;
+  const int* value = _trie.match("+15108580271", &prefix);
+  ASSERT_TRUE(value != NULL);
+  ASSERT_TRUE(prefix != NULL);
+  EXPECT_EQ("+1510", *prefix);
+}
+
+// Looks up numbers in tables with increasing numbers of prefixes, checking
+// that each number matches the block that contains it.
+TEST_F(PrefixTrieTest, LargeTables)
+{
+  const int NUM_LOOKUPS = 100000;
+  // Tables of 100, 10k and 1M prefixes.
+  const int block_digits[] = {2, 4, 6};
+
+  for (size_t ii = 0; ii < sizeof(block_digits) / sizeof(block_digits[0]); ++ii)
+  {
+    int table_size = 1;
+    for (int jj = 0; jj < block_digits[ii]; ++jj)
+    {
+      table_size *= 10;
+    }
+
+    PrefixTrie<int> trie;
+    char buf[32];
+
+    // Number ranges of the form +44<block>, as would be found in a large ENUM
+    // or BGCF configuration.
+    for (int jj = 0; jj < table_size; ++jj)
+    {
+      snprintf(buf, sizeof(buf), "+44%0*d", block_digits[ii], jj);
+      trie.insert(buf, jj);
+    }
+    EXPECT_EQ((size_t)table_size, trie.size());
+
+    // The blocks cover the whole of +44, so every number matches the block
+    // given by its leading digits.
+    int mismatches = 0;
+
+    for (int jj = 0; jj < NUM_LOOKUPS; ++jj)
+    {
+      int number = (jj * 7919) % 10000000;
+      snprintf(buf, sizeof(buf), "+44%07d1234", number);
+      const int* value = trie.match(buf);
+      if ((value == NULL) || (*value != number / (10000000 / table_size)))
+      {
+        mismatches++;
+      }
+    }
+
+    EXPECT_EQ(0, mismatches);
+  }
+}
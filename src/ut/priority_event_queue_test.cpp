@@ -0,0 +1,121 @@
+/**
+ * @file priority_event_queue_test.cpp UT for the worker thread priority queue.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "priority_event_queue.h"
+
+using namespace std;
+
+/// Fixture for PriorityEventQueueTest.
+class PriorityEventQueueTest : public ::testing::Test
+{
+public:
+  PriorityEventQueueTest() :
+    _q(3, 50)
+  {
+  }
+
+  virtual ~PriorityEventQueueTest()
+  {
+  }
+
+  // Pops an event without waiting, returning -1 if the queue is empty.
+  int pop()
+  {
+    int item;
+    return _q.pop(item, 0) ? item : -1;
+  }
+
+  PriorityEventQueue<int> _q;
+};
+
+TEST_F(PriorityEventQueueTest, FifoWithinPriority)
+{
+  _q.push(1, 1);
+  _q.push(2, 1);
+  _q.push(3, 1);
+  EXPECT_EQ(3, _q.size());
+
+  EXPECT_EQ(1, pop());
+  EXPECT_EQ(2, pop());
+  EXPECT_EQ(3, pop());
+  EXPECT_EQ(-1, pop());
+  EXPECT_EQ(0, _q.size());
+}
+
+TEST_F(PriorityEventQueueTest, HighestPriorityFirst)
+{
+  _q.push(20, 2);
+  _q.push(10, 1);
+  _q.push(21, 2);
+  _q.push(0, 0);
+
+  EXPECT_EQ(0, pop());
+  EXPECT_EQ(10, pop());
+  EXPECT_EQ(20, pop());
+  EXPECT_EQ(21, pop());
+}
+
+TEST_F(PriorityEventQueueTest, StarvationProtection)
+{
+  _q.push(20, 2);
+  usleep(10000);
+  _q.push(10, 1);
+
+  // Wait for longer than the maximum wait time, then add a higher priority
+  // event.  The low priority events have waited too long so are popped first,
+  // oldest first.
+  usleep(100000);
+  _q.push(0, 0);
+
+  EXPECT_EQ(20, pop());
+  EXPECT_EQ(10, pop());
+  EXPECT_EQ(0, pop());
+}
+
+TEST_F(PriorityEventQueueTest, PopTimesOut)
+{
+  int item;
+  EXPECT_FALSE(_q.pop(item, 10));
+}
+
+TEST_F(PriorityEventQueueTest, Terminate)
+{
+  _q.push(1, 1);
+  _q.terminate();
+
+  int item;
+  EXPECT_FALSE(_q.pop(item));
+}
+
+TEST_F(PriorityEventQueueTest, DeadlockDetection)
+{
+  _q.set_deadlock_threshold(20);
+
+  // An empty queue is never deadlocked.
+  usleep(40000);
+  EXPECT_FALSE(_q.is_deadlocked());
+
+  // Nor is one whose events are being serviced.
+  _q.push(1, 1);
+  EXPECT_FALSE(_q.is_deadlocked());
+
+  usleep(40000);
+  EXPECT_TRUE(_q.is_deadlocked());
+
+  EXPECT_EQ(1, pop());
+  EXPECT_FALSE(_q.is_deadlocked());
+}
@@ -10,13 +10,18 @@
  */
 
 #include <string>
+#include <atomic>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "basetest.hpp"
 #include "ralf_processor.h"
 #include "mockhttpconnection.h"
+#include "fakesnmp.hpp"
 
 using ::testing::_;
+using ::testing::DoAll;
+using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
 
 class RalfProcessorTest : public BaseTest
@@ -49,3 +54,144 @@ TEST_F(RalfProcessorTest, RequestComplete)
   _ralf_processor->send_request_to_ralf(rr);
   sleep(1);
 }
+
+/// Fixture for tests of a RalfProcessor that batches ACRs.
+class RalfProcessorBatchingTest : public BaseTest
+{
+  MockHttpConnection* _ralf_connection;
+  SNMP::FakeEventAccumulatorTable _latency_tbl;
+  SNMP::FakeCounterTable _dropped_tbl;
+
+  RalfProcessorBatchingTest()
+  {
+    _ralf_connection = new MockHttpConnection();
+  }
+
+  virtual ~RalfProcessorBatchingTest()
+  {
+    delete _ralf_connection;
+  }
+
+  RalfProcessor* create_processor(int max_queued_acrs,
+                                  int batch_size,
+                                  int batch_interval_ms,
+                                  int ralf_threads = 1)
+  {
+    return new RalfProcessor(_ralf_connection,
+                             NULL,
+                             ralf_threads,
+                             max_queued_acrs,
+                             batch_size,
+                             batch_interval_ms,
+                             &_latency_tbl,
+                             &_dropped_tbl);
+  }
+
+  static RalfProcessor::RalfRequest* create_request(const std::string& call_id)
+  {
+    RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
+    rr->path = "/call-id/" + call_id;
+    rr->message = "message";
+    rr->trail = 0;
+    return rr;
+  }
+};
+
+// A full batch is sent without waiting for the batch interval.
+TEST_F(RalfProcessorBatchingTest, FullBatchSent)
+{
+  RalfProcessor* ralf_processor = create_processor(100, 3, 60000);
+
+  EXPECT_CALL(*_ralf_connection, send_post("/call-id/1",_,_,_,_)).WillOnce(Return(200));
+  EXPECT_CALL(*_ralf_connection, send_post("/call-id/2",_,_,_,_)).WillOnce(Return(200));
+  EXPECT_CALL(*_ralf_connection, send_post("/call-id/3",_,_,_,_)).WillOnce(Return(200));
+  ralf_processor->send_request_to_ralf(create_request("1"));
+  ralf_processor->send_request_to_ralf(create_request("2"));
+  ralf_processor->send_request_to_ralf(create_request("3"));
+  sleep(1);
+
+  EXPECT_EQ(3, _latency_tbl._count);
+  EXPECT_EQ(0, _dropped_tbl._count);
+  delete ralf_processor;
+}
+
+// A part-filled batch is sent once the batch interval has passed.
+TEST_F(RalfProcessorBatchingTest, PartialBatchFlushed)
+{
+  RalfProcessor* ralf_processor = create_processor(100, 10, 50);
+
+  EXPECT_CALL(*_ralf_connection, send_post(_,_,_,_,_)).Times(2).WillRepeatedly(Return(200));
+  ralf_processor->send_request_to_ralf(create_request("1"));
+  ralf_processor->send_request_to_ralf(create_request("2"));
+  sleep(1);
+
+  EXPECT_EQ(2, _latency_tbl._count);
+  delete ralf_processor;
+}
+
+// ACRs are dropped, rather than blocking the caller, once too many are queued.
+TEST_F(RalfProcessorBatchingTest, DropWhenQueueFull)
+{
+  RalfProcessor* ralf_processor = create_processor(2, 10, 50);
+
+  EXPECT_CALL(*_ralf_connection, send_post(_,_,_,_,_)).Times(2).WillRepeatedly(Return(200));
+  ralf_processor->send_request_to_ralf(create_request("1"));
+  ralf_processor->send_request_to_ralf(create_request("2"));
+  ralf_processor->send_request_to_ralf(create_request("3"));
+  EXPECT_EQ(1, _dropped_tbl._count);
+  sleep(1);
+
+  // Once the backlog has been sent, ACRs are accepted again.
+  EXPECT_CALL(*_ralf_connection, send_post("/call-id/4",_,_,_,_)).WillOnce(Return(200));
+  ralf_processor->send_request_to_ralf(create_request("4"));
+  sleep(1);
+
+  EXPECT_EQ(1, _dropped_tbl._count);
+  EXPECT_EQ(3, _latency_tbl._count);
+  delete ralf_processor;
+}
+
+// Without batching, a full queue still drops ACRs rather than blocking.
+TEST_F(RalfProcessorBatchingTest, DropWithoutBatching)
+{
+  RalfProcessor* ralf_processor = create_processor(0, 1, 50);
+
+  EXPECT_CALL(*_ralf_connection, send_post(_,_,_,_,_)).Times(0);
+  ralf_processor->send_request_to_ralf(create_request("1"));
+  EXPECT_EQ(1, _dropped_tbl._count);
+  delete ralf_processor;
+}
+
+// A batch is shared out between the sending threads, so its ACRs are sent
+// concurrently.
+TEST_F(RalfProcessorBatchingTest, BatchSentConcurrently)
+{
+  RalfProcessor* ralf_processor = create_processor(100, 4, 60000, 2);
+
+  std::atomic<int> in_flight(0);
+  std::atomic<int> max_in_flight(0);
+
+  EXPECT_CALL(*_ralf_connection, send_post(_,_,_,_,_))
+    .Times(4)
+    .WillRepeatedly(DoAll(InvokeWithoutArgs([&]()
+                          {
+                            int now_in_flight = ++in_flight;
+                            if (now_in_flight > max_in_flight)
+                            {
+                              max_in_flight = now_in_flight;
+                            }
+                            usleep(100000);
+                            in_flight--;
+                          }),
+                          Return(200)));
+
+  for (int ii = 1; ii <= 4; ++ii)
+  {
+    ralf_processor->send_request_to_ralf(create_request(std::to_string(ii)));
+  }
+  sleep(1);
+
+  EXPECT_EQ(2, max_in_flight);
+  EXPECT_EQ(4, _latency_tbl._count);
+  delete ralf_processor;
+}
@@ -11,6 +11,8 @@
 
 #include <string>
 #include <vector>
+#include <new>
+#include <stdlib.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -22,12 +24,42 @@
 #include "test_utils.hpp"
 #include "ifc_parsing_utils.h"
 #include "mockalarm.h"
+#include "rapidxml/rapidxml_print.hpp"
 
 using ::testing::UnorderedElementsAreArray;
 using ::testing::AtLeast;
 
 using namespace std;
 
+// Counts the calls to operator new made on this thread while
+// count_allocations is set, so that tests can check how many allocations an
+// operation makes.  Replacing operator new affects the whole test binary, but
+// it behaves exactly like the default unless counting is enabled.
+static thread_local bool count_allocations = false;
+static thread_local int num_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+  if (count_allocations)
+  {
+    ++num_allocations;
+  }
+
+  void* p = malloc((size != 0) ? size : 1);
+
+  if (p == NULL)
+  {
+    throw std::bad_alloc(); // LCOV_EXCL_LINE
+  }
+
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
 /// Fixture for SIFCServiceTest.
 class SIFCServiceTest : public ::testing::Test
 {
@@ -56,9 +88,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // iFC for ID 2).
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "publish.example.com");
 
@@ -66,7 +96,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // ID 1)
   std::set<int> multiple_ifcs; multiple_ifcs.insert(1);
   std::multimap<int32_t, Ifc> multiple_ifc_map;
-  sifc.get_ifcs_from_id(multiple_ifc_map, multiple_ifcs, root, 0);
+  sifc.get_ifcs_from_id(multiple_ifc_map, multiple_ifcs, 0);
   EXPECT_EQ(multiple_ifc_map.size(), 2);
   std::vector<std::string> expected_server_names;
   expected_server_names.push_back("invite.example.com");
@@ -83,7 +113,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // Pull out multiple iFCs from multiple IDs
   std::set<int> multiple_ids; multiple_ids.insert(1); multiple_ids.insert(2);
   std::multimap<int32_t, Ifc> multiple_ids_map;
-  sifc.get_ifcs_from_id(multiple_ids_map, multiple_ids, root, 0);
+  sifc.get_ifcs_from_id(multiple_ids_map, multiple_ids, 0);
   EXPECT_EQ(multiple_ids_map.size(), 3);
   expected_server_names.push_back("publish.example.com");
   std::vector<std::string> server_names_multiple_ids;
@@ -99,7 +129,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // check that this doesn't return any iFCs.
   std::set<int> missing_ids; missing_ids.insert(100);
   std::multimap<int32_t, Ifc> missing_ids_map;
-  sifc.get_ifcs_from_id(missing_ids_map, missing_ids, root, 0);
+  sifc.get_ifcs_from_id(missing_ids_map, missing_ids, 0);
   EXPECT_EQ(missing_ids_map.size(), 0);
 }
 
@@ -113,9 +143,7 @@ TEST_F(SIFCServiceTest, SIFCReloadInvalidFile)
   // Load the iFC file, and check that it's been parsed correctly
   std::set<int> id; id.insert(2);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 
@@ -126,7 +154,7 @@ TEST_F(SIFCServiceTest, SIFCReloadInvalidFile)
   sifc._configuration = string(UT_DIR).append("/test_sifc_parse_error.xml");
   sifc.update_sets();
   std::multimap<int32_t, Ifc> ifc_map_reload;
-  sifc.get_ifcs_from_id(ifc_map_reload, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map_reload, id, 0);
   EXPECT_EQ(ifc_map_reload.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map_reload.find(0)->second), "publish.example.com");
 }
@@ -141,9 +169,7 @@ TEST_F(SIFCServiceTest, SIFCReloadDifferentFile)
   // Load the iFC file, and check that it's been parsed correctly
   std::set<int> id; id.insert(2);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 
@@ -154,7 +180,7 @@ TEST_F(SIFCServiceTest, SIFCReloadDifferentFile)
   sifc._configuration = string(UT_DIR).append("/test_sifc_changed.xml");
   sifc.update_sets();
   std::multimap<int32_t, Ifc> ifc_map_reload;
-  sifc.get_ifcs_from_id(ifc_map_reload, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map_reload, id, 0);
   EXPECT_EQ(ifc_map_reload.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map_reload.find(0)->second), "register.example.com");
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
@@ -174,7 +200,7 @@ TEST_F(SIFCServiceTest, MissingFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/non_existent_file.xml"));
   EXPECT_TRUE(log.contains("No shared iFCs configuration"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_TRUE(sifc._shared_ifc_sets->empty());
 }
 
 // Test that we log appropriately if the shared iFC file is empty.
@@ -184,7 +210,7 @@ TEST_F(SIFCServiceTest, EmptyFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_empty_file.xml"));
   EXPECT_TRUE(log.contains("Failed to read shared iFCs configuration"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_TRUE(sifc._shared_ifc_sets->empty());
 }
 
 // Test that we log appropriately if the shared iFC file is unparseable.
@@ -194,7 +220,7 @@ TEST_F(SIFCServiceTest, ParseError)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_parse_error.xml"));
   EXPECT_TRUE(log.contains("Failed to parse the shared iFCs configuration data"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_TRUE(sifc._shared_ifc_sets->empty());
 }
 
 // Test that we log appropriately if the shared iFC file has the wrong syntax.
@@ -204,7 +230,7 @@ TEST_F(SIFCServiceTest, MissingSetBlock)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_missing_set.xml"));
   EXPECT_TRUE(log.contains("Invalid shared iFCs configuration file - missing SharedIFCsSets block"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_TRUE(sifc._shared_ifc_sets->empty());
 }
 
 // Test that we cope with the case that the shared iFC file is valid but empty
@@ -214,7 +240,7 @@ TEST_F(SIFCServiceTest, NoEntries)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_no_entries.xml"));
   EXPECT_FALSE(log.contains("Failed"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_TRUE(sifc._shared_ifc_sets->empty());
 }
 
 // In the following tests we have various SiFC xml files that have invalid
@@ -236,9 +262,7 @@ TEST_F(SIFCServiceTest, MissingSetID)
   // was added to the map.
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "register.example.com");
 }
@@ -255,9 +279,7 @@ TEST_F(SIFCServiceTest, InvalidSetID)
   // was added to the map.
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "register.example.com");
 }
@@ -275,9 +297,7 @@ TEST_F(SIFCServiceTest, RepeatedSetID)
   // Check that the map entry has the correct server name.
   std::set<int> single_ifc; single_ifc.insert(1);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "publish.example.com");
 }
@@ -295,10 +315,63 @@ TEST_F(SIFCServiceTest, SIFCPriorities)
   // Get the iFCs for ID. There should be two (as one was invalid)
   std::set<int> id; id.insert(1);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 2);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "invite.example.com");
   EXPECT_EQ(get_server_name(ifc_map.find(200)->second), "register.example.com");
 }
+
+// Compares the allocations made by looking up shared iFCs (as done on every
+// INVITE for subscribers with shared iFC sets) against reparsing the iFC XML
+// for each lookup, as was done before the iFCs were parsed once at load time.
+TEST_F(SIFCServiceTest, SharedIfcAllocations)
+{
+  EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
+  SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc.xml"));
+  std::set<int> id; id.insert(1);
+
+  std::multimap<int32_t, Ifc> ifc_map;
+  num_allocations = 0;
+  count_allocations = true;
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
+  count_allocations = false;
+  int shared_allocations = num_allocations;
+  ASSERT_EQ(ifc_map.size(), 2);
+
+  // Now do the same lookup by parsing the XML of each iFC into the request's
+  // document.
+  std::vector<std::pair<int32_t, std::string>> ifc_strs;
+  for (std::multimap<int32_t, Ifc>::iterator it = ifc_map.begin();
+       it != ifc_map.end();
+       ++it)
+  {
+    std::string ifc_str;
+    rapidxml::print(std::back_inserter(ifc_str), *it->second._ifc, 0);
+    ifc_strs.push_back(std::make_pair(it->first, ifc_str));
+  }
+
+  std::multimap<int32_t, Ifc> parsed_ifc_map;
+  num_allocations = 0;
+  count_allocations = true;
+  {
+    std::shared_ptr<rapidxml::xml_document<> > root(new rapidxml::xml_document<>);
+
+    for (size_t jj = 0; jj < ifc_strs.size(); ++jj)
+    {
+      rapidxml::xml_document<>* new_document = new rapidxml::xml_document<>();
+      char* xml_str = root->allocate_string(ifc_strs[jj].second.c_str());
+      new_document->parse<0>(xml_str);
+      rapidxml::xml_node<>* node = root->clone_node(new_document->first_node());
+      delete new_document;
+      parsed_ifc_map.insert(std::make_pair(ifc_strs[jj].first, Ifc(node)));
+    }
+
+    parsed_ifc_map.clear();
+  }
+  count_allocations = false;
+  int parsed_allocations = num_allocations;
+
+  // Sharing the parsed iFCs saves the documents, strings and compiled iFCs
+  // allocated by each parse, leaving little more than the map nodes.
+  EXPECT_LT(shared_allocations, parsed_allocations);
+}
@@ -0,0 +1,375 @@
+/**
+ * @file simservs_cache_test.cpp UT for the simservs cache.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "test_interposer.hpp"
+#include "simservs_cache.h"
+#include "mock_xdm_connection.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+using ::testing::_;
+using ::testing::DoAll;
+using ::testing::Eq;
+using ::testing::Invoke;
+using ::testing::Return;
+using ::testing::SetArgReferee;
+
+static const string OIR_SIMSERVS =
+  "<simservs xmlns=\"http://uri.etsi.org/ngn/params/xml/simservs/xcap\" xmlns:cp=\"urn:ietf:params:xml:ns:common-policy\">"
+  "  <originating-identity-presentation-restriction active=\"true\">"
+  "    <default-behaviour>presentation-restricted</default-behaviour>"
+  "  </originating-identity-presentation-restriction>"
+  "</simservs>";
+
+static const string NO_SERVICES_SIMSERVS =
+  "<simservs xmlns=\"http://uri.etsi.org/ngn/params/xml/simservs/xcap\" xmlns:cp=\"urn:ietf:params:xml:ns:common-policy\">"
+  "</simservs>";
+
+/// Fixture for SimservsCacheTest.
+class SimservsCacheTest : public ::testing::Test
+{
+public:
+  SimservsCacheTest() :
+    _cache(&_xdm, 100, 30, &_hits_tbl, &_misses_tbl, &_revalidations_tbl)
+  {
+  }
+
+  virtual ~SimservsCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  MockXDMConnection _xdm;
+  SNMP::FakeCounterTable _hits_tbl;
+  SNMP::FakeCounterTable _misses_tbl;
+  SNMP::FakeCounterTable _revalidations_tbl;
+  SimservsCache _cache;
+};
+
+// Repeated lookups within the TTL only fetch the document once.
+TEST_F(SimservsCacheTest, Hit)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+
+  std::shared_ptr<const simservs> services1 = _cache.get("sip:6505550001@homedomain", 0);
+  ASSERT_TRUE(services1 != NULL);
+  EXPECT_TRUE(services1->oir_enabled());
+
+  cwtest_advance_time_ms(29000);
+  std::shared_ptr<const simservs> services2 = _cache.get("sip:6505550001@homedomain", 0);
+  EXPECT_EQ(services1, services2);
+
+  EXPECT_EQ(1, _hits_tbl._count);
+  EXPECT_EQ(1, _misses_tbl._count);
+  EXPECT_EQ(0, _revalidations_tbl._count);
+}
+
+// After the TTL, the cached document is revalidated using its ETag, and kept
+// if the XDMS says it hasn't changed.
+TEST_F(SimservsCacheTest, NotModified)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+  std::shared_ptr<const simservs> services1 = _cache.get("sip:6505550001@homedomain", 0);
+
+  cwtest_advance_time_ms(31000);
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq("\"1\""), _))
+    .WillOnce(Return(HTTP_NOT_MODIFIED));
+  std::shared_ptr<const simservs> services2 = _cache.get("sip:6505550001@homedomain", 0);
+  EXPECT_EQ(services1, services2);
+
+  // The revalidated document is used for another TTL.
+  cwtest_advance_time_ms(29000);
+  std::shared_ptr<const simservs> services3 = _cache.get("sip:6505550001@homedomain", 0);
+  EXPECT_EQ(services1, services3);
+
+  EXPECT_EQ(1, _hits_tbl._count);
+  EXPECT_EQ(1, _misses_tbl._count);
+  EXPECT_EQ(1, _revalidations_tbl._count);
+}
+
+// A document that has changed since it was cached is replaced.
+TEST_F(SimservsCacheTest, Modified)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+  _cache.get("sip:6505550001@homedomain", 0);
+
+  cwtest_advance_time_ms(31000);
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq("\"1\""), _))
+    .WillOnce(DoAll(SetArgReferee<1>(NO_SERVICES_SIMSERVS),
+                    SetArgReferee<2>("\"2\""),
+                    Return(HTTP_OK)));
+  std::shared_ptr<const simservs> services = _cache.get("sip:6505550001@homedomain", 0);
+  ASSERT_TRUE(services != NULL);
+  EXPECT_FALSE(services->oir_enabled());
+
+  // The new ETag is used for the next revalidation.
+  cwtest_advance_time_ms(31000);
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq("\"2\""), _))
+    .WillOnce(Return(HTTP_NOT_MODIFIED));
+  _cache.get("sip:6505550001@homedomain", 0);
+
+  EXPECT_EQ(2, _misses_tbl._count);
+  EXPECT_EQ(1, _revalidations_tbl._count);
+}
+
+// Users with no simservs document are cached with no services enabled.
+TEST_F(SimservsCacheTest, NotFound)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+
+  std::shared_ptr<const simservs> services = _cache.get("sip:6505550001@homedomain", 0);
+  ASSERT_TRUE(services != NULL);
+  EXPECT_FALSE(services->oir_enabled());
+  EXPECT_FALSE(services->cdiv_enabled());
+
+  _cache.get("sip:6505550001@homedomain", 0);
+  EXPECT_EQ(1, _hits_tbl._count);
+}
+
+// Failures aren't cached.
+TEST_F(SimservsCacheTest, ServerError)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Return(HTTP_SERVER_ERROR))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+
+  EXPECT_TRUE(_cache.get("sip:6505550001@homedomain", 0) == NULL);
+
+  std::shared_ptr<const simservs> services = _cache.get("sip:6505550001@homedomain", 0);
+  ASSERT_TRUE(services != NULL);
+  EXPECT_TRUE(services->oir_enabled());
+}
+
+// If the XDMS fails while revalidating a document, the cached document is
+// used, and revalidated again on the next lookup.
+TEST_F(SimservsCacheTest, ServerErrorOnRevalidation)
+{
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+  std::shared_ptr<const simservs> services1 = _cache.get("sip:6505550001@homedomain", 0);
+
+  cwtest_advance_time_ms(31000);
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq("\"1\""), _))
+    .WillOnce(Return(HTTP_SERVER_ERROR))
+    .WillOnce(Return(HTTP_NOT_MODIFIED));
+  EXPECT_EQ(services1, _cache.get("sip:6505550001@homedomain", 0));
+  EXPECT_EQ(services1, _cache.get("sip:6505550001@homedomain", 0));
+  EXPECT_EQ(1, _revalidations_tbl._count);
+}
+
+// When the cache is full, the least recently used user is evicted to make
+// space.
+TEST_F(SimservsCacheTest, Full)
+{
+  SimservsCache cache(&_xdm, 2, 30, NULL, NULL, NULL);
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550002@homedomain", _, Eq(""), _))
+    .Times(2)
+    .WillRepeatedly(Return(HTTP_NOT_FOUND));
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550003@homedomain", _, Eq(""), _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+
+  cache.get("sip:6505550001@homedomain", 0);
+  cache.get("sip:6505550002@homedomain", 0);
+  cache.get("sip:6505550001@homedomain", 0);
+  cache.get("sip:6505550003@homedomain", 0);
+  EXPECT_EQ(2u, cache._cache.size());
+
+  // User 1 was used more recently than user 2, so is still cached.
+  cache.get("sip:6505550001@homedomain", 0);
+  cache.get("sip:6505550002@homedomain", 0);
+}
+
+// Concurrent lookups for a user that isn't cached share a single request to
+// the XDMS.
+TEST_F(SimservsCacheTest, ConcurrentMiss)
+{
+  const int NUM_THREADS = 10;
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Invoke([](const std::string& user,
+                        std::string& xml_data,
+                        std::string& etag,
+                        SAS::TrailId trail)
+    {
+      // Give the other threads time to join the request.
+      usleep(100000);
+      xml_data = OIR_SIMSERVS;
+      etag = "\"1\"";
+      return (HTTPCode)HTTP_OK;
+    }));
+
+  std::vector<std::shared_ptr<const simservs>> services(NUM_THREADS);
+  std::vector<std::thread> threads;
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads.push_back(std::thread([&, ii]()
+    {
+      services[ii] = _cache.get("sip:6505550001@homedomain", 0);
+    }));
+  }
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads[ii].join();
+    ASSERT_TRUE(services[ii] != NULL);
+    EXPECT_EQ(services[0], services[ii]);
+  }
+
+  EXPECT_EQ(NUM_THREADS - 1, _hits_tbl._count);
+  EXPECT_EQ(1, _misses_tbl._count);
+}
+
+// If a shared request to the XDMS fails, the lookups waiting for it count as
+// misses.
+TEST_F(SimservsCacheTest, ConcurrentMissFailure)
+{
+  const int NUM_THREADS = 10;
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Invoke([](const std::string& user,
+                        std::string& xml_data,
+                        std::string& etag,
+                        SAS::TrailId trail)
+    {
+      // Give the other threads time to join the request.
+      usleep(100000);
+      return (HTTPCode)HTTP_SERVER_ERROR;
+    }));
+
+  std::vector<std::thread> threads;
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads.push_back(std::thread([&]()
+    {
+      EXPECT_TRUE(_cache.get("sip:6505550001@homedomain", 0) == NULL);
+    }));
+  }
+
+  for (int ii = 0; ii < NUM_THREADS; ++ii)
+  {
+    threads[ii].join();
+  }
+
+  EXPECT_EQ(0, _hits_tbl._count);
+  EXPECT_EQ(NUM_THREADS, _misses_tbl._count);
+}
+
+// A lookup only waits a limited time for another thread's request to the
+// XDMS, and then makes its own.
+TEST_F(SimservsCacheTest, SlowRequest)
+{
+  std::atomic_bool first_started(false);
+  std::atomic_bool second_done(false);
+
+  EXPECT_CALL(_xdm, get_simservs_if_modified("sip:6505550001@homedomain", _, Eq(""), _))
+    .WillOnce(Invoke([&](const std::string& user,
+                         std::string& xml_data,
+                         std::string& etag,
+                         SAS::TrailId trail)
+    {
+      // Hold this request until the other lookup has given up waiting for it.
+      first_started = true;
+      for (int ii = 0; (!second_done) && (ii < 500); ++ii)
+      {
+        usleep(10000);
+      }
+      return (HTTPCode)HTTP_NOT_FOUND;
+    }))
+    .WillOnce(DoAll(SetArgReferee<1>(OIR_SIMSERVS),
+                    SetArgReferee<2>("\"1\""),
+                    Return(HTTP_OK)));
+
+  std::thread first([&]()
+  {
+    _cache.get("sip:6505550001@homedomain", 0);
+  });
+
+  while (!first_started)
+  {
+    usleep(1000);
+  }
+
+  std::shared_ptr<const simservs> services = _cache.get("sip:6505550001@homedomain", 0);
+  second_done = true;
+  first.join();
+
+  ASSERT_TRUE(services != NULL);
+  EXPECT_TRUE(services->oir_enabled());
+}
+
+// Simulates a load of calls to a population of subscribers, and checks that
+// the cache saves the XDMS all but one request per subscriber per TTL.
+TEST_F(SimservsCacheTest, RequestReduction)
+{
+  const int NUM_SUBSCRIBERS = 100;
+  const int NUM_CALLS = 10000;
+  const int CALLS_PER_SECOND = 50;
+  const int TTL = 30;
+  int xdms_requests = 0;
+
+  EXPECT_CALL(_xdm, get_simservs_if_modified(_, _, _, _))
+    .WillRepeatedly(Invoke([&](const std::string& user,
+                               std::string& xml_data,
+                               std::string& etag,
+                               SAS::TrailId trail)
+    {
+      xdms_requests++;
+      if (etag == "\"1\"")
+      {
+        return (HTTPCode)HTTP_NOT_MODIFIED;
+      }
+      xml_data = OIR_SIMSERVS;
+      etag = "\"1\"";
+      return (HTTPCode)HTTP_OK;
+    }));
+
+  for (int ii = 0; ii < NUM_CALLS; ++ii)
+  {
+    _cache.get("sip:65055" + std::to_string(10000 + (ii * 7919) % NUM_SUBSCRIBERS) + "@homedomain", 0);
+    cwtest_advance_time_ms(1000 / CALLS_PER_SECOND);
+  }
+
+  EXPECT_EQ(NUM_CALLS, _hits_tbl._count + _misses_tbl._count + _revalidations_tbl._count);
+  EXPECT_EQ(xdms_requests, _misses_tbl._count + _revalidations_tbl._count);
+  EXPECT_EQ(NUM_SUBSCRIBERS, _misses_tbl._count);
+
+  // Each subscriber is revalidated at most once per TTL over the run.
+  int duration = NUM_CALLS / CALLS_PER_SECOND;
+  EXPECT_LE(_revalidations_tbl._count, NUM_SUBSCRIBERS * (duration / TTL + 1));
+  EXPECT_LT(xdms_requests, NUM_CALLS / 10);
+}
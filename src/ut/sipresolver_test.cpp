@@ -10,6 +10,8 @@
  */
 
 #include <string>
+#include <pthread.h>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -704,3 +706,50 @@ TEST_F(SIPResolverTest, AllowedHostStateForIPAddr)
   EXPECT_EQ(1, targets.size());
   targets.pop_back();
 }
+
+TEST_F(SIPResolverTest, AsyncResolution)
+{
+  _sipresolver.start_async_threads(1);
+
+  std::vector<DnsRRecord*> records;
+  records.push_back(a("sprout-1.cw-ngv.com", 3600, "3.0.0.1"));
+  _dnsresolver.add_to_cache("sprout-1.cw-ngv.com", ns_t_a, records);
+
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  std::vector<AddrInfo> async_targets;
+  bool resolved = false;
+  std::vector<AddrInfo> targets;
+
+  // IP addresses don't need any DNS lookups, so are resolved synchronously.
+  EXPECT_FALSE(_sipresolver.resolve_async(
+    "192.0.2.1", AF_INET, 5060, IPPROTO_TCP, 1, targets, BaseResolver::ALL_LISTS, 0,
+    [](const std::vector<AddrInfo>& results) {}));
+  ASSERT_EQ(1, targets.size());
+  EXPECT_EQ("192.0.2.1:5060;transport=TCP", addrinfo_to_string(targets[0]));
+  targets.clear();
+
+  // Domain names are resolved on the resolver thread.
+  EXPECT_TRUE(_sipresolver.resolve_async(
+    "sprout-1.cw-ngv.com", AF_INET, 5054, IPPROTO_TCP, 1, targets, BaseResolver::ALL_LISTS, 0,
+    [&](const std::vector<AddrInfo>& results)
+    {
+      pthread_mutex_lock(&lock);
+      async_targets = results;
+      resolved = true;
+      pthread_mutex_unlock(&lock);
+    }));
+  EXPECT_EQ(0, targets.size());
+
+  bool done = false;
+  for (int ii = 0; (!done) && (ii < 100); ++ii)
+  {
+    usleep(10000);
+    pthread_mutex_lock(&lock);
+    done = resolved;
+    pthread_mutex_unlock(&lock);
+  }
+
+  ASSERT_TRUE(done);
+  ASSERT_EQ(1, async_targets.size());
+  EXPECT_EQ("3.0.0.1:5054;transport=TCP", addrinfo_to_string(async_targets[0]));
+}
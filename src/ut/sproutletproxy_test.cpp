@@ -13,7 +13,9 @@
 #include "siptest.hpp"
 #include "test_interposer.hpp"
 #include "sproutletproxy.h"
+#include "thread_dispatcher.h"
 #include "pjutils.h"
+#include "utils.h"
 #include "pjsip.h"
 #include "pjsip_simple.h"
 
@@ -576,6 +578,27 @@ public:
   }
 };
 
+class FakeSproutletTsxSuspend : public SproutletTsx
+{
+public:
+  FakeSproutletTsxSuspend(Sproutlet* sproutlet) :
+    SproutletTsx(sproutlet)
+  {
+  }
+
+  void on_rx_initial_request(pjsip_msg* req)
+  {
+    // Resume straight away, as if an asynchronous lookup had completed.  The
+    // request is only forwarded once the resume callback has been run on a
+    // worker thread.
+    ResumeFn resume = suspend();
+    resume([this, req]()
+    {
+      send_request(req);
+    });
+  }
+};
+
 class SproutletProxyTest : public SipTest
 {
 public:
@@ -609,6 +632,7 @@ public:
     _sproutlets.push_back(new FakeSproutlet<FakeSproutletTsxDelayAfterFwd<1> >("delayafterfwd", 0, "sip:delayafterfwd.homedomain;transport=tcp", ""));
     _sproutlets.push_back(new FakeSproutlet<FakeSproutletTsxDummySCSCF>("scscf", 44444, "sip:scscf.homedomain:44444;transport=tcp", "scscf"));
     _sproutlets.push_back(new FakeSproutlet<FakeSproutletReusesTransport>("transport", 0, "sip:transport.homedomain;transport=tcp", ""));
+    _sproutlets.push_back(new FakeSproutlet<FakeSproutletTsxSuspend>("suspend", 0, "sip:suspend.homedomain;transport=tcp", ""));
     _sproutlets.push_back(new FakeSproutlet<FakeSproutletTsxForwarder<false> >("fwdwithstats", 0, "sip:fwdwithstats.homedomain;transport=tcp", "", "", &SNMP::FAKE_INCOMING_SIP_TRANSACTIONS_TABLE, &SNMP::FAKE_OUTGOING_SIP_TRANSACTIONS_TABLE));
 
     // Create a host alias.
@@ -2348,6 +2372,26 @@ TEST_F(SproutletProxyTest, SproutletSelection)
   ASSERT_EQ("b2bua", service_name);
 }
 
+// Tests sproutlet selection for the hops of a typical S-CSCF -> BGCF -> I-CSCF
+// chain.  Each hop uses a different way of naming the sproutlet (domain part,
+// service parameter and user part respectively), with the fwd and b2bua
+// sproutlets standing in for the BGCF and I-CSCF.
+TEST_F(SproutletProxyTest, SproutletSelectionChain)
+{
+  const char* hops[] = {"sip:scscf.proxy1.homedomain;transport=TCP;lr",
+                        "sip:proxy1.homedomain;transport=TCP;lr;service=fwd",
+                        "sip:b2bua@proxy1.homedomain;transport=TCP;lr"};
+  const char* expected[] = {"scscf", "fwd", "b2bua"};
+  const int num_hops = sizeof(hops) / sizeof(hops[0]);
+
+  for (int ii = 0; ii < num_hops; ++ii)
+  {
+    pjsip_uri* uri = PJUtils::uri_from_string(hops[ii], stack_data.pool, PJ_FALSE);
+    EXPECT_TRUE(_proxy->is_uri_local(uri));
+    EXPECT_EQ(expected[ii], match_sproutlet_from_uri(uri));
+  }
+}
+
 // Tests that it's not possible to register more than one Sproutlet for the
 // same service name or port.
 TEST_F(SproutletProxyTest, ConflictingSproutlets)
@@ -2360,6 +2404,55 @@ TEST_F(SproutletProxyTest, ConflictingSproutlets)
   delete sproutlet;
 }
 
+TEST_F(SproutletProxyTest, SuspendAndResume)
+{
+  // Tests a Sproutlet that suspends processing of a request (as it would
+  // while waiting for an asynchronous lookup) and then resumes it.
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        stack_data.scscf_port,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Inject a request with two Route headers - the first referencing the
+  // suspending Sproutlet and the second referencing an external node.
+  Message msg1;
+  msg1._method = "MESSAGE";
+  msg1._requri = "sip:bob@awaydomain";
+  msg1._from = "sip:alice@homedomain";
+  msg1._to = "sip:bob@awaydomain";
+  msg1._via = tp->to_string(false);
+  msg1._route = "Route: <sip:suspend.proxy1.homedomain;transport=TCP;lr>\r\nRoute: <sip:proxy1.awaydomain;transport=TCP;lr>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Nothing is sent while the Sproutlet is suspended.
+  ASSERT_EQ(0, txdata_count());
+
+  // Run the resume callback, which forwards the request.
+  EXPECT_EQ(1, run_queued_callbacks());
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.20.1", 5060, tdata);
+  ReqMatcher("MESSAGE").matches(tdata->msg);
+  EXPECT_EQ("Route: <sip:proxy1.awaydomain;transport=TCP;lr>",
+            get_headers(tdata->msg, "Route"));
+
+  // Respond, and check the response is passed back.
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(200).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Nothing more was queued.
+  EXPECT_EQ(0, run_queued_callbacks());
+
+  delete tp;
+}
+
 TEST_F(SproutletProxyTest, SproutletCopiesOriginalTransport)
 {
   // Tests standard routing of a request through a Sproutlet that simply
@@ -0,0 +1,156 @@
+/**
+ * @file striped_lock_test.cpp UT for the striped lock.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "striped_lock.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+/// Fixture for StripedLockTest.
+class StripedLockTest : public ::testing::Test
+{
+public:
+  StripedLockTest() : _lock(16, &_contention_tbl)
+  {
+  }
+
+  virtual ~StripedLockTest()
+  {
+  }
+
+  SNMP::FakeCounterTable _contention_tbl;
+  StripedLock _lock;
+};
+
+// Threads working on the same key run one at a time.
+TEST_F(StripedLockTest, SameKeySerialized)
+{
+  atomic<int> active(0);
+  atomic<int> max_active(0);
+  vector<thread> threads;
+
+  for (int ii = 0; ii < 4; ++ii)
+  {
+    threads.push_back(thread([&]()
+    {
+      for (int jj = 0; jj < 5; ++jj)
+      {
+        StripedLock::Guard guard(&_lock, "sip:6505550001@homedomain");
+        int now_active = ++active;
+        if (now_active > max_active)
+        {
+          max_active = now_active;
+        }
+        usleep(1000);
+        active--;
+      }
+    }));
+  }
+
+  for (size_t ii = 0; ii < threads.size(); ++ii)
+  {
+    threads[ii].join();
+  }
+
+  EXPECT_EQ(1, max_active);
+  EXPECT_LT(0, _contention_tbl._count);
+}
+
+// A thread can lock a key it already holds.
+TEST_F(StripedLockTest, Recursive)
+{
+  StripedLock::Guard outer(&_lock, "sip:6505550001@homedomain");
+  StripedLock::Guard inner(&_lock, "sip:6505550001@homedomain");
+  EXPECT_EQ(0, _contention_tbl._count);
+}
+
+// Keys on different stripes don't block each other.
+TEST_F(StripedLockTest, DifferentStripes)
+{
+  // Find two keys on different stripes.
+  string key1 = "sip:6505550001@homedomain";
+  string key2;
+  for (int ii = 2; ; ++ii)
+  {
+    key2 = "sip:650555000" + to_string(ii) + "@homedomain";
+    if ((hash<string>()(key1) % 16) != (hash<string>()(key2) % 16))
+    {
+      break;
+    }
+  }
+
+  StripedLock::Guard guard(&_lock, key1);
+
+  bool locked = false;
+  thread other([&]()
+  {
+    StripedLock::Guard guard(&_lock, key2);
+    locked = true;
+  });
+  other.join();
+
+  EXPECT_TRUE(locked);
+  EXPECT_EQ(0, _contention_tbl._count);
+}
+
+// A Release lets other threads take the stripes this thread holds, and takes
+// them back when it ends.
+TEST_F(StripedLockTest, Release)
+{
+  StripedLock::Guard outer(&_lock, "sip:6505550001@homedomain");
+  StripedLock::Guard inner(&_lock, "sip:6505550001@homedomain");
+
+  {
+    StripedLock::Release release;
+
+    bool locked = false;
+    thread other([&]()
+    {
+      StripedLock::Guard guard(&_lock, "sip:6505550001@homedomain");
+      locked = true;
+    });
+    other.join();
+
+    EXPECT_TRUE(locked);
+  }
+
+  // The stripe is held again, so another thread has to wait for it.
+  atomic<bool> locked(false);
+  thread other([&]()
+  {
+    StripedLock::Guard guard(&_lock, "sip:6505550001@homedomain");
+    locked = true;
+  });
+
+  while (_contention_tbl._count == 0)
+  {
+    usleep(1000);
+  }
+  EXPECT_FALSE(locked);
+
+  // Let the other thread in by releasing again.
+  {
+    StripedLock::Release release;
+    other.join();
+  }
+
+  EXPECT_TRUE(locked);
+}
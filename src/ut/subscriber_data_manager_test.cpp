@@ -11,6 +11,7 @@
 
 
 #include <string>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -28,10 +29,14 @@
 #include "mock_store.h"
 #include "mock_analytics_logger.h"
 #include "analyticslogger.h"
+#include "fakesnmp.hpp"
+#include "timer_wheel.h"
 
 using ::testing::_;
 using ::testing::DoAll;
+using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
+using ::testing::SaveArg;
 using ::testing::SetArgReferee;
 
 /// Fixture for BasicSubscriberDataManagerTest.
@@ -577,6 +582,199 @@ TEST_F(SubscriberDataManagerCorruptDataTest, EmptyJsonObject)
   delete aor_data1;
 }
 
+/// Fixture for tests of the AoR serialization formats.
+class SubscriberDataManagerSerializationTest : public ::testing::Test
+{
+  // Builds an AoR with the specified numbers of bindings and subscriptions,
+  // filled in as they would be by the registrar and subscription sproutlets.
+  SubscriberDataManager::AoR* build_aor(int num_bindings, int num_subscriptions)
+  {
+    SubscriberDataManager::AoR* aor =
+      new SubscriberDataManager::AoR("sip:6505550231@homedomain");
+    aor->_notify_cseq = 123;
+    aor->_timer_id = "AoRtimer";
+    aor->_scscf_uri = "sip:scscf.sprout.homedomain:5058;transport=TCP";
+
+    for (int ii = 0; ii < num_bindings; ++ii)
+    {
+      std::string id = std::to_string(ii);
+      SubscriberDataManager::AoR::Binding* b =
+        aor->get_binding("urn:uuid:00000000-0000-0000-0000-b4dd3281762" + id + ":1");
+      b->_uri = "<sip:6505550231@192.91.191.29:5993" + id + ";transport=tcp;ob>";
+      b->_cid = "gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2g" + id;
+      b->_cseq = 17038 + ii;
+      b->_expires = 1500000000 + ii;
+      b->_priority = -ii;
+      b->_path_uris.push_back("sip:abcdefgh@bono-1.homedomain;lr");
+      b->_path_headers.push_back("\"Bob\" <sip:abcdefgh@bono-1.homedomain;lr>;tag=6ht7");
+      b->_params["+sip.instance"] = "\"<urn:uuid:00000000-0000-0000-0000-b4dd3281762" + id + ">\"";
+      b->_params["reg-id"] = "1";
+      b->_params["+sip.ice"] = "";
+      b->_private_id = "6505550231@homedomain";
+      b->_emergency_registration = (ii == 0);
+    }
+
+    for (int ii = 0; ii < num_subscriptions; ++ii)
+    {
+      std::string id = std::to_string(ii);
+      SubscriberDataManager::AoR::Subscription* s =
+        aor->get_subscription("1234567890" + id);
+      s->_req_uri = "sip:6505550231@192.91.191.29:5991" + id;
+      s->_from_uri = "<sip:6505550231@homedomain>";
+      s->_from_tag = "xyz" + id;
+      s->_to_uri = "<sip:6505550231@homedomain>";
+      s->_to_tag = "1234567890" + id;
+      s->_cid = "xyzabc@192.91.191.29" + id;
+      s->_route_uris.push_back("sip:abcdefgh@bono-1.homedomain;lr");
+      s->_expires = 1500000300 + ii;
+    }
+
+    return aor;
+  }
+
+  SubscriberDataManager::JsonSerializerDeserializer _json;
+  SubscriberDataManager::BinarySerializerDeserializer _binary;
+};
+
+TEST_F(SubscriberDataManagerSerializationTest, BinaryRoundTrip)
+{
+  SubscriberDataManager::AoR* aor = build_aor(3, 2);
+
+  std::string data = _binary.serialize_aor(aor);
+  SubscriberDataManager::AoR* aor2 =
+    _binary.deserialize_aor("sip:6505550231@homedomain", data);
+  ASSERT_TRUE(aor2 != NULL);
+
+  // The JSON forms of the two AoRs must be identical.
+  EXPECT_EQ(_json.serialize_aor(aor), _json.serialize_aor(aor2));
+  EXPECT_EQ(3u, aor2->bindings().size());
+  EXPECT_EQ(2u, aor2->subscriptions().size());
+
+  delete aor2; aor2 = NULL;
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, EmptyAoR)
+{
+  SubscriberDataManager::AoR* aor = new SubscriberDataManager::AoR("sip:6505550231@homedomain");
+
+  SubscriberDataManager::AoR* aor2 =
+    _binary.deserialize_aor("sip:6505550231@homedomain", _binary.serialize_aor(aor));
+  ASSERT_TRUE(aor2 != NULL);
+  EXPECT_EQ(_json.serialize_aor(aor), _json.serialize_aor(aor2));
+
+  delete aor2; aor2 = NULL;
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, FormatsAreDistinguished)
+{
+  SubscriberDataManager::AoR* aor = build_aor(1, 1);
+
+  // Each deserializer rejects the other format.
+  EXPECT_TRUE(_binary.deserialize_aor("sip:6505550231@homedomain",
+                                      _json.serialize_aor(aor)) == NULL);
+  EXPECT_TRUE(_json.deserialize_aor("sip:6505550231@homedomain",
+                                    _binary.serialize_aor(aor)) == NULL);
+
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, TruncatedBinary)
+{
+  SubscriberDataManager::AoR* aor = build_aor(2, 1);
+  std::string data = _binary.serialize_aor(aor);
+
+  // However the data is truncated (or extended), it is rejected.
+  for (size_t len = 0; len < data.size(); ++len)
+  {
+    EXPECT_TRUE(_binary.deserialize_aor("sip:6505550231@homedomain",
+                                        data.substr(0, len)) == NULL);
+  }
+  EXPECT_TRUE(_binary.deserialize_aor("sip:6505550231@homedomain",
+                                      data + "x") == NULL);
+
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, UnsupportedBinaryVersion)
+{
+  SubscriberDataManager::AoR* aor = build_aor(1, 0);
+  std::string data = _binary.serialize_aor(aor);
+  data[1] = 2;
+
+  EXPECT_TRUE(_binary.deserialize_aor("sip:6505550231@homedomain", data) == NULL);
+
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, JsonRoundTrip)
+{
+  SubscriberDataManager::AoR* aor = build_aor(3, 2);
+
+  // Binding IDs and other strings must be escaped.
+  SubscriberDataManager::AoR::Binding* b = aor->get_binding("\"<urn:\\quoted>\":1");
+  b->_uri = "<sip:6505550231@192.91.191.29:59934>";
+  b->_expires = 1500000000;
+  aor->_timer_id = "timer\"id";
+
+  std::string data = _json.serialize_aor(aor);
+  SubscriberDataManager::AoR* aor2 =
+    _json.deserialize_aor("sip:6505550231@homedomain", data);
+  ASSERT_TRUE(aor2 != NULL);
+
+  EXPECT_EQ(data, _json.serialize_aor(aor2));
+  EXPECT_EQ(4u, aor2->bindings().size());
+  EXPECT_EQ(2u, aor2->subscriptions().size());
+  EXPECT_EQ("timer\"id", aor2->_timer_id);
+
+  delete aor2; aor2 = NULL;
+  delete aor; aor = NULL;
+}
+
+TEST_F(SubscriberDataManagerSerializationTest, CopiesShareUnchangedMembers)
+{
+  SubscriberDataManager::AoR* aor = build_aor(2, 1);
+  SubscriberDataManager::AoR* aor2 = new SubscriberDataManager::AoR(*aor);
+  std::string binding_id = aor->bindings().begin()->first;
+  std::string to_tag = aor->subscriptions().begin()->first;
+
+  // The copy shares the bindings and subscriptions.
+  EXPECT_EQ(aor->bindings().begin()->second, aor2->bindings().begin()->second);
+  EXPECT_EQ(aor->subscriptions().begin()->second,
+            aor2->subscriptions().begin()->second);
+
+  // Changing a binding in the copy gives it its own copy of that binding only.
+  SubscriberDataManager::AoR::Binding* b = aor2->get_binding(binding_id);
+  b->_expires = 1600000000;
+  EXPECT_NE(aor->bindings().begin()->second, b);
+  EXPECT_EQ(1500000000, aor->bindings().begin()->second->_expires);
+  EXPECT_EQ(aor->bindings().rbegin()->second, aor2->bindings().rbegin()->second);
+
+  // Removing a member from one AoR leaves it in the other.
+  aor2->remove_subscription(to_tag);
+  EXPECT_EQ(0u, aor2->subscriptions().size());
+  EXPECT_EQ(1u, aor->subscriptions().size());
+
+  // Copying the members back shares them again.
+  aor->copy_subscriptions_and_bindings(aor2);
+  EXPECT_EQ(b, aor->bindings().begin()->second);
+
+  delete aor2; aor2 = NULL;
+  EXPECT_EQ(1600000000, aor->bindings().begin()->second->_expires);
+  EXPECT_EQ(1u, aor->subscriptions().size());
+  delete aor; aor = NULL;
+}
+
+// Checks that the binary format is more compact than JSON for an AoR with
+// several bindings and subscriptions.
+TEST_F(SubscriberDataManagerSerializationTest, BinaryFormatSize)
+{
+  SubscriberDataManager::AoR* aor = build_aor(10, 5);
+  EXPECT_LT(_binary.serialize_aor(aor).size(), _json.serialize_aor(aor).size());
+  delete aor; aor = NULL;
+}
+
 /// Test using a Mock Chronos connection that doesn't just swallow requests
 class SubscriberDataManagerChronosRequestsTest : public SipTest
 {
@@ -1052,3 +1250,327 @@ TEST_F(SubscriberDataManagerChronosRequestsTest, AoRTimerBadRequestNoIDTest)
 
   delete aor_data1; aor_data1 = NULL;
 }
+
+/// Fixture for tests of AoRs expired by a local timer wheel, with Chronos
+/// timers only as a backstop.
+class SubscriberDataManagerLocalExpiryTest : public SubscriberDataManagerChronosRequestsTest
+{
+public:
+  SubscriberDataManagerLocalExpiryTest() :
+    _wheel([this](const std::vector<std::string>& keys)
+           {
+             _popped.insert(_popped.end(), keys.begin(), keys.end());
+           },
+           10)
+  {
+    _store->enable_local_expiry(&_wheel, BACKSTOP_DELAY);
+  }
+
+  /// Adds a binding to an AoR, expiring at the given time.
+  void add_binding(SubscriberDataManager::AoRPair* aor_data,
+                   const std::string& binding_id,
+                   int expires)
+  {
+    SubscriberDataManager::AoR::Binding* b =
+                               aor_data->get_current()->get_binding(binding_id);
+    b->_uri = std::string("<sip:5102175698@192.91.191.29:59934;transport=tcp;ob>");
+    b->_cid = std::string("gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2gq");
+    b->_cseq = 17038;
+    b->_expires = expires;
+    b->_priority = 0;
+    b->_private_id = "5102175698@cw-ngv.com";
+    b->_emergency_registration = false;
+  }
+
+  static const int BACKSTOP_DELAY = 60;
+
+  std::vector<std::string> _popped;
+  TimerWheel _wheel;
+};
+
+// Test that an AoR's expiry is timed locally, with the Chronos timer set to
+// pop after the backstop delay, and that the local timer is cancelled along
+// with the Chronos timer when the last binding is removed.
+TEST_F(SubscriberDataManagerLocalExpiryTest, LocalTimerWithBackstop)
+{
+  std::string aor = "5102175698@cw-ngv.com";
+  AssociatedURIs associated_uris = {};
+  associated_uris.add_uri(aor, false);
+  int now = time(NULL);
+
+  SubscriberDataManager::AoRPair* aor_data1 = _store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  add_binding(aor_data1, "urn:uuid:00000000-0000-0000-0000-b4dd32817622:1", now + 300);
+
+  // The Chronos timer is set for the time left plus the backstop delay (the
+  // store may see a slightly later time than the test).
+  int chronos_expiry = 0;
+  EXPECT_CALL(*_chronos_connection, send_post(_, _, _, _, _, _)).
+                   WillOnce(DoAll(SetArgReferee<0>("TIMER_ID"),
+                                  SaveArg<1>(&chronos_expiry),
+                                  Return(HTTP_OK)));
+  EXPECT_TRUE(_store->set_aor_data(aor, &associated_uris, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+
+  EXPECT_LE(300 + BACKSTOP_DELAY - 1, chronos_expiry);
+  EXPECT_GE(300 + BACKSTOP_DELAY, chronos_expiry);
+  EXPECT_EQ(1u, _wheel.size());
+
+  // The local timer pops when the binding expires.
+  _wheel.pop(now + 299);
+  EXPECT_TRUE(_popped.empty());
+  _wheel.pop(now + 300);
+  EXPECT_EQ(std::vector<std::string>({aor}), _popped);
+
+  // Removing the last binding cancels both timers.
+  _wheel.set(aor, now + 600);
+  aor_data1 = _store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  aor_data1->get_current()->remove_binding("urn:uuid:00000000-0000-0000-0000-b4dd32817622:1");
+
+  EXPECT_CALL(*_chronos_connection, send_delete("TIMER_ID", _)).Times(1);
+  EXPECT_TRUE(_store->set_aor_data(aor, &associated_uris, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+
+  EXPECT_EQ(0u, _wheel.size());
+}
+
+// Test that, with local expiry, the Chronos timer is only updated when the
+// AoR's next expiry changes, and not when only the tags change.
+TEST_F(SubscriberDataManagerLocalExpiryTest, ChronosOnlyUpdatedOnExpiryChange)
+{
+  std::string aor = "5102175698@cw-ngv.com";
+  AssociatedURIs associated_uris = {};
+  associated_uris.add_uri(aor, false);
+  int now = time(NULL);
+
+  SubscriberDataManager::AoRPair* aor_data1 = _store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  add_binding(aor_data1, "urn:uuid:00000000-0000-0000-0000-b4dd32817622:1", now + 300);
+
+  EXPECT_CALL(*_chronos_connection, send_post(_, _, _, _, _, _)).
+                   WillOnce(DoAll(SetArgReferee<0>("TIMER_ID"),
+                                  Return(HTTP_OK)));
+  EXPECT_TRUE(_store->set_aor_data(aor, &associated_uris, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+
+  // Add a binding that expires later.  This changes the BIND tag but not the
+  // next expiry, so Chronos isn't updated.
+  aor_data1 = _store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  add_binding(aor_data1, "urn:uuid:00000000-0000-0000-0000-b4dd32817622:2", now + 600);
+
+  EXPECT_CALL(*_chronos_connection, send_put(_, _, _, _, _, _)).Times(0);
+  EXPECT_TRUE(_store->set_aor_data(aor, &associated_uris, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+  ::testing::Mock::VerifyAndClearExpectations(_chronos_connection);
+
+  // Remove the first binding, which moves the next expiry, so both the local
+  // and Chronos timers move.
+  aor_data1 = _store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  aor_data1->get_current()->remove_binding("urn:uuid:00000000-0000-0000-0000-b4dd32817622:1");
+
+  int chronos_expiry = 0;
+  EXPECT_CALL(*_chronos_connection, send_put(_, _, _, _, _, _)).
+                   WillOnce(DoAll(SaveArg<1>(&chronos_expiry),
+                                  Return(HTTP_OK)));
+  EXPECT_TRUE(_store->set_aor_data(aor, &associated_uris, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+
+  EXPECT_LE(600 + BACKSTOP_DELAY - 1, chronos_expiry);
+  EXPECT_GE(600 + BACKSTOP_DELAY, chronos_expiry);
+
+  _wheel.pop(now + 300);
+  EXPECT_TRUE(_popped.empty());
+  _wheel.pop(now + 600);
+  EXPECT_EQ(std::vector<std::string>({aor}), _popped);
+}
+
+/// Fixture for tests of reading an AoR from several remote stores.
+class SubscriberDataManagerRemoteReadTest : public ::testing::Test
+{
+  void SetUp()
+  {
+    _chronos_connection = new FakeChronosConnection();
+    _slow_datastore = new MockStore();
+    _slow_sdm = new SubscriberDataManager(_slow_datastore,
+                                          _chronos_connection,
+                                          NULL,
+                                          false);
+    _empty_datastore = new LocalStore();
+    _empty_sdm = new SubscriberDataManager(_empty_datastore,
+                                           _chronos_connection,
+                                           NULL,
+                                           false);
+    _datastore = new LocalStore();
+    _sdm = new SubscriberDataManager(_datastore,
+                                     _chronos_connection,
+                                     NULL,
+                                     false);
+
+    // The slow store takes a while to fail to find anything.
+    EXPECT_CALL(*_slow_datastore, get_data(_, _, _, _, _))
+      .WillRepeatedly(DoAll(InvokeWithoutArgs([]() { usleep(300000); }),
+                            Return(Store::NOT_FOUND)));
+
+    // Only the last store has any bindings.
+    SubscriberDataManager::AoRPair* aor_pair = _sdm->get_aor_data(AOR, 0);
+    ASSERT_TRUE(aor_pair != NULL);
+    SubscriberDataManager::AoR::Binding* b =
+                       aor_pair->get_current()->get_binding("<urn:uuid:1>:1");
+    b->_uri = "<sip:6505550231@192.91.191.29:59934;transport=tcp;ob>";
+    b->_cid = "gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2gq";
+    b->_cseq = 1;
+    b->_expires = time(NULL) + 300;
+    AssociatedURIs associated_uris = {};
+    associated_uris.add_uri(AOR, false);
+    EXPECT_EQ(Store::OK, _sdm->set_aor_data(AOR, &associated_uris, aor_pair, 0));
+    delete aor_pair; aor_pair = NULL;
+  }
+
+  void TearDown()
+  {
+    delete _sdm; _sdm = NULL;
+    delete _datastore; _datastore = NULL;
+    delete _empty_sdm; _empty_sdm = NULL;
+    delete _empty_datastore; _empty_datastore = NULL;
+    delete _slow_sdm; _slow_sdm = NULL;
+    delete _slow_datastore; _slow_datastore = NULL;
+    delete _chronos_connection; _chronos_connection = NULL;
+  }
+
+  // Reads the AoR from the specified stores, returning whether a binding was
+  // found and how long it took.
+  bool read_bindings(const std::vector<SubscriberDataManager*>& sdms,
+                     unsigned long& elapsed_ms)
+  {
+    Utils::StopWatch stopwatch;
+    stopwatch.start();
+
+    SubscriberDataManager::AoRPair* aor_pair =
+      SubscriberDataManager::get_aor_data_from_any(
+        sdms,
+        AOR,
+        [](SubscriberDataManager::AoRPair* aor_pair)
+        {
+          return aor_pair->current_contains_bindings();
+        },
+        0);
+
+    unsigned long elapsed_us = 0;
+    stopwatch.read(elapsed_us);
+    elapsed_ms = elapsed_us / 1000;
+
+    bool found = (aor_pair != NULL);
+    EXPECT_TRUE((aor_pair == NULL) || (aor_pair->current_contains_bindings()));
+    delete aor_pair;
+    return found;
+  }
+
+  static const std::string AOR;
+
+  FakeChronosConnection* _chronos_connection;
+  MockStore* _slow_datastore;
+  SubscriberDataManager* _slow_sdm;
+  LocalStore* _empty_datastore;
+  SubscriberDataManager* _empty_sdm;
+  LocalStore* _datastore;
+  SubscriberDataManager* _sdm;
+};
+
+const std::string SubscriberDataManagerRemoteReadTest::AOR = "sip:6505550231@homedomain";
+
+TEST_F(SubscriberDataManagerRemoteReadTest, SerialReads)
+{
+  // Without reading threads the stores are read in turn, so the slow store
+  // holds up the read.
+  unsigned long elapsed_ms;
+  EXPECT_TRUE(read_bindings({_slow_sdm, _empty_sdm, _sdm}, elapsed_ms));
+  EXPECT_GE(elapsed_ms, 300u);
+
+  EXPECT_FALSE(read_bindings({_empty_sdm}, elapsed_ms));
+}
+
+TEST_F(SubscriberDataManagerRemoteReadTest, ParallelReads)
+{
+  _slow_sdm->start_parallel_reads(1, 1000);
+  _empty_sdm->start_parallel_reads(1, 1000);
+  _sdm->start_parallel_reads(1, 1000);
+
+  // The stores are read at once, so the bindings are returned without waiting
+  // for the slow store.
+  unsigned long elapsed_ms;
+  EXPECT_TRUE(read_bindings({_slow_sdm, _empty_sdm, _sdm}, elapsed_ms));
+  EXPECT_LT(elapsed_ms, 300u);
+
+  // If no store has any bindings we wait for them all.
+  EXPECT_FALSE(read_bindings({_slow_sdm, _empty_sdm}, elapsed_ms));
+  EXPECT_GE(elapsed_ms, 300u);
+}
+
+TEST_F(SubscriberDataManagerRemoteReadTest, ParallelReadDeadline)
+{
+  _slow_sdm->start_parallel_reads(1, 100);
+
+  // We give up on the slow store once the deadline passes.
+  unsigned long elapsed_ms;
+  EXPECT_FALSE(read_bindings({_slow_sdm}, elapsed_ms));
+  EXPECT_LT(elapsed_ms, 300u);
+
+  // Stores without reading threads are still read (on this thread) alongside
+  // the parallel ones.
+  EXPECT_TRUE(read_bindings({_slow_sdm, _sdm}, elapsed_ms));
+  EXPECT_LT(elapsed_ms, 300u);
+}
+
+TEST_F(SubscriberDataManagerRemoteReadTest, ParallelReadBacklog)
+{
+  // Only the first read of the slow store is ever made - the second is still
+  // queued when its caller gives up, so is dropped, and the third isn't
+  // queued at all as the queue is full.
+  EXPECT_CALL(*_slow_datastore, get_data(_, _, _, _, _))
+    .Times(1)
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { usleep(300000); }),
+                    Return(Store::NOT_FOUND)));
+  _slow_sdm->start_parallel_reads(1, 100, NULL, 1);
+
+  unsigned long elapsed_ms;
+  EXPECT_FALSE(read_bindings({_slow_sdm}, elapsed_ms));
+  EXPECT_FALSE(read_bindings({_slow_sdm}, elapsed_ms));
+
+  // With the queue full we don't wait for the slow store at all.
+  EXPECT_TRUE(read_bindings({_slow_sdm, _sdm}, elapsed_ms));
+  EXPECT_LT(elapsed_ms, 50u);
+}
+
+TEST_F(SubscriberDataManagerRemoteReadTest, CasRetriesCounted)
+{
+  SNMP::FakeCounterTable cas_retries_tbl;
+  SubscriberDataManager* sdm = new SubscriberDataManager(_datastore,
+                                                         _chronos_connection,
+                                                         NULL,
+                                                         false,
+                                                         SubscriberDataManager::JSON,
+                                                         NULL,
+                                                         &cas_retries_tbl);
+  AssociatedURIs associated_uris = {};
+  associated_uris.add_uri(AOR, false);
+
+  // Read the AoR twice, then write both copies back.  The second write has an
+  // out of date CAS so is rejected and counted.
+  SubscriberDataManager::AoRPair* aor_pair1 = sdm->get_aor_data(AOR, 0);
+  SubscriberDataManager::AoRPair* aor_pair2 = sdm->get_aor_data(AOR, 0);
+  ASSERT_TRUE(aor_pair1 != NULL);
+  ASSERT_TRUE(aor_pair2 != NULL);
+
+  EXPECT_EQ(Store::OK, sdm->set_aor_data(AOR, &associated_uris, aor_pair1, 0));
+  EXPECT_EQ(0, cas_retries_tbl._count);
+  EXPECT_EQ(Store::DATA_CONTENTION,
+            sdm->set_aor_data(AOR, &associated_uris, aor_pair2, 0));
+  EXPECT_EQ(1, cas_retries_tbl._count);
+
+  delete aor_pair2; aor_pair2 = NULL;
+  delete aor_pair1; aor_pair1 = NULL;
+  delete sdm; sdm = NULL;
+}
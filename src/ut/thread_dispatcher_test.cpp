@@ -0,0 +1,387 @@
+/**
+ * @file thread_dispatcher_test.cpp UT for the worker thread dispatcher.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "siptest.hpp"
+#include "stack.h"
+#include "thread_dispatcher.h"
+#include "load_monitor.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+// The number of messages the worker threads have passed on to mod_test.
+static std::atomic<int> processed(0);
+
+// Whether mod_test holds up the worker threads processing messages with
+// Call-IDs starting "block".
+static std::atomic<bool> blocking(false);
+
+static pj_bool_t test_on_rx_msg(pjsip_rx_data* rdata)
+{
+  std::string call_id = PJUtils::pj_str_to_string(&rdata->msg_info.cid->id);
+
+  if (call_id.find("block") == 0)
+  {
+    for (int ii = 0; (blocking) && (ii < 5000); ++ii)
+    {
+      usleep(1000);
+    }
+  }
+
+  processed++;
+  return PJ_TRUE;
+}
+
+// Module that runs after the dispatcher on the worker threads, absorbing the
+// messages they process.
+static pjsip_module mod_test =
+{
+  NULL, NULL,                           /* prev, next.          */
+  pj_str("mod-test"),                   /* Name.                */
+  -1,                                   /* Id                   */
+  PJSIP_MOD_PRIORITY_APPLICATION,       /* Priority             */
+  NULL,                                 /* load()               */
+  NULL,                                 /* start()              */
+  NULL,                                 /* stop()               */
+  NULL,                                 /* unload()             */
+  &test_on_rx_msg,                      /* on_rx_request()      */
+  &test_on_rx_msg,                      /* on_rx_response()     */
+  NULL,                                 /* on_tx_request()      */
+  NULL,                                 /* on_tx_response()     */
+  NULL,                                 /* on_tsx_state()       */
+};
+
+/// Fixture for ThreadDispatcherTest.
+class ThreadDispatcherTest : public SipTest
+{
+public:
+  static const int MAX_WORKERS = 4;
+
+  static void SetUpTestCase()
+  {
+    SipTest::SetUpTestCase();
+    pjsip_endpt_register_module(stack_data.endpt, &mod_test);
+  }
+
+  static void TearDownTestCase()
+  {
+    pjsip_endpt_unregister_module(stack_data.endpt, &mod_test);
+    SipTest::TearDownTestCase();
+  }
+
+  ThreadDispatcherTest() :
+    _initialized(false),
+    _started(false)
+  {
+    _tp1 = new TransportFlow(TransportFlow::Protocol::TCP,
+                             stack_data.scscf_port,
+                             "1.2.3.4",
+                             49152);
+    _tp2 = new TransportFlow(TransportFlow::Protocol::TCP,
+                             stack_data.scscf_port,
+                             "5.6.7.8",
+                             49153);
+    _tp3 = new TransportFlow(TransportFlow::Protocol::TCP,
+                             stack_data.scscf_port,
+                             "9.10.11.12",
+                             49154);
+    _lm = new LoadMonitor(100000, 20, 10.0, 10.0);
+    processed = 0;
+    blocking = false;
+  }
+
+  virtual ~ThreadDispatcherTest()
+  {
+    blocking = false;
+
+    if (_initialized)
+    {
+      if (!_started)
+      {
+        start_worker_threads();
+      }
+
+      stop_worker_threads();
+      unregister_thread_dispatcher();
+    }
+
+    delete _lm; _lm = NULL;
+    delete _tp3; _tp3 = NULL;
+    delete _tp2; _tp2 = NULL;
+    delete _tp1; _tp1 = NULL;
+  }
+
+  /// Sets up the dispatcher.  The worker threads aren't started, so messages
+  /// stay on the queues until process_queued is called.
+  void init(int num_workers, bool sharded, int max_queue_depth)
+  {
+    vector<int> priorities(NUM_WORKER_EVENT_CLASSES);
+    priorities[RESPONSE_EVENT] = 0;
+    priorities[IN_DIALOG_EVENT] = 0;
+    priorities[CALLBACK_EVENT] = 1;
+    priorities[NEW_REQUEST_EVENT] = 2;
+
+    vector<SNMP::EventAccumulatorByScopeTable*> shard_latency_tbls;
+    vector<SNMP::EventAccumulatorByScopeTable*> shard_queue_size_tbls;
+    for (int ii = 0; ii < num_workers; ++ii)
+    {
+      shard_latency_tbls.push_back(&_shard_latency_tbls[ii]);
+      shard_queue_size_tbls.push_back(&_shard_queue_size_tbls[ii]);
+    }
+
+    init_thread_dispatcher(num_workers,
+                           sharded,
+                           max_queue_depth,
+                           priorities,
+                           &_latency_tbl,
+                           vector<SNMP::EventAccumulatorByScopeTable*>(),
+                           &_queue_size_tbl,
+                           shard_latency_tbls,
+                           shard_queue_size_tbls,
+                           &_overload_counter,
+                           _lm,
+                           NULL);
+    _initialized = true;
+  }
+
+  /// Starts the worker threads, and waits for them to process the expected
+  /// number of messages.
+  void process_queued(int expected)
+  {
+    start_worker_threads();
+    _started = true;
+
+    wait_for_processed(expected);
+  }
+
+  /// Waits for the worker threads to have processed the expected number of
+  /// messages.
+  void wait_for_processed(int expected)
+  {
+    for (int ii = 0; (processed < expected) && (ii < 2000); ++ii)
+    {
+      usleep(1000);
+    }
+    EXPECT_EQ(expected, processed);
+  }
+
+  /// Injects a message, and checks whether it was rejected as overloaded.
+  void inject(const string& msg, TransportFlow* tp, bool rejected = false)
+  {
+    inject_msg(msg, tp);
+
+    if (rejected)
+    {
+      ASSERT_EQ(1, txdata_count());
+      RespMatcher(503).matches(current_txdata()->msg);
+      tp->expect_target(current_txdata());
+      free_txdata();
+    }
+    else
+    {
+      EXPECT_EQ(0, txdata_count());
+    }
+  }
+
+  /// Returns the queue a Call-ID is sharded to.
+  static size_t shard(const string& call_id, size_t num_shards)
+  {
+    return pj_hash_calc(0, call_id.c_str(), call_id.length()) % num_shards;
+  }
+
+  /// Builds a request.  Requests within a dialog have a To tag.
+  static string request(TransportFlow* tp,
+                        const string& method,
+                        const string& call_id,
+                        bool in_dialog = false)
+  {
+    static int branch = 1000;
+
+    return method + " sip:6505551234@homedomain SIP/2.0\r\n"
+           "Via: SIP/2.0/TCP " + tp->to_string(false) +
+             ";rport;branch=z9hG4bKPjthreaddispatcher" + to_string(branch++) + "\r\n"
+           "From: <sip:6505551000@homedomain>;tag=10.114.61.213+1+8c8b232a\r\n"
+           "To: <sip:6505551234@homedomain>" + (in_dialog ? ";tag=1234" : "") + "\r\n"
+           "Max-Forwards: 68\r\n"
+           "Call-ID: " + call_id + "\r\n"
+           "CSeq: 1 " + method + "\r\n"
+           "Content-Length: 0\r\n"
+           "\r\n";
+  }
+
+  /// Builds a response to an INVITE.
+  static string response(const string& call_id)
+  {
+    return "SIP/2.0 180 Ringing\r\n"
+           "Via: SIP/2.0/TCP 127.0.0.1:5058;rport;branch=z9hG4bKPjthreaddispatcherrsp\r\n"
+           "From: <sip:6505551000@homedomain>;tag=10.114.61.213+1+8c8b232a\r\n"
+           "To: <sip:6505551234@homedomain>;tag=1234\r\n"
+           "Call-ID: " + call_id + "\r\n"
+           "CSeq: 1 INVITE\r\n"
+           "Content-Length: 0\r\n"
+           "\r\n";
+  }
+
+  TransportFlow* _tp1;
+  TransportFlow* _tp2;
+  TransportFlow* _tp3;
+  LoadMonitor* _lm;
+  SNMP::FakeEventAccumulatorByScopeTable _latency_tbl;
+  SNMP::FakeEventAccumulatorByScopeTable _queue_size_tbl;
+  SNMP::FakeEventAccumulatorByScopeTable _shard_latency_tbls[MAX_WORKERS];
+  SNMP::FakeEventAccumulatorByScopeTable _shard_queue_size_tbls[MAX_WORKERS];
+  SNMP::FakeCounterByScopeTable _overload_counter;
+  bool _initialized;
+  bool _started;
+};
+
+TEST_F(ThreadDispatcherTest, OverloadRejectsNewWork)
+{
+  init(1, false, 4);
+
+  // Fill the queue with in-dialog requests.
+  for (int ii = 0; ii < 4; ++ii)
+  {
+    inject(request(_tp1, "BYE", "call" + to_string(ii), true), _tp1);
+  }
+
+  // New INVITEs and REGISTERs are now rejected, from any connection.
+  inject(request(_tp2, "INVITE", "new-invite"), _tp2, true);
+  inject(request(_tp2, "REGISTER", "new-register"), _tp2, true);
+  EXPECT_EQ(2, _overload_counter._count);
+
+  // Work on existing dialogs is still queued, even from a connection holding
+  // more than its share of the queued messages.
+  inject(request(_tp1, "BYE", "call4", true), _tp1);
+  inject(request(_tp1, "INVITE", "call5", true), _tp1);
+  inject(request(_tp1, "PRACK", "call6", true), _tp1);
+  inject(request(_tp1, "CANCEL", "call7"), _tp1);
+  inject(response("call8"), _tp1);
+  EXPECT_EQ(2, _overload_counter._count);
+
+  process_queued(9);
+}
+
+TEST_F(ThreadDispatcherTest, OverloadPushesBackOnConnectionOverShare)
+{
+  init(1, false, 4);
+
+  // Fill the queue with three in-dialog requests from the first connection
+  // and one from the second, so each connection's share is two.
+  for (int ii = 0; ii < 3; ++ii)
+  {
+    inject(request(_tp1, "BYE", "call" + to_string(ii), true), _tp1);
+  }
+  inject(request(_tp2, "BYE", "call3", true), _tp2);
+
+  // The first connection is over its share, so new work from it is rejected,
+  // but its in-dialog requests are still queued.
+  inject(request(_tp1, "SUBSCRIBE", "new-subscribe1"), _tp1, true);
+  inject(request(_tp1, "BYE", "call4", true), _tp1);
+
+  // The second connection is within its share, so its new work is queued.
+  inject(request(_tp2, "SUBSCRIBE", "new-subscribe2"), _tp2);
+  EXPECT_EQ(1, _overload_counter._count);
+
+  process_queued(6);
+}
+
+TEST_F(ThreadDispatcherTest, OverloadShareAtLeastOneMessage)
+{
+  init(1, false, 2);
+
+  // Queue a request from each of three connections, so there are more
+  // connections than the high-water mark.
+  inject(request(_tp1, "BYE", "call1", true), _tp1);
+  inject(request(_tp2, "BYE", "call2", true), _tp2);
+  inject(request(_tp3, "BYE", "call3", true), _tp3);
+
+  // Each connection's share is still one message, so a connection holding
+  // only one can queue new work, but one holding two can't.
+  inject(request(_tp1, "MESSAGE", "new-message1"), _tp1);
+  inject(request(_tp1, "MESSAGE", "new-message2"), _tp1, true);
+  EXPECT_EQ(1, _overload_counter._count);
+
+  process_queued(4);
+}
+
+TEST_F(ThreadDispatcherTest, ShardsByCallId)
+{
+  init(MAX_WORKERS, true, 0);
+
+  // Queue requests on a number of Call-IDs, and check that each lands on the
+  // queue its Call-ID hashes to.
+  int expected[MAX_WORKERS] = {0};
+  for (int ii = 0; ii < 16; ++ii)
+  {
+    string call_id = "call" + to_string(ii);
+    expected[shard(call_id, MAX_WORKERS)]++;
+    inject(request(_tp1, "INVITE", call_id), _tp1);
+  }
+
+  int shards_used = 0;
+  for (int ii = 0; ii < MAX_WORKERS; ++ii)
+  {
+    EXPECT_EQ(expected[ii], _shard_queue_size_tbls[ii]._count);
+    shards_used += (expected[ii] > 0) ? 1 : 0;
+  }
+  EXPECT_LT(1, shards_used);
+
+  // Messages on the same Call-ID always land on the same queue.
+  string call_id = "call0";
+  inject(request(_tp1, "BYE", call_id, true), _tp1);
+  inject(request(_tp2, "ACK", call_id, true), _tp2);
+  EXPECT_EQ(expected[shard(call_id, MAX_WORKERS)] + 2,
+            _shard_queue_size_tbls[shard(call_id, MAX_WORKERS)]._count);
+
+  process_queued(18);
+}
+
+TEST_F(ThreadDispatcherTest, IdleWorkerStealsWork)
+{
+  init(2, true, 0);
+
+  // Find a second Call-ID on the same queue as the one that blocks.
+  string block_call_id = "block-call";
+  size_t queue = shard(block_call_id, 2);
+  string call_id;
+  for (int ii = 0; call_id.empty(); ++ii)
+  {
+    string candidate = "call" + to_string(ii);
+    if (shard(candidate, 2) == queue)
+    {
+      call_id = candidate;
+    }
+  }
+
+  // Queue both requests, then start the workers with the first request held
+  // up.  The second request can only be processed while the first is blocked
+  // if the other worker steals it from the first worker's queue.
+  blocking = true;
+  inject(request(_tp1, "INVITE", block_call_id), _tp1);
+  inject(request(_tp1, "INVITE", call_id), _tp1);
+  EXPECT_EQ(2, _shard_queue_size_tbls[queue]._count);
+  EXPECT_EQ(0, _shard_queue_size_tbls[1 - queue]._count);
+
+  process_queued(1);
+
+  blocking = false;
+  wait_for_processed(2);
+}
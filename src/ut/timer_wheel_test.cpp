@@ -0,0 +1,180 @@
+/**
+ * @file timer_wheel_test.cpp UT for the timer wheel.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include "gtest/gtest.h"
+
+#include "timer_wheel.h"
+#include "fakesnmp.hpp"
+
+using namespace std;
+
+/// Fixture for TimerWheelTest.
+class TimerWheelTest : public ::testing::Test
+{
+public:
+  TimerWheelTest() :
+    _wheel([this](const vector<string>& keys) { _batches.push_back(keys); },
+           3,
+           &_pops_tbl),
+    _now(time(NULL))
+  {
+  }
+
+  virtual ~TimerWheelTest()
+  {
+  }
+
+  /// Returns all the keys popped so far, and forgets them.
+  vector<string> popped()
+  {
+    vector<string> keys;
+    for (size_t ii = 0; ii < _batches.size(); ++ii)
+    {
+      keys.insert(keys.end(), _batches[ii].begin(), _batches[ii].end());
+    }
+    _batches.clear();
+    return keys;
+  }
+
+  SNMP::FakeCounterTable _pops_tbl;
+  vector<vector<string>> _batches;
+  TimerWheel _wheel;
+  int _now;
+};
+
+TEST_F(TimerWheelTest, PopsWhenDue)
+{
+  _wheel.set("sip:6505550001@homedomain", _now + 5);
+  EXPECT_EQ(1u, _wheel.size());
+
+  _wheel.pop(_now + 4);
+  EXPECT_TRUE(popped().empty());
+
+  _wheel.pop(_now + 5);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+  EXPECT_EQ(0u, _wheel.size());
+  EXPECT_EQ(1, _pops_tbl._count);
+
+  // Timers don't repeat.
+  _wheel.pop(_now + 10);
+  EXPECT_TRUE(popped().empty());
+}
+
+TEST_F(TimerWheelTest, AlreadyDue)
+{
+  _wheel.set("sip:6505550001@homedomain", _now - 10);
+  _wheel.pop(_now);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+}
+
+TEST_F(TimerWheelTest, MoveTimer)
+{
+  _wheel.set("sip:6505550001@homedomain", _now + 5);
+  _wheel.set("sip:6505550001@homedomain", _now + 10);
+  EXPECT_EQ(1u, _wheel.size());
+
+  _wheel.pop(_now + 9);
+  EXPECT_TRUE(popped().empty());
+
+  _wheel.pop(_now + 10);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+
+  // Timers can be moved earlier too.
+  _wheel.set("sip:6505550001@homedomain", _now + 600);
+  _wheel.set("sip:6505550001@homedomain", _now + 20);
+  _wheel.pop(_now + 20);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+}
+
+TEST_F(TimerWheelTest, CancelTimer)
+{
+  _wheel.set("sip:6505550001@homedomain", _now + 5);
+  _wheel.set("sip:6505550002@homedomain", _now + 5);
+  _wheel.cancel("sip:6505550001@homedomain");
+  _wheel.cancel("sip:6505550003@homedomain");
+  EXPECT_EQ(1u, _wheel.size());
+
+  _wheel.pop(_now + 5);
+  EXPECT_EQ(vector<string>({"sip:6505550002@homedomain"}), popped());
+}
+
+TEST_F(TimerWheelTest, PopsInBatches)
+{
+  for (int ii = 0; ii < 7; ++ii)
+  {
+    _wheel.set("sip:650555000" + to_string(ii) + "@homedomain", _now + 1 + (ii % 2));
+  }
+
+  _wheel.pop(_now + 2);
+  ASSERT_EQ(3u, _batches.size());
+  EXPECT_EQ(3u, _batches[0].size());
+  EXPECT_EQ(3u, _batches[1].size());
+  EXPECT_EQ(1u, _batches[2].size());
+  EXPECT_EQ(7u, popped().size());
+  EXPECT_EQ(7, _pops_tbl._count);
+}
+
+TEST_F(TimerWheelTest, OuterLevels)
+{
+  // These timers start in each of the outer levels of the wheel, and must be
+  // moved inwards at the right times to pop when they are due.
+  vector<int> expiries = {_now + 300, _now + 70000, _now + 2000000};
+
+  for (size_t ii = 0; ii < expiries.size(); ++ii)
+  {
+    _wheel.set("sip:650555000" + to_string(ii) + "@homedomain", expiries[ii]);
+  }
+
+  for (size_t ii = 0; ii < expiries.size(); ++ii)
+  {
+    _wheel.pop(expiries[ii] - 1);
+    EXPECT_TRUE(popped().empty());
+
+    _wheel.pop(expiries[ii]);
+    EXPECT_EQ(vector<string>({"sip:650555000" + to_string(ii) + "@homedomain"}),
+              popped());
+  }
+}
+
+TEST_F(TimerWheelTest, BeyondWheel)
+{
+  // This timer is further ahead than the wheel reaches, so is held in its
+  // last slot until it comes within range.
+  int expiry = _now + (1 << 27);
+  _wheel.set("sip:6505550001@homedomain", expiry);
+
+  _wheel.pop(expiry - 1);
+  EXPECT_TRUE(popped().empty());
+  EXPECT_EQ(1u, _wheel.size());
+
+  _wheel.pop(expiry);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+}
+
+TEST_F(TimerWheelTest, SkipsAheadWhenEmpty)
+{
+  // Popping an empty wheel moves it straight to the present, so timers set
+  // afterwards are placed relative to that.
+  _wheel.pop(_now + 1000000);
+  _wheel.set("sip:6505550001@homedomain", _now + 1000005);
+
+  _wheel.pop(_now + 1000004);
+  EXPECT_TRUE(popped().empty());
+
+  _wheel.pop(_now + 1000005);
+  EXPECT_EQ(vector<string>({"sip:6505550001@homedomain"}), popped());
+}
@@ -0,0 +1,225 @@
+/**
+ * @file websockets_test.cpp UT for the WebSocket transport.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+///
+///----------------------------------------------------------------------------
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "siptest.hpp"
+#include "websockets.h"
+
+using namespace std;
+using websocketpp::client;
+
+/// Number of messages received over websockets by the SIP stack, and the
+/// threads they were received on.
+static atomic<int> rx_msg_count(0);
+static mutex rx_threads_lock;
+static set<thread::id> rx_threads;
+
+/// Counts (and swallows) every response the SIP stack receives.  The test
+/// sends responses because, having no matching transaction, they need no
+/// further processing.
+static pj_bool_t count_rx_response(pjsip_rx_data* rdata)
+{
+  rx_msg_count++;
+
+  lock_guard<mutex> guard(rx_threads_lock);
+  rx_threads.insert(this_thread::get_id());
+
+  return PJ_TRUE;
+}
+
+static pjsip_module mod_ws_counter =
+{
+  NULL, NULL,                         /* prev, next.          */
+  pj_str("mod-ws-counter"),           /* Name.                */
+  -1,                                 /* Id                   */
+  PJSIP_MOD_PRIORITY_TSX_LAYER - 1,   /* Priority             */
+  NULL,                               /* load()               */
+  NULL,                               /* start()              */
+  NULL,                               /* stop()               */
+  NULL,                               /* unload()             */
+  NULL,                               /* on_rx_request()      */
+  &count_rx_response,                 /* on_rx_response()     */
+  NULL,                               /* on_tx_request()      */
+  NULL,                               /* on_tx_response()     */
+  NULL,                               /* on_tsx_state()       */
+};
+
+static const string LOAD_MSG =
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/WS 127.0.0.1;branch=z9hG4bKwsload\r\n"
+  "From: <sip:6505550001@homedomain>;tag=10.114.61.213+1+8c8b232a+5fb751cf\r\n"
+  "To: <sip:6505550001@homedomain>;tag=1234\r\n"
+  "Call-ID: 0gQAAC8WAAACBAAALxYAAAL8P3UbW8l4mT8YBkKGRKc5SOHaJ1gMRqs@10.114.61.213\r\n"
+  "CSeq: 1 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+/// Client that sends a fixed number of messages on each connection it opens,
+/// then closes it.
+class LoadClientHandler : public client::handler
+{
+public:
+  LoadClientHandler(int msgs_per_connection) :
+    _msgs_per_connection(msgs_per_connection),
+    _opened(0),
+    _failed(0)
+  {
+  }
+
+  void on_open(connection_ptr con)
+  {
+    _opened++;
+
+    for (int ii = 0; ii < _msgs_per_connection; ++ii)
+    {
+      con->send(LOAD_MSG, websocketpp::frame::opcode::TEXT);
+    }
+
+    con->close(websocketpp::close::status::NORMAL, "");
+  }
+
+  void on_fail(connection_ptr con)
+  {
+    _failed++;
+  }
+
+  int _msgs_per_connection;
+  atomic<int> _opened;
+  atomic<int> _failed;
+};
+
+/// Fixture for WebSocketsTest.
+class WebSocketsTest : public SipTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    SipTest::SetUpTestCase();
+    pjsip_endpt_register_module(stack_data.endpt, &mod_ws_counter);
+  }
+
+  static void TearDownTestCase()
+  {
+    pjsip_endpt_unregister_module(stack_data.endpt, &mod_ws_counter);
+    SipTest::TearDownTestCase();
+  }
+
+  WebSocketsTest() : SipTest(NULL)
+  {
+    rx_msg_count = 0;
+    rx_threads.clear();
+  }
+
+  /// Opens the specified number of connections from each of a number of
+  /// client threads, and waits for all the messages sent on them to reach
+  /// the SIP stack.
+  void run_clients(int port,
+                   int num_clients,
+                   int connections_per_client,
+                   int msgs_per_connection)
+  {
+    string uri = "ws://127.0.0.1:" + to_string(port);
+    int expected = num_clients * connections_per_client * msgs_per_connection;
+    vector<thread> clients;
+    atomic<int> opened(0);
+    atomic<int> failed(0);
+
+    for (int cc = 0; cc < num_clients; ++cc)
+    {
+      clients.push_back(thread([&]()
+      {
+        LoadClientHandler* handler = new LoadClientHandler(msgs_per_connection);
+        client::handler::ptr h(handler);
+        client endpoint(h);
+        endpoint.alog().unset_level(websocketpp::log::alevel::ALL);
+        endpoint.elog().unset_level(websocketpp::log::elevel::ALL);
+
+        for (int ii = 0; ii < connections_per_client; ++ii)
+        {
+          client::connection_ptr con = endpoint.get_connection(uri);
+          con->add_subprotocol("sip");
+          endpoint.connect(con);
+        }
+
+        // Returns once all the connections have closed.
+        endpoint.run();
+
+        opened += handler->_opened;
+        failed += handler->_failed;
+      }));
+    }
+
+    for (size_t ii = 0; ii < clients.size(); ++ii)
+    {
+      clients[ii].join();
+    }
+
+    // Wait (for up to 10s) for the server to finish passing the messages to
+    // the SIP stack.
+    for (int ii = 0; (ii < 1000) && (rx_msg_count < expected); ++ii)
+    {
+      usleep(10000);
+    }
+
+    EXPECT_EQ(num_clients * connections_per_client, opened);
+    EXPECT_EQ(0, failed);
+    EXPECT_EQ(expected, rx_msg_count);
+  }
+};
+
+// Messages on many connections are all received, and are spread across the
+// websocket threads.
+TEST_F(WebSocketsTest, LoadSpreadAcrossThreads)
+{
+  const int NUM_CLIENTS = 8;
+  const int CONNECTIONS_PER_CLIENT = 50;
+  const int MSGS_PER_CONNECTION = 50;
+  const size_t THREAD_COUNTS[] = {1, 4};
+
+  for (size_t tt = 0; tt < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); ++tt)
+  {
+    int port = 15062 + tt;
+    rx_msg_count = 0;
+    rx_threads.clear();
+
+    ASSERT_EQ(PJ_SUCCESS, init_websockets(port, THREAD_COUNTS[tt]));
+
+    // Give the server a moment to start listening.
+    usleep(100000);
+
+    run_clients(port, NUM_CLIENTS, CONNECTIONS_PER_CLIENT, MSGS_PER_CONNECTION);
+    destroy_websockets();
+
+    // With one thread everything is received on it.  With more, the
+    // connections are shared between them, so more than one receives
+    // messages.
+    if (THREAD_COUNTS[tt] == 1)
+    {
+      EXPECT_EQ(1u, rx_threads.size());
+    }
+    else
+    {
+      EXPECT_LT(1u, rx_threads.size());
+      EXPECT_GE(THREAD_COUNTS[tt], rx_threads.size());
+    }
+  }
+}
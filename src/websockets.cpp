@@ -20,6 +20,8 @@ extern "C" {
 
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <pthread.h>
 
 #include "stack.h"
 #include "log.h"
@@ -29,11 +31,15 @@ extern "C" {
 using websocketpp::server;
 
 static unsigned short ws_port;
+static int ws_threads;
+static pj_thread_t* ws_thread = NULL;
+static server* ws_endpoint = NULL;
 
 //
 // mod_ws_transport is the module implementing websockets
 //
 static pj_bool_t ws_transport_on_start();
+static pj_bool_t ws_transport_on_stop();
 
 pjsip_module mod_ws_transport =
 {
@@ -43,7 +49,7 @@ pjsip_module mod_ws_transport =
   PJSIP_MOD_PRIORITY_TRANSPORT_LAYER, // Priority
   NULL,                               // load()
   &ws_transport_on_start,             // start()
-  NULL,                               // stop()
+  &ws_transport_on_stop,              // stop()
   NULL,                               // unload()
   NULL,                               // on_rx_request()
   NULL,                               // on_rx_response()
@@ -72,7 +78,7 @@ static pj_status_t ws_send_msg(pjsip_transport *transport,
                                void *token,
                                pjsip_transport_callback callback)
 {
-  std::string body(tdata->buf.start);
+  std::string body(tdata->buf.start, tdata->buf.cur - tdata->buf.start);
   TRC_DEBUG("Sending message over WS");
 
   struct ws_transport *ws = (struct ws_transport*)transport;
@@ -271,14 +277,20 @@ static pj_bool_t on_ws_data(ws_transport *ws,
   pj_pool_t *pool;
   pj_sockaddr *rem_addr;
 
-  /* Init rdata */
-  pool = pjsip_endpt_create_pool(ws->base.endpt,
-      "rtd%p",
-      PJSIP_POOL_RDATA_LEN,
-      PJSIP_POOL_RDATA_INC);
+  /* Messages on a connection are received one at a time, so the rdata (and
+   * its pool, which is reset after each message) can be reused for every
+   * message on the transport.
+   */
+  pool = ws->rdata.tp_info.pool;
   if (!pool) {
-    TRC_ERROR("Unable to create pool");
-    return PJ_ENOMEM;
+    pool = pjsip_endpt_create_pool(ws->base.endpt,
+        "rtd%p",
+        PJSIP_POOL_RDATA_LEN,
+        PJSIP_POOL_RDATA_INC);
+    if (!pool) {
+      TRC_ERROR("Unable to create pool");
+      return PJ_ENOMEM;
+    }
   }
 
   ws->rdata.tp_info.pool = pool;
@@ -294,12 +306,16 @@ static pj_bool_t on_ws_data(ws_transport *ws,
       sizeof(ws->rdata.pkt_info.src_name), 0);
   ws->rdata.pkt_info.src_port = pj_sockaddr_get_port(rem_addr);
 
-  const char *msg_str = msg->get_payload().c_str();
-  if (strlen(msg_str) <= PJSIP_MAX_PKT_LEN) {
-    ws->rdata.pkt_info.packet = (char*)pj_pool_alloc(ws->rdata.tp_info.pool, strlen(msg_str) + 1);
-    strcpy(ws->rdata.pkt_info.packet, msg_str);
+  /* Copy the message into the rdata's pool, null-terminated as the parser
+   * requires.  The pool is reset after each message, so this doesn't grow.
+   */
+  const std::string& payload = msg->get_payload();
+  if (payload.length() <= PJSIP_MAX_PKT_LEN) {
+    ws->rdata.pkt_info.packet = (char*)pj_pool_alloc(pool, payload.length() + 1);
+    pj_memcpy(ws->rdata.pkt_info.packet, payload.data(), payload.length());
+    ws->rdata.pkt_info.packet[payload.length()] = '\0';
   } else {
-    TRC_ERROR("Dropping incoming websocket message as it is larger than PJSIP_MAX_PKT_LEN, %d", strlen(msg_str));
+    TRC_ERROR("Dropping incoming websocket message as it is larger than PJSIP_MAX_PKT_LEN, %zu", payload.length());
     return PJ_FALSE;
   }
 
@@ -307,7 +323,7 @@ static pj_bool_t on_ws_data(ws_transport *ws,
   rdata = &ws->rdata;
 
   /* Init pkt_info part. */
-  rdata->pkt_info.len = strlen(msg_str);
+  rdata->pkt_info.len = payload.length();
   rdata->pkt_info.zero = 0;
   pj_gettimeofday(&rdata->pkt_info.timestamp);
 
@@ -327,7 +343,8 @@ static pj_bool_t on_ws_data(ws_transport *ws,
    */
   pj_assert(size_eaten == (pj_size_t)rdata->pkt_info.len);
 
-  /* Reset pool. */
+  /* Reset pool, which frees the copy of the packet. */
+  rdata->pkt_info.packet = NULL;
   pj_pool_reset(rdata->tp_info.pool);
 
   return PJ_TRUE;
@@ -370,9 +387,46 @@ static pj_status_t ws_destroy_transport(pjsip_transport *transport)
   return PJ_SUCCESS;
 }
 
-/* Setup callbacks for WebSockets events */
+/*
+ * Registers the calling websocket I/O thread with PJSIP, if it isn't already.
+ * These threads are created by websocketpp, so this is done the first time
+ * each one calls into PJSIP.
+ */
+static void register_ws_thread()
+{
+  // The thread descriptor must stay in scope for the lifetime of the thread,
+  // and is freed along with it.
+  static thread_local pj_thread_desc td;
+
+  if (!pj_thread_is_registered())
+  {
+    pj_bzero(td, sizeof(pj_thread_desc));
+    pj_thread_t* thread = 0;
+
+    pj_status_t status = pj_thread_register("websockets", td, &thread);
+
+    if (status != PJ_SUCCESS)
+    {
+      TRC_ERROR("Failed to register websockets thread with PJSIP"); // LCOV_EXCL_LINE
+    }
+  }
+}
+
+/* Setup callbacks for WebSockets events.  These may be called on any of the
+ * websocket I/O threads, but the callbacks for a single connection are never
+ * run in parallel.
+ */
 class sip_server_handler : public server::handler {
   public:
+    sip_server_handler()
+    {
+      pthread_mutex_init(&connectionMapLock, NULL);
+    }
+
+    ~sip_server_handler()
+    {
+      pthread_mutex_destroy(&connectionMapLock);
+    }
 
     void validate(connection_ptr con)
     {
@@ -403,6 +457,8 @@ class sip_server_handler : public server::handler {
     }
 
     void on_open(connection_ptr con) {
+      register_ws_thread();
+
       TRC_DEBUG("New web socket connection, creating PJSIP transport");
       pjsip_transport *transport;
       pj_status_t status = ws_transport_create(stack_data.endpt,
@@ -416,16 +472,23 @@ class sip_server_handler : public server::handler {
         TRC_DEBUG("Failed to create WS transport");
       }
 
+      pthread_mutex_lock(&connectionMapLock);
       connectionMap.insert(
           std::pair<connection_ptr, struct ws_transport*>(con, (struct ws_transport*)transport));
+      pthread_mutex_unlock(&connectionMapLock);
     }
 
     void on_message(connection_ptr con, message_ptr msg) {
       ws_transport *transport;
 
+      register_ws_thread();
+
       TRC_DEBUG("Received message from websockets");
 
+      pthread_mutex_lock(&connectionMapLock);
       transport = connectionMap.find(con)->second;
+      pthread_mutex_unlock(&connectionMapLock);
+
       TRC_DEBUG("Sending message to PJSIP...");
       pj_status_t status = on_ws_data(transport, msg);
       if (status == PJ_TRUE){
@@ -440,8 +503,14 @@ class sip_server_handler : public server::handler {
       ws_transport *transport;
       pjsip_tp_state_callback state_cb;
 
+      register_ws_thread();
+
       TRC_DEBUG("Closing websocket...");
-      transport = connectionMap.find(con)->second;
+      pthread_mutex_lock(&connectionMapLock);
+      std::map<connection_ptr, struct ws_transport*>::iterator it = connectionMap.find(con);
+      transport = it->second;
+      connectionMap.erase(it);
+      pthread_mutex_unlock(&connectionMapLock);
 
       /* Notify application of transport disconnected state */
       state_cb = pjsip_tpmgr_get_state_cb(transport->base.tpmgr);
@@ -463,6 +532,7 @@ class sip_server_handler : public server::handler {
 
   private:
     static std::string SUBPROTOCOL;
+    pthread_mutex_t connectionMapLock;
     std::map<connection_ptr, struct ws_transport*> connectionMap;
 };
 
@@ -472,22 +542,14 @@ static int websocket_thread(void* p)
 {
   TRC_DEBUG("Started Websockets thread");
 
-  PJSIP_TRANSPORT_WS = ws_transport_register_type(ws_port);
-  TRC_DEBUG("Registered websockets transport with PJSIP, type %d", PJSIP_TRANSPORT_WS);
   try {
-    server::handler::ptr h(new sip_server_handler());
-    server sip_endpoint(h);
-
-    sip_endpoint.alog().unset_level(websocketpp::log::alevel::ALL);
-    sip_endpoint.elog().unset_level(websocketpp::log::elevel::ALL);
-    sip_endpoint.alog().set_level(websocketpp::log::alevel::CONNECT);
-    sip_endpoint.alog().set_level(websocketpp::log::alevel::DISCONNECT);
-    sip_endpoint.elog().set_level(websocketpp::log::elevel::RERROR);
-    sip_endpoint.elog().set_level(websocketpp::log::elevel::FATAL);
-
-    TRC_DEBUG("Starting WebSocket SIP server on port %hu", ws_port);
+    // Accept connections and handle their traffic on a pool of I/O threads.
+    // The connections are shared across the threads, and this returns once
+    // they have all stopped.
+    TRC_DEBUG("Starting WebSocket SIP server on port %hu with %d threads",
+              ws_port, ws_threads);
     boost::asio::ip::tcp::endpoint ep(boost::asio::ip::tcp::v4(), ws_port);
-    sip_endpoint.listen(ep);
+    ws_endpoint->listen(ep, ws_threads);
   } catch (std::exception& e) {
     TRC_ERROR("Exception: %s", e.what());
   }
@@ -497,24 +559,58 @@ static int websocket_thread(void* p)
 
 static pj_bool_t ws_transport_on_start()
 {
+  if (PJSIP_TRANSPORT_WS == -1)
+  {
+    PJSIP_TRANSPORT_WS = ws_transport_register_type(ws_port);
+    TRC_DEBUG("Registered websockets transport with PJSIP, type %d", PJSIP_TRANSPORT_WS);
+  }
+
+  server::handler::ptr h(new sip_server_handler());
+  ws_endpoint = new server(h);
+
+  ws_endpoint->alog().unset_level(websocketpp::log::alevel::ALL);
+  ws_endpoint->elog().unset_level(websocketpp::log::elevel::ALL);
+  ws_endpoint->alog().set_level(websocketpp::log::alevel::CONNECT);
+  ws_endpoint->alog().set_level(websocketpp::log::alevel::DISCONNECT);
+  ws_endpoint->elog().set_level(websocketpp::log::elevel::RERROR);
+  ws_endpoint->elog().set_level(websocketpp::log::elevel::FATAL);
+
   // Create thread for websockets and start
-  pj_thread_t* thread;
   pj_status_t status;
   status = pj_thread_create(stack_data.pool, "websockets", &websocket_thread,
-      NULL, 0, 0, &thread);
+      NULL, 0, 0, &ws_thread);
   if (status != PJ_SUCCESS)
   {
     TRC_ERROR("Error creating Websockets thread, %s",
         PJUtils::pj_status_to_string(status).c_str());
+    delete ws_endpoint; ws_endpoint = NULL;
+    ws_thread = NULL;
     return status;
   }
 
   return PJ_SUCCESS;
 }
 
-pj_status_t init_websockets(unsigned short port)
+static pj_bool_t ws_transport_on_stop()
+{
+  if (ws_thread != NULL)
+  {
+    // Stop the I/O threads and wait for the server to exit.
+    ws_endpoint->stop(false);
+    pj_thread_join(ws_thread);
+    pj_thread_destroy(ws_thread);
+    ws_thread = NULL;
+  }
+
+  delete ws_endpoint; ws_endpoint = NULL;
+
+  return PJ_SUCCESS;
+}
+
+pj_status_t init_websockets(unsigned short port, int num_threads)
 {
   ws_port = port;
+  ws_threads = (num_threads > 0) ? num_threads : 1;
 
   pj_status_t status;
   status = pjsip_endpt_register_module(stack_data.endpt, &mod_ws_transport);
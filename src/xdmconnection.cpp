@@ -14,6 +14,8 @@
 #include <curl/curl.h>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <vector>
 
 #include "utils.h"
 #include "log.h"
@@ -76,3 +78,44 @@ bool XDMConnection::get_simservs(const std::string& user,
   return (http_code == HTTP_OK);
 }
 
+HTTPCode XDMConnection::get_simservs_if_modified(const std::string& user,
+                                                 std::string& xml_data,
+                                                 std::string& etag,
+                                                 SAS::TrailId trail)
+{
+  Utils::StopWatch stopWatch;
+  stopWatch.start();
+
+  std::string url = "/org.etsi.ngn.simservs/users/" + Utils::url_escape(user) + "/simservs.xml";
+
+  std::map<std::string, std::string> rsp_headers;
+  std::vector<std::string> req_headers;
+
+  if (!etag.empty())
+  {
+    req_headers.push_back("If-None-Match: " + etag);
+  }
+
+  HTTPCode http_code = _http->send_get(url,
+                                       rsp_headers,
+                                       xml_data,
+                                       user,
+                                       req_headers,
+                                       trail);
+
+  unsigned long latency_us = 0;
+  if (stopWatch.read(latency_us))
+  {
+    _latency_tbl->accumulate(latency_us);
+  }
+
+  if (http_code == HTTP_OK)
+  {
+    // HttpConnection lower-cases the names of the response headers.
+    std::map<std::string, std::string>::const_iterator it = rsp_headers.find("etag");
+    etag = (it != rsp_headers.end()) ? it->second : "";
+  }
+
+  return http_code;
+}
+